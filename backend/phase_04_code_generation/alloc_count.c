@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "alloc_count.h"
+
+/* The real allocator, reached through the linker's --wrap */
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+static AllocCounts counts;
+
+void* __wrap_malloc(size_t size) {
+    counts.allocations++;
+    counts.bytes += size;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    counts.allocations++;
+    counts.bytes += count * size;
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    if (ptr == NULL) {
+        counts.allocations++;
+    } else {
+        counts.reallocations++;
+    }
+    counts.bytes += size;
+    return __real_realloc(ptr, size);
+}
+
+/* strdup allocates inside libc, so it is rebuilt on the counted malloc */
+char* __wrap_strdup(const char* str) {
+    size_t size = strlen(str) + 1;
+    char* copy = (char*)__wrap_malloc(size);
+    memcpy(copy, str, size);
+    return copy;
+}
+
+void __wrap_free(void* ptr) {
+    if (ptr != NULL) {
+        counts.frees++;
+    }
+    __real_free(ptr);
+}
+
+AllocCounts alloc_counts() {
+    return counts;
+}
+
+/* Print the counts since start; returns the number of blocks still live */
+long report_allocations(const char* label, AllocCounts start, long input_bytes) {
+    long allocations = counts.allocations - start.allocations;
+    long frees = counts.frees - start.frees;
+
+    printf("%s: %ld allocations, %ld reallocations, %zu bytes, %ld frees, %ld live\n",
+           label, allocations, counts.reallocations - start.reallocations,
+           counts.bytes - start.bytes, frees, allocations - frees);
+    if (input_bytes > 0) {
+        printf("%s: %.4f allocations per input byte (%ld input bytes)\n",
+               label, (double)allocations / input_bytes, input_bytes);
+    }
+    return allocations - frees;
+}
@@ -0,0 +1,32 @@
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+#include <stddef.h>
+
+/*
+ * Allocation counting build mode.
+ *
+ * Built with -DCOUNT_ALLOCS and linked with
+ * -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=strdup,--wrap=free
+ * (see the *_counted targets in the Makefile), every heap allocation and
+ * release made by our code, including the generated lexer and parser, goes
+ * through the counters below. Allocations libc makes for itself (such as
+ * FILE buffers) are not seen.
+ */
+
+typedef struct {
+    long allocations;            /* malloc, calloc, strdup and realloc of NULL */
+    long reallocations;          /* realloc of an existing block */
+    long frees;                  /* free of a non-NULL pointer */
+    size_t bytes;                /* Bytes requested by allocations and reallocations */
+} AllocCounts;
+
+AllocCounts alloc_counts();
+
+/*
+ * Print the counts since start (as returned by alloc_counts() earlier) and
+ * the allocations per input byte. Returns the number of blocks still live.
+ */
+long report_allocations(const char* label, AllocCounts start, long input_bytes);
+
+#endif /* ALLOC_COUNT_H */
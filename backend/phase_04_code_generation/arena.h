@@ -0,0 +1,47 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/*
+ * Region allocator. Allocations are carved out of large blocks and are never
+ * freed one by one; destroying the arena releases every block at once.
+ */
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;     /* Previously filled block */
+    size_t size;                 /* Usable bytes in data */
+    size_t used;                 /* Bytes handed out so far */
+    char data[];
+} ArenaBlock;
+
+/* Allocation counters of an arena */
+typedef struct {
+    long allocations;            /* Calls to arena_alloc */
+    long blocks;                 /* Blocks obtained from malloc */
+    size_t bytes_requested;      /* Sum of requested sizes */
+    size_t bytes_reserved;       /* Sum of block sizes currently held */
+    size_t peak_bytes;           /* Largest bytes_reserved seen */
+} ArenaStats;
+
+typedef struct {
+    ArenaBlock* head;            /* Block allocations are taken from */
+    size_t block_size;           /* Default size of a new block */
+    ArenaStats stats;
+} Arena;
+
+Arena* arena_create(size_t block_size);
+void* arena_alloc(Arena* arena, size_t size);
+char* arena_strdup(Arena* arena, const char* str);
+/* Grow the latest allocation, in place when its block allows */
+void* arena_grow(Arena* arena, void* ptr, size_t old_size, size_t new_size);
+
+/* Release all blocks but keep the arena (and its peak) for reuse */
+void arena_reset(Arena* arena);
+/* Empty the arena but keep one block, so refilling it needs no malloc */
+void arena_rewind(Arena* arena);
+void arena_destroy(Arena* arena);
+
+void print_arena_stats(const char* label, Arena* arena);
+
+#endif /* ARENA_H */
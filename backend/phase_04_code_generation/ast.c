@@ -12,7 +12,7 @@ static void print_indent(int indent) {
 }
 
 /* Get operator or quantifier name as string */
-static const char* get_op_name(int op_type) {
+const char* get_op_name(int op_type) {
     switch (op_type) {
         case OP_AND:        return "AND";
         case OP_OR:         return "OR";
@@ -24,7 +24,7 @@ static const char* get_op_name(int op_type) {
     }
 }
 
-static const char* get_quantifier_name(int quant_type) {
+const char* get_quantifier_name(int quant_type) {
     switch (quant_type) {
         case QUANT_FORALL:  return "FORALL";
         case QUANT_EXISTS:  return "EXISTS";
@@ -55,24 +55,114 @@ QuantifierType token_to_quantifier(int token) {
     return QUANT_FORALL; /* Default, shouldn't happen */
 }
 
-/* Print AST node recursively */
-void print_ast(ASTNode* node, int indent) {
-    if (node == NULL) {
-        print_indent(indent);
-        printf("NULL\n");
-        return;
+/* Pending node of walk_ast and the number of its children already visited */
+typedef struct {
+    ASTNode* node;
+    int child;
+    int depth;
+} WalkFrame;
+
+void walk_ast(ASTNode* root, ASTVisitor visit, void* data) {
+    WalkFrame* stack = NULL;
+    int count = 0;
+    int capacity = 0;
+    ASTNode* next = root;
+    int next_depth = 0;
+
+    for (;;) {
+        if (next != NULL && visit(next, VISIT_ENTER, next_depth, data)) {
+            if (count == capacity) {
+                capacity = capacity == 0 ? 64 : capacity * 2;
+                stack = (WalkFrame*)realloc(stack, sizeof(WalkFrame) * capacity);
+            }
+            stack[count].node = next;
+            stack[count].child = 0;
+            stack[count].depth = next_depth;
+            count++;
+        }
+        next = NULL;
+
+        if (count == 0) {
+            break;
+        }
+
+        /* Descend into the next child of the innermost pending node, or leave it */
+        WalkFrame* frame = &stack[count - 1];
+        ASTNode* node = frame->node;
+        int child = frame->child++;
+        next_depth = frame->depth + 1;
+
+        switch (node->type) {
+            case NODE_BINARY_OP:
+                if (child == 0) {
+                    next = node->data.binary.left;
+                } else if (child == 1) {
+                    visit(node, VISIT_BETWEEN, frame->depth, data);
+                    next = node->data.binary.right;
+                }
+                break;
+
+            case NODE_NARY_OP:
+                if (child > 0 && child < node->data.nary.operand_count) {
+                    visit(node, VISIT_BETWEEN, frame->depth, data);
+                }
+                if (child < node->data.nary.operand_count) {
+                    next = node->data.nary.operands[child];
+                }
+                break;
+
+            case NODE_UNARY_OP:
+                if (child == 0) {
+                    next = node->data.unary.operand;
+                }
+                break;
+
+            case NODE_QUANTIFIER:
+                if (child == 0) {
+                    next = node->data.quantifier.expr;
+                }
+                break;
+
+            default:
+                break;
+        }
+
+        if (next == NULL) {
+            count--;
+            visit(node, VISIT_LEAVE, next_depth - 1, data);
+        }
     }
-    
+
+    free(stack);
+}
+
+static bool print_visit(ASTNode* node, VisitStage stage, int depth, void* data) {
+    int indent = *(int*)data + depth;
+
+    if (stage == VISIT_BETWEEN) {
+        if (node->type == NODE_BINARY_OP) {
+            print_indent(indent);
+            printf("Right:\n");
+        }
+        return true;
+    }
+    if (stage == VISIT_LEAVE) {
+        return true;
+    }
+
     switch (node->type) {
         case NODE_BINARY_OP:
             print_indent(indent);
             printf("BinaryOp: %s\n", get_op_name(node->data.binary.operator));
             print_indent(indent);
             printf("Left:\n");
-            print_ast(node->data.binary.left, indent + 1);
+            break;
+            
+        case NODE_NARY_OP:
             print_indent(indent);
-            printf("Right:\n");
-            print_ast(node->data.binary.right, indent + 1);
+            printf("NaryOp: %s\n", get_op_name(node->data.nary.operator));
+            print_indent(indent);
+            printf("Operands: %d\n", node->data.nary.operand_count);
             break;
             
         case NODE_UNARY_OP:
@@ -80,18 +170,17 @@ void print_ast(ASTNode* node, int indent) {
             printf("UnaryOp: %s\n", get_op_name(node->data.unary.operator));
             print_indent(indent);
             printf("Operand:\n");
-            print_ast(node->data.unary.operand, indent + 1);
             break;
             
         case NODE_QUANTIFIER:
             print_indent(indent);
             printf("Quantifier: %s\n", get_quantifier_name(node->data.quantifier.quantifier));
             print_indent(indent);
-            printf("Variable: %s\n", node->data.quantifier.variable);
+            printf("Variable: %s\n", interned_string(node->data.quantifier.variable));
             print_indent(indent);
             printf("Domain: [");
             for (int i = 0; i < node->data.quantifier.domain_size; i++) {
-                printf("%s", node->data.quantifier.domain[i]);
+                printf("%s", interned_string(node->data.quantifier.domain[i]));
                 if (i < node->data.quantifier.domain_size - 1) {
                     printf(", ");
                 }
@@ -99,7 +188,6 @@ void print_ast(ASTNode* node, int indent) {
             printf("]\n");
             print_indent(indent);
             printf("Expression:\n");
-            print_ast(node->data.quantifier.expr, indent + 1);
             break;
             
         case NODE_LITERAL:
@@ -109,16 +197,16 @@ void print_ast(ASTNode* node, int indent) {
             
         case NODE_VARIABLE:
             print_indent(indent);
-            printf("Variable: %s\n", node->data.variable.name);
+            printf("Variable: %s\n", interned_string(node->data.variable.name));
             break;
             
         case NODE_PREDICATE:
             print_indent(indent);
-            printf("Predicate: %s\n", node->data.predicate.name);
+            printf("Predicate: %s\n", interned_string(node->data.predicate.name));
             print_indent(indent);
             printf("Arguments: [");
             for (int i = 0; i < node->data.predicate.arg_count; i++) {
-                printf("%s", node->data.predicate.args[i]);
+                printf("%s", interned_string(node->data.predicate.args[i]));
                 if (i < node->data.predicate.arg_count - 1) {
                     printf(", ");
                 }
@@ -126,49 +214,237 @@ void print_ast(ASTNode* node, int indent) {
             printf("]\n");
             break;
     }
+    return true;
+}
+
+/* Print an AST subtree, children indented one level below their parent */
+void print_ast(ASTNode* node, int indent) {
+    if (node == NULL) {
+        print_indent(indent);
+        printf("NULL\n");
+        return;
+    }
+    
+    walk_ast(node, print_visit, &indent);
+}
+
+/* Whether a node continues a chain of operator op */
+static bool in_chain(ASTNode* node, BinaryOpType op) {
+    return node->type == NODE_BINARY_OP && node->data.binary.operator == op;
+}
+
+static bool is_associative(BinaryOpType op) {
+    return op == OP_AND || op == OP_OR || op == OP_XOR;
+}
+
+/* Replace the chain rooted at a binary node by one n-ary node over its operands */
+static bool flatten_visit(ASTNode* node, VisitStage stage, int depth, void* data) {
+    if (stage != VISIT_ENTER || node->type != NODE_BINARY_OP ||
+        !is_associative(node->data.binary.operator)) {
+        return true;
+    }
+    BinaryOpType op = node->data.binary.operator;
+
+    /* Collect the operands left to right; the chain's own nodes are dropped */
+    int count = 0;
+    int capacity = 64;
+    ASTNode** operands = (ASTNode**)malloc(sizeof(ASTNode*) * capacity);
+    int pending_count = 0;
+    int pending_capacity = 64;
+    ASTNode** pending = (ASTNode**)malloc(sizeof(ASTNode*) * pending_capacity);
+    pending[pending_count++] = node;
+    while (pending_count > 0) {
+        ASTNode* next = pending[--pending_count];
+        if (next == node || in_chain(next, op)) {
+            if (pending_count + 2 > pending_capacity) {
+                pending_capacity *= 2;
+                pending = (ASTNode**)realloc(pending, sizeof(ASTNode*) * pending_capacity);
+            }
+            pending[pending_count++] = next->data.binary.right;
+            pending[pending_count++] = next->data.binary.left;
+        } else {
+            if (count == capacity) {
+                capacity *= 2;
+                operands = (ASTNode**)realloc(operands, sizeof(ASTNode*) * capacity);
+            }
+            operands[count++] = next;
+        }
+    }
+
+    node->type = NODE_NARY_OP;
+    node->data.nary.operator = op;
+    node->data.nary.operands = (ASTNode**)arena_alloc((Arena*)data, sizeof(ASTNode*) * count);
+    memcpy(node->data.nary.operands, operands, sizeof(ASTNode*) * count);
+    node->data.nary.operand_count = count;
+    free(operands);
+    free(pending);
+    return true;
+}
+
+void flatten_associative(ASTNode* root, Arena* arena) {
+    walk_ast(root, flatten_visit, arena);
 }
 
-/* Free memory allocated for AST */
-void free_ast(ASTNode* node) {
+/* Build operands[0, count) into a balanced tree of op; node, if given, becomes its root */
+static ASTNode* balanced_chain(ASTNode** operands, int count, BinaryOpType op, ASTNode* node,
+                               int line, int column, Arena* arena) {
+    if (count == 1) {
+        return operands[0];
+    }
     if (node == NULL) {
+        node = (ASTNode*)arena_alloc(arena, sizeof(ASTNode));
+    }
+    int half = (count + 1) / 2;
+    ASTNode* left = balanced_chain(operands, half, op, NULL, line, column, arena);
+    ASTNode* right = balanced_chain(operands + half, count - half, op, NULL, line, column, arena);
+    node->type = NODE_BINARY_OP;
+    node->data.binary.operator = op;
+    node->data.binary.left = left;
+    node->data.binary.right = right;
+    node->line = line;
+    node->column = column;
+    return node;
+}
+
+static bool balance_visit(ASTNode* node, VisitStage stage, int depth, void* data) {
+    if (stage == VISIT_ENTER && node->type == NODE_NARY_OP) {
+        balanced_chain(node->data.nary.operands, node->data.nary.operand_count,
+                       node->data.nary.operator, node, node->line, node->column, (Arena*)data);
+    }
+    return true;
+}
+
+void balance_associative(ASTNode* root, Arena* arena) {
+    flatten_associative(root, arena);
+    walk_ast(root, balance_visit, arena);
+}
+
+#define AST_ARENA_BLOCK_SIZE (64 * 1024)
+
+/* Create an arena for the nodes of one AST (domains are owned by the interner) */
+Arena* create_ast_arena() {
+    return arena_create(AST_ARENA_BLOCK_SIZE);
+}
+
+/* State of collect_free_variables: the variables bound by enclosing quantifiers */
+typedef struct {
+    VariableSet* set;
+    VariableSet bound;
+} FreeVariableWalk;
+
+bool variable_set_contains(VariableSet* set, InternId name) {
+    for (int i = 0; i < set->count; i++) {
+        if (set->names[i] == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void variable_set_add(VariableSet* set, InternId name) {
+    if (set->count == set->capacity) {
+        set->capacity = set->capacity == 0 ? 4 : set->capacity * 2;
+        set->names = (InternId*)realloc(set->names, sizeof(InternId) * set->capacity);
+    }
+    set->names[set->count++] = name;
+}
+
+static void add_free_variable(FreeVariableWalk* walk, InternId name) {
+    if (variable_set_contains(&walk->bound, name) || variable_set_contains(walk->set, name)) {
         return;
     }
+    variable_set_add(walk->set, name);
+}
+
+static bool free_variable_visit(ASTNode* node, VisitStage stage, int depth, void* data) {
+    FreeVariableWalk* walk = (FreeVariableWalk*)data;
+
+    if (stage != VISIT_ENTER) {
+        if (stage == VISIT_LEAVE && node->type == NODE_QUANTIFIER) {
+            walk->bound.count--;
+        }
+        return true;
+    }
     
     switch (node->type) {
-        case NODE_BINARY_OP:
-            free_ast(node->data.binary.left);
-            free_ast(node->data.binary.right);
+        case NODE_QUANTIFIER:
+            variable_set_add(&walk->bound, node->data.quantifier.variable);
             break;
             
-        case NODE_UNARY_OP:
-            free_ast(node->data.unary.operand);
+        case NODE_VARIABLE:
+            add_free_variable(walk, node->data.variable.name);
             break;
             
-        case NODE_QUANTIFIER:
-            free(node->data.quantifier.variable);
-            for (int i = 0; i < node->data.quantifier.domain_size; i++) {
-                free(node->data.quantifier.domain[i]);
+        case NODE_PREDICATE:
+            for (int i = 0; i < node->data.predicate.arg_count; i++) {
+                add_free_variable(walk, node->data.predicate.args[i]);
             }
-            free(node->data.quantifier.domain);
-            free_ast(node->data.quantifier.expr);
             break;
             
+        default:
+            break;
+    }
+    return true;
+}
+
+/* Collect the variables that occur free in a subtree (in order of first use) */
+void collect_free_variables(ASTNode* node, VariableSet* set) {
+    FreeVariableWalk walk = { set, {0} };
+    walk_ast(node, free_variable_visit, &walk);
+    free_variable_set(&walk.bound);
+}
+
+/* Slot of the innermost of the enclosing quantifiers (outermost first) that binds name */
+static int innermost_slot(VariableSet* scopes, InternId name) {
+    for (int slot = scopes->count - 1; slot >= 0; slot--) {
+        if (scopes->names[slot] == name) {
+            return slot;
+        }
+    }
+    return UNBOUND_SLOT;
+}
+
+static bool resolve_visit(ASTNode* node, VisitStage stage, int depth, void* data) {
+    VariableSet* scopes = (VariableSet*)data;
+
+    if (stage != VISIT_ENTER) {
+        if (stage == VISIT_LEAVE && node->type == NODE_QUANTIFIER) {
+            scopes->count--;
+        }
+        return true;
+    }
+
+    switch (node->type) {
+        case NODE_QUANTIFIER:
+            variable_set_add(scopes, node->data.quantifier.variable);
+            break;
+
         case NODE_VARIABLE:
-            free(node->data.variable.name);
+            node->data.variable.slot = innermost_slot(scopes, node->data.variable.name);
             break;
-            
+
         case NODE_PREDICATE:
-            free(node->data.predicate.name);
             for (int i = 0; i < node->data.predicate.arg_count; i++) {
-                free(node->data.predicate.args[i]);
+                node->data.predicate.slots[i] = innermost_slot(scopes, node->data.predicate.args[i]);
             }
-            free(node->data.predicate.args);
             break;
-            
-        case NODE_LITERAL:
-            /* Nothing to free for literals */
+
+        default:
             break;
     }
-    
-    free(node);
+    return true;
+}
+
+/* Set the slot of every variable and predicate argument of a tree (see ast.h) */
+void resolve_bindings(ASTNode* root) {
+    VariableSet scopes = {0};
+    walk_ast(root, resolve_visit, &scopes);
+    free_variable_set(&scopes);
+}
+
+void free_variable_set(VariableSet* set) {
+    free(set->names);
+    set->names = NULL;
+    set->count = 0;
+    set->capacity = 0;
 }
\ No newline at end of file
@@ -0,0 +1,323 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ast_cache.h"
+
+/* Round a section offset up to 8 bytes */
+static uint64_t align_offset(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+/* Write a section at its offset, padding the gap since the previous one */
+static bool write_section(FILE* file, uint64_t* position, uint64_t offset, const void* data, size_t size) {
+    static const char padding[8] = { 0 };
+    if (offset - *position > 0 && fwrite(padding, 1, offset - *position, file) != offset - *position) {
+        return false;
+    }
+    if (size > 0 && fwrite(data, 1, size, file) != size) {
+        return false;
+    }
+    *position = offset + size;
+    return true;
+}
+
+/* Write a flat AST and the current interned strings; returns false on error */
+bool write_ast_cache(const char* filename, FlatAST* flat, uint32_t flags) {
+    uint32_t string_count = interned_count();
+    uint32_t* string_offsets = (uint32_t*)malloc(sizeof(uint32_t) * (string_count + 1));
+    uint32_t string_bytes = 0;
+    for (uint32_t i = 0; i < string_count; i++) {
+        string_offsets[i] = string_bytes;
+        string_bytes += strlen(interned_string(i)) + 1;
+    }
+    string_offsets[string_count] = string_bytes;
+
+    AstCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, AST_CACHE_MAGIC, sizeof(header.magic));
+    header.version = AST_CACHE_VERSION;
+    header.byte_order = AST_CACHE_BYTE_ORDER;
+    header.flags = flags;
+    header.node_count = flat->count;
+    header.list_count = flat->list_count;
+    header.string_count = string_count;
+    header.string_bytes = string_bytes;
+    header.root = flat->root;
+
+    /* Section sizes in layout order */
+    uint64_t nodes = flat->count;
+    size_t sizes[CACHE_SECTION_COUNT] = {
+        nodes, nodes,
+        nodes * sizeof(InternId), nodes * sizeof(FlatIndex), nodes * sizeof(FlatIndex),
+        nodes * sizeof(int32_t), nodes * sizeof(int32_t),
+        (size_t)flat->list_count * sizeof(uint32_t),
+        (size_t)(string_count + 1) * sizeof(uint32_t),
+        string_bytes
+    };
+    uint64_t offset = sizeof(AstCacheHeader);
+    for (int i = 0; i < CACHE_SECTION_COUNT; i++) {
+        offset = align_offset(offset);
+        header.sections[i] = offset;
+        offset += sizes[i];
+    }
+    header.file_size = offset;
+
+    FILE* file = fopen(filename, "wb");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open cache file '%s' for writing\n", filename);
+        free(string_offsets);
+        return false;
+    }
+
+    const void* data[CACHE_SECTION_COUNT] = {
+        flat->tags, flat->ops, flat->names, flat->lhs, flat->rhs,
+        flat->lines, flat->columns, flat->lists, string_offsets, NULL
+    };
+    uint64_t position = 0;
+    bool ok = write_section(file, &position, 0, &header, sizeof(header));
+    for (int i = 0; ok && i < CACHE_STRING_DATA; i++) {
+        ok = write_section(file, &position, header.sections[i], data[i], sizes[i]);
+    }
+    if (ok) {
+        ok = write_section(file, &position, header.sections[CACHE_STRING_DATA], NULL, 0);
+    }
+    for (uint32_t i = 0; ok && i < string_count; i++) {
+        const char* str = interned_string(i);
+        ok = fwrite(str, 1, strlen(str) + 1, file) == strlen(str) + 1;
+    }
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    free(string_offsets);
+
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to write cache file '%s'\n", filename);
+    }
+    return ok;
+}
+
+/* Check that every section lies inside the file */
+static bool check_sections(AstCacheHeader* header, size_t size) {
+    uint64_t nodes = header->node_count;
+    uint64_t sizes[CACHE_SECTION_COUNT] = {
+        nodes, nodes, nodes * 4, nodes * 4, nodes * 4, nodes * 4, nodes * 4,
+        (uint64_t)header->list_count * 4, ((uint64_t)header->string_count + 1) * 4,
+        header->string_bytes
+    };
+    if (header->file_size != size) {
+        return false;
+    }
+    for (int i = 0; i < CACHE_SECTION_COUNT; i++) {
+        if (header->sections[i] % 8 != 0 || header->sections[i] > size ||
+            sizes[i] > size - header->sections[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Check that the string table is a sequence of NUL-terminated strings */
+static bool check_strings(uint32_t* offsets, const char* data, uint32_t count, uint32_t bytes) {
+    if (offsets[0] != 0 || offsets[count] != bytes) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (offsets[i + 1] <= offsets[i] || offsets[i + 1] > bytes ||
+            data[offsets[i + 1] - 1] != '\0' ||
+            memchr(data + offsets[i], '\0', offsets[i + 1] - offsets[i] - 1) != NULL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* A list offset must name a length and that many elements inside the pool */
+static bool check_list(FlatAST* flat, FlatIndex offset) {
+    return offset < (uint32_t)flat->list_count &&
+           flat->lists[offset] < (uint32_t)flat->list_count - offset;
+}
+
+/*
+ * Check that the nodes form post-order trees the flat AST functions can
+ * follow: each subtree is the contiguous range from its leftmost leaf to its
+ * root, a node's last child immediately precedes it, and the right operand
+ * of a binary operator starts right after the left one ends.
+ */
+static bool check_nodes(FlatAST* flat, uint32_t string_count) {
+    FlatIndex* start = (FlatIndex*)malloc(sizeof(FlatIndex) * (flat->count > 0 ? flat->count : 1));
+    bool ok = true;
+
+    for (FlatIndex i = 0; ok && i < (FlatIndex)flat->count; i++) {
+        start[i] = i;
+        switch ((NodeType)flat->tags[i]) {
+            case NODE_BINARY_OP:
+                ok = i >= 2 && flat->rhs[i] == i - 1 && flat->lhs[i] < flat->rhs[i] &&
+                     start[flat->rhs[i]] == flat->lhs[i] + 1;
+                if (ok) {
+                    start[i] = start[flat->lhs[i]];
+                }
+                break;
+
+            case NODE_UNARY_OP:
+                ok = i >= 1 && flat->lhs[i] == i - 1;
+                if (ok) {
+                    start[i] = start[flat->lhs[i]];
+                }
+                break;
+
+            case NODE_QUANTIFIER:
+                ok = i >= 1 && flat->lhs[i] == i - 1 && flat->names[i] < string_count &&
+                     check_list(flat, flat->rhs[i]);
+                if (ok) {
+                    start[i] = start[flat->lhs[i]];
+                }
+                break;
+
+            case NODE_LITERAL:
+                ok = flat->lhs[i] == FLAT_NONE;
+                break;
+
+            case NODE_VARIABLE:
+                ok = flat->lhs[i] == FLAT_NONE && flat->names[i] < string_count;
+                break;
+
+            case NODE_PREDICATE:
+                ok = flat->lhs[i] == FLAT_NONE && flat->names[i] < string_count &&
+                     check_list(flat, flat->rhs[i]);
+                break;
+
+            default:
+                ok = false;
+                break;
+        }
+    }
+
+    /* The list pool is a sequence of length-prefixed lists of string IDs */
+    for (uint32_t offset = 0; ok && offset < (uint32_t)flat->list_count; offset += flat->lists[offset] + 1) {
+        ok = check_list(flat, offset);
+        for (uint32_t j = 1; ok && j <= flat->lists[offset]; j++) {
+            ok = flat->lists[offset + j] < string_count;
+        }
+    }
+
+    if (ok) {
+        ok = flat->count == 0 ? flat->root == FLAT_NONE : flat->root < (FlatIndex)flat->count;
+    }
+
+    free(start);
+    return ok;
+}
+
+/* Renumber the names and lists of a cache whose string IDs differ from ours */
+static void remap_names(FlatAST* flat, InternId* ids) {
+    for (int i = 0; i < flat->count; i++) {
+        NodeType type = (NodeType)flat->tags[i];
+        if (type == NODE_QUANTIFIER || type == NODE_VARIABLE || type == NODE_PREDICATE) {
+            flat->names[i] = ids[flat->names[i]];
+        }
+    }
+    for (uint32_t offset = 0; offset < (uint32_t)flat->list_count; offset += flat->lists[offset] + 1) {
+        for (uint32_t j = 1; j <= flat->lists[offset]; j++) {
+            flat->lists[offset + j] = ids[flat->lists[offset + j]];
+        }
+    }
+}
+
+/* Map a cache file, check it and intern its strings; returns NULL on error */
+AstCache* load_ast_cache(const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot open cache file '%s'\n", filename);
+        return NULL;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(AstCacheHeader)) {
+        fprintf(stderr, "Error: '%s' is not an AST cache file\n", filename);
+        close(fd);
+        return NULL;
+    }
+
+    /* A private writable mapping lets remap_names change only the pages it touches */
+    size_t size = info.st_size;
+    char* base = (char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Error: Cannot map cache file '%s'\n", filename);
+        return NULL;
+    }
+
+    AstCacheHeader* header = (AstCacheHeader*)base;
+    if (memcmp(header->magic, AST_CACHE_MAGIC, sizeof(header->magic)) != 0) {
+        fprintf(stderr, "Error: '%s' is not an AST cache file\n", filename);
+        munmap(base, size);
+        return NULL;
+    }
+    if (header->version != AST_CACHE_VERSION || header->byte_order != AST_CACHE_BYTE_ORDER) {
+        fprintf(stderr, "Error: Cache file '%s' has version %u, expected %u on this byte order\n",
+                filename, header->version, AST_CACHE_VERSION);
+        munmap(base, size);
+        return NULL;
+    }
+    if (header->node_count > INT32_MAX || header->list_count > INT32_MAX || !check_sections(header, size)) {
+        fprintf(stderr, "Error: Cache file '%s' is truncated or corrupt\n", filename);
+        munmap(base, size);
+        return NULL;
+    }
+
+    AstCache* cache = (AstCache*)calloc(1, sizeof(AstCache));
+    cache->base = base;
+    cache->size = size;
+    cache->flags = header->flags;
+
+    FlatAST* flat = &cache->flat;
+    flat->count = header->node_count;
+    flat->capacity = header->node_count;
+    flat->tags = (uint8_t*)(base + header->sections[CACHE_TAGS]);
+    flat->ops = (uint8_t*)(base + header->sections[CACHE_OPS]);
+    flat->names = (InternId*)(base + header->sections[CACHE_NAMES]);
+    flat->lhs = (FlatIndex*)(base + header->sections[CACHE_LHS]);
+    flat->rhs = (FlatIndex*)(base + header->sections[CACHE_RHS]);
+    flat->lines = (int32_t*)(base + header->sections[CACHE_LINES]);
+    flat->columns = (int32_t*)(base + header->sections[CACHE_COLUMNS]);
+    flat->lists = (uint32_t*)(base + header->sections[CACHE_LISTS]);
+    flat->list_count = header->list_count;
+    flat->list_capacity = header->list_count;
+    flat->root = header->root;
+
+    uint32_t* string_offsets = (uint32_t*)(base + header->sections[CACHE_STRING_OFFSETS]);
+    const char* string_data = base + header->sections[CACHE_STRING_DATA];
+    if (!check_strings(string_offsets, string_data, header->string_count, header->string_bytes) ||
+        !check_nodes(flat, header->string_count)) {
+        fprintf(stderr, "Error: Cache file '%s' is truncated or corrupt\n", filename);
+        close_ast_cache(cache);
+        return NULL;
+    }
+
+    /* Intern the strings in table order; only renumber if an ID came out different */
+    InternId* ids = (InternId*)malloc(sizeof(InternId) * (header->string_count > 0 ? header->string_count : 1));
+    for (uint32_t i = 0; i < header->string_count; i++) {
+        ids[i] = intern_string(string_data + string_offsets[i]);
+        if (ids[i] != i) {
+            cache->remapped = true;
+        }
+    }
+    if (cache->remapped) {
+        remap_names(flat, ids);
+    }
+    free(ids);
+
+    return cache;
+}
+
+void close_ast_cache(AstCache* cache) {
+    if (cache == NULL) {
+        return;
+    }
+    munmap(cache->base, cache->size);
+    free(cache);
+}
@@ -0,0 +1,88 @@
+#ifndef AST_CACHE_H
+#define AST_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "flat_ast.h"
+
+/*
+ * Binary AST cache file.
+ *
+ * A cache holds a flat AST (see flat_ast.h) together with the interned
+ * strings its names refer to, so a later phase can skip lexing and parsing.
+ * Every section is located by a byte offset from the start of the file and
+ * aligned to 8 bytes; the node arrays are stored exactly as FlatAST keeps
+ * them in memory, so a loaded cache is the mapped file itself with a FlatAST
+ * pointing into it. Node references are indices and list references are
+ * pool offsets, so nothing has to be relocated.
+ *
+ * Layout:
+ *   AstCacheHeader
+ *   tags[node_count], ops[node_count]              (uint8_t)
+ *   names, lhs, rhs, lines, columns[node_count]    (uint32_t / int32_t)
+ *   lists[list_count]                              (uint32_t)
+ *   string_offsets[string_count + 1]               (uint32_t, into string_data)
+ *   string_data[string_bytes]                      (NUL-terminated strings)
+ *
+ * String i of the table is the text of InternId i in the writing process.
+ */
+
+#define AST_CACHE_MAGIC "LOGICAST"
+#define AST_CACHE_VERSION 1
+#define AST_CACHE_BYTE_ORDER 0x01020304u
+
+/* Header flags */
+#define AST_CACHE_ANALYZED 0x1   /* The AST passed semantic analysis */
+
+enum {
+    CACHE_TAGS,
+    CACHE_OPS,
+    CACHE_NAMES,
+    CACHE_LHS,
+    CACHE_RHS,
+    CACHE_LINES,
+    CACHE_COLUMNS,
+    CACHE_LISTS,
+    CACHE_STRING_OFFSETS,
+    CACHE_STRING_DATA,
+    CACHE_SECTION_COUNT
+};
+
+typedef struct {
+    char magic[8];               /* AST_CACHE_MAGIC, not NUL-terminated */
+    uint32_t version;            /* AST_CACHE_VERSION */
+    uint32_t byte_order;         /* AST_CACHE_BYTE_ORDER as written */
+    uint32_t flags;
+    uint32_t node_count;
+    uint32_t list_count;
+    uint32_t string_count;
+    uint32_t string_bytes;
+    uint32_t root;               /* Root node index, or FLAT_NONE */
+    uint64_t file_size;
+    uint64_t sections[CACHE_SECTION_COUNT];  /* Byte offsets from the start of the file */
+} AstCacheHeader;
+
+/* A mapped cache file and the flat AST viewed through it */
+typedef struct {
+    void* base;                  /* Start of the mapping */
+    size_t size;                 /* Mapped bytes */
+    uint32_t flags;              /* Header flags */
+    bool remapped;               /* Names were renumbered to this process's IDs */
+    FlatAST flat;                /* Arrays point into the mapping */
+} AstCache;
+
+/* Write a flat AST and the current interned strings; returns false on error */
+bool write_ast_cache(const char* filename, FlatAST* flat, uint32_t flags);
+
+/*
+ * Map a cache file and intern its strings. If the strings get the same IDs
+ * as in the writing process (always the case when nothing was interned yet),
+ * the node arrays are used in place; otherwise the names and lists are
+ * renumbered in the private mapping. Returns NULL on error.
+ */
+AstCache* load_ast_cache(const char* filename);
+
+void close_ast_cache(AstCache* cache);
+
+#endif /* AST_CACHE_H */
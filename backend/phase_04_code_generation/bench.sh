@@ -0,0 +1,201 @@
+#!/bin/bash
+# Benchmark suite with baseline comparison.
+# Measures lexing throughput, parse time against input size, semantic analysis
+# of deeply nested scopes, parsing with semantic analysis as a separate pass
+# and fused into the parser, code generation speed and the speed of the
+# generated code, each the best of a few runs on inputs made by gen_workload
+# or awk. The results go to a JSON file with one metric per line; if a
+# baseline saved with `make bench_baseline` exists, every metric is compared
+# with it and the run fails if any got worse by more than the threshold.
+#
+# Usage: bash bench.sh [<results_file>] [<baseline_file>]
+# BENCH_THRESHOLD sets the tolerated slowdown in percent (default 10) and
+# BENCH_RUNS the number of runs each measurement takes the best of (default 3).
+
+RESULTS=${1:-bench_results.json}
+BASELINE=${2:-bench_baseline.json}
+THRESHOLD=${BENCH_THRESHOLD:-10}
+RUNS=${BENCH_RUNS:-3}
+SEMANTIC_DIR=../../frontend/phase_03_semantic_analysis
+BENCH_DIR=$(mktemp -d)
+
+for program in code_generator lex_bench gen_workload; do
+    if [ ! -f "$program" ]; then
+        make $program > /dev/null
+    fi
+done
+if [ ! -f "${SEMANTIC_DIR}/semantic_analyzer" ]; then
+    make -C "$SEMANTIC_DIR" semantic_analyzer > /dev/null
+fi
+
+# Metrics in the order they were measured: name, value, and whether higher or lower is better
+metrics=()
+
+record() {
+    metrics+=("$1 $2 $3")
+    printf "  %-28s %14s  (%s is better)\n" "$1" "$2" "$3"
+}
+
+# Smallest of the numbers on standard input
+best_of() {
+    sort -g | head -n 1
+}
+
+# Largest of the numbers on standard input
+most_of() {
+    sort -g | tail -n 1
+}
+
+# Wall time in ms of one phase, or of the whole run, from a --stats-json report
+phase_ms() {
+    if [ "$2" = "total" ]; then
+        sed -n 's/^  "total": { "wall_ms": \([0-9.]*\).*/\1/p' "$1"
+    else
+        sed -n "s/^    \"$2\": { \"wall_ms\": \([0-9.]*\).*/\1/p" "$1"
+    fi
+}
+
+# Current time in nanoseconds
+now_ns() {
+    date +%s%N
+}
+
+echo "===== Lexing throughput (MB/s) ====="
+./gen_workload --size 32M -d 5 -q 3 --seed 1 -o "${BENCH_DIR}/lex.logic" 2> /dev/null
+./lex_bench "${BENCH_DIR}/lex.logic" "$RUNS" > "${BENCH_DIR}/lex.txt"
+for mode in stream mapped fast; do
+    record "lex_${mode}_mb_s" "$(sed -n "s/^${mode}: .*, \([0-9.]*\) MB\/s$/\1/p" "${BENCH_DIR}/lex.txt")" higher
+done
+rm -f "${BENCH_DIR}/lex.logic"
+
+echo "===== Parse time against input size (ms) ====="
+declare -A parse_ms
+for megabytes in 2 8 32; do
+    file="${BENCH_DIR}/parse_${megabytes}.logic"
+    ./gen_workload --size ${megabytes}M -d 5 -q 3 --seed 2 -o "$file" 2> /dev/null
+    for run in $(seq "$RUNS"); do
+        ./code_generator "$file" /dev/null -q --stream --stats-json "${BENCH_DIR}/parse.json" > /dev/null
+        awk -v lex="$(phase_ms "${BENCH_DIR}/parse.json" lex)" -v parse="$(phase_ms "${BENCH_DIR}/parse.json" parse)" \
+            'BEGIN { printf "%.3f\n", lex + parse }'
+    done | best_of > "${BENCH_DIR}/parse_ms.txt"
+    parse_ms[$megabytes]=$(cat "${BENCH_DIR}/parse_ms.txt")
+    record "parse_${megabytes}mb_ms" "${parse_ms[$megabytes]}" lower
+    rm -f "$file"
+done
+# 1.0 when parse time grows linearly with the input
+record "parse_scaling" "$(awk -v a="${parse_ms[2]}" -v b="${parse_ms[32]}" 'BEGIN { printf "%.3f", b / (16 * (a > 0.001 ? a : 0.001)) }')" lower
+
+echo "===== Semantic analysis of deep scopes (ms) ====="
+# Each formula nests 400 quantifiers and uses the outermost variable innermost,
+# 400 scopes away from its binding
+awk 'BEGIN { for (f = 0; f < 200; f++) {
+                 for (i = 0; i < 400; i++) printf "forall x%d [a, b] (", i
+                 printf "P(x0, x399)"
+                 for (i = 0; i < 400; i++) printf ")"
+                 print "" } }' > "${BENCH_DIR}/deep.logic"
+for run in $(seq "$RUNS"); do
+    "${SEMANTIC_DIR}/semantic_analyzer" "${BENCH_DIR}/deep.logic" -q --stream --stats-json "${BENCH_DIR}/deep.json" > /dev/null
+    phase_ms "${BENCH_DIR}/deep.json" semantic
+done | best_of > "${BENCH_DIR}/deep_ms.txt"
+record "semantic_deep_scopes_ms" "$(cat "${BENCH_DIR}/deep_ms.txt")" lower
+
+echo "===== Parsing with semantic analysis, as a separate pass and fused (ms) ====="
+./gen_workload --size 8M -d 5 -q 3 --seed 4 -o "${BENCH_DIR}/analyze.logic" 2> /dev/null
+for mode in separate fused; do
+    options=$([ "$mode" = "fused" ] && echo "--fused")
+    for run in $(seq "$RUNS"); do
+        start=$(now_ns)
+        "${SEMANTIC_DIR}/semantic_analyzer" "${BENCH_DIR}/analyze.logic" -q $options > /dev/null
+        awk -v ns=$(($(now_ns) - start)) 'BEGIN { printf "%.3f\n", ns / 1000000 }'
+    done | best_of > "${BENCH_DIR}/analyze_ms.txt"
+    record "analyze_${mode}_ms" "$(cat "${BENCH_DIR}/analyze_ms.txt")" lower
+done
+rm -f "${BENCH_DIR}/analyze.logic"
+
+echo "===== Code generation (million instructions/s) ====="
+./gen_workload -n 20000 -d 6 -q 4 --seed 3 -o "${BENCH_DIR}/code.logic" 2> /dev/null
+for run in $(seq "$RUNS"); do
+    ./code_generator "${BENCH_DIR}/code.logic" "${BENCH_DIR}/code.s" -q -m --stats-json "${BENCH_DIR}/code.json" > /dev/null
+    awk -v ms="$(phase_ms "${BENCH_DIR}/code.json" codegen)" \
+        -v n="$(sed -n 's/.*"instructions": \([0-9]*\).*/\1/p' "${BENCH_DIR}/code.json")" \
+        'BEGIN { printf "%.3f\n", n / (ms > 0.001 ? ms : 0.001) / 1000 }'
+done | most_of > "${BENCH_DIR}/code_rate.txt"
+record "codegen_minstr_s" "$(cat "${BENCH_DIR}/code_rate.txt")" higher
+
+echo "===== Generated code (ms per run) ====="
+# A start routine that exits with main's result, so no C library is needed
+printf '    .text\n    .globl _start\n_start:\n    call main\n    movl %%eax, %%ebx\n    movl $1, %%eax\n    int $0x80\n' > "${BENCH_DIR}/start.s"
+if as --32 "${BENCH_DIR}/start.s" -o "${BENCH_DIR}/start.o" 2> /dev/null &&
+   as --32 "${BENCH_DIR}/code.s" -o "${BENCH_DIR}/code.o" 2> /dev/null &&
+   ld -m elf_i386 "${BENCH_DIR}/start.o" "${BENCH_DIR}/code.o" -o "${BENCH_DIR}/code" 2> /dev/null; then
+    for run in $(seq "$RUNS"); do
+        start=$(now_ns)
+        for i in $(seq 10); do
+            "${BENCH_DIR}/code"
+        done
+        awk -v ns=$(($(now_ns) - start)) 'BEGIN { printf "%.3f\n", ns / 10 / 1000000 }'
+    done | best_of > "${BENCH_DIR}/run_ms.txt"
+    record "run_generated_ms" "$(cat "${BENCH_DIR}/run_ms.txt")" lower
+else
+    echo "  skipped: 32-bit x86 binaries cannot be assembled and linked here"
+fi
+echo
+
+# One metric per line, so the file can be read back with awk
+{
+    echo "{"
+    for i in "${!metrics[@]}"; do
+        read -r name value better <<< "${metrics[$i]}"
+        separator=$([ "$i" -lt $((${#metrics[@]} - 1)) ] && echo "," || echo "")
+        echo "  \"${name}\": { \"value\": ${value}, \"better\": \"${better}\" }${separator}"
+    done
+    echo "}"
+} > "$RESULTS"
+echo "Results written to $RESULTS"
+
+status=0
+if [ -f "$BASELINE" ]; then
+    echo
+    echo "===== Comparison with $BASELINE (threshold ${THRESHOLD}%) ====="
+    awk -v threshold="$THRESHOLD" '
+        match($0, /"[a-z0-9_]+": \{ "value": [-0-9.e+]+, "better": "[a-z]+" \}/) {
+            split($0, field, "\"")
+            name = field[2]
+            value = $0; sub(/.*"value": /, "", value); sub(/,.*/, "", value)
+            if (FILENAME == ARGV[1]) {
+                baseline[name] = value
+            } else {
+                current[name] = value
+                better[name] = field[8]
+                order[++count] = name
+            }
+        }
+        END {
+            printf "  %-28s %14s %14s %9s\n", "metric", "baseline", "current", "change"
+            for (i = 1; i <= count; i++) {
+                name = order[i]
+                if (!(name in baseline)) {
+                    printf "  %-28s %14s %14s %9s\n", name, "-", current[name], "new"
+                    continue
+                }
+                base = baseline[name] + 0
+                change = base != 0 ? (current[name] - base) * 100 / base : 0
+                worse = better[name] == "higher" ? -change : change
+                flag = worse > threshold ? "  REGRESSION" : ""
+                printf "  %-28s %14s %14s %+8.1f%%%s\n", name, baseline[name], current[name], change, flag
+                if (flag != "") {
+                    regressions++
+                }
+            }
+            if (regressions > 0) {
+                printf "%d metric(s) regressed by more than %s%%\n", regressions, threshold
+                exit 1
+            }
+            print "No regressions"
+        }' "$BASELINE" "$RESULTS" || status=1
+else
+    echo "No baseline at $BASELINE; save one with: make bench_baseline"
+fi
+
+rm -rf "$BENCH_DIR"
+exit $status
@@ -0,0 +1,70 @@
+#!/bin/bash
+# Benchmark parsing of long domains and argument lists.
+# Times the code generator on a quantifier over an N-element domain and on a
+# predicate with N arguments for N = 10^3 .. 10^6, and checks that going from
+# 10^5 to 10^6 elements costs about 10 times as much (linear), not 100 times.
+# A run that exits non-zero fails the benchmark.
+
+BENCH_DIR=$(mktemp -d)
+TIMEFORMAT=%R
+
+if [ ! -f "code_generator" ]; then
+    make code_generator > /dev/null
+fi
+
+# Print a comma-separated list of n names with the given prefix
+names() {
+    awk -v n="$2" -v p="$1" 'BEGIN { for (i = 0; i < n; i++) printf "%s%s%d", (i ? ", " : ""), p, i }'
+}
+
+# Time one run of the code generator on a file, in seconds; fails if the run does
+time_run() {
+    local seconds
+    seconds=$({ time ./code_generator "$1" /dev/null -q > /dev/null 2>&1; } 2>&1) || return 1
+    echo "$seconds"
+}
+
+status=0
+for shape in domain args; do
+    if [ "$shape" = "domain" ]; then
+        echo "===== Parsing a domain of N elements ====="
+    else
+        echo "===== Parsing a predicate with N arguments ====="
+    fi
+    printf "%10s %10s %14s\n" "N" "seconds" "us/element"
+    declare -A seconds
+    failed=0
+    for n in 1000 10000 100000 1000000; do
+        file="${BENCH_DIR}/${shape}_${n}.logic"
+        if [ "$shape" = "domain" ]; then
+            echo "forall x [$(names d "$n")] P(x)" > "$file"
+        else
+            echo "P($(names a "$n"))" > "$file"
+        fi
+        if ! seconds[$n]=$(time_run "$file"); then
+            echo "code_generator failed on N = $n"
+            failed=1
+            break
+        fi
+        printf "%10d %10s %14s\n" "$n" "${seconds[$n]}" \
+            "$(awk -v s="${seconds[$n]}" -v n="$n" 'BEGIN { printf "%.3f", s * 1000000 / n }')"
+    done
+    if [ $failed -eq 1 ]; then
+        status=1
+        unset seconds
+        echo
+        continue
+    fi
+    ratio=$(awk -v a="${seconds[100000]}" -v b="${seconds[1000000]}" 'BEGIN { printf "%.1f", b / (a > 0.001 ? a : 0.001) }')
+    if awk -v r="$ratio" 'BEGIN { exit !(r < 30) }'; then
+        echo "10^6 / 10^5 time ratio: $ratio (linear)"
+    else
+        echo "10^6 / 10^5 time ratio: $ratio (NOT linear)"
+        status=1
+    fi
+    unset seconds
+    echo
+done
+
+rm -rf "$BENCH_DIR"
+exit $status
@@ -0,0 +1,660 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "build_cache.h"
+#include "parser.h"
+
+/* Code known to this build: from the cache, or generated for a new text */
+typedef struct {
+    uint64_t fingerprint;
+    const char* text;            /* Source of a formula with this text */
+    size_t text_length;
+    const char* code;
+    size_t code_length;
+    int loop_depth;
+    bool generated;              /* The code was generated by this build (and is owned here) */
+    int order;                   /* Index in the new cache, or -1 while unused */
+    char scope[17];              /* Fingerprint in hex, the function and label suffix; two
+                                    texts with one fingerprint clash in the assembler rather
+                                    than share code */
+} Fragment;
+
+typedef struct {
+    /* The new source */
+    char* source;
+    size_t source_size;
+
+    /* The previous build, mapped; header is NULL without a usable cache */
+    void* cache_base;
+    size_t cache_size;
+    const BuildCacheHeader* header;
+    const char* old_source;
+    const BuildFormula* old_formulas;
+    const BuildFragment* old_fragments;
+    const char* old_code;
+
+    /* Known fragments, and a hash table of their indices by fingerprint (-1 when empty) */
+    Fragment* fragments;
+    int fragment_count;
+    int fragment_capacity;
+    int* slots;
+    size_t slot_mask;
+
+    /* Formulas of the new source; their fragment fields index the known fragments */
+    BuildFormula* formulas;
+    int formula_count;
+    int formula_capacity;
+
+    /* Region being parsed: its context and its offset in the source */
+    ParseContext* ctx;
+    size_t region_start;
+    CodeGenOptions* options;
+    int compiled;
+} Build;
+
+/* FNV-1a over a formula's text */
+static uint64_t fingerprint(const char* text, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Rebuild the fragment hash table with room for twice the fragments */
+static void grow_slots(Build* build) {
+    size_t size = 16;
+    while (size < (size_t)build->fragment_capacity * 2) {
+        size *= 2;
+    }
+    free(build->slots);
+    build->slots = (int*)malloc(sizeof(int) * size);
+    memset(build->slots, 0xff, sizeof(int) * size);
+    build->slot_mask = size - 1;
+    for (int i = 0; i < build->fragment_count; i++) {
+        size_t slot = build->fragments[i].fingerprint & build->slot_mask;
+        while (build->slots[slot] >= 0) {
+            slot = (slot + 1) & build->slot_mask;
+        }
+        build->slots[slot] = i;
+    }
+}
+
+/*
+ * Find the fragment for a formula text. Fingerprints only pick the candidates;
+ * the texts are compared too, so a collision never pastes the wrong code.
+ */
+static int find_fragment(Build* build, uint64_t hash, const char* text, size_t length) {
+    if (build->slots == NULL) {
+        return -1;
+    }
+    for (size_t slot = hash & build->slot_mask; build->slots[slot] >= 0;
+         slot = (slot + 1) & build->slot_mask) {
+        Fragment* fragment = &build->fragments[build->slots[slot]];
+        if (fragment->fingerprint == hash && fragment->text_length == length &&
+            memcmp(fragment->text, text, length) == 0) {
+            return build->slots[slot];
+        }
+    }
+    return -1;
+}
+
+/* Add a fragment with no code yet; returns its index */
+static int add_fragment(Build* build, uint64_t hash, const char* text, size_t length) {
+    if (build->fragment_count == build->fragment_capacity) {
+        build->fragment_capacity = build->fragment_capacity == 0 ? 64 : build->fragment_capacity * 2;
+        build->fragments = (Fragment*)realloc(build->fragments, sizeof(Fragment) * build->fragment_capacity);
+        grow_slots(build);
+    }
+    int index = build->fragment_count++;
+    Fragment* fragment = &build->fragments[index];
+    memset(fragment, 0, sizeof(Fragment));
+    fragment->fingerprint = hash;
+    fragment->text = text;
+    fragment->text_length = length;
+    fragment->order = -1;
+    snprintf(fragment->scope, sizeof(fragment->scope), "%016llx", (unsigned long long)hash);
+
+    size_t slot = hash & build->slot_mask;
+    while (build->slots[slot] >= 0) {
+        slot = (slot + 1) & build->slot_mask;
+    }
+    build->slots[slot] = index;
+    return index;
+}
+
+static BuildFormula* add_formula(Build* build) {
+    if (build->formula_count == build->formula_capacity) {
+        build->formula_capacity = build->formula_capacity == 0 ? 64 : build->formula_capacity * 2;
+        build->formulas = (BuildFormula*)realloc(build->formulas, sizeof(BuildFormula) * build->formula_capacity);
+    }
+    BuildFormula* formula = &build->formulas[build->formula_count++];
+    memset(formula, 0, sizeof(BuildFormula));
+    return formula;
+}
+
+/* Read the whole input file into memory */
+static bool read_source(Build* build, const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot open file '%s'\n", filename);
+        return false;
+    }
+    size_t capacity = 4096;
+    build->source = (char*)malloc(capacity);
+    size_t got;
+    while ((got = fread(build->source + build->source_size, 1, capacity - build->source_size, file)) > 0) {
+        build->source_size += got;
+        if (build->source_size == capacity) {
+            capacity *= 2;
+            build->source = (char*)realloc(build->source, capacity);
+        }
+    }
+    bool ok = !ferror(file);
+    fclose(file);
+    if (!ok) {
+        fprintf(stderr, "Error: Cannot read file '%s'\n", filename);
+    }
+    return ok;
+}
+
+/* Check that the sections, spans and fragment references of a cache are in bounds */
+static bool check_cache(const BuildCacheHeader* header, size_t size) {
+    uint64_t sizes[BUILD_SECTION_COUNT] = {
+        header->source_size,
+        (uint64_t)header->formula_count * sizeof(BuildFormula),
+        (uint64_t)header->fragment_count * sizeof(BuildFragment),
+        header->code_size
+    };
+    if (header->file_size != size) {
+        return false;
+    }
+    for (int i = 0; i < BUILD_SECTION_COUNT; i++) {
+        if (header->sections[i] % 8 != 0 || header->sections[i] > size ||
+            sizes[i] > size - header->sections[i]) {
+            return false;
+        }
+    }
+
+    const char* base = (const char*)header;
+    const BuildFormula* formulas = (const BuildFormula*)(base + header->sections[BUILD_FORMULAS]);
+    const BuildFragment* fragments = (const BuildFragment*)(base + header->sections[BUILD_FRAGMENTS]);
+    uint64_t previous_end = 0;
+    for (uint32_t i = 0; i < header->formula_count; i++) {
+        if (formulas[i].start < previous_end || formulas[i].end <= formulas[i].start ||
+            formulas[i].end > header->source_size || formulas[i].fragment >= header->fragment_count) {
+            return false;
+        }
+        previous_end = formulas[i].end;
+    }
+    for (uint32_t i = 0; i < header->fragment_count; i++) {
+        if (fragments[i].formula >= header->formula_count ||
+            formulas[fragments[i].formula].fragment != i ||
+            fragments[i].code > header->code_size ||
+            fragments[i].code_length > header->code_size - fragments[i].code ||
+            fragments[i].loop_depth < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Map the previous build's cache and make its fragments known. The cache is
+ * ignored, without an error, if there is none or it does not fit these options.
+ */
+static void load_previous(Build* build, const char* filename, uint32_t flags) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(BuildCacheHeader)) {
+        close(fd);
+        return;
+    }
+    size_t size = info.st_size;
+    void* base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return;
+    }
+
+    const BuildCacheHeader* header = (const BuildCacheHeader*)base;
+    if (memcmp(header->magic, BUILD_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != BUILD_CACHE_VERSION || header->byte_order != BUILD_CACHE_BYTE_ORDER ||
+        header->flags != flags || !check_cache(header, size)) {
+        fprintf(stderr, "Warning: Ignoring build cache '%s'\n", filename);
+        munmap(base, size);
+        return;
+    }
+
+    build->cache_base = base;
+    build->cache_size = size;
+    build->header = header;
+    build->old_source = (const char*)base + header->sections[BUILD_SOURCE];
+    build->old_formulas = (const BuildFormula*)((const char*)base + header->sections[BUILD_FORMULAS]);
+    build->old_fragments = (const BuildFragment*)((const char*)base + header->sections[BUILD_FRAGMENTS]);
+    build->old_code = (const char*)base + header->sections[BUILD_CODE];
+
+    /* Cached fragment i becomes known fragment i, so cached formulas keep their indices */
+    for (uint32_t i = 0; i < header->fragment_count; i++) {
+        const BuildFragment* cached = &build->old_fragments[i];
+        const BuildFormula* first = &build->old_formulas[cached->formula];
+        int index = add_fragment(build, cached->fingerprint, build->old_source + first->start,
+                                 first->end - first->start);
+        Fragment* fragment = &build->fragments[index];
+        fragment->code = build->old_code + cached->code;
+        fragment->code_length = cached->code_length;
+        fragment->loop_depth = cached->loop_depth;
+    }
+}
+
+/* Record a parsed formula and generate its code unless its text is already known */
+static void take_formula_code(ASTNode* formula, int number, void* data) {
+    (void)number;
+    Build* build = (Build*)data;
+    SourceSpan* span = &build->ctx->formula_span;
+    BuildFormula* record = add_formula(build);
+    record->start = build->region_start + span->start;
+    record->end = build->region_start + span->end;
+    record->first_line = span->first_line;
+    record->first_column = span->first_column;
+    record->last_line = span->last_line;
+    record->last_column = span->last_column;
+
+    const char* text = build->source + record->start;
+    size_t length = record->end - record->start;
+    record->fingerprint = fingerprint(text, length);
+    int index = find_fragment(build, record->fingerprint, text, length);
+    if (index < 0) {
+        index = add_fragment(build, record->fingerprint, text, length);
+        Fragment* fragment = &build->fragments[index];
+        prepare_tree(formula, build->ctx->arena, build->options);
+        fragment->code = generate_formula_fragment(formula, fragment->scope, &fragment->loop_depth);
+        fragment->code_length = strlen(fragment->code);
+        fragment->generated = true;
+        build->compiled++;
+    }
+    record->fragment = index;
+}
+
+/*
+ * Parse source[start, end), which begins at the given line and column, and
+ * record its formulas. If diagnostics is not NULL, what the parse writes to
+ * stderr goes there instead: the region is then only part of the file, may
+ * end inside a comment or a formula, and its messages only count if it is
+ * kept (see replay_diagnostics).
+ */
+static bool parse_region(Build* build, size_t start, size_t end, int line, int column,
+                         FILE* diagnostics) {
+    ParseContext* ctx = create_buffer_parse_context(build->source + start, end - start);
+    ctx->line_num = line;
+    ctx->col_num = column;
+    ctx->on_formula = take_formula_code;
+    ctx->handler_data = build;
+    use_fast_lexer(ctx);
+    build->ctx = ctx;
+    build->region_start = start;
+
+    int saved = -1;
+    if (diagnostics != NULL) {
+        rewind(diagnostics);
+        if (ftruncate(fileno(diagnostics), 0) == 0) {
+            fflush(stderr);
+            saved = dup(STDERR_FILENO);
+        }
+        if (saved >= 0) {
+            dup2(fileno(diagnostics), STDERR_FILENO);
+        }
+    }
+    int parse_result = parse_input(ctx);
+    if (saved >= 0) {
+        fflush(stderr);
+        dup2(saved, STDERR_FILENO);
+        close(saved);
+    }
+
+    bool ok = parse_result == 0 && ctx->syntax_errors == 0;
+    free_parse_context(ctx);
+    build->ctx = NULL;
+    return ok;
+}
+
+/* Pass on the messages of the region that was kept */
+static void replay_diagnostics(FILE* diagnostics) {
+    char buffer[4096];
+    size_t got;
+    rewind(diagnostics);
+    while ((got = fread(buffer, 1, sizeof(buffer), diagnostics)) > 0) {
+        fwrite(buffer, 1, got, stderr);
+    }
+}
+
+/* Whether a reparsed formula has a cached one's span, moved by delta bytes */
+static bool same_span(const BuildFormula* parsed, const BuildFormula* cached, bool shrunk, size_t delta) {
+    uint64_t start = shrunk ? cached->start - delta : cached->start + delta;
+    uint64_t end = shrunk ? cached->end - delta : cached->end + delta;
+    return parsed->start == start && parsed->end == end;
+}
+
+/*
+ * Reparse only around the edit. The new text shares a prefix and a suffix
+ * with the cached one; cached formulas that end inside the prefix or start
+ * inside the suffix are kept, moved by the change in length. The region from
+ * the last formula before the edit to the first one after it is parsed
+ * again, and its first and last formulas must come out as those two (or the
+ * edit changed where formulas end, e.g. by opening a comment). If they do
+ * not, the region is widened by more and more formulas on each side.
+ * Returns false if no region short of the whole file parsed and matched;
+ * the caller then parses the whole file, which also reports any errors.
+ */
+static bool rebuild_edited(Build* build, BuildStats* stats) {
+    const BuildCacheHeader* header = build->header;
+    const BuildFormula* old = build->old_formulas;
+    int count = (int)header->formula_count;
+    size_t old_size = header->source_size;
+    size_t new_size = build->source_size;
+    size_t limit = old_size < new_size ? old_size : new_size;
+
+    size_t prefix = 0;
+    while (prefix < limit && build->old_source[prefix] == build->source[prefix]) {
+        prefix++;
+    }
+    if (prefix == old_size && old_size == new_size) {
+        /* Unchanged: every formula keeps its code */
+        for (int i = 0; i < count; i++) {
+            *add_formula(build) = old[i];
+        }
+        return true;
+    }
+    size_t suffix = 0;
+    while (suffix < limit - prefix &&
+           build->old_source[old_size - 1 - suffix] == build->source[new_size - 1 - suffix]) {
+        suffix++;
+    }
+    bool shrunk = new_size < old_size;
+    size_t delta = shrunk ? old_size - new_size : new_size - old_size;
+
+    /*
+     * lo: last formula ending before the edit, with the byte after it unchanged
+     * too (it ended lo's last token); hi: first formula starting at or after
+     * the end of the edit (scanning never looks back)
+     */
+    int lo = -1;
+    for (int low = 0, high = count - 1; low <= high;) {
+        int mid = low + (high - low) / 2;
+        if (old[mid].end < prefix) {
+            lo = mid;
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    int hi = count;
+    for (int low = lo + 1, high = count - 1; low <= high;) {
+        int mid = low + (high - low) / 2;
+        if (old[mid].start >= old_size - suffix) {
+            hi = mid;
+            high = mid - 1;
+        } else {
+            low = mid + 1;
+        }
+    }
+
+    FILE* diagnostics = tmpfile();
+    if (diagnostics == NULL) {
+        return false;
+    }
+    for (int widen = 1; lo >= 0 || hi < count; widen *= 2) {
+        build->formula_count = 0;
+        for (int i = 0; i < lo; i++) {
+            *add_formula(build) = old[i];
+        }
+        int first = build->formula_count;
+
+        size_t start = lo >= 0 ? old[lo].start : 0;
+        size_t end = new_size;
+        if (hi < count) {
+            end = shrunk ? old[hi].end - delta : old[hi].end + delta;
+        }
+        int line = lo >= 0 ? old[lo].first_line : 1;
+        int column = lo >= 0 ? old[lo].first_column : 1;
+        bool parsed = parse_region(build, start, end, line, column, diagnostics);
+        int last = build->formula_count - 1;
+
+        if (parsed && last >= first &&
+            (lo < 0 || same_span(&build->formulas[first], &old[lo], 0, 0)) &&
+            (hi == count || same_span(&build->formulas[last], &old[hi], shrunk, delta))) {
+            replay_diagnostics(diagnostics);
+            fclose(diagnostics);
+            stats->reparsed = last - first + 1;
+            stats->reparsed_bytes = end - start;
+
+            /* Move the formulas after the edit; columns change only on hi's last line */
+            if (hi < count) {
+                int line_shift = build->formulas[last].last_line - old[hi].last_line;
+                int column_shift = build->formulas[last].last_column - old[hi].last_column;
+                for (int i = hi + 1; i < count; i++) {
+                    BuildFormula* moved = add_formula(build);
+                    *moved = old[i];
+                    moved->start = shrunk ? moved->start - delta : moved->start + delta;
+                    moved->end = shrunk ? moved->end - delta : moved->end + delta;
+                    if (moved->first_line == old[hi].last_line) {
+                        moved->first_column += column_shift;
+                    }
+                    if (moved->last_line == old[hi].last_line) {
+                        moved->last_column += column_shift;
+                    }
+                    moved->first_line += line_shift;
+                    moved->last_line += line_shift;
+                }
+            }
+            return true;
+        }
+
+        lo = lo - widen < 0 ? -1 : lo - widen;
+        hi = hi + widen > count ? count : hi + widen;
+    }
+    fclose(diagnostics);
+    build->formula_count = 0;
+    return false;
+}
+
+/* Round a section offset up to 8 bytes */
+static uint64_t align_offset(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+/* Write a section at its offset, padding the gap since the previous one */
+static bool write_section(FILE* file, uint64_t* position, uint64_t offset, const void* data, size_t size) {
+    static const char padding[8] = { 0 };
+    if (offset - *position > 0 && fwrite(padding, 1, offset - *position, file) != offset - *position) {
+        return false;
+    }
+    if (size > 0 && fwrite(data, 1, size, file) != size) {
+        return false;
+    }
+    *position = offset + size;
+    return true;
+}
+
+/*
+ * Write the cache for the new source. It goes to a temporary file renamed
+ * over the old one, which is still mapped and holds code being copied.
+ */
+static bool write_cache(Build* build, const char* filename, uint32_t flags, int* used, int used_count) {
+    BuildFormula* formulas = (BuildFormula*)malloc(sizeof(BuildFormula) * (build->formula_count + 1));
+    BuildFragment* fragments = (BuildFragment*)malloc(sizeof(BuildFragment) * (used_count + 1));
+    uint64_t code_size = 0;
+    for (int i = 0; i < used_count; i++) {
+        Fragment* fragment = &build->fragments[used[i]];
+        fragments[i].fingerprint = fragment->fingerprint;
+        fragments[i].code = code_size;
+        fragments[i].code_length = fragment->code_length;
+        fragments[i].formula = 0;
+        fragments[i].loop_depth = fragment->loop_depth;
+        code_size += fragment->code_length;
+    }
+    for (int i = build->formula_count - 1; i >= 0; i--) {
+        formulas[i] = build->formulas[i];
+        formulas[i].fragment = (uint32_t)build->fragments[formulas[i].fragment].order;
+        fragments[formulas[i].fragment].formula = (uint32_t)i;
+    }
+
+    BuildCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BUILD_CACHE_MAGIC, sizeof(header.magic));
+    header.version = BUILD_CACHE_VERSION;
+    header.byte_order = BUILD_CACHE_BYTE_ORDER;
+    header.flags = flags;
+    header.formula_count = (uint32_t)build->formula_count;
+    header.fragment_count = (uint32_t)used_count;
+    header.source_size = build->source_size;
+    header.code_size = code_size;
+
+    uint64_t sizes[BUILD_SECTION_COUNT] = {
+        build->source_size,
+        (uint64_t)build->formula_count * sizeof(BuildFormula),
+        (uint64_t)used_count * sizeof(BuildFragment),
+        code_size
+    };
+    uint64_t offset = sizeof(BuildCacheHeader);
+    for (int i = 0; i < BUILD_SECTION_COUNT; i++) {
+        offset = align_offset(offset);
+        header.sections[i] = offset;
+        offset += sizes[i];
+    }
+    header.file_size = offset;
+
+    size_t name_length = strlen(filename);
+    char* temporary = (char*)malloc(name_length + 5);
+    memcpy(temporary, filename, name_length);
+    strcpy(temporary + name_length, ".tmp");
+
+    FILE* file = fopen(temporary, "wb");
+    bool ok = file != NULL;
+    if (ok) {
+        uint64_t position = 0;
+        ok = write_section(file, &position, 0, &header, sizeof(header)) &&
+             write_section(file, &position, header.sections[BUILD_SOURCE], build->source, sizes[BUILD_SOURCE]) &&
+             write_section(file, &position, header.sections[BUILD_FORMULAS], formulas, sizes[BUILD_FORMULAS]) &&
+             write_section(file, &position, header.sections[BUILD_FRAGMENTS], fragments, sizes[BUILD_FRAGMENTS]) &&
+             write_section(file, &position, header.sections[BUILD_CODE], NULL, 0);
+        for (int i = 0; ok && i < used_count; i++) {
+            Fragment* fragment = &build->fragments[used[i]];
+            ok = fwrite(fragment->code, 1, fragment->code_length, file) == fragment->code_length;
+        }
+        if (fclose(file) != 0) {
+            ok = false;
+        }
+        if (ok) {
+            ok = rename(temporary, filename) == 0;
+        } else {
+            remove(temporary);
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to write build cache '%s'\n", filename);
+    }
+    free(temporary);
+    free(formulas);
+    free(fragments);
+    return ok;
+}
+
+static void free_build(Build* build) {
+    for (int i = 0; i < build->fragment_count; i++) {
+        if (build->fragments[i].generated) {
+            free((char*)build->fragments[i].code);
+        }
+    }
+    free(build->fragments);
+    free(build->slots);
+    free(build->formulas);
+    free(build->source);
+    if (build->cache_base != NULL) {
+        munmap(build->cache_base, build->cache_size);
+    }
+}
+
+/* Compile a file, reusing the code of formulas unchanged since the cached build */
+bool incremental_build(const char* input_filename, const char* cache_filename,
+                       CodeGenOptions* options, BuildStats* stats) {
+    Build build;
+    memset(&build, 0, sizeof(build));
+    memset(stats, 0, sizeof(BuildStats));
+    build.options = options;
+    uint32_t flags = (options->enable_short_circuit ? BUILD_SHORT_CIRCUIT : 0) |
+                     (options->enable_optimization ? BUILD_OPTIMIZED : 0) |
+                     (options->enable_memoization ? BUILD_MEMOIZED : 0) |
+                     (options->balance_chains ? BUILD_BALANCED : 0);
+
+    if (!read_source(&build, input_filename)) {
+        free_build(&build);
+        return false;
+    }
+    load_previous(&build, cache_filename, flags);
+    if (!begin_code_stream(options)) {
+        free_build(&build);
+        return false;
+    }
+
+    double start = now_seconds();
+    bool ok = build.header != NULL && rebuild_edited(&build, stats);
+    if (!ok) {
+        ok = parse_region(&build, 0, build.source_size, 1, 1, NULL);
+        stats->reparsed = build.formula_count;
+        stats->reparsed_bytes = build.source_size;
+    }
+    stats->seconds = now_seconds() - start;
+    if (ok && build.formula_count == 0) {
+        fprintf(stderr, "Error: No formulas in '%s'\n", input_filename);
+        ok = false;
+    }
+    if (!ok) {
+        cancel_code_stream();
+        free_build(&build);
+        return false;
+    }
+
+    /* Emit each fragment where it is first used; main calls one per formula */
+    int* used = (int*)malloc(sizeof(int) * build.formula_count);
+    const char** scopes = (const char**)malloc(sizeof(char*) * build.formula_count);
+    int used_count = 0;
+    for (int i = 0; i < build.formula_count; i++) {
+        Fragment* fragment = &build.fragments[build.formulas[i].fragment];
+        if (fragment->order < 0) {
+            fragment->order = used_count;
+            used[used_count++] = (int)build.formulas[i].fragment;
+            emit_formula_fragment(fragment->code, fragment->code_length, fragment->loop_depth);
+        }
+        if (!fragment->generated) {
+            stats->reused++;
+        }
+        scopes[i] = fragment->scope;
+    }
+    end_fragment_stream(scopes, build.formula_count);
+
+    stats->formulas = build.formula_count;
+    stats->source_bytes = build.source_size;
+    stats->compiled = build.compiled;
+    ok = write_cache(&build, cache_filename, flags, used, used_count);
+
+    free(scopes);
+    free(used);
+    free_build(&build);
+    return ok;
+}
@@ -0,0 +1,107 @@
+#ifndef BUILD_CACHE_H
+#define BUILD_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "codegen.h"
+
+/*
+ * Incremental build cache.
+ *
+ * An incremental build compiles each top-level formula of a file into its
+ * own function, as --stream does, and keeps the source text, every formula's
+ * span and a fingerprint of its text, and the code generated for it in a
+ * cache file. The next build of the file compares the new text with the
+ * cached one: formulas wholly before or after the edited bytes keep their
+ * code, and only the stretch from the formula before the edit to the one
+ * after it is parsed again. A reparsed formula whose text is in the cache
+ * (such as the two around the edit) reuses its code too, so only formulas
+ * that really changed are compiled.
+ *
+ * Every section is located by a byte offset from the start of the file and
+ * aligned to 8 bytes.
+ *
+ * Layout:
+ *   BuildCacheHeader
+ *   source[source_size]               (the text that was compiled)
+ *   formulas[formula_count]           (BuildFormula, in source order)
+ *   fragments[fragment_count]         (BuildFragment, in order of first use)
+ *   code[code_size]                   (the fragments' assembly text)
+ */
+
+#define BUILD_CACHE_MAGIC "LOGICBLD"
+#define BUILD_CACHE_VERSION 4
+#define BUILD_CACHE_BYTE_ORDER 0x01020304u
+
+/* Header flags: the options the code was generated with */
+#define BUILD_SHORT_CIRCUIT 0x1
+#define BUILD_OPTIMIZED 0x2
+#define BUILD_MEMOIZED 0x4
+#define BUILD_BALANCED 0x8
+
+enum {
+    BUILD_SOURCE,
+    BUILD_FORMULAS,
+    BUILD_FRAGMENTS,
+    BUILD_CODE,
+    BUILD_SECTION_COUNT
+};
+
+typedef struct {
+    char magic[8];               /* BUILD_CACHE_MAGIC, not NUL-terminated */
+    uint32_t version;            /* BUILD_CACHE_VERSION */
+    uint32_t byte_order;         /* BUILD_CACHE_BYTE_ORDER as written */
+    uint32_t flags;
+    uint32_t formula_count;
+    uint32_t fragment_count;
+    uint32_t reserved;
+    uint64_t source_size;
+    uint64_t code_size;
+    uint64_t file_size;
+    uint64_t sections[BUILD_SECTION_COUNT];  /* Byte offsets from the start of the file */
+} BuildCacheHeader;
+
+/* A top-level formula and the fragment holding its code */
+typedef struct {
+    uint64_t start;              /* Byte offsets of its first token and just past its last */
+    uint64_t end;
+    int32_t first_line;          /* Positions of the same, as in SourceSpan */
+    int32_t first_column;
+    int32_t last_line;
+    int32_t last_column;
+    uint64_t fingerprint;        /* Hash of its text */
+    uint32_t fragment;           /* Index into the fragments */
+    uint32_t reserved;
+} BuildFormula;
+
+/* The code of one formula text, shared by every formula with that text */
+typedef struct {
+    uint64_t fingerprint;        /* Hash of the text; names the function formula_<hex> */
+    uint64_t code;               /* Byte offset into the code section */
+    uint64_t code_length;
+    uint32_t formula;            /* First formula with this text */
+    int32_t loop_depth;          /* Quantifier slots the code uses */
+} BuildFragment;
+
+/* What an incremental build did */
+typedef struct {
+    int formulas;                /* Top-level formulas in the file */
+    int reparsed;                /* Formulas parsed again */
+    size_t reparsed_bytes;       /* Bytes of text parsed again */
+    size_t source_bytes;
+    int compiled;                /* Fragments generated by this build */
+    int reused;                  /* Formulas whose code came from the cache */
+    double seconds;              /* Time spent parsing and generating code */
+} BuildStats;
+
+/*
+ * Compile input_filename into options->output_filename, reusing what it can
+ * from cache_filename, then replace the cache with one for the new text. A
+ * cache that is missing, damaged or made with other options is ignored.
+ * Returns false on a syntax or I/O error, leaving the cache as it was.
+ */
+bool incremental_build(const char* input_filename, const char* cache_filename,
+                       CodeGenOptions* options, BuildStats* stats);
+
+#endif /* BUILD_CACHE_H */
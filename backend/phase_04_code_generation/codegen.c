@@ -4,14 +4,71 @@
 #include <stdarg.h>
 #include "codegen.h"
 #include "ast.h"
+#include "predicates.h"
 
 /* Global variables */
 int label_counter = 0;
 FILE* asm_file = NULL;
 bool registers_in_use[6] = {false, false, false, false, false, false};
 
-/* Forward declaration for recursion */
-void generate_code_for_node(ASTNode* node, CodeGenMode mode);
+/* Quantifier domains are fixed to {0, 1} */
+#define QUANT_DOMAIN_SIZE 2
+
+/* Largest number of loop variables a memo table may be keyed on */
+#define MAX_MEMO_KEY_VARIABLES 16
+
+/* Largest arity given a fact table; calls with more arguments are assumed TRUE */
+#define MAX_FACT_TABLE_ARITY 16
+
+/* Quantifier loops enclosing the code being generated, and the most at once */
+static int loop_depth = 0;
+static int max_loop_depth = 0;
+
+/* Memo tables to reserve in .bss once the code has been emitted */
+typedef struct {
+    char* label;
+    int size;
+} MemoTable;
+
+static MemoTable* memo_tables = NULL;
+static int memo_table_count = 0;
+static int memo_table_capacity = 0;
+static bool memoize_invariants = false;
+
+/*
+ * Predicates of the output, and the handles of those whose fact tables the
+ * function being generated uses and has yet to declare
+ */
+static PredicateRegistry* predicates = NULL;
+static int* fact_tables = NULL;
+static bool* fact_table_pending = NULL;  /* By handle */
+static int fact_table_count = 0;
+static int fact_table_capacity = 0;
+
+/*
+ * Labels of an operator or quantifier whose code is emitted across several
+ * stages of the walk over its subtree, innermost last
+ */
+typedef struct {
+    char* labels[3];             /* Binary: end, false; n-ary: end; quantifier loop: start, end, short circuit */
+    char* memo_labels[3];        /* Memoized quantifier: table (owned by memo_tables), miss, done */
+    bool memoized;
+    int operands_done;           /* N-ary: operands evaluated so far */
+} CodeGenFrame;
+
+static CodeGenFrame* frames = NULL;
+static int frame_count = 0;
+static int frame_capacity = 0;
+
+/* Mode and file name of the output being generated */
+static CodeGenMode output_mode = MODE_NORMAL;
+static const char* output_filename = NULL;
+
+/* Added to every label while a fragment is generated (see generate_formula_fragment) */
+static const char* label_scope = NULL;
+
+/* What has been written to the output since it was opened */
+static CodeGenCounts counts;
 
 /* Register allocation */
 Register allocate_register() {
@@ -50,7 +107,11 @@ char* new_label(const char* prefix) {
         fprintf(stderr, "Memory allocation error\n");
         exit(1);
     }
-    sprintf(label, ".%s_%d", prefix, label_counter++);
+    if (label_scope != NULL) {
+        sprintf(label, ".%s_%s_%d", prefix, label_scope, label_counter++);
+    } else {
+        sprintf(label, ".%s_%d", prefix, label_counter++);
+    }
     return label;
 }
 
@@ -62,10 +123,12 @@ void emit_instruction(const char* format, ...) {
     vfprintf(asm_file, format, args);
     fprintf(asm_file, "\n");
     va_end(args);
+    counts.instructions++;
 }
 
 void emit_label(const char* label) {
     fprintf(asm_file, "%s:\n", label);
+    counts.labels++;
 }
 
 void emit_comment(const char* format, ...) {
@@ -77,21 +140,17 @@ void emit_comment(const char* format, ...) {
     va_end(args);
 }
 
-void emit_prologue() {
-    fprintf(asm_file, "    .text\n");
-    fprintf(asm_file, "    .globl main\n");
-    fprintf(asm_file, "main:\n");
+/* Set up the frame of a function and save the callee-saved registers */
+static void emit_frame_setup() {
     emit_instruction("pushl %%ebp");
     emit_instruction("movl %%esp, %%ebp");
     emit_instruction("pushl %%ebx");
     emit_instruction("pushl %%esi");
     emit_instruction("pushl %%edi");
-    emit_comment("Begin logic expression evaluation");
 }
 
-void emit_epilogue() {
-    emit_comment("End logic expression evaluation");
-    emit_comment("Result is in %%eax (0=FALSE, 1=TRUE)");
+/* Restore the saved registers and return */
+static void emit_frame_teardown() {
     emit_instruction("popl %%edi");
     emit_instruction("popl %%esi");
     emit_instruction("popl %%ebx");
@@ -100,84 +159,134 @@ void emit_epilogue() {
     emit_instruction("ret");
 }
 
-/* Code generation for binary operations */
-void generate_binary_op(ASTNode* node, CodeGenMode mode) {
-    char* end_label = NULL;
-    char* false_label = NULL;
+void emit_prologue() {
+    fprintf(asm_file, "    .text\n");
+    fprintf(asm_file, "    .globl main\n");
+    fprintf(asm_file, "main:\n");
+    emit_frame_setup();
+    emit_comment("Begin logic expression evaluation");
+}
+
+void emit_epilogue() {
+    emit_comment("End logic expression evaluation");
+    emit_comment("Result is in %%eax (0=FALSE, 1=TRUE)");
+    emit_frame_teardown();
+}
+
+/* Reserve the memo tables created so far and forget them */
+static void emit_memo_tables() {
+    for (int i = 0; i < memo_table_count; i++) {
+        fprintf(asm_file, "    .lcomm %s, %d\n", memo_tables[i].label, memo_tables[i].size);
+        free(memo_tables[i].label);
+    }
+    memo_table_count = 0;
+}
+
+/* Declare the fact tables used since the last declaration and forget them */
+static void emit_fact_tables() {
+    for (int i = 0; i < fact_table_count; i++) {
+        PredicateInfo* predicate = &predicates->predicates[fact_tables[i]];
+        fprintf(asm_file, "    .comm facts_%s_%d, %d, 1\n", interned_string(predicate->name),
+                predicate->arity, 1 << predicate->arity);
+        fact_table_pending[fact_tables[i]] = false;
+    }
+    fact_table_count = 0;
+}
+
+/* Reserve storage for quantifier slots, memo tables and fact tables */
+void emit_data_section() {
+    if (max_loop_depth > 0) {
+        fprintf(asm_file, "    .lcomm quant_slots, %d\n", 4 * max_loop_depth);
+    }
     
+    emit_memo_tables();
+    emit_fact_tables();
+    free(memo_tables);
+    memo_tables = NULL;
+    memo_table_capacity = 0;
+}
+
+/* Short-circuit evaluation applies to AND and OR */
+static bool is_short_circuit(ASTNode* node, CodeGenMode mode) {
+    return mode == MODE_SHORT_CIRCUIT &&
+           (node->data.binary.operator == OP_AND || node->data.binary.operator == OP_OR);
+}
+
+/* Code generation for binary operations */
+void generate_binary_op(ASTNode* node, VisitStage stage, CodeGenMode mode) {
     if (node == NULL || node->type != NODE_BINARY_OP) {
         fprintf(stderr, "Error: Invalid binary operation node\n");
         exit(1);
     }
     
-    emit_comment("Binary operation");
+    CodeGenFrame* frame = &frames[frame_count - 1];
     
     /* Short-circuit evaluation for AND and OR */
-    if (mode == MODE_SHORT_CIRCUIT) {
-        switch (node->data.binary.operator) {
-            case OP_AND:
-                emit_comment("Short-circuit AND");
-                end_label = new_label("end");
-                false_label = new_label("false");
-                
-                /* Evaluate left operand */
-                generate_code_for_node(node->data.binary.left, mode);
-                
-                /* If left is false, the result is false */
-                emit_instruction("cmpl $0, %%eax");
-                emit_instruction("je %s", false_label);
-                
-                /* Otherwise, evaluate right operand */
-                emit_instruction("pushl %%eax");    /* Save left result */
-                generate_code_for_node(node->data.binary.right, mode);
-                emit_instruction("movl %%eax, %%ecx");  /* Right result in %ecx */
-                emit_instruction("popl %%eax");     /* Restore left result */
-                
-                /* AND the results */
-                emit_instruction("andl %%ecx, %%eax");
-                emit_instruction("jmp %s", end_label);
-                
-                emit_label(false_label);
-                emit_instruction("movl $0, %%eax");
-                emit_label(end_label);
-                
-                free(end_label);
-                free(false_label);
-                return;
-                
-            case OP_OR:
-                emit_comment("Short-circuit OR");
-                end_label = new_label("end");
-                
-                /* Evaluate left operand */
-                generate_code_for_node(node->data.binary.left, mode);
+    if (is_short_circuit(node, mode)) {
+        bool is_and = node->data.binary.operator == OP_AND;
+        char* end_label = frame->labels[0];
+        char* false_label = frame->labels[1];
+        
+        switch (stage) {
+            case VISIT_ENTER:
+                emit_comment("Binary operation");
+                emit_comment("Short-circuit %s", is_and ? "AND" : "OR");
+                frame->labels[0] = new_label("end");
+                if (is_and) {
+                    frame->labels[1] = new_label("false");
+                }
+                /* The left operand is evaluated next */
+                break;
                 
-                /* If left is true, the result is true */
+            case VISIT_BETWEEN:
                 emit_instruction("cmpl $0, %%eax");
-                emit_instruction("jne %s", end_label);
-                
-                /* Otherwise, evaluate right operand */
-                generate_code_for_node(node->data.binary.right, mode);
+                if (is_and) {
+                    /* If left is false, the result is false */
+                    emit_instruction("je %s", false_label);
+                    
+                    /* Otherwise, evaluate right operand */
+                    emit_instruction("pushl %%eax");    /* Save left result */
+                } else {
+                    /* If left is true, the result is true */
+                    emit_instruction("jne %s", end_label);
+                }
+                break;
                 
+            case VISIT_LEAVE:
+                if (is_and) {
+                    emit_instruction("movl %%eax, %%ecx");  /* Right result in %ecx */
+                    emit_instruction("popl %%eax");     /* Restore left result */
+                    
+                    /* AND the results */
+                    emit_instruction("andl %%ecx, %%eax");
+                    emit_instruction("jmp %s", end_label);
+                    
+                    emit_label(false_label);
+                    emit_instruction("movl $0, %%eax");
+                }
                 emit_label(end_label);
-                free(end_label);
-                return;
-                
-            default:
-                /* For other operators, continue with normal evaluation */
                 break;
         }
+        return;
     }
     
     /* Normal evaluation for other operators */
-    emit_comment("Evaluate left operand");
-    generate_code_for_node(node->data.binary.left, mode);
-    
-    /* Save left operand result */
-    emit_instruction("pushl %%eax");
-    
-    emit_comment("Evaluate right operand");
-    generate_code_for_node(node->data.binary.right, mode);
+    switch (stage) {
+        case VISIT_ENTER:
+            emit_comment("Binary operation");
+            emit_comment("Evaluate left operand");
+            return;
+            
+        case VISIT_BETWEEN:
+            /* Save left operand result */
+            emit_instruction("pushl %%eax");
+            
+            emit_comment("Evaluate right operand");
+            return;
+            
+        case VISIT_LEAVE:
+            break;
+    }
     
     /* Right operand result in %ecx */
     emit_instruction("movl %%eax, %%ecx");
@@ -220,17 +329,84 @@ void generate_binary_op(ASTNode* node, CodeGenMode mode) {
     }
 }
 
+/*
+ * Code generation for AND, OR and XOR over a list of operands, as one flat
+ * sequence instead of a nest of binary operations. With short-circuit
+ * evaluation every operand but the last tests its result and jumps to one
+ * shared exit label; otherwise the results are folded into an accumulator in
+ * a single stack slot. Either way the stack does not grow with the operands.
+ */
+void generate_nary_op(ASTNode* node, VisitStage stage, CodeGenMode mode) {
+    if (node == NULL || node->type != NODE_NARY_OP) {
+        fprintf(stderr, "Error: Invalid n-ary operation node\n");
+        exit(1);
+    }
+    
+    CodeGenFrame* frame = &frames[frame_count - 1];
+    BinaryOpType op = node->data.nary.operator;
+    const char* instruction;
+    switch (op) {
+        case OP_AND: instruction = "andl"; break;
+        case OP_OR:  instruction = "orl"; break;
+        case OP_XOR: instruction = "xorl"; break;
+        default:
+            fprintf(stderr, "Error: Unknown n-ary operator: %d\n", op);
+            exit(1);
+    }
+    
+    if (mode == MODE_SHORT_CIRCUIT && op != OP_XOR) {
+        switch (stage) {
+            case VISIT_ENTER:
+                emit_comment("Short-circuit %s of %d operands", get_op_name(op),
+                             node->data.nary.operand_count);
+                frame->labels[0] = new_label("end");
+                break;
+                
+            case VISIT_BETWEEN:
+                /* A false operand decides an AND, a true one an OR */
+                emit_instruction("cmpl $0, %%eax");
+                emit_instruction("%s %s", op == OP_AND ? "je" : "jne", frame->labels[0]);
+                break;
+                
+            case VISIT_LEAVE:
+                emit_label(frame->labels[0]);
+                break;
+        }
+        return;
+    }
+    
+    switch (stage) {
+        case VISIT_ENTER:
+            emit_comment("%s of %d operands", get_op_name(op), node->data.nary.operand_count);
+            break;
+            
+        case VISIT_BETWEEN:
+            if (frame->operands_done++ == 0) {
+                emit_instruction("pushl %%eax");  /* First operand starts the accumulator */
+            } else {
+                emit_instruction("%s %%eax, (%%esp)", instruction);
+            }
+            break;
+            
+        case VISIT_LEAVE:
+            emit_instruction("%s (%%esp), %%eax", instruction);
+            emit_instruction("addl $4, %%esp");
+            break;
+    }
+}
+
 /* Code generation for unary operations */
-void generate_unary_op(ASTNode* node, CodeGenMode mode) {
+void generate_unary_op(ASTNode* node, VisitStage stage, CodeGenMode mode) {
     if (node == NULL || node->type != NODE_UNARY_OP) {
         fprintf(stderr, "Error: Invalid unary operation node\n");
         exit(1);
     }
     
-    emit_comment("Unary operation");
-    
-    /* Generate code for operand */
-    generate_code_for_node(node->data.unary.operand, mode);
+    if (stage == VISIT_ENTER) {
+        emit_comment("Unary operation");
+        /* The operand is evaluated next */
+        return;
+    }
     
     /* Apply operation */
     switch (node->data.unary.operator) {
@@ -263,36 +439,115 @@ void generate_variable(ASTNode* node, CodeGenMode mode) {
         exit(1);
     }
     
-    /* In this simple implementation, we assume variables are TRUE */
-    /* In a real compiler, this would load the variable's value from memory */
-    emit_comment("Variable reference: %s (assumed TRUE)", node->data.variable.name);
-    emit_instruction("movl $1, %%eax");
+    /* Names no quantifier binds are constants, assumed TRUE */
+    if (node->data.variable.slot == UNBOUND_SLOT) {
+        emit_comment("Variable reference: %s (assumed TRUE)", interned_string(node->data.variable.name));
+        emit_instruction("movl $1, %%eax");
+        return;
+    }
+    
+    /* A bound variable is the current element of its loop, read from the loop's slot */
+    emit_comment("Variable reference: %s (slot %d)", interned_string(node->data.variable.name),
+                 node->data.variable.slot);
+    emit_instruction("movl quant_slots+%d, %%eax", 4 * node->data.variable.slot);
 }
 
-/* Code generation for predicates */
+/* Note that the function being generated reads a predicate's fact table */
+static void use_fact_table(PredicateInfo* predicate) {
+    if (predicate->handle >= fact_table_capacity) {
+        int capacity = fact_table_capacity == 0 ? 16 : fact_table_capacity;
+        while (capacity <= predicate->handle) {
+            capacity *= 2;
+        }
+        fact_tables = (int*)realloc(fact_tables, sizeof(int) * capacity);
+        fact_table_pending = (bool*)realloc(fact_table_pending, sizeof(bool) * capacity);
+        memset(fact_table_pending + fact_table_capacity, 0, sizeof(bool) * (capacity - fact_table_capacity));
+        fact_table_capacity = capacity;
+    }
+    if (!fact_table_pending[predicate->handle]) {
+        fact_table_pending[predicate->handle] = true;
+        fact_tables[fact_table_count++] = predicate->handle;
+    }
+}
+
+/*
+ * Code generation for predicates. A predicate P called with n arguments
+ * reads byte facts_P_n[i], where bit k of i is the value of argument k + 1
+ * as written (the parser keeps the arguments last first, so that is
+ * args[n - 1 - k]); constants count as 1, like unbound variables. The
+ * table is a common symbol, so a facts object linked with the program may
+ * define it; a nonzero byte means the predicate does not hold, and the
+ * zero-filled default keeps every predicate TRUE. The index is computed in
+ * straight-line code for the call's arity: constant arguments fold into the
+ * table offset and the slots of bound ones are shifted into place.
+ */
 void generate_predicate(ASTNode* node, CodeGenMode mode) {
     if (node == NULL || node->type != NODE_PREDICATE) {
         fprintf(stderr, "Error: Invalid predicate node\n");
         exit(1);
     }
     
-    /* In this simple implementation, we assume predicates are TRUE */
-    /* In a real compiler, this would evaluate the predicate with its arguments */
-    emit_comment("Predicate call: %s (assumed TRUE)", node->data.predicate.name);
-    emit_instruction("movl $1, %%eax");
+    const char* name = interned_string(node->data.predicate.name);
+    int arity = node->data.predicate.arg_count;
+    PredicateInfo* predicate = use_predicate(predicates, node->data.predicate.name, arity,
+                                             node->line, node->column);
+    
+    /* Calls semantic analysis would reject, and tables too large to declare */
+    if (predicate->arity != arity || arity > MAX_FACT_TABLE_ARITY) {
+        emit_comment("Predicate call: %s (assumed TRUE)", name);
+        emit_instruction("movl $1, %%eax");
+        return;
+    }
+    use_fact_table(predicate);
+    emit_comment("Predicate call: %s/%d", name, arity);
+    
+    int offset = 0;
+    int last_bound = -1;
+    for (int i = 0; i < arity; i++) {
+        int slot = node->data.predicate.slots[i];
+        if (slot == UNBOUND_SLOT) {
+            offset |= 1 << (arity - 1 - i);
+        } else if (last_bound < 0) {
+            emit_instruction("movl quant_slots+%d, %%ecx", 4 * slot);
+            last_bound = i;
+        } else {
+            emit_instruction("shll $%d, %%ecx", i - last_bound);
+            emit_instruction("addl quant_slots+%d, %%ecx", 4 * slot);
+            last_bound = i;
+        }
+    }
+    
+    if (last_bound >= 0 && last_bound < arity - 1) {
+        emit_instruction("shll $%d, %%ecx", arity - 1 - last_bound);
+    }
+    
+    char displacement[16] = "";
+    if (offset > 0) {
+        snprintf(displacement, sizeof(displacement), "+%d", offset);
+    }
+    emit_instruction("movzbl facts_%s_%d%s%s, %%eax", name, arity, displacement,
+                     last_bound >= 0 ? "(%ecx)" : "");
+    emit_instruction("xorl $1, %%eax");
 }
 
-/* Code generation for quantifiers */
-void generate_quantifier(ASTNode* node, CodeGenMode mode) {
+/* Track the quantifier loops enclosing the code being generated */
+static void push_loop() {
+    loop_depth++;
+    if (loop_depth > max_loop_depth) {
+        max_loop_depth = loop_depth;
+    }
+}
+
+static void pop_loop() {
+    loop_depth--;
+}
+
+/* Emit the loop over the quantifier's domain up to its body */
+static void begin_quantifier_loop(ASTNode* node, CodeGenFrame* frame) {
     char* loop_start = NULL;
     char* loop_end = NULL;
     char* short_circuit = NULL;
     
-    if (node == NULL || node->type != NODE_QUANTIFIER) {
-        fprintf(stderr, "Error: Invalid quantifier node\n");
-        exit(1);
-    }
-    
     /* We'll use a simple implementation with fixed domain {0, 1} */
     /* In a real compiler, you would use the domain from the AST */
     
@@ -301,7 +556,7 @@ void generate_quantifier(ASTNode* node, CodeGenMode mode) {
     
     emit_comment("Quantifier: %s over variable %s", 
                  node->data.quantifier.quantifier == QUANT_FORALL ? "FORALL" : "EXISTS",
-                 node->data.quantifier.variable);
+                 interned_string(node->data.quantifier.variable));
     
     /* Initialize loop counter */
     emit_instruction("movl $0, %%edx");  /* Start with domain value 0 */
@@ -320,14 +575,31 @@ void generate_quantifier(ASTNode* node, CodeGenMode mode) {
     /* Loop start */
     emit_label(loop_start);
     
+    /* Publish the loop counter in the loop's slot, where the body's
+       variables and memoized subformulas read it */
+    emit_instruction("movl %%edx, quant_slots+%d", 4 * loop_depth);
+    
     /* Push loop counter and result to stack */
     emit_instruction("pushl %%edx");
     emit_instruction("pushl %%eax");
     
-    /* Evaluate expression */
+    /* The body is evaluated next */
     emit_comment("Evaluating quantified expression with %s = %%edx", 
-                 node->data.quantifier.variable);
-    generate_code_for_node(node->data.quantifier.expr, mode);
+                 interned_string(node->data.quantifier.variable));
+    push_loop();
+    
+    frame->labels[0] = loop_start;
+    frame->labels[1] = loop_end;
+    frame->labels[2] = short_circuit;
+}
+
+/* Emit the rest of the loop once its body has been generated */
+static void end_quantifier_loop(ASTNode* node, CodeGenFrame* frame, CodeGenMode mode) {
+    char* loop_start = frame->labels[0];
+    char* loop_end = frame->labels[1];
+    char* short_circuit = frame->labels[2];
+    
+    pop_loop();
     
     /* Move expression result to %ecx */
     emit_instruction("movl %%eax, %%ecx");
@@ -361,7 +633,7 @@ void generate_quantifier(ASTNode* node, CodeGenMode mode) {
     emit_instruction("incl %%edx");
     
     /* Check if we've processed the entire domain */
-    emit_instruction("cmpl $2, %%edx");  /* Domain size is 2 (0 and 1) */
+    emit_instruction("cmpl $%d, %%edx", QUANT_DOMAIN_SIZE);  /* Domain size is 2 (0 and 1) */
     emit_instruction("jl %s", loop_start);
     
     /* Loop end */
@@ -370,59 +642,239 @@ void generate_quantifier(ASTNode* node, CodeGenMode mode) {
     }
     
     emit_label(loop_end);
+}
+
+/* Slots of the loops outside a subformula that its variables read, in order of first use */
+typedef struct {
+    int* depths;
+    int* depth_count;
+    int outer;                   /* Loops enclosing the subformula */
+    bool overflow;               /* More than MAX_MEMO_KEY_VARIABLES of them */
+} OuterSlots;
+
+static void add_outer_slot(OuterSlots* outer, int slot) {
+    if (slot == UNBOUND_SLOT || slot >= outer->outer) {
+        return; /* A constant (assumed TRUE), or bound inside the subformula */
+    }
+    for (int i = 0; i < *outer->depth_count; i++) {
+        if (outer->depths[i] == slot) {
+            return;
+        }
+    }
+    if (*outer->depth_count == MAX_MEMO_KEY_VARIABLES) {
+        outer->overflow = true;
+    } else {
+        outer->depths[(*outer->depth_count)++] = slot;
+    }
+}
+
+static bool outer_slot_visit(ASTNode* node, VisitStage stage, int depth, void* data) {
+    OuterSlots* outer = (OuterSlots*)data;
     
-    /* Free memory for labels */
-    free(loop_start);
-    free(loop_end);
-    free(short_circuit);
+    if (stage == VISIT_ENTER && node->type == NODE_VARIABLE) {
+        add_outer_slot(outer, node->data.variable.slot);
+    } else if (stage == VISIT_ENTER && node->type == NODE_PREDICATE) {
+        for (int i = 0; i < node->data.predicate.arg_count; i++) {
+            add_outer_slot(outer, node->data.predicate.slots[i]);
+        }
+    }
+    return !outer->overflow;
 }
 
-/* Helper function to generate code for a node */
-void generate_code_for_node(ASTNode* node, CodeGenMode mode) {
-    if (node == NULL) {
-        fprintf(stderr, "Error: NULL node in code generation\n");
+/*
+ * A quantified subformula nested in other quantifiers is loop-invariant with
+ * respect to every enclosing variable it does not mention. When its free
+ * variables bind to a strict subset of the enclosing loops, its value can be
+ * cached per binding of that subset. On success, depths receives the loop
+ * depth of each free variable.
+ */
+bool should_memoize_quantifier(ASTNode* node, int* depths, int* depth_count) {
+    OuterSlots outer = { depths, depth_count, loop_depth, false };
+    
+    *depth_count = 0;
+    if (loop_depth == 0) {
+        return false;
+    }
+    
+    walk_ast(node, outer_slot_visit, &outer);
+    
+    /* Every enclosing loop is used: each binding is visited once anyway */
+    return !outer.overflow && *depth_count < loop_depth;
+}
+
+/* Look up a quantifier's memo table, falling through to its loop on a miss */
+void begin_memoized_quantifier(ASTNode* node, int* depths, int depth_count) {
+    CodeGenFrame* frame = &frames[frame_count - 1];
+    char* table = new_label("memo_table");
+    char* miss = new_label("memo_miss");
+    char* done = new_label("memo_done");
+    int size = 1;
+    
+    for (int i = 0; i < depth_count; i++) {
+        size *= QUANT_DOMAIN_SIZE;
+    }
+    
+    if (memo_table_count == memo_table_capacity) {
+        memo_table_capacity = memo_table_capacity == 0 ? 8 : memo_table_capacity * 2;
+        memo_tables = (MemoTable*)realloc(memo_tables, sizeof(MemoTable) * memo_table_capacity);
+    }
+    memo_tables[memo_table_count].label = table;
+    memo_tables[memo_table_count].size = size;
+    memo_table_count++;
+    
+    emit_comment("Memoized quantifier over %s (keyed on %d of %d enclosing loops)",
+                 interned_string(node->data.quantifier.variable), depth_count, loop_depth);
+    
+    /* Table index from the slots of the loops the subformula depends on */
+    if (depth_count == 0) {
+        emit_instruction("movl $0, %%ecx");
+    } else {
+        emit_instruction("movl quant_slots+%d, %%ecx", 4 * depths[0]);
+    }
+    for (int i = 1; i < depth_count; i++) {
+        emit_instruction("imull $%d, %%ecx", QUANT_DOMAIN_SIZE);
+        emit_instruction("addl quant_slots+%d, %%ecx", 4 * depths[i]);
+    }
+    
+    /* Entries hold 0 when not yet computed, otherwise result + 1 */
+    emit_instruction("movzbl %s(%%ecx), %%eax", table);
+    emit_instruction("testl %%eax, %%eax");
+    emit_instruction("jz %s", miss);
+    emit_instruction("decl %%eax");
+    emit_instruction("jmp %s", done);
+    
+    emit_label(miss);
+    emit_instruction("pushl %%ecx");
+    
+    frame->memoized = true;
+    frame->memo_labels[0] = table;
+    frame->memo_labels[1] = miss;
+    frame->memo_labels[2] = done;
+}
+
+/* Store the result computed by the loop in the memo table */
+void end_memoized_quantifier(ASTNode* node) {
+    CodeGenFrame* frame = &frames[frame_count - 1];
+    
+    emit_instruction("popl %%ecx");
+    emit_instruction("leal 1(%%eax), %%edx");
+    emit_instruction("movb %%dl, %s(%%ecx)", frame->memo_labels[0]);
+    emit_label(frame->memo_labels[2]);
+}
+
+/* Code generation for quantifiers */
+void generate_quantifier(ASTNode* node, VisitStage stage, CodeGenMode mode) {
+    int depths[MAX_MEMO_KEY_VARIABLES];
+    int depth_count = 0;
+    
+    if (node == NULL || node->type != NODE_QUANTIFIER) {
+        fprintf(stderr, "Error: Invalid quantifier node\n");
         exit(1);
     }
     
+    CodeGenFrame* frame = &frames[frame_count - 1];
+    
+    if (stage == VISIT_ENTER) {
+        if (memoize_invariants && should_memoize_quantifier(node, depths, &depth_count)) {
+            begin_memoized_quantifier(node, depths, depth_count);
+        }
+        begin_quantifier_loop(node, frame);
+    } else if (stage == VISIT_LEAVE) {
+        end_quantifier_loop(node, frame, mode);
+        if (frame->memoized) {
+            end_memoized_quantifier(node);
+        }
+    }
+}
+
+static void push_frame() {
+    if (frame_count == frame_capacity) {
+        frame_capacity = frame_capacity == 0 ? 64 : frame_capacity * 2;
+        frames = (CodeGenFrame*)realloc(frames, sizeof(CodeGenFrame) * frame_capacity);
+    }
+    memset(&frames[frame_count++], 0, sizeof(CodeGenFrame));
+}
+
+static void pop_frame() {
+    CodeGenFrame* frame = &frames[--frame_count];
+    for (int i = 0; i < 3; i++) {
+        free(frame->labels[i]);
+    }
+    /* The memo table label is freed with memo_tables */
+    free(frame->memo_labels[1]);
+    free(frame->memo_labels[2]);
+}
+
+/* Emit the code of one node at one stage of the walk */
+static bool codegen_visit(ASTNode* node, VisitStage stage, int depth, void* data) {
+    CodeGenMode mode = *(CodeGenMode*)data;
+    
+    if (stage == VISIT_ENTER) {
+        push_frame();
+    }
+    
     switch (node->type) {
         case NODE_BINARY_OP:
-            generate_binary_op(node, mode);
+            generate_binary_op(node, stage, mode);
+            break;
+            
+        case NODE_NARY_OP:
+            generate_nary_op(node, stage, mode);
             break;
             
         case NODE_UNARY_OP:
-            generate_unary_op(node, mode);
+            generate_unary_op(node, stage, mode);
             break;
             
         case NODE_QUANTIFIER:
-            generate_quantifier(node, mode);
+            generate_quantifier(node, stage, mode);
             break;
             
         case NODE_PREDICATE:
-            generate_predicate(node, mode);
+            if (stage == VISIT_ENTER) {
+                generate_predicate(node, mode);
+            }
             break;
             
         case NODE_VARIABLE:
-            generate_variable(node, mode);
+            if (stage == VISIT_ENTER) {
+                generate_variable(node, mode);
+            }
             break;
             
         case NODE_LITERAL:
-            generate_literal(node, mode);
+            if (stage == VISIT_ENTER) {
+                generate_literal(node, mode);
+            }
             break;
             
         default:
             fprintf(stderr, "Error: Unknown node type: %d\n", node->type);
             exit(1);
     }
+    
+    if (stage == VISIT_LEAVE) {
+        pop_frame();
+    }
+    return true;
 }
 
-/* Main code generation function */
-bool generate_code(ASTNode* ast, CodeGenOptions* options) {
-    if (ast == NULL) {
-        fprintf(stderr, "Error: NULL AST in code generation\n");
-        return false;
+/*
+ * Generate code for a subtree. Operators and quantifiers emit their code in
+ * pieces around their children, driven by walk_ast, so the depth of the tree
+ * is not limited by the C stack.
+ */
+void generate_code_for_node(ASTNode* node, CodeGenMode mode) {
+    if (node == NULL) {
+        fprintf(stderr, "Error: NULL node in code generation\n");
+        exit(1);
     }
     
-    /* Open output file */
+    walk_ast(node, codegen_visit, &mode);
+}
+
+/* Open the output file and set up the state shared by all formulas */
+static bool begin_output(CodeGenOptions* options) {
     asm_file = fopen(options->output_filename, "w");
     if (asm_file == NULL) {
         fprintf(stderr, "Error: Could not open output file '%s'\n", options->output_filename);
@@ -430,23 +882,193 @@ bool generate_code(ASTNode* ast, CodeGenOptions* options) {
     }
     
     /* Determine code generation mode */
-    CodeGenMode mode = MODE_NORMAL;
+    output_mode = MODE_NORMAL;
     if (options->enable_short_circuit) {
-        mode = MODE_SHORT_CIRCUIT;
+        output_mode = MODE_SHORT_CIRCUIT;
     }
     if (options->enable_optimization) {
-        mode = MODE_OPTIMIZED;
+        output_mode = MODE_OPTIMIZED;
+    }
+    memoize_invariants = options->enable_memoization;
+    predicates = create_predicate_registry();
+    loop_depth = 0;
+    max_loop_depth = 0;
+    output_filename = options->output_filename;
+    memset(&counts, 0, sizeof(counts));
+    return true;
+}
+
+/* Reserve the data, release the shared state and close (or discard) the output file */
+static void end_output(bool keep) {
+    emit_data_section();
+    
+    free(frames);
+    frames = NULL;
+    frame_capacity = 0;
+    
+    free_predicate_registry(predicates);
+    predicates = NULL;
+    free(fact_tables);
+    free(fact_table_pending);
+    fact_tables = NULL;
+    fact_table_pending = NULL;
+    fact_table_capacity = 0;
+    
+    /* Close output file */
+    counts.bytes = ftell(asm_file);
+    fclose(asm_file);
+    asm_file = NULL;
+    
+    if (keep) {
+        printf("Assembly code generated successfully: %s\n", output_filename);
+    } else {
+        remove(output_filename);
+    }
+}
+
+/* Main code generation function */
+bool generate_code(ASTNode* ast, CodeGenOptions* options) {
+    if (ast == NULL) {
+        fprintf(stderr, "Error: NULL AST in code generation\n");
+        return false;
+    }
+    
+    /* Open output file */
+    if (!begin_output(options)) {
+        return false;
     }
     
     /* Generate assembly code */
     emit_prologue();
-    generate_code_for_node(ast, mode);
+    generate_code_for_node(ast, output_mode);
     emit_epilogue();
+    end_output(true);
+    return true;
+}
+
+/* Flatten or balance the associative chains of a tree and resolve its variables, in place */
+void prepare_tree(ASTNode* ast, Arena* arena, CodeGenOptions* options) {
+    if (options->balance_chains) {
+        balance_associative(ast, arena);
+    } else {
+        flatten_associative(ast, arena);
+    }
+    resolve_bindings(ast);
+}
+
+/* Start a streamed output file; formulas are then added one at a time */
+bool begin_code_stream(CodeGenOptions* options) {
+    return begin_output(options);
+}
+
+/*
+ * Emit one top-level formula as the function formula_<index>, which returns
+ * its value in %eax. Its memo tables are reserved and its fact tables
+ * declared right after it, so nothing about the formula is kept once this
+ * returns and the AST can be freed.
+ */
+void generate_formula_function(ASTNode* formula, int index) {
+    fprintf(asm_file, "    .text\n");
+    fprintf(asm_file, "formula_%d:\n", index);
+    emit_frame_setup();
+    emit_comment("Begin formula %d", index);
+    generate_code_for_node(formula, output_mode);
+    emit_comment("End formula %d", index);
+    emit_frame_teardown();
+    emit_memo_tables();
+    emit_fact_tables();
+}
+
+/*
+ * Generate one top-level formula as the function formula_<scope> into a
+ * string instead of the output file. Its labels are numbered from 0 and
+ * carry the scope and its predicates are registered apart, so the code does
+ * not depend on anything else generated in the same run and an incremental
+ * build can paste it into a later output.
+ * loop_depth receives the quantifier nesting the code needs in quant_slots,
+ * which counts only once the fragment is emitted. Must be called between
+ * begin_code_stream and end_fragment_stream.
+ */
+char* generate_formula_fragment(ASTNode* formula, const char* scope, int* loop_depth) {
+    FILE* output = asm_file;
+    int labels = label_counter;
+    int depth = max_loop_depth;
+    PredicateRegistry* registry = predicates;
+    char* code = NULL;
+    size_t length = 0;
     
-    /* Close output file */
+    asm_file = open_memstream(&code, &length);
+    if (asm_file == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(1);
+    }
+    label_scope = scope;
+    label_counter = 0;
+    max_loop_depth = 0;
+    predicates = create_predicate_registry();
+    
+    fprintf(asm_file, "    .text\n");
+    fprintf(asm_file, "formula_%s:\n", scope);
+    emit_frame_setup();
+    emit_comment("Begin formula %s", scope);
+    generate_code_for_node(formula, output_mode);
+    emit_comment("End formula %s", scope);
+    emit_frame_teardown();
+    emit_memo_tables();
+    emit_fact_tables();
     fclose(asm_file);
-    asm_file = NULL;
     
-    printf("Assembly code generated successfully: %s\n", options->output_filename);
+    *loop_depth = max_loop_depth;
+    asm_file = output;
+    label_scope = NULL;
+    label_counter = labels;
+    max_loop_depth = depth;
+    free_predicate_registry(predicates);
+    predicates = registry;
+    return code;
+}
+
+/* Add the code of a fragment, generated by this run or an earlier one, to the output */
+void emit_formula_fragment(const char* code, size_t length, int loop_depth) {
+    fwrite(code, 1, length, asm_file);
+    if (loop_depth > max_loop_depth) {
+        max_loop_depth = loop_depth;
+    }
+}
+
+/* Emit main, which ANDs the results of formula_<scope> for each scope in order */
+bool end_fragment_stream(const char* const* scopes, int count) {
+    emit_prologue();
+    emit_instruction("movl $1, %%ebx");
+    for (int i = 0; i < count; i++) {
+        emit_instruction("call formula_%s", scopes[i]);
+        emit_instruction("andl %%eax, %%ebx");
+    }
+    emit_instruction("movl %%ebx, %%eax");
+    emit_epilogue();
+    end_output(true);
+    return true;
+}
+
+/* Emit main, which ANDs the results of formula_1 to formula_<formula_count> */
+bool end_code_stream(int formula_count) {
+    emit_prologue();
+    emit_instruction("movl $1, %%ebx");
+    for (int i = 1; i <= formula_count; i++) {
+        emit_instruction("call formula_%d", i);
+        emit_instruction("andl %%eax, %%ebx");
+    }
+    emit_instruction("movl %%ebx, %%eax");
+    emit_epilogue();
+    end_output(true);
     return true;
-}
\ No newline at end of file
+}
+
+CodeGenCounts codegen_counts() {
+    return counts;
+}
+
+/* Abandon a streamed output file, e.g. after a syntax error */
+void cancel_code_stream() {
+    end_output(false);
+}
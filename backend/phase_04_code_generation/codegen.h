@@ -34,19 +34,58 @@ extern FILE* asm_file;
 typedef struct {
     bool enable_short_circuit;     /* Enable short-circuit evaluation */
     bool enable_optimization;      /* Enable additional optimizations */
+    bool enable_memoization;       /* Cache loop-invariant quantified subformulas */
+    bool balance_chains;           /* Emit AND/OR/XOR chains as balanced trees, not flat sequences */
     char* output_filename;         /* Output filename for assembly */
 } CodeGenOptions;
 
+/*
+ * Prepare a parsed tree for code generation. Its AND, OR and XOR chains are
+ * reshaped into n-ary nodes emitted as flat sequences, or with
+ * balance_chains into balanced binary trees (see flatten_associative), and
+ * its variables are resolved to the slots of their quantifier loops.
+ */
+void prepare_tree(ASTNode* ast, Arena* arena, CodeGenOptions* options);
+
 /* Main code generation function */
 bool generate_code(ASTNode* ast, CodeGenOptions* options);
 
+/*
+ * Streaming code generation: each top-level formula becomes its own function
+ * as soon as it is parsed, and main ANDs their results once all are emitted
+ */
+bool begin_code_stream(CodeGenOptions* options);
+void generate_formula_function(ASTNode* formula, int index);
+bool end_code_stream(int formula_count);
+void cancel_code_stream();
+
+/*
+ * Fragments for incremental builds: a formula's function as a string that
+ * is independent of the rest of the output, so it can be kept and pasted
+ * into later outputs; main then calls the fragments' functions in order
+ */
+char* generate_formula_fragment(ASTNode* formula, const char* scope, int* loop_depth);
+void emit_formula_fragment(const char* code, size_t length, int loop_depth);
+bool end_fragment_stream(const char* const* scopes, int count);
+
+/* Size of the code written to the last output opened, for --stats */
+typedef struct {
+    long instructions;
+    long labels;
+    long bytes;                  /* Known once the output is closed */
+} CodeGenCounts;
+
+CodeGenCounts codegen_counts();
+
 /* Function to generate code for a specific node type */
 void generate_code_for_node(ASTNode* node, CodeGenMode mode);
 
-/* Helper functions for code generation */
-void generate_binary_op(ASTNode* node, CodeGenMode mode);
-void generate_unary_op(ASTNode* node, CodeGenMode mode);
-void generate_quantifier(ASTNode* node, CodeGenMode mode);
+/* Helper functions for code generation; operators and quantifiers are
+   called at each stage of the walk over their subtree */
+void generate_binary_op(ASTNode* node, VisitStage stage, CodeGenMode mode);
+void generate_nary_op(ASTNode* node, VisitStage stage, CodeGenMode mode);
+void generate_unary_op(ASTNode* node, VisitStage stage, CodeGenMode mode);
+void generate_quantifier(ASTNode* node, VisitStage stage, CodeGenMode mode);
 void generate_predicate(ASTNode* node, CodeGenMode mode);
 void generate_variable(ASTNode* node, CodeGenMode mode);
 void generate_literal(ASTNode* node, CodeGenMode mode);
@@ -56,12 +95,18 @@ Register allocate_register();
 void free_register(Register reg);
 const char* register_name(Register reg);
 
+/* Loop-invariant memoization of quantified subformulas */
+bool should_memoize_quantifier(ASTNode* node, int* depths, int* depth_count);
+void begin_memoized_quantifier(ASTNode* node, int* depths, int depth_count);
+void end_memoized_quantifier(ASTNode* node);
+
 /* Label generation */
 char* new_label(const char* prefix);
 
 /* Assembly generation helpers */
 void emit_prologue();
 void emit_epilogue();
+void emit_data_section();
 void emit_instruction(const char* format, ...);
 void emit_label(const char* label);
 void emit_comment(const char* format, ...);
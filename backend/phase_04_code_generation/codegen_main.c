@@ -2,24 +2,190 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <sys/resource.h>
 #include "ast.h"
 #include "codegen.h"
-
-/* External declarations from parser */
-extern ASTNode* ast_root;
-extern int yyparse();
-extern FILE* yyin;
+#include "flat_ast.h"
+#include "ast_cache.h"
+#include "build_cache.h"
+#include "parser.h"
+#include "stats.h"
+#ifdef COUNT_ALLOCS
+#include <sys/stat.h>
+#include "alloc_count.h"
+#endif
 
 /* Forward declaration for generate_code_for_node function */
 void generate_code_for_node(ASTNode* node, CodeGenMode mode);
 
+/* Print the largest resident set size the process has had */
+static void print_peak_rss() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("Peak resident set: %ld KB\n", usage.ru_maxrss);
+}
+
+/* Print the --stats table and write the --stats-json report, as asked */
+static bool report_stats(CompileStats* stats, bool table, const char* json_filename) {
+    CodeGenCounts code = codegen_counts();
+    stats->instructions = code.instructions;
+    stats->labels = code.labels;
+    stats->bytes = code.bytes;
+    if (table) {
+        printf("\n");
+        print_compile_stats(stats, stdout);
+    }
+    if (json_filename == NULL) {
+        return true;
+    }
+    FILE* json = strcmp(json_filename, "-") == 0 ? stdout : fopen(json_filename, "w");
+    if (json == NULL) {
+        fprintf(stderr, "Error: Could not open stats file '%s'\n", json_filename);
+        return false;
+    }
+    write_compile_stats_json(stats, json);
+    if (json != stdout) {
+        fclose(json);
+    }
+    return true;
+}
+
+/*
+ * Open the input: read through a stream, or mapped and scanned in place with
+ * --mmap. --fast-lexer maps it too and scans it with the hand-written scanner
+ * (input that cannot be mapped, such as a pipe, is still scanned by Flex).
+ */
+static ParseContext* open_input(const char* input_filename, bool map_input, bool fast_lexer) {
+    ParseContext* ctx = map_input || fast_lexer ? create_mapped_parse_context(input_filename)
+                                                : create_file_parse_context(input_filename);
+    if (ctx == NULL) {
+        fprintf(stderr, "Error: Cannot open file '%s'\n", input_filename);
+        return NULL;
+    }
+    if (fast_lexer) {
+        use_fast_lexer(ctx);
+    }
+    return ctx;
+}
+
+/* What stream_formula needs besides the formula */
+typedef struct {
+    bool print_tree;
+    CodeGenOptions* options;
+    Arena* arena;                /* The parse context's, which holds the formula */
+    CompileStats* stats;         /* Code generation is timed apart from parsing, or NULL */
+} StreamState;
+
+/* Print and compile one streamed formula */
+static void stream_formula(ASTNode* formula, int number, void* data) {
+    StreamState* state = (StreamState*)data;
+    if (state->print_tree) {
+        printf("Formula %d:\n", number);
+        print_ast(formula, 0);
+        printf("\n");
+    }
+    Stopwatch watch = state->stats != NULL ? start_phase(state->stats) : (Stopwatch){ 0 };
+    prepare_tree(formula, state->arena, state->options);
+    generate_formula_function(formula, number);
+    if (state->stats != NULL) {
+        stop_phase(state->stats, PHASE_CODEGEN, watch);
+    }
+}
+
+/*
+ * Compile each top-level formula into its own function as soon as it is
+ * parsed. The formula's nodes are freed before the next one is read, so the
+ * AST memory stays at one arena block however long the input is.
+ */
+static bool stream_code(const char* input_filename, CodeGenOptions* options,
+                        bool print_tree, bool mem_stats, bool map_input, bool fast_lexer,
+                        CompileStats* stats) {
+    ParseContext* ctx = open_input(input_filename, map_input, fast_lexer);
+    if (ctx == NULL) {
+        return false;
+    }
+    if (!begin_code_stream(options)) {
+        free_parse_context(ctx);
+        return false;
+    }
+    
+    printf("Streaming input file: %s\n", input_filename);
+    StreamState state = { print_tree, options, ctx->arena, stats };
+    ctx->on_formula = stream_formula;
+    ctx->handler_data = &state;
+    ctx->stats = stats;
+    Stopwatch watch = stats != NULL ? start_phase(stats) : (Stopwatch){ 0 };
+    int parse_result = parse_input(ctx);
+    if (stats != NULL) {
+        stop_phase(stats, PHASE_PARSE, watch);
+    }
+    
+    bool ok = parse_result == 0 && ctx->formula_count > 0;
+    if (ok) {
+        printf("Formulas compiled: %d\n", ctx->formula_count);
+        if (mem_stats) {
+            print_arena_stats("AST memory", ctx->arena);
+            print_peak_rss();
+        }
+        watch = stats != NULL ? start_phase(stats) : (Stopwatch){ 0 };
+        end_code_stream(ctx->formula_count);
+        if (stats != NULL) {
+            stop_phase(stats, PHASE_CODEGEN, watch);
+        }
+    } else {
+        fprintf(stderr, "Parsing failed. Cannot generate code.\n");
+        cancel_code_stream();
+    }
+    
+    free_parse_context(ctx);
+    return ok;
+}
+
+/*
+ * Compile like --stream, but keep each formula's code in a build cache so
+ * the next build of the file reparses and recompiles only what was edited.
+ */
+static bool build_incrementally(const char* input_filename, const char* build_filename,
+                                CodeGenOptions* options) {
+    BuildStats stats;
+    printf("Incremental build of: %s\n", input_filename);
+    if (!incremental_build(input_filename, build_filename, options, &stats)) {
+        fprintf(stderr, "Incremental build failed.\n");
+        return false;
+    }
+    printf("Formulas compiled: %d\n", stats.formulas);
+    printf("Incremental build: %d reparsed (%zu of %zu bytes), %d compiled, %d reused\n",
+           stats.reparsed, stats.reparsed_bytes, stats.source_bytes, stats.compiled, stats.reused);
+    printf("Reparse and recompile time: %.3f ms\n", stats.seconds * 1000);
+    return true;
+}
+
 /* Main function to test code generation */
 int main(int argc, char* argv[]) {
+#ifdef COUNT_ALLOCS
+    AllocCounts start = alloc_counts();
+    AllocCounts parse_start = start;
+    long input_bytes = 0;
+#endif
+    
     /* Check command line arguments */
-    if (argc < 2 || argc > 5) {
-        fprintf(stderr, "Usage: %s <input_file> [<output_file>] [-s] [-o]\n", argv[0]);
+    if (argc < 2 || argc > 21) {
+        fprintf(stderr, "Usage: %s <input_file> [<output_file>] [-s] [-o] [-m] [-b] [-q] [--mem-stats] [--flat-ast] [--save-ast <cache_file>] [--load-ast] [--stream] [--mmap] [--fast-lexer] [--incremental <build_cache>] [--stats] [--stats-json <stats_file>]\n", argv[0]);
         fprintf(stderr, "  -s: Enable short-circuit evaluation\n");
-        fprintf(stderr, "  -o: Enable additional optimizations\n");
+        fprintf(stderr, "  -o: Enable additional optimizations (implies -m)\n");
+        fprintf(stderr, "  -m: Memoize loop-invariant quantified subformulas\n");
+        fprintf(stderr, "  -b: Evaluate AND/OR/XOR chains as balanced trees instead of flat sequences\n");
+        fprintf(stderr, "  -q: Do not print the AST\n");
+        fprintf(stderr, "  --mem-stats: Print AST memory statistics and the peak resident set\n");
+        fprintf(stderr, "  --flat-ast: Convert the AST to the flat layout and generate code from the converted tree\n");
+        fprintf(stderr, "  --save-ast: Write the parsed AST to a binary cache file\n");
+        fprintf(stderr, "  --load-ast: Read the AST from the cache file <input_file> instead of parsing\n");
+        fprintf(stderr, "  --stream: Compile each top-level formula into its own function as it is parsed\n");
+        fprintf(stderr, "  --mmap: Map the input file and scan it in place instead of reading it\n");
+        fprintf(stderr, "  --fast-lexer: Map the input file and scan it with the hand-written SIMD scanner\n");
+        fprintf(stderr, "  --incremental: Compile like --stream, reusing the code of formulas unchanged since the build recorded in <build_cache>\n");
+        fprintf(stderr, "  --stats: Print the time spent in each phase and what each phase produced\n");
+        fprintf(stderr, "  --stats-json: Write the same report as JSON to <stats_file> (- for standard output)\n");
         return 1;
     }
     
@@ -29,6 +195,19 @@ int main(int argc, char* argv[]) {
     CodeGenOptions options;
     options.enable_short_circuit = false;
     options.enable_optimization = false;
+    options.enable_memoization = false;
+    options.balance_chains = false;
+    bool mem_stats = false;
+    bool use_flat_ast = false;
+    bool print_tree = true;
+    bool load_cache = false;
+    bool stream = false;
+    bool map_input = false;
+    bool fast_lexer = false;
+    char* cache_filename = NULL;
+    char* build_filename = NULL;
+    bool stats_table = false;
+    char* stats_filename = NULL;
     
     /* Process remaining arguments */
     for (int i = 2; i < argc; i++) {
@@ -36,6 +215,33 @@ int main(int argc, char* argv[]) {
             options.enable_short_circuit = true;
         } else if (strcmp(argv[i], "-o") == 0) {
             options.enable_optimization = true;
+            options.enable_memoization = true;
+        } else if (strcmp(argv[i], "-m") == 0) {
+            options.enable_memoization = true;
+        } else if (strcmp(argv[i], "-b") == 0) {
+            options.balance_chains = true;
+        } else if (strcmp(argv[i], "-q") == 0) {
+            print_tree = false;
+        } else if (strcmp(argv[i], "--mem-stats") == 0) {
+            mem_stats = true;
+        } else if (strcmp(argv[i], "--flat-ast") == 0) {
+            use_flat_ast = true;
+        } else if (strcmp(argv[i], "--save-ast") == 0 && i + 1 < argc) {
+            cache_filename = argv[++i];
+        } else if (strcmp(argv[i], "--load-ast") == 0) {
+            load_cache = true;
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            stream = true;
+        } else if (strcmp(argv[i], "--mmap") == 0) {
+            map_input = true;
+        } else if (strcmp(argv[i], "--fast-lexer") == 0) {
+            fast_lexer = true;
+        } else if (strcmp(argv[i], "--incremental") == 0 && i + 1 < argc) {
+            build_filename = argv[++i];
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats_table = true;
+        } else if (strcmp(argv[i], "--stats-json") == 0 && i + 1 < argc) {
+            stats_filename = argv[++i];
         } else if (output_filename == NULL) {
             output_filename = argv[i];
         } else {
@@ -44,7 +250,30 @@ int main(int argc, char* argv[]) {
         }
     }
     
+    /* A streamed AST is never whole, so it cannot be converted or cached */
+    if (stream && (use_flat_ast || load_cache || cache_filename != NULL)) {
+        fprintf(stderr, "Error: --stream cannot be combined with --flat-ast, --save-ast or --load-ast\n");
+        return 1;
+    }
+    if (build_filename != NULL && (stream || use_flat_ast || load_cache || cache_filename != NULL)) {
+        fprintf(stderr, "Error: --incremental cannot be combined with --stream, --flat-ast, --save-ast or --load-ast\n");
+        return 1;
+    }
+    if (build_filename != NULL && (stats_table || stats_filename != NULL)) {
+        fprintf(stderr, "Error: --incremental reports its own statistics and cannot be combined with --stats\n");
+        return 1;
+    }
+    
+    /* Phase times and counters are only gathered when they will be reported */
+    CompileStats stats_storage;
+    CompileStats* stats = NULL;
+    if (stats_table || stats_filename != NULL) {
+        init_compile_stats(&stats_storage);
+        stats = &stats_storage;
+    }
+    
     /* Set default output filename if not provided */
+    bool output_allocated = output_filename == NULL;
     if (output_filename == NULL) {
         /* Create output filename by replacing .logic extension with .s */
         output_filename = (char*)malloc(strlen(input_filename) + 3); /* +3 for .s\0 */
@@ -68,49 +297,162 @@ int main(int argc, char* argv[]) {
     
     options.output_filename = output_filename;
     
-    /* Open input file */
-    FILE* input_file = fopen(input_filename, "r");
-    if (!input_file) {
-        fprintf(stderr, "Error: Cannot open file '%s'\n", input_filename);
-        return 1;
+    if (build_filename != NULL) {
+        bool build_result = build_incrementally(input_filename, build_filename, &options);
+        free_interned();
+        if (output_allocated) {
+            free(output_filename);
+        }
+        return build_result ? 0 : 1;
     }
     
-    yyin = input_file;
+    if (stream) {
+        bool stream_result = stream_code(input_filename, &options, print_tree, mem_stats,
+                                         map_input, fast_lexer, stats);
+        if (stream_result && stats != NULL) {
+            stream_result = report_stats(stats, stats_table, stats_filename);
+        }
+        free_interned();
+        if (output_allocated) {
+            free(output_filename);
+        }
+        return stream_result ? 0 : 1;
+    }
     
-    /* Parse the input */
-    printf("Parsing input file: %s\n", input_filename);
-    int parse_result = yyparse();
+    FlatAST* flat = NULL;
+    AstCache* cache = NULL;
+    ParseContext* ctx = NULL;
+    Arena* arena = NULL;
+    ASTNode* ast_root = NULL;
     
-    if (parse_result != 0 || ast_root == NULL) {
-        fprintf(stderr, "Parsing failed. Cannot generate code.\n");
-        fclose(input_file);
-        return 1;
+    if (load_cache) {
+        /* Map the cache; its node arrays are used in place as a flat AST */
+        printf("Loading AST cache: %s\n", input_filename);
+        cache = load_ast_cache(input_filename);
+        if (cache == NULL) {
+            fprintf(stderr, "Loading failed. Cannot generate code.\n");
+            return 1;
+        }
+        flat = &cache->flat;
+#ifdef COUNT_ALLOCS
+        input_bytes = cache->size;
+#endif
+        if (flat->root == FLAT_NONE) {
+            fprintf(stderr, "AST cache is empty. Cannot generate code.\n");
+            close_ast_cache(cache);
+            return 1;
+        }
+        if (cache->flags & AST_CACHE_ANALYZED) {
+            printf("AST passed semantic analysis\n");
+        }
+        arena = create_ast_arena();
+    } else {
+#ifdef COUNT_ALLOCS
+        struct stat input_info;
+        input_bytes = stat(input_filename, &input_info) == 0 ? input_info.st_size : 0;
+        parse_start = alloc_counts();
+#endif
+        
+        /* Open the input file */
+        ctx = open_input(input_filename, map_input, fast_lexer);
+        if (ctx == NULL) {
+            return 1;
+        }
+        
+        /* Parse the input */
+        printf("Parsing input file: %s\n", input_filename);
+        ctx->stats = stats;
+        Stopwatch watch = stats != NULL ? start_phase(stats) : (Stopwatch){ 0 };
+        int parse_result = parse_input(ctx);
+        if (stats != NULL) {
+            stop_phase(stats, PHASE_PARSE, watch);
+        }
+        
+        if (parse_result != 0 || ctx->root == NULL) {
+            fprintf(stderr, "Parsing failed. Cannot generate code.\n");
+            free_parse_context(ctx);
+            return 1;
+        }
+        ast_root = ctx->root;
+        arena = ctx->arena;
+#ifdef COUNT_ALLOCS
+        report_allocations("Parse", parse_start, input_bytes);
+#endif
+        
+        if (use_flat_ast || cache_filename != NULL) {
+            flat = flatten_ast(ast_root);
+        }
     }
     
-    /* Print the AST */
-    printf("Abstract Syntax Tree:\n");
-    print_ast(ast_root, 0);
-    printf("\n");
+    /* A failed cache write skips code generation but still frees everything below */
+    bool code_result = cache_filename == NULL ||
+                       write_ast_cache(cache_filename, flat, cache != NULL ? cache->flags : 0);
     
-    /* Generate code */
-    printf("Generating assembly code...\n");
-    bool code_result = generate_code(ast_root, &options);
+    if (code_result) {
+        /* Print the AST (its indentation grows with depth, so -q skips it for deep inputs) */
+        if (print_tree) {
+            printf("Abstract Syntax Tree:\n");
+        }
+        if (use_flat_ast || load_cache) {
+            /* Print from the flat layout and generate code from the converted tree */
+            if (print_tree) {
+                print_flat_ast(flat, flat->root, 0);
+            }
+            ast_root = unflatten_ast(flat, flat->root, arena);
+        } else if (print_tree) {
+            print_ast(ast_root, 0);
+        }
+        if (print_tree) {
+            printf("\n");
+        }
+    }
+    if (cache != NULL) {
+        close_ast_cache(cache);
+    } else {
+        free_flat_ast(flat);
+    }
     
-    if (!code_result) {
-        fprintf(stderr, "Code generation failed.\n");
-        free_ast(ast_root);
-        fclose(input_file);
-        return 1;
+    if (code_result) {
+        if (mem_stats) {
+            print_arena_stats("AST memory", arena);
+            print_peak_rss();
+        }
+        
+        /* Generate code */
+        printf("Generating assembly code...\n");
+        Stopwatch watch = stats != NULL ? start_phase(stats) : (Stopwatch){ 0 };
+        prepare_tree(ast_root, arena, &options);
+        code_result = generate_code(ast_root, &options);
+        if (stats != NULL) {
+            stop_phase(stats, PHASE_CODEGEN, watch);
+            code_result = code_result && report_stats(stats, stats_table, stats_filename);
+        }
+        if (!code_result) {
+            fprintf(stderr, "Code generation failed.\n");
+        }
     }
     
-    /* Cleanup */
-    free_ast(ast_root);
-    fclose(input_file);
+    /* Cleanup (the parse context owns the arena when there is one) */
+    if (ctx != NULL) {
+        free_parse_context(ctx);
+    } else {
+        arena_destroy(arena);
+    }
+    free_interned();
     
     /* If we allocated the output filename, free it */
-    if (output_filename != argv[2]) {
+    if (output_allocated) {
         free(output_filename);
     }
     
-    return 0;
+#ifdef COUNT_ALLOCS
+    /* Every block allocated by this run must have been freed, whether it succeeded or not */
+    long live = report_allocations("Total", start, input_bytes);
+    if (live != 0) {
+        fprintf(stderr, "Error: %ld allocations were not freed\n", live);
+        return 1;
+    }
+#endif
+    
+    return code_result ? 0 : 1;
 }
\ No newline at end of file
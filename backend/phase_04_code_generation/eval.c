@@ -0,0 +1,706 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "eval.h"
+#include "planner.h"
+
+/* Binding of a quantified variable to a domain element */
+typedef struct {
+    InternId name;
+    InternId value;
+} Binding;
+
+/* Cached truth value of a quantifier for one binding of its free variables */
+typedef struct MemoValue {
+    InternId* key;               /* Values of the bound free variables */
+    unsigned int hash;           /* Of the key, before reduction to a bucket */
+    bool value;
+    struct MemoValue* next;
+} MemoValue;
+
+/* Memo table for one quantifier node */
+typedef struct NodeMemo {
+    ASTNode* node;
+    VariableSet free_vars;       /* Free variables of the quantifier */
+    MemoValue** buckets;
+    int size;
+    int count;                   /* Entries in the buckets */
+    bool plan_checked;           /* Join planning was attempted */
+    JoinPlan* plan;              /* Join plan, or NULL if the shape does not match */
+    struct NodeMemo* next;
+} NodeMemo;
+
+/* Evaluation context */
+typedef struct {
+    FactTable* facts;
+    EvalOptions* options;
+    EvalStats* stats;
+    Binding* bindings;           /* Stack of quantifier bindings, innermost last */
+    int depth;
+    int capacity;
+    NodeMemo** memos;            /* Memo tables keyed by quantifier node */
+    int memo_size;
+    int memo_count;
+    struct EvalFrame* frames;    /* Explicit stack of eval_node, innermost last */
+    int frame_count;
+    int frame_capacity;
+} EvalContext;
+
+/* An operator or quantifier whose operands are being evaluated */
+typedef struct EvalFrame {
+    ASTNode* node;
+    int stage;                   /* Operands evaluated so far, or the quantifier's domain index */
+    bool value;                  /* Left operand, or the quantifier's result so far */
+    bool in_body;                /* Quantifiers: the body is being evaluated */
+    MemoValue* entry;            /* Quantifiers: memo entry to fill with the result */
+} EvalFrame;
+
+/*
+ * Hash a sequence of interned IDs onto a seed. IDs are runs of nearby
+ * integers, so each is mixed in with a multiplication and the high bits are
+ * folded down; a plain hash * 31 + id puts most facts and memo keys in a few
+ * buckets.
+ */
+static unsigned int hash_ids(unsigned int hash, InternId* ids, int count) {
+    for (int i = 0; i < count; i++) {
+        hash = (hash ^ ids[i]) * 0x9E3779B1u;
+    }
+    return hash ^ (hash >> 16);
+}
+
+static unsigned int hash_fact(InternId predicate, InternId* args, int arg_count) {
+    return hash_ids(predicate * 0x9E3779B1u, args, arg_count);
+}
+
+static bool fact_matches(Fact* fact, InternId predicate, InternId* args, int arg_count) {
+    return fact->predicate == predicate && fact->arg_count == arg_count &&
+           (arg_count == 0 || memcmp(fact->args, args, sizeof(InternId) * arg_count) == 0);
+}
+
+/* Create a new fact table */
+FactTable* create_fact_table(int size) {
+    FactTable* table = (FactTable*)malloc(sizeof(FactTable));
+    table->buckets = (Fact**)calloc(size, sizeof(Fact*));
+    table->size = size;
+    table->count = 0;
+    table->relations = NULL;
+    table->relation_count = 0;
+    table->relation_capacity = 0;
+    return table;
+}
+
+/* Double the fact buckets once they average two facts */
+static void grow_fact_buckets(FactTable* table) {
+    int size = table->size * 2;
+    Fact** buckets = (Fact**)calloc(size, sizeof(Fact*));
+
+    for (int i = 0; i < table->size; i++) {
+        Fact* fact = table->buckets[i];
+        while (fact != NULL) {
+            Fact* next = fact->next;
+            fact->next = buckets[fact->hash % size];
+            buckets[fact->hash % size] = fact;
+            fact = next;
+        }
+    }
+    free(table->buckets);
+    table->buckets = buckets;
+    table->size = size;
+}
+
+/* Free memory used by a fact table */
+void free_fact_table(FactTable* table) {
+    if (table == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < table->size; i++) {
+        Fact* fact = table->buckets[i];
+        while (fact != NULL) {
+            Fact* next = fact->next;
+            free(fact->args);
+            free(fact);
+            fact = next;
+        }
+    }
+
+    for (int i = 0; i < table->relation_count; i++) {
+        free(table->relations[i].tuples);
+    }
+    free(table->relations);
+
+    free(table->buckets);
+    free(table);
+}
+
+/* Find the relation holding all facts of a predicate */
+Relation* find_relation(FactTable* table, InternId predicate, int arity) {
+    for (int i = 0; i < table->relation_count; i++) {
+        if (table->relations[i].predicate == predicate && table->relations[i].arity == arity) {
+            return &table->relations[i];
+        }
+    }
+    return NULL;
+}
+
+/* Append a tuple to the relation of its predicate; returns its index */
+static int add_to_relation(FactTable* table, InternId predicate, InternId* args, int arity) {
+    Relation* relation = find_relation(table, predicate, arity);
+
+    if (relation == NULL) {
+        if (table->relation_count == table->relation_capacity) {
+            table->relation_capacity = table->relation_capacity == 0 ? 8 : table->relation_capacity * 2;
+            table->relations = (Relation*)realloc(table->relations, sizeof(Relation) * table->relation_capacity);
+        }
+        relation = &table->relations[table->relation_count++];
+        relation->predicate = predicate;
+        relation->arity = arity;
+        relation->tuples = NULL;
+        relation->count = 0;
+        relation->capacity = 0;
+    }
+
+    if (relation->count == relation->capacity) {
+        relation->capacity = relation->capacity == 0 ? 16 : relation->capacity * 2;
+        relation->tuples = (InternId*)realloc(relation->tuples,
+                                              sizeof(InternId) * relation->capacity * (arity > 0 ? arity : 1));
+    }
+    if (arity > 0) {
+        memcpy(relation->tuples + (size_t)relation->count * arity, args, sizeof(InternId) * arity);
+    }
+    return relation->count++;
+}
+
+/* Insert a fact; returns false if it was already present */
+bool insert_fact(FactTable* table, InternId predicate, InternId* args, int arg_count) {
+    unsigned int hash = hash_fact(predicate, args, arg_count);
+
+    for (Fact* fact = table->buckets[hash % table->size]; fact != NULL; fact = fact->next) {
+        if (fact->hash == hash && fact_matches(fact, predicate, args, arg_count)) {
+            return false;
+        }
+    }
+
+    Fact* fact = (Fact*)malloc(sizeof(Fact));
+    fact->predicate = predicate;
+    fact->args = (InternId*)malloc(sizeof(InternId) * (arg_count > 0 ? arg_count : 1));
+    if (arg_count > 0) {
+        memcpy(fact->args, args, sizeof(InternId) * arg_count);
+    }
+    fact->arg_count = arg_count;
+    fact->hash = hash;
+
+    fact->next = table->buckets[hash % table->size];
+    table->buckets[hash % table->size] = fact;
+    if (++table->count > 2 * table->size) {
+        grow_fact_buckets(table);
+    }
+
+    fact->tuple_index = add_to_relation(table, predicate, args, arg_count);
+
+    return true;
+}
+
+/* Find the fact with the given contents */
+static Fact* find_fact(FactTable* table, InternId predicate, InternId* args, int arg_count) {
+    unsigned int hash = hash_fact(predicate, args, arg_count);
+
+    for (Fact* fact = table->buckets[hash % table->size]; fact != NULL; fact = fact->next) {
+        if (fact->hash == hash && fact_matches(fact, predicate, args, arg_count)) {
+            return fact;
+        }
+    }
+    return NULL;
+}
+
+/* Remove a fact; returns false if it was not present */
+bool remove_fact(FactTable* table, InternId predicate, InternId* args, int arg_count) {
+    unsigned int hash = hash_fact(predicate, args, arg_count);
+    Fact** link = &table->buckets[hash % table->size];
+
+    while (*link != NULL && ((*link)->hash != hash || !fact_matches(*link, predicate, args, arg_count))) {
+        link = &(*link)->next;
+    }
+    if (*link == NULL) {
+        return false;
+    }
+
+    Fact* fact = *link;
+    *link = fact->next;
+    table->count--;
+
+    /* Move the last tuple of the relation into the freed slot */
+    Relation* relation = find_relation(table, predicate, arg_count);
+    int last = relation->count - 1;
+    if (fact->tuple_index != last) {
+        InternId* moved = relation->tuples + (size_t)last * arg_count;
+        memcpy(relation->tuples + (size_t)fact->tuple_index * arg_count, moved, sizeof(InternId) * arg_count);
+        find_fact(table, predicate, moved, arg_count)->tuple_index = fact->tuple_index;
+    }
+    relation->count--;
+
+    free(fact->args);
+    free(fact);
+    return true;
+}
+
+/* Check whether a fact holds */
+bool fact_holds(FactTable* table, InternId predicate, InternId* args, int arg_count) {
+    return find_fact(table, predicate, args, arg_count) != NULL;
+}
+
+/* State of load_facts */
+typedef struct {
+    FactTable* table;
+    bool ok;
+} FactLoad;
+
+static bool load_fact_visit(ASTNode* facts, VisitStage stage, int depth, void* data) {
+    FactLoad* load = (FactLoad*)data;
+
+    if (stage != VISIT_ENTER || !load->ok) {
+        return false;
+    }
+
+    switch (facts->type) {
+        case NODE_BINARY_OP:
+            if (facts->data.binary.operator != OP_AND) {
+                break;
+            }
+            return true;
+
+        case NODE_PREDICATE: {
+            insert_fact(load->table, facts->data.predicate.name, facts->data.predicate.args,
+                        facts->data.predicate.arg_count);
+            return false;
+        }
+
+        case NODE_VARIABLE:
+            /* A bare name asserts a proposition */
+            insert_fact(load->table, facts->data.variable.name, NULL, 0);
+            return false;
+
+        default:
+            break;
+    }
+
+    fprintf(stderr, "Error at line %d, column %d: Facts must be ground predicates or propositions\n",
+            facts->line, facts->column);
+    load->ok = false;
+    return false;
+}
+
+/* Load facts from a parsed facts file: a conjunction of ground atoms */
+bool load_facts(FactTable* table, ASTNode* facts) {
+    FactLoad load = { table, true };
+    walk_ast(facts, load_fact_visit, &load);
+    return load.ok;
+}
+
+/* Resolve a name through the quantifier bindings; unbound names are constants */
+static InternId resolve_name(EvalContext* ctx, InternId name, bool* bound) {
+    for (int i = ctx->depth - 1; i >= 0; i--) {
+        if (ctx->bindings[i].name == name) {
+            if (bound) *bound = true;
+            return ctx->bindings[i].value;
+        }
+    }
+    if (bound) *bound = false;
+    return name;
+}
+
+/*
+ * Same for a name whose slot resolve_bindings has set: the binding at that
+ * depth is read directly, after checking that it is the variable's own
+ */
+static InternId resolve_slot(EvalContext* ctx, InternId name, int slot) {
+    if (slot != UNBOUND_SLOT && slot < ctx->depth && ctx->bindings[slot].name == name) {
+        return ctx->bindings[slot].value;
+    }
+    return resolve_name(ctx, name, NULL);
+}
+
+static void push_binding(EvalContext* ctx, InternId name, InternId value) {
+    if (ctx->depth == ctx->capacity) {
+        ctx->capacity = ctx->capacity == 0 ? 8 : ctx->capacity * 2;
+        ctx->bindings = (Binding*)realloc(ctx->bindings, sizeof(Binding) * ctx->capacity);
+    }
+    ctx->bindings[ctx->depth].name = name;
+    ctx->bindings[ctx->depth].value = value;
+    ctx->depth++;
+}
+
+static unsigned int hash_node(ASTNode* node, int size) {
+    return (unsigned int)(((size_t)node >> 4) % size);
+}
+
+/* Double the number of memo table chains once they average two tables */
+static void grow_memos(EvalContext* ctx) {
+    int size = ctx->memo_size * 2 + 1;
+    NodeMemo** memos = (NodeMemo**)calloc(size, sizeof(NodeMemo*));
+
+    for (int i = 0; i < ctx->memo_size; i++) {
+        NodeMemo* memo = ctx->memos[i];
+        while (memo != NULL) {
+            NodeMemo* next = memo->next;
+            unsigned int hash = hash_node(memo->node, size);
+            memo->next = memos[hash];
+            memos[hash] = memo;
+            memo = next;
+        }
+    }
+    free(ctx->memos);
+    ctx->memos = memos;
+    ctx->memo_size = size;
+}
+
+/* Double a node's memo buckets once they average two entries */
+static void grow_memo_buckets(NodeMemo* memo) {
+    int size = memo->size * 2;
+    MemoValue** buckets = (MemoValue**)calloc(size, sizeof(MemoValue*));
+
+    for (int i = 0; i < memo->size; i++) {
+        MemoValue* entry = memo->buckets[i];
+        while (entry != NULL) {
+            MemoValue* next = entry->next;
+            entry->next = buckets[entry->hash % size];
+            buckets[entry->hash % size] = entry;
+            entry = next;
+        }
+    }
+    free(memo->buckets);
+    memo->buckets = buckets;
+    memo->size = size;
+}
+
+/* Find or create the memo table of a quantifier node (its buckets are allocated on first use) */
+static NodeMemo* get_node_memo(EvalContext* ctx, ASTNode* node) {
+    unsigned int hash = hash_node(node, ctx->memo_size);
+
+    for (NodeMemo* memo = ctx->memos[hash]; memo != NULL; memo = memo->next) {
+        if (memo->node == node) {
+            return memo;
+        }
+    }
+
+    NodeMemo* memo = (NodeMemo*)calloc(1, sizeof(NodeMemo));
+    memo->node = node;
+    collect_free_variables(node, &memo->free_vars);
+    memo->size = 64;
+    memo->next = ctx->memos[hash];
+    ctx->memos[hash] = memo;
+    if (++ctx->memo_count > 2 * ctx->memo_size) {
+        grow_memos(ctx);
+    }
+    return memo;
+}
+
+/*
+ * Build the memo key of a quantifier from the values of its free variables
+ * that are bound by enclosing quantifiers. Returns false when the subformula
+ * depends on every enclosing binding, since no evaluation could be reused.
+ * Free variables that are not bound are constants and do not vary the key.
+ */
+static bool build_memo_key(EvalContext* ctx, NodeMemo* memo, InternId* key, int* key_size) {
+    *key_size = 0;
+    for (int i = 0; i < memo->free_vars.count; i++) {
+        bool bound = false;
+        InternId value = resolve_name(ctx, memo->free_vars.names[i], &bound);
+        if (bound) {
+            key[(*key_size)++] = value;
+        }
+    }
+    return *key_size < ctx->depth;
+}
+
+/* Evaluate a quantifier chain over a conjunction of atoms as a join */
+static bool eval_join(ASTNode* node, EvalContext* ctx, bool* result) {
+    NodeMemo* memo = get_node_memo(ctx, node);
+    if (!memo->plan_checked) {
+        memo->plan_checked = true;
+        memo->plan = plan_quantified_conjunction(node);
+    }
+    if (memo->plan == NULL) {
+        return false;
+    }
+
+    JoinPlan* plan = memo->plan;
+    InternId externals[plan->external_count > 0 ? plan->external_count : 1];
+    for (int i = 0; i < plan->external_count; i++) {
+        externals[i] = resolve_name(ctx, plan->externals[i], NULL);
+    }
+
+    ctx->stats->join_plans_run++;
+    *result = execute_join_plan(plan, ctx->facts, externals, ctx->options->explain);
+    return true;
+}
+
+/*
+ * Start evaluating a quantifier. Returns true with its value when a memo
+ * entry or a join plan answers it; otherwise its domain has to be looped
+ * over, and entry receives the memo entry to fill with the result (or NULL).
+ */
+static bool start_quantifier(ASTNode* node, EvalContext* ctx, bool* value, MemoValue** entry) {
+    *entry = NULL;
+
+    if (ctx->options->enable_memoization && ctx->depth > 0) {
+        NodeMemo* memo = get_node_memo(ctx, node);
+        InternId key[memo->free_vars.count > 0 ? memo->free_vars.count : 1];
+        int key_size = 0;
+        if (build_memo_key(ctx, memo, key, &key_size)) {
+            /* Every lookup of this node uses keys of the same size */
+            unsigned int hash = hash_ids(0, key, key_size);
+            if (memo->buckets == NULL) {
+                memo->buckets = (MemoValue**)calloc(memo->size, sizeof(MemoValue*));
+            }
+            for (MemoValue* found = memo->buckets[hash % memo->size]; found != NULL; found = found->next) {
+                if (found->hash == hash && memcmp(found->key, key, sizeof(InternId) * key_size) == 0) {
+                    ctx->stats->memo_hits++;
+                    *value = found->value;
+                    return true;
+                }
+            }
+
+            /* The node is not inside its own body, so the entry cannot be
+               looked up before the loop below has filled it in */
+            ctx->stats->memo_misses++;
+            *entry = (MemoValue*)malloc(sizeof(MemoValue));
+            (*entry)->key = (InternId*)malloc(sizeof(InternId) * (key_size > 0 ? key_size : 1));
+            memcpy((*entry)->key, key, sizeof(InternId) * key_size);
+            (*entry)->hash = hash;
+            (*entry)->next = memo->buckets[hash % memo->size];
+            memo->buckets[hash % memo->size] = *entry;
+            if (++memo->count > 2 * memo->size) {
+                grow_memo_buckets(memo);
+            }
+        }
+    }
+
+    if (ctx->options->enable_joins && eval_join(node, ctx, value)) {
+        if (*entry != NULL) {
+            (*entry)->value = *value;
+        }
+        return true;
+    }
+    return false;
+}
+
+static bool eval_predicate(ASTNode* node, EvalContext* ctx) {
+    int arg_count = node->data.predicate.arg_count;
+    InternId args[arg_count > 0 ? arg_count : 1];
+
+    for (int i = 0; i < arg_count; i++) {
+        args[i] = resolve_slot(ctx, node->data.predicate.args[i], node->data.predicate.slots[i]);
+    }
+
+    ctx->stats->fact_lookups++;
+    return fact_holds(ctx->facts, node->data.predicate.name, args, arg_count);
+}
+
+static void push_frame(EvalContext* ctx, ASTNode* node) {
+    if (ctx->frame_count == ctx->frame_capacity) {
+        ctx->frame_capacity = ctx->frame_capacity == 0 ? 64 : ctx->frame_capacity * 2;
+        ctx->frames = (EvalFrame*)realloc(ctx->frames, sizeof(EvalFrame) * ctx->frame_capacity);
+    }
+    EvalFrame* frame = &ctx->frames[ctx->frame_count++];
+    frame->node = node;
+    frame->stage = 0;
+    frame->value = false;
+    frame->in_body = false;
+    frame->entry = NULL;
+}
+
+/*
+ * Evaluate a subtree. Operators and quantifiers wait on ctx->frames for the
+ * values of their operands instead of recursing, so the depth of the tree is
+ * not limited by the C stack.
+ */
+static bool eval_node(ASTNode* root, EvalContext* ctx) {
+    int base = ctx->frame_count;
+    ASTNode* next = root;
+    bool value = false;
+
+    for (;;) {
+        /* Enter a node: leaves and answered quantifiers produce a value at once */
+        if (next != NULL) {
+            ASTNode* node = next;
+            next = NULL;
+            ctx->stats->nodes_evaluated++;
+
+            switch (node->type) {
+                case NODE_BINARY_OP:
+                case NODE_UNARY_OP:
+                    push_frame(ctx, node);
+                    break;
+
+                case NODE_QUANTIFIER: {
+                    MemoValue* entry = NULL;
+                    if (!start_quantifier(node, ctx, &value, &entry)) {
+                        push_frame(ctx, node);
+                        ctx->frames[ctx->frame_count - 1].value =
+                            node->data.quantifier.quantifier == QUANT_FORALL;
+                        ctx->frames[ctx->frame_count - 1].entry = entry;
+                    }
+                    break;
+                }
+
+                case NODE_PREDICATE:
+                    value = eval_predicate(node, ctx);
+                    break;
+
+                case NODE_VARIABLE:
+                    /* A variable used as a formula is the proposition it names */
+                    ctx->stats->fact_lookups++;
+                    value = fact_holds(ctx->facts, resolve_slot(ctx, node->data.variable.name,
+                                                           node->data.variable.slot), NULL, 0);
+                    break;
+
+                case NODE_LITERAL:
+                    value = node->data.literal.value;
+                    break;
+
+                default:
+                    fprintf(stderr, "Error: Unknown node type in evaluation: %d\n", node->type);
+                    exit(1);
+            }
+        }
+
+        if (ctx->frame_count == base) {
+            return value;
+        }
+
+        /* Resume the innermost pending node with the value just computed */
+        EvalFrame* frame = &ctx->frames[ctx->frame_count - 1];
+        ASTNode* node = frame->node;
+        bool done = false;
+
+        switch (node->type) {
+            case NODE_BINARY_OP:
+                if (frame->stage == 0) {
+                    next = node->data.binary.left;
+                } else if (frame->stage == 1) {
+                    bool left = value;
+                    frame->value = left;
+                    switch (node->data.binary.operator) {
+                        case OP_AND:
+                            done = !left;
+                            break;
+                        case OP_OR:
+                            done = left;
+                            break;
+                        case OP_IMPLIES:
+                            done = !left;
+                            value = true;
+                            break;
+                        default:
+                            break;
+                    }
+                    if (!done) {
+                        next = node->data.binary.right;
+                    }
+                } else {
+                    switch (node->data.binary.operator) {
+                        case OP_IFF:
+                            value = frame->value == value;
+                            break;
+                        case OP_XOR:
+                            value = frame->value != value;
+                            break;
+                        default:
+                            /* AND, OR and IMPLIES take the right operand's value */
+                            break;
+                    }
+                    done = true;
+                }
+                frame->stage++;
+                break;
+
+            case NODE_UNARY_OP:
+                if (frame->stage++ == 0) {
+                    next = node->data.unary.operand;
+                } else {
+                    value = !value;
+                    done = true;
+                }
+                break;
+
+            case NODE_QUANTIFIER: {
+                bool forall = node->data.quantifier.quantifier == QUANT_FORALL;
+
+                if (frame->in_body) {
+                    ctx->depth--;
+                    frame->in_body = false;
+                    if (forall != value) {
+                        frame->value = value;
+                        frame->stage = node->data.quantifier.domain_size;
+                    } else {
+                        frame->stage++;
+                    }
+                }
+
+                if (frame->stage < node->data.quantifier.domain_size) {
+                    push_binding(ctx, node->data.quantifier.variable,
+                                 node->data.quantifier.domain[frame->stage]);
+                    frame->in_body = true;
+                    next = node->data.quantifier.expr;
+                } else {
+                    value = frame->value;
+                    if (frame->entry != NULL) {
+                        frame->entry->value = value;
+                    }
+                    done = true;
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+
+        if (done) {
+            ctx->frame_count--;
+        }
+    }
+}
+
+/* Free all memo tables of a context */
+static void free_memos(EvalContext* ctx) {
+    for (int i = 0; i < ctx->memo_size; i++) {
+        NodeMemo* memo = ctx->memos[i];
+        while (memo != NULL) {
+            NodeMemo* next = memo->next;
+            for (int j = 0; memo->buckets != NULL && j < memo->size; j++) {
+                MemoValue* entry = memo->buckets[j];
+                while (entry != NULL) {
+                    MemoValue* next_entry = entry->next;
+                    free(entry->key);
+                    free(entry);
+                    entry = next_entry;
+                }
+            }
+            free(memo->buckets);
+            free_join_plan(memo->plan);
+            free_variable_set(&memo->free_vars);
+            free(memo);
+            memo = next;
+        }
+    }
+    free(ctx->memos);
+}
+
+/* Evaluate a closed formula against a fact table */
+bool evaluate_formula(ASTNode* formula, FactTable* facts, EvalOptions* options, EvalStats* stats) {
+    EvalContext ctx = {0};
+    ctx.facts = facts;
+    ctx.options = options;
+    ctx.stats = stats;
+    ctx.memo_size = 101;
+    ctx.memos = (NodeMemo**)calloc(ctx.memo_size, sizeof(NodeMemo*));
+
+    bool result = eval_node(formula, &ctx);
+
+    free_memos(&ctx);
+    free(ctx.bindings);
+    free(ctx.frames);
+    return result;
+}
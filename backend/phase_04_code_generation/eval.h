@@ -0,0 +1,65 @@
+#ifndef EVAL_H
+#define EVAL_H
+
+#include <stdbool.h>
+#include "ast.h"
+#include "intern.h"
+
+/* A ground fact: predicate name applied to constant arguments */
+typedef struct Fact {
+    InternId predicate;          /* Predicate name (or proposition name) */
+    InternId* args;              /* Constant arguments */
+    int arg_count;               /* 0 for propositions */
+    int tuple_index;             /* Position of the tuple in its relation */
+    unsigned int hash;           /* Of the fact, before reduction to a bucket */
+    struct Fact* next;           /* For hash table chaining */
+} Fact;
+
+/* All facts of one predicate and arity, as a flat array of tuples */
+typedef struct {
+    InternId predicate;
+    int arity;
+    InternId* tuples;            /* count * arity argument IDs */
+    int count;
+    int capacity;
+} Relation;
+
+/* Hash set of ground facts, also grouped into one relation per predicate */
+typedef struct {
+    Fact** buckets;
+    int size;
+    int count;
+    Relation* relations;
+    int relation_count;
+    int relation_capacity;
+} FactTable;
+
+/* Evaluation options */
+typedef struct {
+    bool enable_memoization;     /* Cache loop-invariant quantified subformulas */
+    bool enable_joins;           /* Evaluate quantified conjunctions as joins */
+    bool explain;                /* Print each join plan the first time it runs */
+} EvalOptions;
+
+/* Evaluation counters */
+typedef struct {
+    long nodes_evaluated;        /* Number of node visits */
+    long fact_lookups;           /* Number of fact table probes */
+    long memo_hits;              /* Quantifier evaluations answered from a memo table */
+    long memo_misses;            /* Quantifier evaluations that filled a memo table */
+    long join_plans_run;         /* Quantifier chains evaluated as joins */
+} EvalStats;
+
+/* Fact table operations */
+FactTable* create_fact_table(int size);
+void free_fact_table(FactTable* table);
+bool insert_fact(FactTable* table, InternId predicate, InternId* args, int arg_count);
+bool remove_fact(FactTable* table, InternId predicate, InternId* args, int arg_count);
+bool fact_holds(FactTable* table, InternId predicate, InternId* args, int arg_count);
+bool load_facts(FactTable* table, ASTNode* facts);
+Relation* find_relation(FactTable* table, InternId predicate, int arity);
+
+/* Evaluate a closed formula against a fact table */
+bool evaluate_formula(ASTNode* formula, FactTable* facts, EvalOptions* options, EvalStats* stats);
+
+#endif /* EVAL_H */
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "ast.h"
+#include "eval.h"
+#include "incremental.h"
+#include "parser.h"
+
+/* Parse one input file; the returned context holds its AST until freed */
+static ParseContext* parse_file(const char* filename) {
+    ParseContext* ctx = create_file_parse_context(filename);
+    if (ctx == NULL) {
+        fprintf(stderr, "Error: Cannot open file '%s'\n", filename);
+        return NULL;
+    }
+
+    int parse_result = parse_input(ctx);
+
+    if (parse_result != 0 || ctx->root == NULL) {
+        fprintf(stderr, "Parsing of '%s' failed.\n", filename);
+        free_parse_context(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+/* Keep the formulas up to date across batches of fact updates */
+static bool run_incremental(ASTNode** formulas, int count, FactTable* facts,
+                            char** update_files, int update_file_count, bool verbose) {
+    IncrementalEvaluator* inc = create_incremental(formulas, count, facts);
+    if (inc == NULL) {
+        return false;
+    }
+
+    for (int f = 0; f < count; f++) {
+        printf("Formula %d: %s\n", f + 1, incremental_value(inc, f) ? "TRUE" : "FALSE");
+    }
+
+    bool ok = true;
+    int changed[count > 0 ? count : 1];
+    for (int i = 0; i < update_file_count && ok; i++) {
+        ParseContext* updates_ctx = parse_file(update_files[i]);
+        FactUpdate* updates = NULL;
+        int update_count = 0;
+        int capacity = 0;
+
+        ok = updates_ctx != NULL && load_fact_updates(updates_ctx->root, &updates, &update_count, &capacity);
+        free_parse_context(updates_ctx);
+        if (ok) {
+            int changed_count = apply_fact_updates(inc, updates, update_count, changed);
+            printf("Batch %d: %d update(s), ", i + 1, update_count);
+            if (changed_count == 0) {
+                printf("no formulas changed\n");
+            }
+            for (int c = 0; c < changed_count; c++) {
+                printf("%sformula %d changed to %s", c > 0 ? ", " : "", changed[c] + 1,
+                       incremental_value(inc, changed[c]) ? "TRUE" : "FALSE");
+                printf(c == changed_count - 1 ? "\n" : "");
+            }
+        }
+
+        free_fact_updates(updates, update_count);
+    }
+
+    if (ok) {
+        bool result = true;
+        for (int f = 0; f < count; f++) {
+            result = result && incremental_value(inc, f);
+        }
+        printf("Result: %s\n", result ? "TRUE" : "FALSE");
+
+        if (verbose) {
+            IncrementalStats* stats = incremental_stats(inc);
+            printf("Facts loaded: %d\n", facts->count);
+            printf("Updates applied: %ld\n", stats->updates_applied);
+            printf("Bindings re-evaluated: %ld\n", stats->bindings_reevaluated);
+            printf("Values changed: %ld\n", stats->values_changed);
+        }
+    }
+
+    free_incremental(inc);
+    return ok;
+}
+
+/* Main function to evaluate a formula against a set of facts */
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <formula_file> <facts_file> [-m] [-j] [--explain] [-u <updates_file>]... [-v]\n", argv[0]);
+        fprintf(stderr, "  -m: Memoize loop-invariant quantified subformulas\n");
+        fprintf(stderr, "  -j: Evaluate quantified conjunctions as joins\n");
+        fprintf(stderr, "  --explain: Print each join plan (implies -j)\n");
+        fprintf(stderr, "  -u: Apply a batch of fact updates incrementally (repeatable)\n");
+        fprintf(stderr, "  -v: Print evaluation statistics\n");
+        return 1;
+    }
+
+    EvalOptions options;
+    options.enable_memoization = false;
+    options.enable_joins = false;
+    options.explain = false;
+    bool verbose = false;
+    char* update_files[argc];
+    int update_file_count = 0;
+
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "-m") == 0) {
+            options.enable_memoization = true;
+        } else if (strcmp(argv[i], "-j") == 0) {
+            options.enable_joins = true;
+        } else if (strcmp(argv[i], "--explain") == 0) {
+            options.enable_joins = true;
+            options.explain = true;
+        } else if (strcmp(argv[i], "-u") == 0 && i + 1 < argc) {
+            update_files[update_file_count++] = argv[++i];
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        } else {
+            fprintf(stderr, "Error: Unknown argument: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    ParseContext* formula_ctx = parse_file(argv[1]);
+    if (formula_ctx == NULL) {
+        return 1;
+    }
+    ASTNode* formula = formula_ctx->root;
+    resolve_bindings(formula);
+
+    /* The fact table copies the facts, so their AST is released right away */
+    ParseContext* facts_ctx = parse_file(argv[2]);
+    if (facts_ctx == NULL) {
+        free_parse_context(formula_ctx);
+        return 1;
+    }
+
+    FactTable* facts = create_fact_table(1021);
+    bool loaded = load_facts(facts, facts_ctx->root);
+    free_parse_context(facts_ctx);
+    if (!loaded) {
+        free_fact_table(facts);
+        free_parse_context(formula_ctx);
+        return 1;
+    }
+
+    if (update_file_count > 0) {
+        bool ok = run_incremental(formula_ctx->formulas, formula_ctx->formula_count, facts,
+                                  update_files, update_file_count, verbose);
+        free_fact_table(facts);
+        free_parse_context(formula_ctx);
+        free_interned();
+        return ok ? 0 : 1;
+    }
+
+    EvalStats stats = {0};
+    bool result = evaluate_formula(formula, facts, &options, &stats);
+
+    printf("Result: %s\n", result ? "TRUE" : "FALSE");
+    if (verbose) {
+        printf("Facts loaded: %d\n", facts->count);
+        printf("Nodes evaluated: %ld\n", stats.nodes_evaluated);
+        printf("Fact lookups: %ld\n", stats.fact_lookups);
+        printf("Memo hits: %ld, misses: %ld\n", stats.memo_hits, stats.memo_misses);
+        printf("Join plans run: %ld\n", stats.join_plans_run);
+    }
+
+    /* Cleanup */
+    free_fact_table(facts);
+    free_parse_context(formula_ctx);
+    free_interned();
+
+    return 0;
+}
@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+/*
+ * Synthetic workload generator. Writes a .logic file of random formulas that
+ * every phase accepts: each formula is a tree of connectives of a fixed
+ * depth, quantifiers open scopes along the way, every predicate argument is
+ * a variable bound by an enclosing quantifier, each predicate is always
+ * called with the same number of arguments, and no quantifier shadows
+ * another. A facts file for the evaluator can be written alongside.
+ *
+ * The output depends only on the parameters and the seed, and is written as
+ * it is generated, so it can be as large as the disk allows.
+ */
+
+enum { OP_AND, OP_OR, OP_IMPLIES, OP_IFF, OP_XOR, OP_NOT, OP_COUNT };
+
+static const char* op_names[OP_COUNT] = { "and", "or", "implies", "iff", "xor", "not" };
+static const char* op_tokens[OP_COUNT] = { "/\\", "\\/", "->", "<->", "^", "~" };
+
+typedef struct {
+    long long formulas;          /* Formulas to write, unless size is set */
+    long long size;              /* Bytes to write at least, or 0 */
+    int depth;                   /* Connectives on every path from a formula to a leaf */
+    int nesting;                 /* Quantifiers on a path, at most */
+    int weights[OP_COUNT];       /* Relative frequency of each connective */
+    int domain;                  /* Constants in each quantifier's domain */
+    int constants;               /* Distinct constants c0, c1, ... */
+    int predicates;              /* Distinct predicates P0, P1, ... */
+    int arity;                   /* Largest predicate arity */
+    double density;              /* Fraction of ground atoms that are facts */
+    const char* output;
+    const char* facts;
+} Workload;
+
+/* Small generator so a workload can be repeated from its seed */
+static unsigned long long random_state;
+
+static unsigned next_random() {
+    random_state = random_state * 6364136223846793005ull + 1442695040888963407ull;
+    return (unsigned)(random_state >> 33);
+}
+
+/* Uniform in (0, 1) */
+static double next_uniform() {
+    return (next_random() + 0.5) / 2147483648.0;
+}
+
+/* Counts what was written to the formula file */
+static long long bytes_written;
+
+static void emit(FILE* out, const char* text) {
+    bytes_written += (long long)strlen(text);
+    fputs(text, out);
+}
+
+static void emit_format(FILE* out, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+static void emit_format(FILE* out, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int written = vfprintf(out, format, args);
+    va_end(args);
+    if (written > 0) {
+        bytes_written += written;
+    }
+}
+
+/* Predicate k always takes the same number of arguments */
+static int predicate_arity(const Workload* w, int k) {
+    return 1 + k % w->arity;
+}
+
+static int pick_operator(const Workload* w, int total_weight) {
+    int choice = (int)(next_random() % (unsigned)total_weight);
+    for (int op = 0; op < OP_COUNT; op++) {
+        if (choice < w->weights[op]) {
+            return op;
+        }
+        choice -= w->weights[op];
+    }
+    return OP_AND;
+}
+
+/*
+ * Write a subformula with depth connectives left on every path, inside bound
+ * quantifiers. Variables are named by nesting level (x0 in the outermost
+ * quantifier), so an inner quantifier never shadows an outer one. Recursion
+ * is bounded by depth + nesting, which are small.
+ */
+static void write_formula(FILE* out, const Workload* w, int total_weight, int depth, int bound) {
+    bool quantify = bound < w->nesting && (bound == 0 || next_random() % 3 == 0);
+    if (quantify) {
+        /* A quantifier's body extends as far right as it can, so an inner
+           quantifier is parenthesised to end it where the subformula ends */
+        emit_format(out, "%s%s x%d [", bound > 0 ? "(" : "", next_random() % 2 ? "forall" : "exists", bound);
+        int first = (int)(next_random() % (unsigned)w->constants);
+        for (int i = 0; i < w->domain; i++) {
+            emit_format(out, "%sc%d", i ? ", " : "", (first + i) % w->constants);
+        }
+        emit(out, "] (");
+        write_formula(out, w, total_weight, depth, bound + 1);
+        emit(out, bound > 0 ? "))" : ")");
+        return;
+    }
+
+    if (depth == 0) {
+        if (bound == 0) {
+            emit(out, next_random() % 2 ? "true" : "false");
+            return;
+        }
+        int k = (int)(next_random() % (unsigned)w->predicates);
+        emit_format(out, "P%d(", k);
+        for (int i = 0, arity = predicate_arity(w, k); i < arity; i++) {
+            emit_format(out, "%sx%u", i ? ", " : "", next_random() % (unsigned)bound);
+        }
+        emit(out, ")");
+        return;
+    }
+
+    int op = pick_operator(w, total_weight);
+    if (op == OP_NOT) {
+        emit(out, "~");
+        write_formula(out, w, total_weight, depth - 1, bound);
+        return;
+    }
+    emit(out, "(");
+    write_formula(out, w, total_weight, depth - 1, bound);
+    emit_format(out, " %s ", op_tokens[op]);
+    write_formula(out, w, total_weight, depth - 1, bound);
+    emit(out, ")");
+}
+
+/*
+ * Write each ground atom P(c...) as a fact with probability density. The
+ * atoms of a predicate are numbered in base constants and the gaps between
+ * facts are drawn from the geometric distribution, so the time taken is
+ * proportional to the facts written and not to the atoms skipped.
+ */
+static long long write_facts(FILE* out, const Workload* w) {
+    long long facts = 0;
+    if (w->density <= 0) {
+        return 0;
+    }
+    double skip_scale = w->density < 1 ? 1 / log(1 - w->density) : 0;
+    for (int k = 0; k < w->predicates; k++) {
+        int arity = predicate_arity(w, k);
+        double atoms = pow(w->constants, arity);
+        for (double index = 0;; index++) {
+            if (skip_scale != 0) {
+                index += floor(log(next_uniform()) * skip_scale);
+            }
+            if (index >= atoms) {
+                break;
+            }
+            fprintf(out, "P%d(", k);
+            double rest = index;
+            for (int i = 0; i < arity; i++) {
+                double digit = fmod(rest, w->constants);
+                rest = floor(rest / w->constants);
+                fprintf(out, "%sc%d", i ? ", " : "", (int)digit);
+            }
+            fprintf(out, ")\n");
+            facts++;
+        }
+    }
+    return facts;
+}
+
+/* Parse a byte count with an optional K, M or G suffix */
+static long long parse_size(const char* text) {
+    char* end;
+    double value = strtod(text, &end);
+    switch (*end) {
+        case 'K': case 'k': value *= 1024; end++; break;
+        case 'M': case 'm': value *= 1024.0 * 1024; end++; break;
+        case 'G': case 'g': value *= 1024.0 * 1024 * 1024; end++; break;
+    }
+    return *end == '\0' && value > 0 ? (long long)value : -1;
+}
+
+/* Parse "and=4,or=3,..."; operators left out keep their weight */
+static bool parse_weights(const char* text, int* weights) {
+    while (*text) {
+        int op;
+        for (op = 0; op < OP_COUNT; op++) {
+            size_t length = strlen(op_names[op]);
+            if (strncmp(text, op_names[op], length) == 0 && text[length] == '=') {
+                text += length + 1;
+                break;
+            }
+        }
+        if (op == OP_COUNT) {
+            return false;
+        }
+        char* end;
+        long weight = strtol(text, &end, 10);
+        if (end == text || weight < 0 || weight > 1000000) {
+            return false;
+        }
+        weights[op] = (int)weight;
+        text = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s [-n <formulas> | --size <bytes>] [-d <depth>] [-q <nesting>] [--ops <weights>]\n"
+                    "       [--domain <size>] [--constants <count>] [--predicates <count>] [--arity <max>]\n"
+                    "       [--facts <file>] [--density <fraction>] [--seed <n>] [-o <output_file>]\n", program);
+    fprintf(stderr, "  -n: Number of formulas (default 1000)\n");
+    fprintf(stderr, "  --size: Write formulas until the file has this many bytes (K, M and G suffixes)\n");
+    fprintf(stderr, "  -d: Connectives on every path from a formula to a leaf (default 4)\n");
+    fprintf(stderr, "  -q: Quantifiers nested on a path, at most (default 2)\n");
+    fprintf(stderr, "  --ops: Connective weights, e.g. and=4,or=3,implies=1,iff=1,xor=1,not=2 (the default)\n");
+    fprintf(stderr, "  --domain: Constants in each quantifier's domain (default 3)\n");
+    fprintf(stderr, "  --constants: Distinct constants (default 16)\n");
+    fprintf(stderr, "  --predicates: Distinct predicates (default 20)\n");
+    fprintf(stderr, "  --arity: Largest predicate arity (default 3)\n");
+    fprintf(stderr, "  --facts: Also write a facts file for the evaluator\n");
+    fprintf(stderr, "  --density: Fraction of ground atoms written as facts (default 0.1)\n");
+    fprintf(stderr, "  --seed: Random seed (default 1)\n");
+    fprintf(stderr, "  -o: Output file (default standard output)\n");
+}
+
+int main(int argc, char* argv[]) {
+    Workload w = { 1000, 0, 4, 2, { 4, 3, 1, 1, 1, 2 }, 3, 16, 20, 3, 0.1, NULL, NULL };
+    random_state = 1;
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        const char* value = has_value ? argv[i + 1] : NULL;
+        bool ok = has_value;
+        if (strcmp(argv[i], "-n") == 0 && has_value) {
+            w.formulas = atoll(value);
+            ok = w.formulas > 0;
+        } else if (strcmp(argv[i], "--size") == 0 && has_value) {
+            w.size = parse_size(value);
+            ok = w.size > 0;
+        } else if (strcmp(argv[i], "-d") == 0 && has_value) {
+            w.depth = atoi(value);
+            ok = w.depth >= 0 && w.depth <= 30;
+        } else if (strcmp(argv[i], "-q") == 0 && has_value) {
+            w.nesting = atoi(value);
+            ok = w.nesting >= 0 && w.nesting <= 1000;
+        } else if (strcmp(argv[i], "--ops") == 0 && has_value) {
+            ok = parse_weights(value, w.weights);
+        } else if (strcmp(argv[i], "--domain") == 0 && has_value) {
+            w.domain = atoi(value);
+            ok = w.domain > 0;
+        } else if (strcmp(argv[i], "--constants") == 0 && has_value) {
+            w.constants = atoi(value);
+            ok = w.constants > 0;
+        } else if (strcmp(argv[i], "--predicates") == 0 && has_value) {
+            w.predicates = atoi(value);
+            ok = w.predicates > 0;
+        } else if (strcmp(argv[i], "--arity") == 0 && has_value) {
+            w.arity = atoi(value);
+            ok = w.arity > 0 && w.arity <= 16;
+        } else if (strcmp(argv[i], "--facts") == 0 && has_value) {
+            w.facts = value;
+        } else if (strcmp(argv[i], "--density") == 0 && has_value) {
+            w.density = atof(value);
+            ok = w.density >= 0 && w.density <= 1;
+        } else if (strcmp(argv[i], "--seed") == 0 && has_value) {
+            random_state = strtoull(value, NULL, 10);
+        } else if (strcmp(argv[i], "-o") == 0 && has_value) {
+            w.output = value;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            fprintf(stderr, "Error: Invalid argument: %s%s%s\n", argv[i], value ? " " : "", value ? value : "");
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+
+    int total_weight = 0;
+    for (int op = 0; op < OP_COUNT; op++) {
+        total_weight += w.weights[op];
+    }
+    if (total_weight == 0 && w.depth > 0) {
+        fprintf(stderr, "Error: Every connective has weight 0\n");
+        return 1;
+    }
+    if (w.domain > w.constants) {
+        w.constants = w.domain;
+    }
+
+    FILE* out = w.output != NULL ? fopen(w.output, "w") : stdout;
+    if (out == NULL) {
+        fprintf(stderr, "Error: Cannot write file '%s'\n", w.output);
+        return 1;
+    }
+    setvbuf(out, NULL, _IOFBF, 1 << 20);
+
+    long long formulas = 0;
+    while (w.size > 0 ? bytes_written < w.size : formulas < w.formulas) {
+        write_formula(out, &w, total_weight, w.depth, 0);
+        emit(out, "\n");
+        formulas++;
+    }
+    if (fflush(out) != 0 || ferror(out)) {
+        fprintf(stderr, "Error: Cannot write file '%s'\n", w.output != NULL ? w.output : "<stdout>");
+        return 1;
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    long long facts = 0;
+    if (w.facts != NULL) {
+        FILE* facts_file = fopen(w.facts, "w");
+        if (facts_file == NULL) {
+            fprintf(stderr, "Error: Cannot write file '%s'\n", w.facts);
+            return 1;
+        }
+        facts = write_facts(facts_file, &w);
+        if (fclose(facts_file) != 0) {
+            fprintf(stderr, "Error: Cannot write file '%s'\n", w.facts);
+            return 1;
+        }
+    }
+
+    fprintf(stderr, "Wrote %lld formulas (%lld bytes)", formulas, bytes_written);
+    if (w.facts != NULL) {
+        fprintf(stderr, " and %lld facts", facts);
+    }
+    fprintf(stderr, "\n");
+    return 0;
+}
@@ -0,0 +1,563 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "incremental.h"
+
+#define ATOM_BUCKETS 211
+
+/* A quantifier variable enclosing a subformula */
+typedef struct {
+    InternId name;
+    InternId* domain;
+    int size;
+} ScopeVar;
+
+/* Kept results of one subformula */
+typedef struct IncNode {
+    ASTNode* node;
+    struct IncNode* parent;
+    struct IncNode* left;        /* Operand, quantifier body or left operand */
+    struct IncNode* right;
+    ScopeVar* scope;             /* Enclosing quantifier variables, outermost first */
+    int depth;
+    int binding_count;           /* Product of the enclosing domain sizes */
+    unsigned char* values;       /* Truth value per binding (mixed radix, innermost last) */
+    int* counters;               /* Quantifiers: bindings of the body that hold */
+    ScopeVar* inner_scope;       /* Quantifiers: scope of the body (owned) */
+    InternId predicate;          /* Atoms: predicate or proposition name */
+    int name_slot;               /* Atoms: scope position of a bound proposition, else -1 */
+    int arity;
+    int* arg_slots;              /* Atoms: scope position of each argument, -1 for constants */
+    InternId* arg_values;        /* Atoms: value of each constant argument */
+    struct IncNode* next_atom;   /* Next atom in the same index chain */
+} IncNode;
+
+struct IncrementalEvaluator {
+    FactTable* facts;
+    IncNode** roots;
+    int formula_count;
+    IncNode* atoms[ATOM_BUCKETS]; /* Atoms with a fixed predicate, by predicate */
+    IncNode* bound_propositions;  /* Propositions named by a quantifier variable */
+    IncrementalStats stats;
+};
+
+static bool apply_binary(BinaryOpType operator, bool left, bool right) {
+    switch (operator) {
+        case OP_AND:     return left && right;
+        case OP_OR:      return left || right;
+        case OP_IMPLIES: return !left || right;
+        case OP_IFF:     return left == right;
+        case OP_XOR:     return left != right;
+    }
+    return false;
+}
+
+static bool quantifier_value(IncNode* n, int binding) {
+    int size = n->inner_scope[n->depth].size;
+    if (n->node->data.quantifier.quantifier == QUANT_FORALL) {
+        return n->counters[binding] == size;
+    }
+    return n->counters[binding] > 0;
+}
+
+/* Scope position of the innermost variable with this name, or -1 */
+static int resolve_slot(ScopeVar* scope, int depth, InternId name) {
+    for (int k = depth - 1; k >= 0; k--) {
+        if (scope[k].name == name) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+/* Split a binding index into one domain index per scope position */
+static void decode_binding(IncNode* n, int binding, int* indices) {
+    for (int k = n->depth - 1; k >= 0; k--) {
+        indices[k] = binding % n->scope[k].size;
+        binding /= n->scope[k].size;
+    }
+}
+
+static bool eval_atom(IncNode* n, FactTable* facts, int binding) {
+    int indices[n->depth > 0 ? n->depth : 1];
+    InternId args[n->arity > 0 ? n->arity : 1];
+
+    decode_binding(n, binding, indices);
+    for (int i = 0; i < n->arity; i++) {
+        int slot = n->arg_slots[i];
+        args[i] = slot >= 0 ? n->scope[slot].domain[indices[slot]] : n->arg_values[i];
+    }
+
+    InternId predicate = n->name_slot >= 0 ? n->scope[n->name_slot].domain[indices[n->name_slot]] : n->predicate;
+    return fact_holds(facts, predicate, args, n->arity);
+}
+
+/* Set up an atom and add it to the index */
+static void init_atom(IncrementalEvaluator* inc, IncNode* n) {
+    ASTNode* node = n->node;
+    n->name_slot = -1;
+
+    if (node->type == NODE_VARIABLE) {
+        n->arity = 0;
+        n->name_slot = resolve_slot(n->scope, n->depth, node->data.variable.name);
+        if (n->name_slot < 0) {
+            n->predicate = node->data.variable.name;
+        }
+    } else {
+        n->arity = node->data.predicate.arg_count;
+        n->predicate = node->data.predicate.name;
+    }
+
+    n->arg_slots = (int*)malloc(sizeof(int) * (n->arity > 0 ? n->arity : 1));
+    n->arg_values = (InternId*)malloc(sizeof(InternId) * (n->arity > 0 ? n->arity : 1));
+    for (int i = 0; i < n->arity; i++) {
+        InternId name = node->data.predicate.args[i];
+        n->arg_slots[i] = resolve_slot(n->scope, n->depth, name);
+        n->arg_values[i] = n->arg_slots[i] < 0 ? name : 0;
+    }
+
+    if (n->name_slot >= 0) {
+        n->next_atom = inc->bound_propositions;
+        inc->bound_propositions = n;
+    } else {
+        n->next_atom = inc->atoms[n->predicate % ATOM_BUCKETS];
+        inc->atoms[n->predicate % ATOM_BUCKETS] = n;
+    }
+
+    for (int b = 0; b < n->binding_count; b++) {
+        n->values[b] = eval_atom(n, inc->facts, b);
+    }
+}
+
+static void free_inc_node(IncNode* root) {
+    IncNode** stack = NULL;
+    int count = 0;
+    int capacity = 0;
+    IncNode* n = root;
+
+    while (n != NULL) {
+        /* Keep the children to free before releasing the node */
+        if (count + 2 > capacity) {
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            stack = (IncNode**)realloc(stack, sizeof(IncNode*) * capacity);
+        }
+        if (n->left != NULL) {
+            stack[count++] = n->left;
+        }
+        if (n->right != NULL) {
+            stack[count++] = n->right;
+        }
+
+        free(n->values);
+        free(n->counters);
+        free(n->inner_scope);
+        free(n->arg_slots);
+        free(n->arg_values);
+        free(n);
+        n = count > 0 ? stack[--count] : NULL;
+    }
+    free(stack);
+}
+
+/* State of build_node: the kept results of the nodes on the path from the root */
+typedef struct {
+    IncrementalEvaluator* inc;
+    IncNode** path;
+    int count;
+    int capacity;
+    IncNode* root;
+    bool ok;
+} IncBuild;
+
+/* Create the kept results of a node and evaluate it if it is a leaf */
+static bool build_enter(IncBuild* build, ASTNode* node) {
+    IncNode* parent = build->count > 0 ? build->path[build->count - 1] : NULL;
+    ScopeVar* scope = NULL;
+    int depth = 0;
+    int binding_count = 1;
+
+    if (parent != NULL && parent->node->type == NODE_QUANTIFIER) {
+        scope = parent->inner_scope;
+        depth = parent->depth + 1;
+        binding_count = parent->binding_count * parent->inner_scope[parent->depth].size;
+    } else if (parent != NULL) {
+        scope = parent->scope;
+        depth = parent->depth;
+        binding_count = parent->binding_count;
+    }
+
+    IncNode* n = (IncNode*)calloc(1, sizeof(IncNode));
+    n->node = node;
+    n->parent = parent;
+    n->scope = scope;
+    n->depth = depth;
+    n->binding_count = binding_count;
+    n->values = (unsigned char*)calloc(binding_count > 0 ? binding_count : 1, 1);
+
+    /* Attach first so a failed build is freed with the root */
+    if (parent == NULL) {
+        build->root = n;
+    } else if (parent->left == NULL) {
+        parent->left = n;
+    } else {
+        parent->right = n;
+    }
+
+    switch (node->type) {
+        case NODE_LITERAL:
+            memset(n->values, node->data.literal.value, binding_count);
+            break;
+
+        case NODE_VARIABLE:
+        case NODE_PREDICATE:
+            init_atom(build->inc, n);
+            break;
+
+        case NODE_QUANTIFIER: {
+            int size = node->data.quantifier.domain_size;
+            if (size > 0 && binding_count > INT_MAX / size) {
+                fprintf(stderr, "Error at line %d, column %d: Too many quantifier bindings for incremental evaluation\n",
+                        node->line, node->column);
+                return false;
+            }
+
+            n->inner_scope = (ScopeVar*)malloc(sizeof(ScopeVar) * (depth + 1));
+            if (depth > 0) {
+                memcpy(n->inner_scope, scope, sizeof(ScopeVar) * depth);
+            }
+            n->inner_scope[depth].name = node->data.quantifier.variable;
+            n->inner_scope[depth].domain = node->data.quantifier.domain;
+            n->inner_scope[depth].size = size;
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    if (build->count == build->capacity) {
+        build->capacity = build->capacity == 0 ? 64 : build->capacity * 2;
+        build->path = (IncNode**)realloc(build->path, sizeof(IncNode*) * build->capacity);
+    }
+    build->path[build->count++] = n;
+    return true;
+}
+
+/* Compute the values of an operator or quantifier from its operands */
+static void build_leave(IncNode* n) {
+    ASTNode* node = n->node;
+    int binding_count = n->binding_count;
+
+    switch (node->type) {
+        case NODE_UNARY_OP:
+            for (int b = 0; b < binding_count; b++) {
+                n->values[b] = !n->left->values[b];
+            }
+            break;
+
+        case NODE_BINARY_OP:
+            for (int b = 0; b < binding_count; b++) {
+                n->values[b] = apply_binary(node->data.binary.operator, n->left->values[b], n->right->values[b]);
+            }
+            break;
+
+        case NODE_QUANTIFIER: {
+            int size = node->data.quantifier.domain_size;
+            n->counters = (int*)calloc(binding_count > 0 ? binding_count : 1, sizeof(int));
+            for (int b = 0; b < binding_count; b++) {
+                for (int i = 0; i < size; i++) {
+                    n->counters[b] += n->left->values[b * size + i];
+                }
+                n->values[b] = quantifier_value(n, b);
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+static bool build_visit(ASTNode* node, VisitStage stage, int depth, void* data) {
+    IncBuild* build = (IncBuild*)data;
+
+    if (stage == VISIT_ENTER) {
+        if (build->ok && !build_enter(build, node)) {
+            build->ok = false;
+        }
+        return build->ok;
+    }
+    if (stage == VISIT_LEAVE) {
+        IncNode* n = build->path[--build->count];
+        if (build->ok) {
+            build_leave(n);
+        }
+    }
+    return true;
+}
+
+/* Build the kept results of a formula; returns NULL if the bindings do not fit */
+static IncNode* build_node(IncrementalEvaluator* inc, ASTNode* node) {
+    IncBuild build = { inc, NULL, 0, 0, NULL, true };
+    walk_ast(node, build_visit, &build);
+    free(build.path);
+
+    if (!build.ok) {
+        free_inc_node(build.root);
+        return NULL;
+    }
+    return build.root;
+}
+
+/* Evaluate the formulas once and keep their intermediate results */
+IncrementalEvaluator* create_incremental(ASTNode** formulas, int formula_count, FactTable* facts) {
+    IncrementalEvaluator* inc = (IncrementalEvaluator*)calloc(1, sizeof(IncrementalEvaluator));
+    inc->facts = facts;
+    inc->roots = (IncNode**)calloc(formula_count > 0 ? formula_count : 1, sizeof(IncNode*));
+    inc->formula_count = formula_count;
+
+    for (int f = 0; f < formula_count; f++) {
+        inc->roots[f] = build_node(inc, formulas[f]);
+        if (inc->roots[f] == NULL) {
+            free_incremental(inc);
+            return NULL;
+        }
+    }
+    return inc;
+}
+
+bool incremental_value(IncrementalEvaluator* inc, int formula) {
+    return inc->roots[formula]->values[0];
+}
+
+IncrementalStats* incremental_stats(IncrementalEvaluator* inc) {
+    return &inc->stats;
+}
+
+/* Store a new value and propagate the change to the enclosing subformulas */
+static void set_value(IncrementalEvaluator* inc, IncNode* n, int binding, bool value) {
+    while (n != NULL && n->values[binding] != value) {
+        n->values[binding] = value;
+        inc->stats.values_changed++;
+
+        IncNode* parent = n->parent;
+        if (parent == NULL) {
+            return;
+        }
+
+        switch (parent->node->type) {
+            case NODE_UNARY_OP:
+                value = !value;
+                break;
+
+            case NODE_BINARY_OP:
+                value = apply_binary(parent->node->data.binary.operator,
+                                     parent->left->values[binding], parent->right->values[binding]);
+                break;
+
+            case NODE_QUANTIFIER:
+                parent->counters[binding / parent->inner_scope[parent->depth].size] += value ? 1 : -1;
+                binding /= parent->inner_scope[parent->depth].size;
+                value = quantifier_value(parent, binding);
+                break;
+
+            default:
+                return;
+        }
+        n = parent;
+    }
+}
+
+/* Re-evaluate the bindings of an atom under which it denotes the updated fact */
+static void update_atom(IncrementalEvaluator* inc, IncNode* n, FactUpdate* update) {
+    if (n->arity != update->arg_count || (n->name_slot < 0 && n->predicate != update->predicate)) {
+        return;
+    }
+
+    /* Value each scope position must take, if the atom fixes it */
+    InternId wanted[n->depth > 0 ? n->depth : 1];
+    bool fixed[n->depth > 0 ? n->depth : 1];
+    memset(fixed, 0, sizeof(bool) * n->depth);
+
+    for (int i = -1; i < n->arity; i++) {
+        int slot = i < 0 ? n->name_slot : n->arg_slots[i];
+        InternId value = i < 0 ? update->predicate : update->args[i];
+
+        if (slot < 0) {
+            if (i >= 0 && n->arg_values[i] != value) {
+                return;
+            }
+        } else if (fixed[slot] && wanted[slot] != value) {
+            return;
+        } else {
+            fixed[slot] = true;
+            wanted[slot] = value;
+        }
+    }
+
+    /* Candidate domain indices of each scope position */
+    int total = 0;
+    for (int k = 0; k < n->depth; k++) {
+        total += n->scope[k].size;
+    }
+    int* candidates = (int*)malloc(sizeof(int) * (total > 0 ? total : 1));
+    int start[n->depth > 0 ? n->depth : 1];
+    int count[n->depth > 0 ? n->depth : 1];
+    int used = 0;
+
+    for (int k = 0; k < n->depth; k++) {
+        start[k] = used;
+        for (int j = 0; j < n->scope[k].size; j++) {
+            if (!fixed[k] || n->scope[k].domain[j] == wanted[k]) {
+                candidates[used++] = j;
+            }
+        }
+        count[k] = used - start[k];
+        if (count[k] == 0) {
+            free(candidates);
+            return;
+        }
+    }
+
+    /* Visit every combination of candidates */
+    int position[n->depth > 0 ? n->depth : 1];
+    memset(position, 0, sizeof(int) * n->depth);
+    for (;;) {
+        int binding = 0;
+        for (int k = 0; k < n->depth; k++) {
+            binding = binding * n->scope[k].size + candidates[start[k] + position[k]];
+        }
+        inc->stats.bindings_reevaluated++;
+        set_value(inc, n, binding, update->insert);
+
+        int k = n->depth - 1;
+        while (k >= 0 && ++position[k] == count[k]) {
+            position[k--] = 0;
+        }
+        if (k < 0) {
+            break;
+        }
+    }
+
+    free(candidates);
+}
+
+/* Apply a batch of updates; returns the number of formulas that changed value */
+int apply_fact_updates(IncrementalEvaluator* inc, FactUpdate* updates, int update_count, int* changed) {
+    bool before[inc->formula_count > 0 ? inc->formula_count : 1];
+    for (int f = 0; f < inc->formula_count; f++) {
+        before[f] = incremental_value(inc, f);
+    }
+
+    for (int u = 0; u < update_count; u++) {
+        FactUpdate* update = &updates[u];
+        bool applied = update->insert
+            ? insert_fact(inc->facts, update->predicate, update->args, update->arg_count)
+            : remove_fact(inc->facts, update->predicate, update->args, update->arg_count);
+        if (!applied) {
+            continue;
+        }
+        inc->stats.updates_applied++;
+
+        for (IncNode* n = inc->atoms[update->predicate % ATOM_BUCKETS]; n != NULL; n = n->next_atom) {
+            update_atom(inc, n, update);
+        }
+        if (update->arg_count == 0) {
+            for (IncNode* n = inc->bound_propositions; n != NULL; n = n->next_atom) {
+                update_atom(inc, n, update);
+            }
+        }
+    }
+
+    int changed_count = 0;
+    for (int f = 0; f < inc->formula_count; f++) {
+        if (incremental_value(inc, f) != before[f]) {
+            changed[changed_count++] = f;
+        }
+    }
+    return changed_count;
+}
+
+void free_incremental(IncrementalEvaluator* inc) {
+    if (inc == NULL) {
+        return;
+    }
+    for (int f = 0; f < inc->formula_count; f++) {
+        free_inc_node(inc->roots[f]);
+    }
+    free(inc->roots);
+    free(inc);
+}
+
+static void add_update(FactUpdate** updates, int* count, int* capacity, bool insert, InternId name,
+                       InternId* args, int arg_count) {
+    if (*count == *capacity) {
+        *capacity = *capacity == 0 ? 16 : *capacity * 2;
+        *updates = (FactUpdate*)realloc(*updates, sizeof(FactUpdate) * *capacity);
+    }
+
+    FactUpdate* update = &(*updates)[(*count)++];
+    update->insert = insert;
+    update->predicate = name;
+    update->args = (InternId*)malloc(sizeof(InternId) * (arg_count > 0 ? arg_count : 1));
+    update->arg_count = arg_count;
+    for (int i = 0; i < arg_count; i++) {
+        update->args[i] = args[i];
+    }
+}
+
+/* State of load_fact_updates */
+typedef struct {
+    FactUpdate** updates;
+    int* count;
+    int* capacity;
+    bool ok;
+} UpdateLoad;
+
+static bool load_update_visit(ASTNode* node, VisitStage stage, int depth, void* data) {
+    UpdateLoad* load = (UpdateLoad*)data;
+    bool insert = true;
+    ASTNode* atom = node;
+
+    if (stage != VISIT_ENTER || !load->ok) {
+        return false;
+    }
+
+    if (node->type == NODE_BINARY_OP && node->data.binary.operator == OP_AND) {
+        return true;
+    }
+    if (node->type == NODE_UNARY_OP) {
+        insert = false;
+        atom = node->data.unary.operand;
+    }
+
+    if (atom->type == NODE_PREDICATE) {
+        add_update(load->updates, load->count, load->capacity, insert, atom->data.predicate.name,
+                   atom->data.predicate.args, atom->data.predicate.arg_count);
+        return false;
+    }
+    if (atom->type == NODE_VARIABLE) {
+        add_update(load->updates, load->count, load->capacity, insert, atom->data.variable.name, NULL, 0);
+        return false;
+    }
+
+    fprintf(stderr, "Error at line %d, column %d: Updates must be ground atoms or negated ground atoms\n",
+            node->line, node->column);
+    load->ok = false;
+    return false;
+}
+
+/* Read updates from a parsed file: ground atoms insert, negated atoms delete */
+bool load_fact_updates(ASTNode* node, FactUpdate** updates, int* count, int* capacity) {
+    UpdateLoad load = { updates, count, capacity, true };
+    walk_ast(node, load_update_visit, &load);
+    return load.ok;
+}
+
+void free_fact_updates(FactUpdate* updates, int count) {
+    for (int i = 0; i < count; i++) {
+        free(updates[i].args);
+    }
+    free(updates);
+}
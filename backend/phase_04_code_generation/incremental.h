@@ -0,0 +1,58 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <stdbool.h>
+#include "ast.h"
+#include "intern.h"
+#include "eval.h"
+
+/*
+ * Incremental re-evaluation of formulas under fact updates.
+ *
+ * Every subformula keeps its truth value for each binding of the quantifier
+ * variables that enclose it, and every quantifier keeps a counter of the
+ * bindings of its own variable under which its body holds. Inserting or
+ * deleting a fact re-evaluates only the atom bindings that match the fact
+ * and propagates the changed values upward: operators are recomputed at the
+ * same binding, quantifiers adjust their counter by one.
+ */
+
+/* One fact insertion or deletion */
+typedef struct {
+    bool insert;                 /* true to insert, false to delete */
+    InternId predicate;
+    InternId* args;
+    int arg_count;
+} FactUpdate;
+
+/* Work done by incremental updates */
+typedef struct {
+    long updates_applied;        /* Updates that changed the fact table */
+    long bindings_reevaluated;   /* Atom bindings matched by an update */
+    long values_changed;         /* Subformula values flipped by propagation */
+} IncrementalStats;
+
+typedef struct IncrementalEvaluator IncrementalEvaluator;
+
+/* Evaluate the formulas once and keep their intermediate results */
+IncrementalEvaluator* create_incremental(ASTNode** formulas, int formula_count, FactTable* facts);
+
+/* Current value of a top-level formula */
+bool incremental_value(IncrementalEvaluator* inc, int formula);
+
+/*
+ * Apply a batch of updates to the fact table and the kept results. The
+ * indices of the formulas whose value differs from before the batch are
+ * stored in changed (room for formula_count entries); returns their number.
+ */
+int apply_fact_updates(IncrementalEvaluator* inc, FactUpdate* updates, int update_count, int* changed);
+
+IncrementalStats* incremental_stats(IncrementalEvaluator* inc);
+
+void free_incremental(IncrementalEvaluator* inc);
+
+/* Read updates from a parsed file: ground atoms insert, negated atoms delete */
+bool load_fact_updates(ASTNode* node, FactUpdate** updates, int* count, int* capacity);
+void free_fact_updates(FactUpdate* updates, int count);
+
+#endif /* INCREMENTAL_H */
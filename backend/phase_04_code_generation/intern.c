@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "intern.h"
+
+/* One interner serves every parse in the process, so all access is locked */
+static pthread_mutex_t intern_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Interned strings, indexed by ID */
+static char** strings = NULL;
+static int string_count = 0;
+static int string_capacity = 0;
+
+/* Open-addressing table of (ID + 1); 0 marks an empty slot */
+static InternId* string_slots = NULL;
+static int slot_count = 0;
+
+/* Open-addressing table of interned domains; NULL marks an empty slot */
+static Domain** domain_slots = NULL;
+static int domain_count = 0;
+static int domain_slot_count = 0;
+
+/* FNV-1a hash of length bytes */
+static unsigned int hash_bytes(const char* str, size_t length) {
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Double the slot table and re-insert every string */
+static void grow_slots() {
+    int new_count = slot_count == 0 ? 256 : slot_count * 2;
+    InternId* new_slots = (InternId*)calloc(new_count, sizeof(InternId));
+
+    for (int id = 0; id < string_count; id++) {
+        unsigned int i = hash_bytes(strings[id], strlen(strings[id])) & (new_count - 1);
+        while (new_slots[i] != 0) {
+            i = (i + 1) & (new_count - 1);
+        }
+        new_slots[i] = id + 1;
+    }
+
+    free(string_slots);
+    string_slots = new_slots;
+    slot_count = new_count;
+}
+
+/* Intern a string and return its ID; equal strings get equal IDs */
+InternId intern_string(const char* str) {
+    return intern_slice(str, strlen(str));
+}
+
+/* Intern the first length bytes of text, which need not end in a NUL */
+InternId intern_slice(const char* text, size_t length) {
+    pthread_mutex_lock(&intern_lock);
+    if ((string_count + 1) * 4 > slot_count * 3) {
+        grow_slots();
+    }
+
+    unsigned int i = hash_bytes(text, length) & (slot_count - 1);
+    while (string_slots[i] != 0) {
+        InternId id = string_slots[i] - 1;
+        if (strncmp(strings[id], text, length) == 0 && strings[id][length] == '\0') {
+            pthread_mutex_unlock(&intern_lock);
+            return id;
+        }
+        i = (i + 1) & (slot_count - 1);
+    }
+
+    if (string_count == string_capacity) {
+        string_capacity = string_capacity == 0 ? 256 : string_capacity * 2;
+        strings = (char**)realloc(strings, sizeof(char*) * string_capacity);
+    }
+
+    InternId id = string_count++;
+    strings[id] = (char*)malloc(length + 1);
+    memcpy(strings[id], text, length);
+    strings[id][length] = '\0';
+    string_slots[i] = id + 1;
+    pthread_mutex_unlock(&intern_lock);
+    return id;
+}
+
+/* Look up the text of an interned string */
+const char* interned_string(InternId id) {
+    const char* str = "<invalid>";
+    pthread_mutex_lock(&intern_lock);
+    if ((int)id < string_count) {
+        str = strings[id];
+    }
+    pthread_mutex_unlock(&intern_lock);
+    return str;
+}
+
+/* Number of distinct interned strings */
+int interned_count() {
+    pthread_mutex_lock(&intern_lock);
+    int count = string_count;
+    pthread_mutex_unlock(&intern_lock);
+    return count;
+}
+
+/* Double the domain table and re-insert every domain by its stored hash */
+static void grow_domain_slots() {
+    int new_count = domain_slot_count == 0 ? 256 : domain_slot_count * 2;
+    Domain** new_slots = (Domain**)calloc(new_count, sizeof(Domain*));
+
+    for (int j = 0; j < domain_slot_count; j++) {
+        Domain* domain = domain_slots[j];
+        if (domain != NULL) {
+            unsigned int i = domain->hash & (new_count - 1);
+            while (new_slots[i] != NULL) {
+                i = (i + 1) & (new_count - 1);
+            }
+            new_slots[i] = domain;
+        }
+    }
+
+    free(domain_slots);
+    domain_slots = new_slots;
+    domain_slot_count = new_count;
+}
+
+/*
+ * Find an interned domain equal to the given elements. Otherwise *slot is
+ * the empty slot to add it in and *hash its hash.
+ */
+static Domain* find_domain(InternId* elements, int size, unsigned int* hash, unsigned int* slot) {
+    if ((domain_count + 1) * 4 > domain_slot_count * 3) {
+        grow_domain_slots();
+    }
+
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < size; i++) {
+        h = (h ^ elements[i]) * 16777619u;
+    }
+    *hash = h ^ (h >> 15);
+
+    unsigned int i = *hash & (domain_slot_count - 1);
+    for (Domain* domain = domain_slots[i]; domain != NULL; domain = domain_slots[i]) {
+        if (domain->hash == *hash && domain->size == size &&
+            memcmp(domain->elements, elements, sizeof(InternId) * size) == 0) {
+            return domain;
+        }
+        i = (i + 1) & (domain_slot_count - 1);
+    }
+    *slot = i;
+    return NULL;
+}
+
+static Domain* add_domain(InternId* elements, int size, unsigned int hash, unsigned int slot) {
+    Domain* domain = (Domain*)malloc(sizeof(Domain));
+    domain->elements = elements;
+    domain->size = size;
+    domain->hash = hash;
+    domain_slots[slot] = domain;
+    domain_count++;
+    return domain;
+}
+
+/* Intern a domain; the returned elements must not be modified or freed */
+Domain* intern_domain(InternId* elements, int size) {
+    unsigned int hash;
+    unsigned int slot;
+    pthread_mutex_lock(&intern_lock);
+    Domain* domain = find_domain(elements, size, &hash, &slot);
+    if (domain == NULL) {
+        InternId* copy = (InternId*)malloc(sizeof(InternId) * (size > 0 ? size : 1));
+        memcpy(copy, elements, sizeof(InternId) * size);
+        domain = add_domain(copy, size, hash, slot);
+    }
+    pthread_mutex_unlock(&intern_lock);
+    return domain;
+}
+
+/* Intern a malloc'd domain, taking ownership: it is kept if new and freed if not */
+Domain* intern_domain_owned(InternId* elements, int size) {
+    unsigned int hash;
+    unsigned int slot;
+    pthread_mutex_lock(&intern_lock);
+    Domain* domain = find_domain(elements, size, &hash, &slot);
+    if (domain != NULL) {
+        free(elements);
+    } else {
+        domain = add_domain(elements, size, hash, slot);
+    }
+    pthread_mutex_unlock(&intern_lock);
+    return domain;
+}
+
+/* Release all interned strings and domains */
+void free_interned() {
+    pthread_mutex_lock(&intern_lock);
+    for (int i = 0; i < string_count; i++) {
+        free(strings[i]);
+    }
+    free(strings);
+    free(string_slots);
+    strings = NULL;
+    string_slots = NULL;
+    string_count = 0;
+    string_capacity = 0;
+    slot_count = 0;
+
+    for (int i = 0; i < domain_slot_count; i++) {
+        if (domain_slots[i] != NULL) {
+            free(domain_slots[i]->elements);
+            free(domain_slots[i]);
+        }
+    }
+    free(domain_slots);
+    domain_slots = NULL;
+    domain_count = 0;
+    domain_slot_count = 0;
+    pthread_mutex_unlock(&intern_lock);
+}
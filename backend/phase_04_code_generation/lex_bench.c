@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "ast.h"
+#include "parser.h"
+
+/*
+ * Lexing throughput. A file is scanned to the end without parsing: read
+ * through a stdio stream into the scanner's own buffer, mapped and scanned
+ * in place by Flex, and mapped and scanned by the hand-written scanner. The
+ * best rate of each over several runs is printed in MB/s.
+ */
+
+enum { STREAM, MAPPED, FAST, MODES };
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Scan the file once; returns the seconds taken and sets the token count */
+static double time_scan(const char* filename, int mode, long* tokens) {
+    double start = now();
+    ParseContext* ctx = mode == STREAM ? create_file_parse_context(filename)
+                                       : create_mapped_parse_context(filename);
+    if (ctx == NULL) {
+        fprintf(stderr, "Error: Cannot open file '%s'\n", filename);
+        exit(1);
+    }
+    if (mode == FAST) {
+        use_fast_lexer(ctx);
+    }
+
+    *tokens = scan_tokens(ctx);
+    free_parse_context(ctx);
+    return now() - start;
+}
+
+int main(int argc, char* argv[]) {
+    int runs = argc > 2 ? atoi(argv[2]) : 3;
+    if (argc < 2 || argc > 3 || runs < 1) {
+        fprintf(stderr, "Usage: %s <input_file> [<runs>]\n", argv[0]);
+        return 1;
+    }
+
+    struct stat info;
+    if (stat(argv[1], &info) != 0) {
+        fprintf(stderr, "Error: Cannot open file '%s'\n", argv[1]);
+        return 1;
+    }
+    double megabytes = info.st_size / (1024.0 * 1024.0);
+
+    const char* names[MODES] = { "stream", "mapped", "fast" };
+    long tokens[MODES] = { 0, 0, 0 };
+    for (int mode = 0; mode < MODES; mode++) {
+        double best = 0;
+        for (int run = 0; run < runs; run++) {
+            double seconds = time_scan(argv[1], mode, &tokens[mode]);
+            if (run == 0 || seconds < best) {
+                best = seconds;
+            }
+        }
+        if (mode == STREAM) {
+            printf("Input: %s, %.1f MB, %ld tokens\n", argv[1], megabytes, tokens[STREAM]);
+        }
+        printf("%s: %.3f s, %.1f MB/s\n", names[mode], best, megabytes / (best > 1e-9 ? best : 1e-9));
+    }
+    free_interned();
+
+    if (tokens[STREAM] != tokens[MAPPED] || tokens[STREAM] != tokens[FAST]) {
+        printf("Token counts differ: %ld read through a stream, %ld mapped, %ld by the fast scanner\n",
+               tokens[STREAM], tokens[MAPPED], tokens[FAST]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include "ast.h"
+#include "parser.h"
+#include "fast_lexer.h"
+
+/*
+ * Scanner equivalence check. Random inputs built from keywords in any case,
+ * identifiers, operators and their prefixes, both kinds of comment (closed
+ * or not), every kind of line break and stray bytes are scanned by the Flex
+ * scanner and by the hand-written one. Each must give the same tokens and
+ * values, the same span for every token and the same diagnostics.
+ */
+
+/* Growable text buffer */
+typedef struct {
+    char* text;
+    size_t length;
+    size_t capacity;
+} Buffer;
+
+static void append(Buffer* buffer, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+static void append(Buffer* buffer, const char* format, ...) {
+    va_list args;
+    for (;;) {
+        size_t room = buffer->capacity - buffer->length;
+        va_start(args, format);
+        int needed = vsnprintf(buffer->text + buffer->length, room, format, args);
+        va_end(args);
+        if ((size_t)needed < room) {
+            buffer->length += needed;
+            return;
+        }
+        buffer->capacity = (buffer->capacity + needed) * 2;
+        buffer->text = (char*)realloc(buffer->text, buffer->capacity);
+    }
+}
+
+/* Small generator so a run can be repeated from its seed */
+static unsigned long long random_state;
+
+static unsigned next_random() {
+    random_state = random_state * 6364136223846793005ull + 1442695040888963407ull;
+    return (unsigned)(random_state >> 33);
+}
+
+static const char* fragments[] = {
+    "x", "y1", "abc_def", "a9", "P", "Pred_2", "Q", "forallx", "trueish", "Falsey",
+    "/\\", "\\/", "~", "->", "<->", "<-", "<", "-", "^", "(", ")", "[", "]", ",",
+    "/", "\\", "*", "**", "*/", "/*/", "/**/", "//", "_", "9", "#", "@",
+    " ", "\t", "\n", "\r", "\r\n", "\n\r", "  \t  ",
+};
+
+static const char* keywords[] = { "forall", "exists", "true", "false" };
+
+/* Append a piece of input chosen at random */
+static void add_fragment(Buffer* buffer) {
+    unsigned choice = next_random() % 16;
+    if (choice < 8) {
+        append(buffer, "%s", fragments[next_random() % (sizeof(fragments) / sizeof(fragments[0]))]);
+    } else if (choice < 10) {
+        /* A keyword with each letter in either case */
+        const char* keyword = keywords[next_random() % 4];
+        for (const char* c = keyword; *c; c++) {
+            append(buffer, "%c", next_random() % 2 ? *c - 'a' + 'A' : *c);
+        }
+    } else if (choice < 11) {
+        /* An identifier longer than the limit, or just at it */
+        int length = next_random() % 2 ? 64 : 65 + next_random() % 40;
+        append(buffer, "%c", next_random() % 2 ? 'v' : 'V');
+        for (int i = 1; i < length; i++) {
+            append(buffer, "%c", "az_09QZ"[next_random() % 7]);
+        }
+    } else if (choice < 13) {
+        /* A run of blanks and line breaks, long enough to fill several blocks */
+        int length = next_random() % 100;
+        for (int i = 0; i < length; i++) {
+            append(buffer, "%s", (const char*[]){ " ", " ", " ", "\t", "\n", "\r", "\r\n" }[next_random() % 7]);
+        }
+    } else if (choice < 15) {
+        /* A comment whose body has stars, slashes and line breaks */
+        bool block = next_random() % 3 != 0;
+        append(buffer, block ? "/*" : "//");
+        int length = next_random() % 120;
+        for (int i = 0; i < length; i++) {
+            append(buffer, "%s", (const char*[]){ " ", "a", "*", "/", "\n", "\r", "x y", "**" }[next_random() % 8]);
+        }
+        if (block && next_random() % 8 != 0) {
+            append(buffer, "*/");
+        }
+    } else {
+        /* Any byte but NUL, which Flex treats as the end of a string */
+        append(buffer, "%c", (char)(1 + next_random() % 255));
+    }
+}
+
+static char* make_input(size_t* length) {
+    Buffer buffer = { (char*)malloc(256), 0, 256 };
+    buffer.text[0] = '\0';
+    int pieces = next_random() % 200;
+    for (int i = 0; i < pieces; i++) {
+        add_fragment(&buffer);
+    }
+    *length = buffer.length;
+    return buffer.text;
+}
+
+/*
+ * Scan the input with one scanner and describe every token, its value and its
+ * span, followed by whatever the scanner wrote to stderr, which
+ * is sent to the file open as diagnostics while it runs.
+ */
+static char* describe_scan(const char* input, bool fast, int diagnostics) {
+    Buffer buffer = { (char*)malloc(1024), 0, 1024 };
+    buffer.text[0] = '\0';
+
+    ParseContext* ctx = create_string_parse_context(input);
+    if (fast && !use_fast_lexer(ctx)) {
+        append(&buffer, "no fast scanner\n");
+    }
+
+    fflush(stderr);
+    int saved = dup(STDERR_FILENO);
+    dup2(diagnostics, STDERR_FILENO);
+    YYSTYPE value;
+    SourceSpan span;
+    int token;
+    while ((token = next_token(ctx, &value, &span)) != 0) {
+        append(&buffer, "%d", token);
+        if (token == VARIABLE || token == PREDICATE) {
+            append(&buffer, " %s", interned_string(value.id));
+        } else if (token == TRUE_VAL || token == FALSE_VAL) {
+            append(&buffer, " %d", value.bool_val);
+        }
+        append(&buffer, " %d:%d-%d:%d [%zu, %zu)\n", span.first_line, span.first_column,
+               span.last_line, span.last_column, span.start, span.end);
+    }
+    append(&buffer, "end @%d:%d\n", ctx->line_num, ctx->col_num);
+    fflush(stderr);
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+    free_parse_context(ctx);
+
+    off_t size = lseek(diagnostics, 0, SEEK_CUR);
+    char* written = (char*)malloc(size + 1);
+    ssize_t got = pread(diagnostics, written, size, 0);
+    written[got > 0 ? got : 0] = '\0';
+    append(&buffer, "%s", written);
+    free(written);
+    lseek(diagnostics, 0, SEEK_SET);
+    if (ftruncate(diagnostics, 0) != 0) {
+        perror("ftruncate");
+    }
+    return buffer.text;
+}
+
+/* Print an input with its control characters escaped */
+static void print_input(const char* input, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)input[i];
+        if (c == '\n') {
+            printf("\\n\n");
+        } else if (c < 32 || c >= 127 || c == '\\') {
+            printf("\\x%02x", c);
+        } else {
+            putchar(c);
+        }
+    }
+    printf("\n");
+}
+
+int main(int argc, char* argv[]) {
+    int input_count = argc > 1 ? atoi(argv[1]) : 20000;
+    random_state = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+    if (argc > 3 || input_count < 1) {
+        fprintf(stderr, "Usage: %s [<inputs>] [<seed>]\n", argv[0]);
+        return 1;
+    }
+
+    FILE* diagnostics_file = tmpfile();
+    if (diagnostics_file == NULL) {
+        perror("tmpfile");
+        return 1;
+    }
+    int diagnostics = fileno(diagnostics_file);
+
+    int mismatches = 0;
+    for (int k = 0; k < input_count; k++) {
+        size_t length;
+        char* input = make_input(&length);
+        char* expected = describe_scan(input, false, diagnostics);
+        char* actual = describe_scan(input, true, diagnostics);
+        if (strcmp(expected, actual) != 0) {
+            if (mismatches == 0) {
+                printf("Input %d scanned differently:\n", k);
+                print_input(input, length);
+                printf("----- Flex -----\n%s----- hand-written -----\n%s", expected, actual);
+            }
+            mismatches++;
+        }
+        free(expected);
+        free(actual);
+        free(input);
+    }
+    fclose(diagnostics_file);
+    free_interned();
+
+    if (mismatches > 0) {
+        printf("%d of %d random inputs scanned differently (%d-byte blocks)\n",
+               mismatches, input_count, fast_lexer_block_size());
+        return 1;
+    }
+    printf("%d random inputs scanned alike by both scanners (%d-byte blocks)\n",
+           input_count, fast_lexer_block_size());
+    return 0;
+}
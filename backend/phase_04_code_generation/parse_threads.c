@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include "ast.h"
+#include "parser.h"
+
+/*
+ * Concurrent parsing test. Many threads parse generated inputs at the same
+ * time, each with its own parse context, and every AST is compared against
+ * the one produced for the same input by a single-threaded parse afterwards.
+ */
+
+/* Growable text buffer */
+typedef struct {
+    char* text;
+    size_t length;
+    size_t capacity;
+} Buffer;
+
+static void append(Buffer* buffer, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+static void append(Buffer* buffer, const char* format, ...) {
+    va_list args;
+    for (;;) {
+        size_t room = buffer->capacity - buffer->length;
+        va_start(args, format);
+        int needed = vsnprintf(buffer->text + buffer->length, room, format, args);
+        va_end(args);
+        if ((size_t)needed < room) {
+            buffer->length += needed;
+            return;
+        }
+        buffer->capacity = (buffer->capacity + needed) * 2;
+        buffer->text = (char*)realloc(buffer->text, buffer->capacity);
+    }
+}
+
+/* Source of input number k: its shape, names and line breaks all depend on k */
+static char* make_input(int k) {
+    Buffer buffer = { (char*)malloc(256), 0, 256 };
+    buffer.text[0] = '\0';
+    int formulas = 1 + k % 4;
+
+    for (int f = 0; f < formulas; f++) {
+        switch ((k + f) % 4) {
+            case 0:
+                append(&buffer, "forall x [a%d, b, c%d] (P%d(x, y%d) -> ~Q(x))\n", k, f, k % 7, k);
+                break;
+            case 1:
+                append(&buffer, "exists y [d%d]\n  (R(y, z%d) /\\ S%d(y)) \\/ v%d\n", k, f, k, k % 5);
+                break;
+            case 2:
+                append(&buffer, "/* formula %d */ (p%d <-> true) ^ ~(q%d -> false)\n", f, k, k);
+                break;
+            default:
+                append(&buffer, "%*sT%d(a, b%d, c) // trailing %d\n", k % 9, "", k, f, k);
+                break;
+        }
+        for (int i = 0; i < k % 3; i++) {
+            append(&buffer, "\n");
+        }
+    }
+    return buffer.text;
+}
+
+/* Text form of an AST: every node with its fields and source position */
+static bool describe_visit(ASTNode* node, VisitStage stage, int depth, void* data) {
+    Buffer* buffer = (Buffer*)data;
+    if (stage != VISIT_ENTER) {
+        return true;
+    }
+
+    append(buffer, "%d@%d:%d ", node->type, node->line, node->column);
+    switch (node->type) {
+        case NODE_BINARY_OP:
+            append(buffer, "op %d", node->data.binary.operator);
+            break;
+        case NODE_UNARY_OP:
+            append(buffer, "op %d", node->data.unary.operator);
+            break;
+        case NODE_QUANTIFIER:
+            append(buffer, "q %d %s [", node->data.quantifier.quantifier,
+                   interned_string(node->data.quantifier.variable));
+            for (int i = 0; i < node->data.quantifier.domain_size; i++) {
+                append(buffer, " %s", interned_string(node->data.quantifier.domain[i]));
+            }
+            append(buffer, " ]");
+            break;
+        case NODE_LITERAL:
+            append(buffer, "%s", node->data.literal.value ? "true" : "false");
+            break;
+        case NODE_VARIABLE:
+            append(buffer, "%s", interned_string(node->data.variable.name));
+            break;
+        case NODE_PREDICATE:
+            append(buffer, "%s(", interned_string(node->data.predicate.name));
+            for (int i = 0; i < node->data.predicate.arg_count; i++) {
+                append(buffer, " %s", interned_string(node->data.predicate.args[i]));
+            }
+            append(buffer, " )");
+            break;
+        case NODE_NARY_OP:
+            append(buffer, "op %d x%d", node->data.nary.operator, node->data.nary.operand_count);
+            break;
+    }
+    append(buffer, "\n");
+    return true;
+}
+
+/* Parse one input and describe its AST and formula list; NULL if parsing failed */
+static char* parse_and_describe(const char* source) {
+    ParseContext* ctx = create_string_parse_context(source);
+    if (parse_input(ctx) != 0 || ctx->root == NULL || ctx->syntax_errors != 0) {
+        free_parse_context(ctx);
+        return NULL;
+    }
+
+    Buffer buffer = { (char*)malloc(1024), 0, 1024 };
+    buffer.text[0] = '\0';
+    append(&buffer, "%d formulas\n", ctx->formula_count);
+    walk_ast(ctx->root, describe_visit, &buffer);
+    free_parse_context(ctx);
+    return buffer.text;
+}
+
+typedef struct {
+    char** sources;
+    char** results;              /* Description of each input, written by its thread */
+    int input_count;
+    int thread_count;
+    int index;                   /* This thread takes inputs index, index + thread_count, ... */
+} Job;
+
+static void* parse_thread(void* data) {
+    Job* job = (Job*)data;
+    for (int k = job->index; k < job->input_count; k += job->thread_count) {
+        job->results[k] = parse_and_describe(job->sources[k]);
+    }
+    return NULL;
+}
+
+int main(int argc, char* argv[]) {
+    int thread_count = argc > 1 ? atoi(argv[1]) : 16;
+    int input_count = argc > 2 ? atoi(argv[2]) : 4096;
+    if (argc > 3 || thread_count < 1 || input_count < 1) {
+        fprintf(stderr, "Usage: %s [<threads>] [<inputs>]\n", argv[0]);
+        return 1;
+    }
+
+    char** sources = (char**)malloc(sizeof(char*) * input_count);
+    char** results = (char**)calloc(input_count, sizeof(char*));
+    for (int k = 0; k < input_count; k++) {
+        sources[k] = make_input(k);
+    }
+
+    /* Parse every input concurrently */
+    pthread_t threads[thread_count];
+    Job jobs[thread_count];
+    for (int t = 0; t < thread_count; t++) {
+        jobs[t] = (Job){ sources, results, input_count, thread_count, t };
+        pthread_create(&threads[t], NULL, parse_thread, &jobs[t]);
+    }
+    for (int t = 0; t < thread_count; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    /* Parse them again one at a time and compare */
+    int mismatches = 0;
+    for (int k = 0; k < input_count; k++) {
+        char* expected = parse_and_describe(sources[k]);
+        if (expected == NULL || results[k] == NULL || strcmp(expected, results[k]) != 0) {
+            if (mismatches == 0) {
+                fprintf(stderr, "Input %d parsed differently on a thread:\n%s\n", k, sources[k]);
+            }
+            mismatches++;
+        }
+        free(expected);
+        free(results[k]);
+        free(sources[k]);
+    }
+    free(sources);
+    free(results);
+    free_interned();
+
+    if (mismatches > 0) {
+        printf("%d of %d inputs parsed on %d threads gave a different AST\n",
+               mismatches, input_count, thread_count);
+        return 1;
+    }
+    printf("%d inputs parsed on %d threads: all ASTs match\n", input_count, thread_count);
+    return 0;
+}
@@ -55,7 +55,7 @@
 #define YYSKELETON_NAME "yacc.c"
 
 /* Pure parsers.  */
-#define YYPURE 0
+#define YYPURE 2
 
 /* Push parsers.  */
 #define YYPUSH 0
@@ -73,35 +73,36 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "ast.h"
 
-/* External declarations */
-extern int yylex();
-extern int line_num;
-extern int col_num;
-extern FILE* yyin;
-extern char* yytext;
-
-/* Error handling */
-void yyerror(const char* msg);
-int syntax_errors = 0;
-
-/* Root of the AST */
-ASTNode* ast_root = NULL;
-
-/* Forward declarations for helper functions */
-ASTNode* create_binary_op_node(int operator, ASTNode* left, ASTNode* right);
-ASTNode* create_unary_op_node(int operator, ASTNode* operand);
-ASTNode* create_quantifier_node(int quantifier, char* variable, char** domain, int domain_size, ASTNode* expr);
-ASTNode* create_literal_node(bool value);
-ASTNode* create_variable_node(char* name);
-ASTNode* create_predicate_node(char* name, char** args, int arg_count);
-char** create_arg_list(char* arg);
-char** append_to_arg_list(char** arg_list, int curr_size, char* arg);
-char** create_domain_list(char* value);
-char** append_to_domain_list(char** domain_list, int curr_size, char* value);
-
-#line 105 "parser.c"
+/* Let the parser stacks grow on the heap for deeply nested input */
+#define YYMAXDEPTH 10000000
+
+/* Scanned pages of a mapped input are dropped in chunks of this many bytes */
+#define RELEASE_CHUNK (1 << 18)
+
+/* A rule spans from the start of its first symbol to the end of its last */
+#define YYLLOC_DEFAULT(Current, Rhs, N)                                   \
+    do {                                                                  \
+        if (N) {                                                          \
+            (Current).first_line = YYRHSLOC(Rhs, 1).first_line;           \
+            (Current).first_column = YYRHSLOC(Rhs, 1).first_column;       \
+            (Current).start = YYRHSLOC(Rhs, 1).start;                     \
+            (Current).last_line = YYRHSLOC(Rhs, N).last_line;            \
+            (Current).last_column = YYRHSLOC(Rhs, N).last_column;        \
+            (Current).end = YYRHSLOC(Rhs, N).end;                         \
+        } else {                                                          \
+            (Current).first_line = (Current).last_line = YYRHSLOC(Rhs, 0).last_line; \
+            (Current).first_column = (Current).last_column = YYRHSLOC(Rhs, 0).last_column; \
+            (Current).start = (Current).end = YYRHSLOC(Rhs, 0).end;       \
+        }                                                                 \
+    } while (0)
+
+#line 106 "parser.c"
 
 # ifndef YY_CAST
 #  ifdef __cplusplus
@@ -157,19 +158,56 @@ enum yysymbol_kind_t
   YYSYMBOL_binary_op = 25,                 /* binary_op  */
   YYSYMBOL_unary_expr = 26,                /* unary_expr  */
   YYSYMBOL_quant_expr = 27,                /* quant_expr  */
-  YYSYMBOL_quantifier = 28,                /* quantifier  */
-  YYSYMBOL_domain = 29,                    /* domain  */
-  YYSYMBOL_domain_list = 30,               /* domain_list  */
-  YYSYMBOL_atom_expr = 31,                 /* atom_expr  */
-  YYSYMBOL_predicate = 32,                 /* predicate  */
-  YYSYMBOL_arg_list = 33,                  /* arg_list  */
-  YYSYMBOL_variable = 34,                  /* variable  */
-  YYSYMBOL_literal = 35                    /* literal  */
+  YYSYMBOL_28_1 = 28,                      /* @1  */
+  YYSYMBOL_quantifier = 29,                /* quantifier  */
+  YYSYMBOL_domain = 30,                    /* domain  */
+  YYSYMBOL_domain_list = 31,               /* domain_list  */
+  YYSYMBOL_atom_expr = 32,                 /* atom_expr  */
+  YYSYMBOL_predicate = 33,                 /* predicate  */
+  YYSYMBOL_arg_list = 34,                  /* arg_list  */
+  YYSYMBOL_variable = 35,                  /* variable  */
+  YYSYMBOL_literal = 36                    /* literal  */
 };
 typedef enum yysymbol_kind_t yysymbol_kind_t;
 
 
 
+/* Unqualified %code blocks.  */
+#line 171 "parser.y"
+
+#include "fast_lexer.h"
+#include "stats.h"
+
+/* Reentrant scanner interface (see lexer.l); Flex's scanner is named flex_token */
+int flex_token(YYSTYPE* yylval_param, yyscan_t yyscanner);
+int yylex(YYSTYPE* yylval_param, SourceSpan* yylloc_param, yyscan_t yyscanner);
+int yylex_init_extra(ParseContext* extra, yyscan_t* scanner);
+ParseContext* yyget_extra(yyscan_t scanner);
+int yylex_destroy(yyscan_t scanner);
+void yyset_in(FILE* input, yyscan_t scanner);
+char* yyget_text(yyscan_t scanner);
+int yyget_leng(yyscan_t scanner);
+struct yy_buffer_state* yy_scan_buffer(char* base, size_t size, yyscan_t scanner);
+
+void yyerror(SourceSpan* location, yyscan_t scanner, ParseContext* ctx, const char* msg);
+
+static ASTNode* take_formula(ParseContext* ctx, ASTNode* formula, SourceSpan* span);
+static void release_scanned_input(ParseContext* ctx);
+static const char* input_text(ParseContext* ctx, size_t* length);
+
+/* Helper functions for AST construction; nodes are allocated in ctx->arena */
+ASTNode* create_binary_op_node(ParseContext* ctx, int operator, ASTNode* left, ASTNode* right);
+ASTNode* create_unary_op_node(ParseContext* ctx, int operator, ASTNode* operand);
+ASTNode* create_quantifier_node(ParseContext* ctx, int quantifier, InternId variable, Domain* domain, ASTNode* expr);
+ASTNode* create_literal_node(ParseContext* ctx, bool value);
+ASTNode* create_variable_node(ParseContext* ctx, InternId name);
+ASTNode* create_predicate_node(ParseContext* ctx, InternId name, InternId* args, int arg_count);
+IdList create_id_list(InternId value);
+IdList append_to_id_list(IdList list, InternId value);
+IdList create_arg_list(ParseContext* ctx, InternId value);
+IdList append_to_arg_list(ParseContext* ctx, IdList list, InternId value);
+
+#line 211 "parser.c"
 
 #ifdef short
 # undef short
@@ -431,13 +469,15 @@ void free (void *); /* INFRINGES ON USER NAME SPACE */
 
 #if (! defined yyoverflow \
      && (! defined __cplusplus \
-         || (defined YYSTYPE_IS_TRIVIAL && YYSTYPE_IS_TRIVIAL)))
+         || (defined YYLTYPE_IS_TRIVIAL && YYLTYPE_IS_TRIVIAL \
+             && defined YYSTYPE_IS_TRIVIAL && YYSTYPE_IS_TRIVIAL)))
 
 /* A type that is properly aligned for any stack member.  */
 union yyalloc
 {
   yy_state_t yyss_alloc;
   YYSTYPE yyvs_alloc;
+  YYLTYPE yyls_alloc;
 };
 
 /* The size of the maximum gap between one aligned stack and the next.  */
@@ -446,8 +486,9 @@ union yyalloc
 /* The size of an array large to enough to hold all stacks, each with
    N elements.  */
 # define YYSTACK_BYTES(N) \
-     ((N) * (YYSIZEOF (yy_state_t) + YYSIZEOF (YYSTYPE)) \
-      + YYSTACK_GAP_MAXIMUM)
+     ((N) * (YYSIZEOF (yy_state_t) + YYSIZEOF (YYSTYPE) \
+             + YYSIZEOF (YYLTYPE)) \
+      + 2 * YYSTACK_GAP_MAXIMUM)
 
 # define YYCOPY_NEEDED 1
 
@@ -492,16 +533,16 @@ union yyalloc
 /* YYFINAL -- State number of the termination state.  */
 #define YYFINAL  23
 /* YYLAST -- Last index in YYTABLE.  */
-#define YYLAST   39
+#define YYLAST   42
 
 /* YYNTOKENS -- Number of terminals.  */
 #define YYNTOKENS  20
 /* YYNNTS -- Number of nonterminals.  */
-#define YYNNTS  16
+#define YYNNTS  17
 /* YYNRULES -- Number of rules.  */
-#define YYNRULES  33
+#define YYNRULES  34
 /* YYNSTATES -- Number of states.  */
-#define YYNSTATES  50
+#define YYNSTATES  51
 
 /* YYMAXUTOK -- Last valid token kind.  */
 #define YYMAXUTOK   273
@@ -550,12 +591,12 @@ static const yytype_int8 yytranslate[] =
 
 #if YYDEBUG
 /* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
-static const yytype_uint8 yyrline[] =
+static const yytype_int16 yyrline[] =
 {
-       0,    76,    76,    85,    89,    97,   101,   105,   109,   116,
-     123,   124,   125,   126,   127,   131,   138,   145,   146,   150,
-     157,   162,   167,   172,   180,   184,   188,   192,   199,   213,
-     217,   231,   238,   242
+       0,   243,   243,   252,   256,   265,   269,   273,   277,   284,
+     291,   292,   293,   294,   295,   299,   307,   306,   326,   327,
+     331,   338,   342,   346,   350,   357,   361,   365,   369,   376,
+     386,   390,   397,   407,   411
 };
 #endif
 
@@ -575,7 +616,7 @@ static const char *const yytname[] =
   "IMPLIES", "IFF", "XOR", "FORALL", "EXISTS", "TRUE_VAL", "FALSE_VAL",
   "LPAREN", "RPAREN", "LBRACKET", "RBRACKET", "VARIABLE", "PREDICATE",
   "','", "$accept", "program", "expr_list", "expr", "binary_expr",
-  "binary_op", "unary_expr", "quant_expr", "quantifier", "domain",
+  "binary_op", "unary_expr", "quant_expr", "@1", "quantifier", "domain",
   "domain_list", "atom_expr", "predicate", "arg_list", "variable",
   "literal", YY_NULLPTR
 };
@@ -602,10 +643,11 @@ yysymbol_name (yysymbol_kind_t yysymbol)
 static const yytype_int8 yypact[] =
 {
        1,     1,   -43,   -43,   -43,   -43,     1,   -43,    -6,     8,
-       1,    31,   -43,   -43,   -43,    -2,   -43,   -43,   -43,   -43,
-      31,    17,     0,   -43,    31,   -43,   -43,   -43,   -43,   -43,
-       1,     7,   -43,    -3,    12,    31,   -16,     1,     0,   -43,
-       9,    11,    16,    31,   -43,   -16,   -16,   -43,   -43,   -43
+       1,    29,   -43,   -43,   -43,    -2,   -43,   -43,   -43,   -43,
+      29,    17,     0,   -43,    29,   -43,   -43,   -43,   -43,   -43,
+       1,     7,   -43,    -3,    12,    29,   -16,   -43,     0,   -43,
+       9,    11,    18,     1,   -43,   -16,   -16,   -43,    29,   -43,
+     -43
 };
 
 /* YYDEFACT[STATE-NUM] -- Default reduction number in state STATE-NUM.
@@ -613,25 +655,26 @@ static const yytype_int8 yypact[] =
    means the default is an error.  */
 static const yytype_int8 yydefact[] =
 {
-       0,     0,    17,    18,    32,    33,     0,    31,     0,     0,
-       2,     3,     5,     6,     7,     0,     8,    25,    26,    27,
+       0,     0,    18,    19,    33,    34,     0,    32,     0,     0,
+       2,     3,     5,     6,     7,     0,     8,    26,    27,    28,
       15,     0,     0,     1,     4,    10,    11,    12,    13,    14,
-       0,     0,    24,    29,     0,     9,     0,     0,     0,    28,
-      20,    21,     0,    16,    30,     0,     0,    19,    22,    23
+       0,     0,    25,    30,     0,     9,     0,    16,     0,    29,
+      21,    22,     0,     0,    31,     0,     0,    20,    17,    23,
+      24
 };
 
 /* YYPGOTO[NTERM-NUM].  */
 static const yytype_int8 yypgoto[] =
 {
      -43,   -43,   -43,    -1,   -43,   -43,   -43,   -43,   -43,   -43,
-     -42,   -43,   -43,   -11,   -43,   -43
+     -43,   -42,   -43,   -43,   -11,   -43,   -43
 };
 
 /* YYDEFGOTO[NTERM-NUM].  */
 static const yytype_int8 yydefgoto[] =
 {
-       0,     9,    10,    11,    12,    30,    13,    14,    15,    37,
-      42,    16,    17,    34,    18,    19
+       0,     9,    10,    11,    12,    30,    13,    14,    43,    15,
+      37,    42,    16,    17,    34,    18,    19
 };
 
 /* YYTABLE[YYPACT[STATE-NUM]] -- What to do in state STATE-NUM.  If
@@ -639,10 +682,11 @@ static const yytype_int8 yydefgoto[] =
    number is the opposite.  If YYTABLE_NINF, syntax error.  */
 static const yytype_int8 yytable[] =
 {
-      20,    40,    41,    48,    49,    21,     1,    22,    23,    24,
+      20,    40,    41,    49,    50,    21,     1,    22,    23,    24,
        2,     3,     4,     5,     6,    31,    38,    33,     7,     8,
       25,    26,    36,    27,    28,    29,    39,    44,    45,    35,
-      46,    32,    47,     0,    25,    26,    43,    27,    28,    29
+      46,    32,    25,    26,    47,    27,    28,    29,     0,     0,
+       0,     0,    48
 };
 
 static const yytype_int8 yycheck[] =
@@ -650,7 +694,8 @@ static const yytype_int8 yycheck[] =
        1,    17,    18,    45,    46,     6,     5,    13,     0,    10,
        9,    10,    11,    12,    13,    17,    19,    17,    17,    18,
        3,     4,    15,     6,     7,     8,    14,    38,    19,    30,
-      19,    14,    16,    -1,     3,     4,    37,     6,     7,     8
+      19,    14,     3,     4,    16,     6,     7,     8,    -1,    -1,
+      -1,    -1,    43
 };
 
 /* YYSTOS[STATE-NUM] -- The symbol kind of the accessing symbol of
@@ -658,28 +703,29 @@ static const yytype_int8 yycheck[] =
 static const yytype_int8 yystos[] =
 {
        0,     5,     9,    10,    11,    12,    13,    17,    18,    21,
-      22,    23,    24,    26,    27,    28,    31,    32,    34,    35,
+      22,    23,    24,    26,    27,    29,    32,    33,    35,    36,
       23,    23,    13,     0,    23,     3,     4,     6,     7,     8,
-      25,    17,    14,    17,    33,    23,    15,    29,    19,    14,
-      17,    18,    30,    23,    33,    19,    19,    16,    30,    30
+      25,    17,    14,    17,    34,    23,    15,    30,    19,    14,
+      17,    18,    31,    28,    34,    19,    19,    16,    23,    31,
+      31
 };
 
 /* YYR1[RULE-NUM] -- Symbol kind of the left-hand side of rule RULE-NUM.  */
 static const yytype_int8 yyr1[] =
 {
        0,    20,    21,    22,    22,    23,    23,    23,    23,    24,
-      25,    25,    25,    25,    25,    26,    27,    28,    28,    29,
-      30,    30,    30,    30,    31,    31,    31,    31,    32,    33,
-      33,    34,    35,    35
+      25,    25,    25,    25,    25,    26,    28,    27,    29,    29,
+      30,    31,    31,    31,    31,    32,    32,    32,    32,    33,
+      34,    34,    35,    36,    36
 };
 
 /* YYR2[RULE-NUM] -- Number of symbols on the right-hand side of rule RULE-NUM.  */
 static const yytype_int8 yyr2[] =
 {
        0,     2,     1,     1,     2,     1,     1,     1,     1,     3,
-       1,     1,     1,     1,     1,     2,     4,     1,     1,     3,
-       1,     1,     3,     3,     3,     1,     1,     1,     4,     1,
-       3,     1,     1,     1
+       1,     1,     1,     1,     1,     2,     0,     5,     1,     1,
+       3,     1,     1,     3,     3,     3,     1,     1,     1,     4,
+       1,     3,     1,     1,     1
 };
 
 
@@ -708,7 +754,7 @@ enum { YYENOMEM = -2 };
       }                                                           \
     else                                                          \
       {                                                           \
-        yyerror (YY_("syntax error: cannot back up")); \
+        yyerror (&yylloc, scanner, ctx, YY_("syntax error: cannot back up")); \
         YYERROR;                                                  \
       }                                                           \
   while (0)
@@ -717,6 +763,32 @@ enum { YYENOMEM = -2 };
    Use YYerror or YYUNDEF. */
 #define YYERRCODE YYUNDEF
 
+/* YYLLOC_DEFAULT -- Set CURRENT to span from RHS[1] to RHS[N].
+   If N is 0, then set CURRENT to the empty location which ends
+   the previous symbol: RHS[0] (always defined).  */
+
+#ifndef YYLLOC_DEFAULT
+# define YYLLOC_DEFAULT(Current, Rhs, N)                                \
+    do                                                                  \
+      if (N)                                                            \
+        {                                                               \
+          (Current).first_line   = YYRHSLOC (Rhs, 1).first_line;        \
+          (Current).first_column = YYRHSLOC (Rhs, 1).first_column;      \
+          (Current).last_line    = YYRHSLOC (Rhs, N).last_line;         \
+          (Current).last_column  = YYRHSLOC (Rhs, N).last_column;       \
+        }                                                               \
+      else                                                              \
+        {                                                               \
+          (Current).first_line   = (Current).last_line   =              \
+            YYRHSLOC (Rhs, 0).last_line;                                \
+          (Current).first_column = (Current).last_column =              \
+            YYRHSLOC (Rhs, 0).last_column;                              \
+        }                                                               \
+    while (0)
+#endif
+
+#define YYRHSLOC(Rhs, K) ((Rhs)[K])
+
 
 /* Enable debugging if requested.  */
 #if YYDEBUG
@@ -733,6 +805,63 @@ do {                                            \
 } while (0)
 
 
+/* YYLOCATION_PRINT -- Print the location on the stream.
+   This macro was not mandated originally: define only if we know
+   we won't break user code: when these are the locations we know.  */
+
+# ifndef YYLOCATION_PRINT
+
+#  if defined YY_LOCATION_PRINT
+
+   /* Temporary convenience wrapper in case some people defined the
+      undocumented and private YY_LOCATION_PRINT macros.  */
+#   define YYLOCATION_PRINT(File, Loc)  YY_LOCATION_PRINT(File, *(Loc))
+
+#  elif defined YYLTYPE_IS_TRIVIAL && YYLTYPE_IS_TRIVIAL
+
+/* Print *YYLOCP on YYO.  Private, do not rely on its existence. */
+
+YY_ATTRIBUTE_UNUSED
+static int
+yy_location_print_ (FILE *yyo, YYLTYPE const * const yylocp)
+{
+  int res = 0;
+  int end_col = 0 != yylocp->last_column ? yylocp->last_column - 1 : 0;
+  if (0 <= yylocp->first_line)
+    {
+      res += YYFPRINTF (yyo, "%d", yylocp->first_line);
+      if (0 <= yylocp->first_column)
+        res += YYFPRINTF (yyo, ".%d", yylocp->first_column);
+    }
+  if (0 <= yylocp->last_line)
+    {
+      if (yylocp->first_line < yylocp->last_line)
+        {
+          res += YYFPRINTF (yyo, "-%d", yylocp->last_line);
+          if (0 <= end_col)
+            res += YYFPRINTF (yyo, ".%d", end_col);
+        }
+      else if (0 <= end_col && yylocp->first_column < end_col)
+        res += YYFPRINTF (yyo, "-%d", end_col);
+    }
+  return res;
+}
+
+#   define YYLOCATION_PRINT  yy_location_print_
+
+    /* Temporary convenience wrapper in case some people defined the
+       undocumented and private YY_LOCATION_PRINT macros.  */
+#   define YY_LOCATION_PRINT(File, Loc)  YYLOCATION_PRINT(File, &(Loc))
+
+#  else
+
+#   define YYLOCATION_PRINT(File, Loc) ((void) 0)
+    /* Temporary convenience wrapper in case some people defined the
+       undocumented and private YY_LOCATION_PRINT macros.  */
+#   define YY_LOCATION_PRINT  YYLOCATION_PRINT
+
+#  endif
+# endif /* !defined YYLOCATION_PRINT */
 
 
 # define YY_SYMBOL_PRINT(Title, Kind, Value, Location)                    \
@@ -741,7 +870,7 @@ do {                                                                      \
     {                                                                     \
       YYFPRINTF (stderr, "%s ", Title);                                   \
       yy_symbol_print (stderr,                                            \
-                  Kind, Value); \
+                  Kind, Value, Location, scanner, ctx); \
       YYFPRINTF (stderr, "\n");                                           \
     }                                                                     \
 } while (0)
@@ -753,10 +882,13 @@ do {                                                                      \
 
 static void
 yy_symbol_value_print (FILE *yyo,
-                       yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep)
+                       yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep, YYLTYPE const * const yylocationp, yyscan_t scanner, ParseContext* ctx)
 {
   FILE *yyoutput = yyo;
   YY_USE (yyoutput);
+  YY_USE (yylocationp);
+  YY_USE (scanner);
+  YY_USE (ctx);
   if (!yyvaluep)
     return;
   YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
@@ -771,12 +903,14 @@ yy_symbol_value_print (FILE *yyo,
 
 static void
 yy_symbol_print (FILE *yyo,
-                 yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep)
+                 yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep, YYLTYPE const * const yylocationp, yyscan_t scanner, ParseContext* ctx)
 {
   YYFPRINTF (yyo, "%s %s (",
              yykind < YYNTOKENS ? "token" : "nterm", yysymbol_name (yykind));
 
-  yy_symbol_value_print (yyo, yykind, yyvaluep);
+  YYLOCATION_PRINT (yyo, yylocationp);
+  YYFPRINTF (yyo, ": ");
+  yy_symbol_value_print (yyo, yykind, yyvaluep, yylocationp, scanner, ctx);
   YYFPRINTF (yyo, ")");
 }
 
@@ -809,8 +943,8 @@ do {                                                            \
 `------------------------------------------------*/
 
 static void
-yy_reduce_print (yy_state_t *yyssp, YYSTYPE *yyvsp,
-                 int yyrule)
+yy_reduce_print (yy_state_t *yyssp, YYSTYPE *yyvsp, YYLTYPE *yylsp,
+                 int yyrule, yyscan_t scanner, ParseContext* ctx)
 {
   int yylno = yyrline[yyrule];
   int yynrhs = yyr2[yyrule];
@@ -823,7 +957,8 @@ yy_reduce_print (yy_state_t *yyssp, YYSTYPE *yyvsp,
       YYFPRINTF (stderr, "   $%d = ", yyi + 1);
       yy_symbol_print (stderr,
                        YY_ACCESSING_SYMBOL (+yyssp[yyi + 1 - yynrhs]),
-                       &yyvsp[(yyi + 1) - (yynrhs)]);
+                       &yyvsp[(yyi + 1) - (yynrhs)],
+                       &(yylsp[(yyi + 1) - (yynrhs)]), scanner, ctx);
       YYFPRINTF (stderr, "\n");
     }
 }
@@ -831,7 +966,7 @@ yy_reduce_print (yy_state_t *yyssp, YYSTYPE *yyvsp,
 # define YY_REDUCE_PRINT(Rule)          \
 do {                                    \
   if (yydebug)                          \
-    yy_reduce_print (yyssp, yyvsp, Rule); \
+    yy_reduce_print (yyssp, yyvsp, yylsp, Rule, scanner, ctx); \
 } while (0)
 
 /* Nonzero means print parse trace.  It is left uninitialized so that
@@ -872,26 +1007,38 @@ int yydebug;
 
 static void
 yydestruct (const char *yymsg,
-            yysymbol_kind_t yykind, YYSTYPE *yyvaluep)
+            yysymbol_kind_t yykind, YYSTYPE *yyvaluep, YYLTYPE *yylocationp, yyscan_t scanner, ParseContext* ctx)
 {
   YY_USE (yyvaluep);
+  YY_USE (yylocationp);
+  YY_USE (scanner);
+  YY_USE (ctx);
   if (!yymsg)
     yymsg = "Deleting";
   YY_SYMBOL_PRINT (yymsg, yykind, yyvaluep, yylocationp);
 
   YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
-  YY_USE (yykind);
+  switch (yykind)
+    {
+    case YYSYMBOL_domain: /* domain  */
+#line 227 "parser.y"
+            { free(((*yyvaluep).id_list).list); }
+#line 1027 "parser.c"
+        break;
+
+    case YYSYMBOL_domain_list: /* domain_list  */
+#line 227 "parser.y"
+            { free(((*yyvaluep).id_list).list); }
+#line 1033 "parser.c"
+        break;
+
+      default:
+        break;
+    }
   YY_IGNORE_MAYBE_UNINITIALIZED_END
 }
 
 
-/* Lookahead token kind.  */
-int yychar;
-
-/* The semantic value of the lookahead symbol.  */
-YYSTYPE yylval;
-/* Number of syntax errors so far.  */
-int yynerrs;
 
 
 
@@ -901,8 +1048,29 @@ int yynerrs;
 `----------*/
 
 int
-yyparse (void)
+yyparse (yyscan_t scanner, ParseContext* ctx)
 {
+/* Lookahead token kind.  */
+int yychar;
+
+
+/* The semantic value of the lookahead symbol.  */
+/* Default value used for initialization, for pacifying older GCCs
+   or non-GCC compilers.  */
+YY_INITIAL_VALUE (static YYSTYPE yyval_default;)
+YYSTYPE yylval YY_INITIAL_VALUE (= yyval_default);
+
+/* Location data for the lookahead symbol.  */
+static YYLTYPE yyloc_default
+# if defined YYLTYPE_IS_TRIVIAL && YYLTYPE_IS_TRIVIAL
+  = { 1, 1, 1, 1 }
+# endif
+;
+YYLTYPE yylloc = yyloc_default;
+
+    /* Number of syntax errors so far.  */
+    int yynerrs = 0;
+
     yy_state_fast_t yystate = 0;
     /* Number of tokens to shift before error messages enabled.  */
     int yyerrstatus = 0;
@@ -923,6 +1091,11 @@ yyparse (void)
     YYSTYPE *yyvs = yyvsa;
     YYSTYPE *yyvsp = yyvs;
 
+    /* The location stack: array, bottom, top.  */
+    YYLTYPE yylsa[YYINITDEPTH];
+    YYLTYPE *yyls = yylsa;
+    YYLTYPE *yylsp = yyls;
+
   int yyn;
   /* The return value of yyparse.  */
   int yyresult;
@@ -931,10 +1104,14 @@ yyparse (void)
   /* The variables used to return semantic value and location from the
      action routines.  */
   YYSTYPE yyval;
+  YYLTYPE yyloc;
 
+  /* The locations where the error started and ended.  */
+  YYLTYPE yyerror_range[3];
 
 
-#define YYPOPSTACK(N)   (yyvsp -= (N), yyssp -= (N))
+
+#define YYPOPSTACK(N)   (yyvsp -= (N), yyssp -= (N), yylsp -= (N))
 
   /* The number of symbols on the RHS of the reduced rule.
      Keep to zero when no symbol should be popped.  */
@@ -944,6 +1121,7 @@ yyparse (void)
 
   yychar = YYEMPTY; /* Cause a token to be read.  */
 
+  yylsp[0] = yylloc;
   goto yysetstate;
 
 
@@ -982,6 +1160,7 @@ yysetstate:
            memory.  */
         yy_state_t *yyss1 = yyss;
         YYSTYPE *yyvs1 = yyvs;
+        YYLTYPE *yyls1 = yyls;
 
         /* Each stack pointer address is followed by the size of the
            data in use in that stack, in bytes.  This used to be a
@@ -990,9 +1169,11 @@ yysetstate:
         yyoverflow (YY_("memory exhausted"),
                     &yyss1, yysize * YYSIZEOF (*yyssp),
                     &yyvs1, yysize * YYSIZEOF (*yyvsp),
+                    &yyls1, yysize * YYSIZEOF (*yylsp),
                     &yystacksize);
         yyss = yyss1;
         yyvs = yyvs1;
+        yyls = yyls1;
       }
 # else /* defined YYSTACK_RELOCATE */
       /* Extend the stack our own way.  */
@@ -1011,6 +1192,7 @@ yysetstate:
           YYNOMEM;
         YYSTACK_RELOCATE (yyss_alloc, yyss);
         YYSTACK_RELOCATE (yyvs_alloc, yyvs);
+        YYSTACK_RELOCATE (yyls_alloc, yyls);
 #  undef YYSTACK_RELOCATE
         if (yyss1 != yyssa)
           YYSTACK_FREE (yyss1);
@@ -1019,6 +1201,7 @@ yysetstate:
 
       yyssp = yyss + yysize - 1;
       yyvsp = yyvs + yysize - 1;
+      yylsp = yyls + yysize - 1;
 
       YY_IGNORE_USELESS_CAST_BEGIN
       YYDPRINTF ((stderr, "Stack size increased to %ld\n",
@@ -1055,7 +1238,7 @@ yybackup:
   if (yychar == YYEMPTY)
     {
       YYDPRINTF ((stderr, "Reading a token\n"));
-      yychar = yylex ();
+      yychar = yylex (&yylval, &yylloc, scanner);
     }
 
   if (yychar <= YYEOF)
@@ -1072,6 +1255,7 @@ yybackup:
          loop in error recovery. */
       yychar = YYUNDEF;
       yytoken = YYSYMBOL_YYerror;
+      yyerror_range[1] = yylloc;
       goto yyerrlab1;
     }
   else
@@ -1105,6 +1289,7 @@ yybackup:
   YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
   *++yyvsp = yylval;
   YY_IGNORE_MAYBE_UNINITIALIZED_END
+  *++yylsp = yylloc;
 
   /* Discard the shifted token.  */
   yychar = YYEMPTY;
@@ -1138,275 +1323,283 @@ yyreduce:
      GCC warning that YYVAL may be used uninitialized.  */
   yyval = yyvsp[1-yylen];
 
-
+  /* Default location. */
+  YYLLOC_DEFAULT (yyloc, (yylsp - yylen), yylen);
+  yyerror_range[1] = yyloc;
   YY_REDUCE_PRINT (yyn);
   switch (yyn)
     {
   case 2: /* program: expr_list  */
-#line 77 "parser.y"
+#line 244 "parser.y"
         {
             /* In case of multiple expressions, use the first one as the root */
-            ast_root = (yyvsp[0].node);
+            ctx->root = (yyvsp[0].node);
             (yyval.node) = (yyvsp[0].node);
         }
-#line 1153 "parser.c"
+#line 1340 "parser.c"
     break;
 
   case 3: /* expr_list: expr  */
-#line 86 "parser.y"
+#line 253 "parser.y"
         {
-            (yyval.node) = (yyvsp[0].node);
+            (yyval.node) = take_formula(ctx, (yyvsp[0].node), &(yylsp[0]));
         }
-#line 1161 "parser.c"
+#line 1348 "parser.c"
     break;
 
   case 4: /* expr_list: expr_list expr  */
-#line 90 "parser.y"
+#line 257 "parser.y"
         {
+            ASTNode* formula = take_formula(ctx, (yyvsp[0].node), &(yylsp[0]));
             /* Create a binary op node to combine expressions with implicit AND */
-            (yyval.node) = create_binary_op_node(AND, (yyvsp[-1].node), (yyvsp[0].node));
+            (yyval.node) = formula != NULL ? create_binary_op_node(ctx, AND, (yyvsp[-1].node), formula) : NULL;
         }
-#line 1170 "parser.c"
+#line 1358 "parser.c"
     break;
 
   case 5: /* expr: binary_expr  */
-#line 98 "parser.y"
+#line 266 "parser.y"
         {
             (yyval.node) = (yyvsp[0].node);
         }
-#line 1178 "parser.c"
+#line 1366 "parser.c"
     break;
 
   case 6: /* expr: unary_expr  */
-#line 102 "parser.y"
+#line 270 "parser.y"
         {
             (yyval.node) = (yyvsp[0].node);
         }
-#line 1186 "parser.c"
+#line 1374 "parser.c"
     break;
 
   case 7: /* expr: quant_expr  */
-#line 106 "parser.y"
+#line 274 "parser.y"
         {
             (yyval.node) = (yyvsp[0].node);
         }
-#line 1194 "parser.c"
+#line 1382 "parser.c"
     break;
 
   case 8: /* expr: atom_expr  */
-#line 110 "parser.y"
+#line 278 "parser.y"
         {
             (yyval.node) = (yyvsp[0].node);
         }
-#line 1202 "parser.c"
+#line 1390 "parser.c"
     break;
 
   case 9: /* binary_expr: expr binary_op expr  */
-#line 117 "parser.y"
+#line 285 "parser.y"
         {
-            (yyval.node) = create_binary_op_node((yyvsp[-1].token), (yyvsp[-2].node), (yyvsp[0].node));
+            (yyval.node) = create_binary_op_node(ctx, (yyvsp[-1].token), (yyvsp[-2].node), (yyvsp[0].node));
         }
-#line 1210 "parser.c"
+#line 1398 "parser.c"
     break;
 
   case 10: /* binary_op: AND  */
-#line 123 "parser.y"
+#line 291 "parser.y"
                { (yyval.token) = AND; }
-#line 1216 "parser.c"
+#line 1404 "parser.c"
     break;
 
   case 11: /* binary_op: OR  */
-#line 124 "parser.y"
+#line 292 "parser.y"
                { (yyval.token) = OR; }
-#line 1222 "parser.c"
+#line 1410 "parser.c"
     break;
 
   case 12: /* binary_op: IMPLIES  */
-#line 125 "parser.y"
+#line 293 "parser.y"
                { (yyval.token) = IMPLIES; }
-#line 1228 "parser.c"
+#line 1416 "parser.c"
     break;
 
   case 13: /* binary_op: IFF  */
-#line 126 "parser.y"
+#line 294 "parser.y"
                { (yyval.token) = IFF; }
-#line 1234 "parser.c"
+#line 1422 "parser.c"
     break;
 
   case 14: /* binary_op: XOR  */
-#line 127 "parser.y"
+#line 295 "parser.y"
                { (yyval.token) = XOR; }
-#line 1240 "parser.c"
+#line 1428 "parser.c"
     break;
 
   case 15: /* unary_expr: NOT expr  */
-#line 132 "parser.y"
+#line 300 "parser.y"
         {
-            (yyval.node) = create_unary_op_node(NOT, (yyvsp[0].node));
+            (yyval.node) = create_unary_op_node(ctx, NOT, (yyvsp[0].node));
+        }
+#line 1436 "parser.c"
+    break;
+
+  case 16: /* @1: %empty  */
+#line 307 "parser.y"
+        {
+            /* The interner takes over the domain list before the body is
+               parsed, so fused analysis can bind the variable to it */
+            (yyval.domain) = intern_domain_owned((yyvsp[0].id_list).list, (yyvsp[0].id_list).size);
+            (yyvsp[0].id_list).list = NULL;
+            if (ctx->actions != NULL) {
+                ctx->actions->enter_quantifier((yyvsp[-1].id), (yyval.domain)->elements, (yyval.domain)->size, ctx->action_data);
+            }
         }
-#line 1248 "parser.c"
+#line 1450 "parser.c"
     break;
 
-  case 16: /* quant_expr: quantifier VARIABLE domain expr  */
-#line 139 "parser.y"
+  case 17: /* quant_expr: quantifier VARIABLE domain @1 expr  */
+#line 317 "parser.y"
         {
-            (yyval.node) = create_quantifier_node((yyvsp[-3].token), (yyvsp[-2].string_val), (yyvsp[-1].domain_info).list, (yyvsp[-1].domain_info).size, (yyvsp[0].node));
+            (yyval.node) = create_quantifier_node(ctx, (yyvsp[-4].token), (yyvsp[-3].id), (yyvsp[-1].domain), (yyvsp[0].node));
+            if (ctx->actions != NULL) {
+                ctx->actions->leave_quantifier((yyval.node), ctx->action_data);
+            }
         }
-#line 1256 "parser.c"
+#line 1461 "parser.c"
     break;
 
-  case 17: /* quantifier: FORALL  */
-#line 145 "parser.y"
+  case 18: /* quantifier: FORALL  */
+#line 326 "parser.y"
                { (yyval.token) = FORALL; }
-#line 1262 "parser.c"
+#line 1467 "parser.c"
     break;
 
-  case 18: /* quantifier: EXISTS  */
-#line 146 "parser.y"
+  case 19: /* quantifier: EXISTS  */
+#line 327 "parser.y"
                { (yyval.token) = EXISTS; }
-#line 1268 "parser.c"
+#line 1473 "parser.c"
     break;
 
-  case 19: /* domain: LBRACKET domain_list RBRACKET  */
-#line 151 "parser.y"
+  case 20: /* domain: LBRACKET domain_list RBRACKET  */
+#line 332 "parser.y"
         {
-            (yyval.domain_info) = (yyvsp[-1].domain_info);
+            (yyval.id_list) = (yyvsp[-1].id_list);
         }
-#line 1276 "parser.c"
+#line 1481 "parser.c"
     break;
 
-  case 20: /* domain_list: VARIABLE  */
-#line 158 "parser.y"
+  case 21: /* domain_list: VARIABLE  */
+#line 339 "parser.y"
         {
-            (yyval.domain_info).list = create_domain_list((yyvsp[0].string_val));
-            (yyval.domain_info).size = 1;
+            (yyval.id_list) = create_id_list((yyvsp[0].id));
         }
-#line 1285 "parser.c"
+#line 1489 "parser.c"
     break;
 
-  case 21: /* domain_list: PREDICATE  */
-#line 163 "parser.y"
+  case 22: /* domain_list: PREDICATE  */
+#line 343 "parser.y"
         {
-            (yyval.domain_info).list = create_domain_list((yyvsp[0].string_val));
-            (yyval.domain_info).size = 1;
+            (yyval.id_list) = create_id_list((yyvsp[0].id));
         }
-#line 1294 "parser.c"
+#line 1497 "parser.c"
     break;
 
-  case 22: /* domain_list: VARIABLE ',' domain_list  */
-#line 168 "parser.y"
+  case 23: /* domain_list: VARIABLE ',' domain_list  */
+#line 347 "parser.y"
         {
-            (yyval.domain_info).list = append_to_domain_list((yyvsp[0].domain_info).list, (yyvsp[0].domain_info).size, (yyvsp[-2].string_val));
-            (yyval.domain_info).size = (yyvsp[0].domain_info).size + 1;
+            (yyval.id_list) = append_to_id_list((yyvsp[0].id_list), (yyvsp[-2].id));
         }
-#line 1303 "parser.c"
+#line 1505 "parser.c"
     break;
 
-  case 23: /* domain_list: PREDICATE ',' domain_list  */
-#line 173 "parser.y"
+  case 24: /* domain_list: PREDICATE ',' domain_list  */
+#line 351 "parser.y"
         {
-            (yyval.domain_info).list = append_to_domain_list((yyvsp[0].domain_info).list, (yyvsp[0].domain_info).size, (yyvsp[-2].string_val));
-            (yyval.domain_info).size = (yyvsp[0].domain_info).size + 1;
+            (yyval.id_list) = append_to_id_list((yyvsp[0].id_list), (yyvsp[-2].id));
         }
-#line 1312 "parser.c"
+#line 1513 "parser.c"
     break;
 
-  case 24: /* atom_expr: LPAREN expr RPAREN  */
-#line 181 "parser.y"
+  case 25: /* atom_expr: LPAREN expr RPAREN  */
+#line 358 "parser.y"
         {
             (yyval.node) = (yyvsp[-1].node);
         }
-#line 1320 "parser.c"
+#line 1521 "parser.c"
     break;
 
-  case 25: /* atom_expr: predicate  */
-#line 185 "parser.y"
+  case 26: /* atom_expr: predicate  */
+#line 362 "parser.y"
         {
             (yyval.node) = (yyvsp[0].node);
         }
-#line 1328 "parser.c"
+#line 1529 "parser.c"
     break;
 
-  case 26: /* atom_expr: variable  */
-#line 189 "parser.y"
+  case 27: /* atom_expr: variable  */
+#line 366 "parser.y"
         {
             (yyval.node) = (yyvsp[0].node);
         }
-#line 1336 "parser.c"
+#line 1537 "parser.c"
     break;
 
-  case 27: /* atom_expr: literal  */
-#line 193 "parser.y"
+  case 28: /* atom_expr: literal  */
+#line 370 "parser.y"
         {
             (yyval.node) = (yyvsp[0].node);
         }
-#line 1344 "parser.c"
+#line 1545 "parser.c"
     break;
 
-  case 28: /* predicate: PREDICATE LPAREN arg_list RPAREN  */
-#line 200 "parser.y"
+  case 29: /* predicate: PREDICATE LPAREN arg_list RPAREN  */
+#line 377 "parser.y"
         {
-            /* Count the number of arguments */
-            int count = 0;
-            char** args_ptr = (yyvsp[-1].string_list);
-            while (args_ptr && *args_ptr) {
-                count++;
-                args_ptr++;
+            (yyval.node) = create_predicate_node(ctx, (yyvsp[-3].id), (yyvsp[-1].args).list, (yyvsp[-1].args).size);
+            if (ctx->actions != NULL) {
+                ctx->actions->atom((yyval.node), ctx->action_data);
             }
-            (yyval.node) = create_predicate_node((yyvsp[-3].string_val), (yyvsp[-1].string_list), count);
         }
-#line 1359 "parser.c"
+#line 1556 "parser.c"
     break;
 
-  case 29: /* arg_list: VARIABLE  */
-#line 214 "parser.y"
+  case 30: /* arg_list: VARIABLE  */
+#line 387 "parser.y"
         {
-            (yyval.string_list) = create_arg_list((yyvsp[0].string_val));
+            (yyval.args) = create_arg_list(ctx, (yyvsp[0].id));
         }
-#line 1367 "parser.c"
+#line 1564 "parser.c"
     break;
 
-  case 30: /* arg_list: VARIABLE ',' arg_list  */
-#line 218 "parser.y"
+  case 31: /* arg_list: VARIABLE ',' arg_list  */
+#line 391 "parser.y"
         {
-            /* Count the number of existing arguments */
-            int count = 0;
-            char** args_ptr = (yyvsp[0].string_list);
-            while (args_ptr && *args_ptr) {
-                count++;
-                args_ptr++;
-            }
-            (yyval.string_list) = append_to_arg_list((yyvsp[0].string_list), count, (yyvsp[-2].string_val));
+            (yyval.args) = append_to_arg_list(ctx, (yyvsp[0].args), (yyvsp[-2].id));
         }
-#line 1382 "parser.c"
+#line 1572 "parser.c"
     break;
 
-  case 31: /* variable: VARIABLE  */
-#line 232 "parser.y"
+  case 32: /* variable: VARIABLE  */
+#line 398 "parser.y"
         {
-            (yyval.node) = create_variable_node((yyvsp[0].string_val));
+            (yyval.node) = create_variable_node(ctx, (yyvsp[0].id));
+            if (ctx->actions != NULL) {
+                ctx->actions->atom((yyval.node), ctx->action_data);
+            }
         }
-#line 1390 "parser.c"
+#line 1583 "parser.c"
     break;
 
-  case 32: /* literal: TRUE_VAL  */
-#line 239 "parser.y"
+  case 33: /* literal: TRUE_VAL  */
+#line 408 "parser.y"
         {
-            (yyval.node) = create_literal_node(true);
+            (yyval.node) = create_literal_node(ctx, true);
         }
-#line 1398 "parser.c"
+#line 1591 "parser.c"
     break;
 
-  case 33: /* literal: FALSE_VAL  */
-#line 243 "parser.y"
+  case 34: /* literal: FALSE_VAL  */
+#line 412 "parser.y"
         {
-            (yyval.node) = create_literal_node(false);
+            (yyval.node) = create_literal_node(ctx, false);
         }
-#line 1406 "parser.c"
+#line 1599 "parser.c"
     break;
 
 
-#line 1410 "parser.c"
+#line 1603 "parser.c"
 
       default: break;
     }
@@ -1427,6 +1620,7 @@ yyreduce:
   yylen = 0;
 
   *++yyvsp = yyval;
+  *++yylsp = yyloc;
 
   /* Now 'shift' the result of the reduction.  Determine what state
      that goes to, based on the state we popped back to and the rule
@@ -1453,9 +1647,10 @@ yyerrlab:
   if (!yyerrstatus)
     {
       ++yynerrs;
-      yyerror (YY_("syntax error"));
+      yyerror (&yylloc, scanner, ctx, YY_("syntax error"));
     }
 
+  yyerror_range[1] = yylloc;
   if (yyerrstatus == 3)
     {
       /* If just tried and failed to reuse lookahead token after an
@@ -1470,7 +1665,7 @@ yyerrlab:
       else
         {
           yydestruct ("Error: discarding",
-                      yytoken, &yylval);
+                      yytoken, &yylval, &yylloc, scanner, ctx);
           yychar = YYEMPTY;
         }
     }
@@ -1524,9 +1719,9 @@ yyerrlab1:
       if (yyssp == yyss)
         YYABORT;
 
-
+      yyerror_range[1] = *yylsp;
       yydestruct ("Error: popping",
-                  YY_ACCESSING_SYMBOL (yystate), yyvsp);
+                  YY_ACCESSING_SYMBOL (yystate), yyvsp, yylsp, scanner, ctx);
       YYPOPSTACK (1);
       yystate = *yyssp;
       YY_STACK_PRINT (yyss, yyssp);
@@ -1536,6 +1731,9 @@ yyerrlab1:
   *++yyvsp = yylval;
   YY_IGNORE_MAYBE_UNINITIALIZED_END
 
+  yyerror_range[2] = yylloc;
+  ++yylsp;
+  YYLLOC_DEFAULT (*yylsp, yyerror_range, 2);
 
   /* Shift the error token.  */
   YY_SYMBOL_PRINT ("Shifting", YY_ACCESSING_SYMBOL (yyn), yyvsp, yylsp);
@@ -1564,7 +1762,7 @@ yyabortlab:
 | yyexhaustedlab -- YYNOMEM (memory exhaustion) comes here.  |
 `-----------------------------------------------------------*/
 yyexhaustedlab:
-  yyerror (YY_("memory exhausted"));
+  yyerror (&yylloc, scanner, ctx, YY_("memory exhausted"));
   yyresult = 2;
   goto yyreturnlab;
 
@@ -1579,7 +1777,7 @@ yyreturnlab:
          user semantic actions for why this is necessary.  */
       yytoken = YYTRANSLATE (yychar);
       yydestruct ("Cleanup: discarding lookahead",
-                  yytoken, &yylval);
+                  yytoken, &yylval, &yylloc, scanner, ctx);
     }
   /* Do not reclaim the symbols of the rule whose action triggered
      this YYABORT or YYACCEPT.  */
@@ -1588,7 +1786,7 @@ yyreturnlab:
   while (yyssp != yyss)
     {
       yydestruct ("Cleanup: popping",
-                  YY_ACCESSING_SYMBOL (+*yyssp), yyvsp);
+                  YY_ACCESSING_SYMBOL (+*yyssp), yyvsp, yylsp, scanner, ctx);
       YYPOPSTACK (1);
     }
 #ifndef yyoverflow
@@ -1599,16 +1797,22 @@ yyreturnlab:
   return yyresult;
 }
 
-#line 248 "parser.y"
+#line 417 "parser.y"
 
 
 /* Error handler for Bison */
-void yyerror(const char* msg) {
-    syntax_errors++;
-    fprintf(stderr, "Error at line %d, column %d: %s\n", line_num, col_num, msg);
+void yyerror(SourceSpan* location, yyscan_t scanner, ParseContext* ctx, const char* msg) {
+    ctx->syntax_errors++;
+    fprintf(stderr, "Error at line %d, column %d: %s\n", ctx->line_num, ctx->col_num, msg);
     
     /* Add more context to the error message */
-    fprintf(stderr, "Near token: '%s'\n", yytext);
+    const char* text = input_text(ctx, NULL);
+    if (text != NULL) {
+        /* The token may have been scanned by the hand-written scanner */
+        fprintf(stderr, "Near token: '%.*s'\n", (int)(location->end - location->start), text + location->start);
+    } else {
+        fprintf(stderr, "Near token: '%s'\n", yyget_text(scanner));
+    }
 }
 
 /* Main function if we're testing the parser directly */
@@ -1625,169 +1829,395 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
-    yyin = input_file;
+    ParseContext* ctx = create_parse_context(input_file);
     
     /* Parse the input */
-    int parse_result = yyparse();
+    int parse_result = parse_input(ctx);
     
     /* Report results */
-    if (parse_result == 0 && syntax_errors == 0) {
+    if (parse_result == 0 && ctx->syntax_errors == 0) {
         printf("Parsing completed successfully.\n");
         
         /* Print the AST if parsing was successful */
         printf("Abstract Syntax Tree:\n");
-        print_ast(ast_root, 0);
-        
-        /* Free the AST */
-        free_ast(ast_root);
+        print_ast(ctx->root, 0);
     } else {
-        printf("Parsing failed with %d errors.\n", syntax_errors);
+        printf("Parsing failed with %d errors.\n", ctx->syntax_errors);
     }
     
+    /* Free the AST */
+    free_parse_context(ctx);
+    free_interned();
     fclose(input_file);
     return parse_result;
 }
 #endif
 
+/* Create a context with a scanner and an empty AST arena */
+static ParseContext* new_parse_context() {
+    ParseContext* ctx = (ParseContext*)calloc(1, sizeof(ParseContext));
+    ctx->arena = create_ast_arena();
+    ctx->line_num = 1;
+    ctx->col_num = 1;
+    yylex_init_extra(ctx, &ctx->scanner);
+    return ctx;
+}
+
+/* Create a context that parses a file */
+ParseContext* create_parse_context(FILE* input) {
+    ParseContext* ctx = new_parse_context();
+    yyset_in(input, ctx->scanner);
+    return ctx;
+}
+
+/* Create a context that parses a copy of a string */
+ParseContext* create_string_parse_context(const char* text) {
+    return create_buffer_parse_context(text, strlen(text));
+}
+
+/*
+ * Create a context that parses a copy of length bytes of text. The copy ends
+ * in the two NUL bytes yy_scan_buffer needs and is kept with the context, so
+ * the fast scanner can read it too.
+ */
+ParseContext* create_buffer_parse_context(const char* text, size_t length) {
+    ParseContext* ctx = new_parse_context();
+    ctx->copied = (char*)malloc(length + 2);
+    memcpy(ctx->copied, text, length);
+    ctx->copied[length] = ctx->copied[length + 1] = '\0';
+    ctx->copied_length = length + 2;
+    yy_scan_buffer(ctx->copied, ctx->copied_length, ctx->scanner);
+    return ctx;
+}
+
+/*
+ * Map a file for yy_scan_buffer, which scans a buffer in place if it ends in
+ * two NUL bytes. The file is mapped privately over a zeroed anonymous region
+ * two bytes longer, so those bytes exist even when the file fills its last
+ * page; the scanner's temporary writes stay in copy-on-write pages.
+ */
+static char* map_input(int fd, size_t size, size_t* length) {
+    *length = size + 2;
+    char* base = (char*)mmap(NULL, *length, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+    if (size > 0 &&
+        mmap(base, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, *length);
+        return NULL;
+    }
+    return base;
+}
+
+/* Create a context that reads a file through a stream it owns */
+ParseContext* create_file_parse_context(const char* filename) {
+    FILE* input = fopen(filename, "r");
+    if (input == NULL) {
+        return NULL;
+    }
+    ParseContext* ctx = create_parse_context(input);
+    ctx->opened = input;
+    return ctx;
+}
+
+/* Create a context that scans a file in place if it can be mapped */
+ParseContext* create_mapped_parse_context(const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat info;
+    char* mapped = NULL;
+    size_t length = 0;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+        mapped = map_input(fd, (size_t)info.st_size, &length);
+    }
+
+    if (mapped == NULL) {
+        /* Pipes and other special files are read through a stream */
+        FILE* input = fdopen(fd, "r");
+        if (input == NULL) {
+            close(fd);
+            return NULL;
+        }
+        ParseContext* ctx = create_parse_context(input);
+        ctx->opened = input;
+        return ctx;
+    }
+    close(fd);
+
+    ParseContext* ctx = new_parse_context();
+    ctx->mapped = mapped;
+    ctx->mapped_length = length;
+    yy_scan_buffer(mapped, length, ctx->scanner);
+    return ctx;
+}
+
+/* Input held in memory and its length, or NULL for a stream */
+static const char* input_text(ParseContext* ctx, size_t* length) {
+    char* text = ctx->mapped != NULL ? ctx->mapped : ctx->copied;
+    if (length != NULL && text != NULL) {
+        /* Both buffers end in two NUL bytes that are not part of the input */
+        *length = (ctx->mapped != NULL ? ctx->mapped_length : ctx->copied_length) - 2;
+    }
+    return text;
+}
+
+/* Switch the context to the hand-written scanner if its input is in memory */
+bool use_fast_lexer(ParseContext* ctx) {
+    size_t length;
+    const char* text = input_text(ctx, &length);
+    if (text == NULL) {
+        return false;
+    }
+    if (ctx->fast_lexer == NULL) {
+        ctx->fast_lexer = (FastLexer*)malloc(sizeof(FastLexer));
+    }
+    fast_lexer_init(ctx->fast_lexer, text, length);
+    return true;
+}
+
+/*
+ * The parser's scanner: the hand-written one if the context uses it, else
+ * Flex. Tokens never span lines, so the span follows from the position the
+ * scanner leaves behind and the token's length.
+ */
+int yylex(YYSTYPE* yylval_param, SourceSpan* yylloc_param, yyscan_t yyscanner) {
+    ParseContext* ctx = yyget_extra(yyscanner);
+    const char* token_text;
+    int token;
+    int length;
+    double scan_start = ctx->stats != NULL ? monotonic_seconds() : 0;
+    if (ctx->fast_lexer != NULL) {
+        token = fast_lexer_next(ctx->fast_lexer, yylval_param, ctx);
+        token_text = ctx->fast_lexer->token;
+        length = (int)(ctx->fast_lexer->cursor - token_text);
+    } else {
+        token = flex_token(yylval_param, yyscanner);
+        token_text = yyget_text(yyscanner);
+        length = yyget_leng(yyscanner);
+    }
+    if (ctx->stats != NULL && token != 0) {
+        record_token(ctx->stats, monotonic_seconds() - scan_start);
+    }
+
+    size_t input_length = 0;
+    const char* text = input_text(ctx, &input_length);
+    if (token == 0) {
+        /* The end of input is an empty token after everything else */
+        length = 0;
+        token_text = text != NULL ? text + input_length : NULL;
+    }
+    yylloc_param->first_line = yylloc_param->last_line = ctx->line_num;
+    yylloc_param->first_column = ctx->col_num - length;
+    yylloc_param->last_column = ctx->col_num;
+    if (text != NULL && token_text >= text && token_text <= text + input_length) {
+        yylloc_param->start = (size_t)(token_text - text);
+        yylloc_param->end = yylloc_param->start + length;
+    } else {
+        yylloc_param->start = yylloc_param->end = 0;
+    }
+    return token;
+}
+
+int next_token(ParseContext* ctx, YYSTYPE* value, SourceSpan* span) {
+    return yylex(value, span, ctx->scanner);
+}
+
+/* Scan the context's input to the end, e.g. to measure the scanner alone */
+long scan_tokens(ParseContext* ctx) {
+    YYSTYPE value;
+    SourceSpan span;
+    long tokens = 0;
+    while (next_token(ctx, &value, &span) != 0) {
+        tokens++;
+        release_scanned_input(ctx);
+    }
+    return tokens;
+}
+
+/* Parse the context's input; the AST is left in ctx->root and ctx->formulas */
+int parse_input(ParseContext* ctx) {
+    return yyparse(ctx->scanner, ctx);
+}
+
+/* Release the scanner's buffers, the input, the formula list and the whole AST */
+void free_parse_context(ParseContext* ctx) {
+    if (ctx == NULL) {
+        return;
+    }
+    yylex_destroy(ctx->scanner);
+    if (ctx->mapped != NULL) {
+        munmap(ctx->mapped, ctx->mapped_length);
+    }
+    if (ctx->opened != NULL) {
+        fclose(ctx->opened);
+    }
+    free(ctx->copied);
+    free(ctx->fast_lexer);
+    free(ctx->formulas);
+    arena_destroy(ctx->arena);
+    free(ctx);
+}
+
+/* Record a top-level formula */
+static void add_formula(ParseContext* ctx, ASTNode* formula) {
+    if (ctx->formula_count == ctx->formula_capacity) {
+        ctx->formula_capacity = ctx->formula_capacity == 0 ? 8 : ctx->formula_capacity * 2;
+        ctx->formulas = (ASTNode**)realloc(ctx->formulas, sizeof(ASTNode*) * ctx->formula_capacity);
+    }
+    ctx->formulas[ctx->formula_count++] = formula;
+}
+
+/*
+ * Flex ends every token with a NUL while it is being matched, so each page of
+ * a mapped input the scanner passes becomes a private copy (the hand-written
+ * scanner only reads it, but the pages still count as resident). The AST keeps no
+ * pointers into the input, so pages wholly before the current token are
+ * dropped once a chunk of them has built up; a mapped file then does not stay
+ * resident as it is read.
+ */
+static void release_scanned_input(ParseContext* ctx) {
+    if (ctx->mapped == NULL) {
+        return;
+    }
+    const char* position = ctx->fast_lexer != NULL ? ctx->fast_lexer->cursor
+                                                   : yyget_text(ctx->scanner);
+    /* After an unterminated comment Flex has moved on to a buffer of its own */
+    if (position < ctx->mapped || position > ctx->mapped + ctx->mapped_length) {
+        return;
+    }
+    size_t scanned = (size_t)(position - ctx->mapped);
+    if (scanned - ctx->mapped_released >= RELEASE_CHUNK) {
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        scanned = scanned / page * page;
+        madvise(ctx->mapped + ctx->mapped_released, scanned - ctx->mapped_released, MADV_DONTNEED);
+        ctx->mapped_released = scanned;
+    }
+}
+
+/*
+ * Keep a top-level formula, or in streaming mode hand it to the handler and
+ * free its nodes. Only this formula is on the parser stack when it is reduced
+ * into the list, so the arena can be emptied; NULL means it was streamed.
+ */
+static ASTNode* take_formula(ParseContext* ctx, ASTNode* formula, SourceSpan* span) {
+    release_scanned_input(ctx);
+    ctx->formula_span = *span;
+    if (ctx->on_formula == NULL) {
+        add_formula(ctx, formula);
+        return formula;
+    }
+    ctx->formula_count++;
+    ctx->on_formula(formula, ctx->formula_count, ctx->handler_data);
+    arena_rewind(ctx->arena);
+    return NULL;
+}
+
 /* Helper functions for AST construction */
 
-ASTNode* create_binary_op_node(int operator, ASTNode* left, ASTNode* right) {
-    ASTNode* node = (ASTNode*)malloc(sizeof(ASTNode));
-    node->type = NODE_BINARY_OP;
+/* Allocate a node at the scanner's position and count it for --stats */
+static ASTNode* new_node(ParseContext* ctx, NodeType type) {
+    ASTNode* node = (ASTNode*)arena_alloc(ctx->arena, sizeof(ASTNode));
+    node->type = type;
+    node->line = ctx->line_num;
+    node->column = ctx->col_num;
+    if (ctx->stats != NULL) {
+        ctx->stats->nodes[type]++;
+    }
+    return node;
+}
+
+ASTNode* create_binary_op_node(ParseContext* ctx, int operator, ASTNode* left, ASTNode* right) {
+    ASTNode* node = new_node(ctx, NODE_BINARY_OP);
     node->data.binary.operator = token_to_binary_op(operator);
     node->data.binary.left = left;
     node->data.binary.right = right;
-    node->line = line_num;
-    node->column = col_num;
     return node;
 }
 
-ASTNode* create_unary_op_node(int operator, ASTNode* operand) {
-    ASTNode* node = (ASTNode*)malloc(sizeof(ASTNode));
-    node->type = NODE_UNARY_OP;
+ASTNode* create_unary_op_node(ParseContext* ctx, int operator, ASTNode* operand) {
+    ASTNode* node = new_node(ctx, NODE_UNARY_OP);
     node->data.unary.operator = token_to_unary_op(operator);
     node->data.unary.operand = operand;
-    node->line = line_num;
-    node->column = col_num;
     return node;
 }
 
-ASTNode* create_quantifier_node(int quantifier, char* variable, char** domain, int domain_size, ASTNode* expr) {
-    ASTNode* node = (ASTNode*)malloc(sizeof(ASTNode));
-    node->type = NODE_QUANTIFIER;
+ASTNode* create_quantifier_node(ParseContext* ctx, int quantifier, InternId variable, Domain* domain, ASTNode* expr) {
+    ASTNode* node = new_node(ctx, NODE_QUANTIFIER);
     node->data.quantifier.quantifier = token_to_quantifier(quantifier);
-    node->data.quantifier.variable = strdup(variable);
-    node->data.quantifier.domain = (char**)malloc(sizeof(char*) * (domain_size + 1)); // +1 for NULL terminator
-    
-    /* Copy domain values */
-    for (int i = 0; i < domain_size; i++) {
-        node->data.quantifier.domain[i] = strdup(domain[i]);
-    }
-    node->data.quantifier.domain[domain_size] = NULL; // NULL-terminate the list
-    
-    node->data.quantifier.domain_size = domain_size;
+    node->data.quantifier.variable = variable;
+    node->data.quantifier.domain = domain->elements;
+    node->data.quantifier.domain_size = domain->size;
     node->data.quantifier.expr = expr;
-    node->line = line_num;
-    node->column = col_num;
-    
-    /* Free the original domain list since we've duplicated it */
-    for (int i = 0; i < domain_size; i++) {
-        free(domain[i]);
-    }
-    free(domain);
-    
     return node;
 }
 
-ASTNode* create_literal_node(bool value) {
-    ASTNode* node = (ASTNode*)malloc(sizeof(ASTNode));
-    node->type = NODE_LITERAL;
+ASTNode* create_literal_node(ParseContext* ctx, bool value) {
+    ASTNode* node = new_node(ctx, NODE_LITERAL);
     node->data.literal.value = value;
-    node->line = line_num;
-    node->column = col_num;
     return node;
 }
 
-ASTNode* create_variable_node(char* name) {
-    ASTNode* node = (ASTNode*)malloc(sizeof(ASTNode));
-    node->type = NODE_VARIABLE;
-    node->data.variable.name = strdup(name);
-    node->line = line_num;
-    node->column = col_num;
+ASTNode* create_variable_node(ParseContext* ctx, InternId name) {
+    ASTNode* node = new_node(ctx, NODE_VARIABLE);
+    node->data.variable.name = name;
+    node->data.variable.slot = UNBOUND_SLOT;
     return node;
 }
 
-ASTNode* create_predicate_node(char* name, char** args, int arg_count) {
-    ASTNode* node = (ASTNode*)malloc(sizeof(ASTNode));
-    node->type = NODE_PREDICATE;
-    node->data.predicate.name = strdup(name);
-    node->data.predicate.args = (char**)malloc(sizeof(char*) * (arg_count + 1)); // +1 for NULL terminator
-    
-    /* Copy argument names */
+ASTNode* create_predicate_node(ParseContext* ctx, InternId name, InternId* args, int arg_count) {
+    ASTNode* node = new_node(ctx, NODE_PREDICATE);
+    node->data.predicate.name = name;
+    node->data.predicate.args = args; /* Already in the AST arena */
+    node->data.predicate.slots = (int*)arena_alloc(ctx->arena, sizeof(int) * arg_count);
     for (int i = 0; i < arg_count; i++) {
-        node->data.predicate.args[i] = strdup(args[i]);
+        node->data.predicate.slots[i] = UNBOUND_SLOT;
     }
-    node->data.predicate.args[arg_count] = NULL; // NULL-terminate the list
-    
     node->data.predicate.arg_count = arg_count;
-    node->line = line_num;
-    node->column = col_num;
-    
-    /* Free the original arg list since we've duplicated it */
-    for (int i = 0; i < arg_count; i++) {
-        free(args[i]);
-    }
-    free(args);
-    
     return node;
 }
 
-char** create_arg_list(char* arg) {
-    char** list = (char**)malloc(sizeof(char*) * 2); // Space for the arg and NULL terminator
-    list[0] = strdup(arg);
-    list[1] = NULL;
+/* Start a list with one name */
+IdList create_id_list(InternId value) {
+    IdList list;
+    list.capacity = 4;
+    list.list = (InternId*)malloc(sizeof(InternId) * list.capacity);
+    list.list[0] = value;
+    list.size = 1;
     return list;
 }
 
-char** append_to_arg_list(char** arg_list, int curr_size, char* arg) {
-    char** new_list = (char**)malloc(sizeof(char*) * (curr_size + 2)); // +1 for new arg, +1 for NULL
-    
-    /* Copy existing arguments */
-    for (int i = 0; i < curr_size; i++) {
-        new_list[i] = arg_list[i];
+/* Takes ownership of list and returns it with value appended in amortized O(1) */
+IdList append_to_id_list(IdList list, InternId value) {
+    if (list.size == list.capacity) {
+        list.capacity *= 2;
+        list.list = (InternId*)realloc(list.list, sizeof(InternId) * list.capacity);
     }
-    
-    /* Add the new argument */
-    new_list[curr_size] = strdup(arg);
-    new_list[curr_size + 1] = NULL;
-    
-    /* Free the old list but not its contents */
-    free(arg_list);
-    
-    return new_list;
+    list.list[list.size++] = value;
+    return list;
 }
 
-char** create_domain_list(char* value) {
-    char** list = (char**)malloc(sizeof(char*) * 2); // Space for the value and NULL terminator
-    list[0] = strdup(value);
-    list[1] = NULL;
+/* Start an argument list in the AST arena, where the predicate node keeps it */
+IdList create_arg_list(ParseContext* ctx, InternId value) {
+    IdList list;
+    list.capacity = 4;
+    list.list = (InternId*)arena_alloc(ctx->arena, sizeof(InternId) * list.capacity);
+    list.list[0] = value;
+    list.size = 1;
     return list;
 }
 
-char** append_to_domain_list(char** domain_list, int curr_size, char* value) {
-    char** new_list = (char**)malloc(sizeof(char*) * (curr_size + 2)); // +1 for new value, +1 for NULL
-    
-    /* Copy existing values */
-    for (int i = 0; i < curr_size; i++) {
-        new_list[i] = domain_list[i];
+/* Append to an argument list; nothing else is allocated while it is built, so it grows in place */
+IdList append_to_arg_list(ParseContext* ctx, IdList list, InternId value) {
+    if (list.size == list.capacity) {
+        list.list = (InternId*)arena_grow(ctx->arena, list.list, sizeof(InternId) * list.capacity,
+                                          sizeof(InternId) * list.capacity * 2);
+        list.capacity *= 2;
     }
-    
-    /* Add the new value */
-    new_list[curr_size] = strdup(value);
-    new_list[curr_size + 1] = NULL;
-    
-    /* Free the old list but not its contents */
-    free(domain_list);
-    
-    return new_list;
+    list.list[list.size++] = value;
+    return list;
 }
@@ -3,62 +3,229 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "ast.h"
 
-/* External declarations */
-extern int yylex();
-extern int line_num;
-extern int col_num;
-extern FILE* yyin;
-extern char* yytext;
-
-/* Error handling */
-void yyerror(const char* msg);
-int syntax_errors = 0;
-
-/* Root of the AST */
-ASTNode* ast_root = NULL;
-
-/* Forward declarations for helper functions */
-ASTNode* create_binary_op_node(int operator, ASTNode* left, ASTNode* right);
-ASTNode* create_unary_op_node(int operator, ASTNode* operand);
-ASTNode* create_quantifier_node(int quantifier, char* variable, char** domain, int domain_size, ASTNode* expr);
-ASTNode* create_literal_node(bool value);
-ASTNode* create_variable_node(char* name);
-ASTNode* create_predicate_node(char* name, char** args, int arg_count);
-char** create_arg_list(char* arg);
-char** append_to_arg_list(char** arg_list, int curr_size, char* arg);
-char** create_domain_list(char* value);
-char** append_to_domain_list(char** domain_list, int curr_size, char* value);
+/* Let the parser stacks grow on the heap for deeply nested input */
+#define YYMAXDEPTH 10000000
+
+/* Scanned pages of a mapped input are dropped in chunks of this many bytes */
+#define RELEASE_CHUNK (1 << 18)
+
+/* A rule spans from the start of its first symbol to the end of its last */
+#define YYLLOC_DEFAULT(Current, Rhs, N)                                   \
+    do {                                                                  \
+        if (N) {                                                          \
+            (Current).first_line = YYRHSLOC(Rhs, 1).first_line;           \
+            (Current).first_column = YYRHSLOC(Rhs, 1).first_column;       \
+            (Current).start = YYRHSLOC(Rhs, 1).start;                     \
+            (Current).last_line = YYRHSLOC(Rhs, N).last_line;            \
+            (Current).last_column = YYRHSLOC(Rhs, N).last_column;        \
+            (Current).end = YYRHSLOC(Rhs, N).end;                         \
+        } else {                                                          \
+            (Current).first_line = (Current).last_line = YYRHSLOC(Rhs, 0).last_line; \
+            (Current).first_column = (Current).last_column = YYRHSLOC(Rhs, 0).last_column; \
+            (Current).start = (Current).end = YYRHSLOC(Rhs, 0).end;       \
+        }                                                                 \
+    } while (0)
 %}
 
+%code requires {
+#include <stdio.h>
+#include "intern.h"
+#include "arena.h"
+
+/* Handle of a reentrant Flex scanner (lexer.c defines it the same way) */
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void* yyscan_t;
+#endif
+
+struct ASTNode;
+struct CompileStats;
+
+/*
+ * Location of a token or rule: line and column of its first character and
+ * just past its last, and the same as byte offsets into the input. Offsets
+ * are only known for input held in memory (strings and mapped files); they
+ * are 0 for a stream.
+ */
+typedef struct SourceSpan {
+    int first_line;
+    int first_column;
+    int last_line;
+    int last_column;
+    size_t start;
+    size_t end;
+} SourceSpan;
+
+/* Receives each top-level formula in streaming mode; number counts from 1 */
+typedef void (*FormulaHandler)(struct ASTNode* formula, int number, void* data);
+
+/*
+ * Analysis fused with the parse, called from the grammar actions in source
+ * order: enter_quantifier once a quantifier's variable and domain have been
+ * read and before its body is parsed, leave_quantifier once its node has
+ * been built, and atom as each predicate and variable node is built
+ */
+typedef struct ParseActions {
+    void (*enter_quantifier)(InternId variable, InternId* domain, int domain_size, void* data);
+    void (*leave_quantifier)(struct ASTNode* quantifier, void* data);
+    void (*atom)(struct ASTNode* atom, void* data);
+} ParseActions;
+
+/*
+ * State of one parse. The parser and scanner keep everything here rather
+ * than in globals, so separate contexts can parse on different threads at
+ * the same time; only the interner is shared, and it is locked.
+ */
+typedef struct ParseContext {
+    yyscan_t scanner;             /* Scanner reading this context's input */
+    Arena* arena;                 /* Owns every node of the AST */
+    struct ASTNode* root;         /* Root of the AST; NULL until parsed */
+    struct ASTNode** formulas;    /* Top-level formulas in source order (root joins them with AND) */
+    int formula_count;
+    int formula_capacity;
+    int line_num;                 /* Current scanner position */
+    int col_num;
+    int syntax_errors;
+    /*
+     * Streaming mode: when on_formula is set, each top-level formula is passed
+     * to it as soon as it has been parsed and its nodes are freed afterwards,
+     * so memory does not grow with the input; root and formulas stay empty
+     * and formula_count only counts
+     */
+    FormulaHandler on_formula;
+    void* handler_data;
+    SourceSpan formula_span;      /* Source of the formula last taken, e.g. for on_formula */
+    const ParseActions* actions;  /* Analysis fused with the parse, or NULL */
+    void* action_data;
+    /* Input owned by the context, released with it */
+    char* mapped;                 /* Mapping scanned in place, or NULL */
+    size_t mapped_length;
+    size_t mapped_released;       /* Leading bytes of the mapping already dropped */
+    char* copied;                 /* Copy of a string being parsed, or NULL */
+    size_t copied_length;
+    FILE* opened;                 /* Stream opened for the file, or NULL */
+    struct FastLexer* fast_lexer; /* Hand-written scanner in use, or NULL for Flex */
+    struct CompileStats* stats;   /* Counts tokens and nodes and times the scanner for --stats, or NULL */
+} ParseContext;
+
+/* Growable list of argument or domain names; capacity doubles as it fills */
+typedef struct {
+    InternId* list;
+    int size;
+    int capacity;
+} IdList;
+}
+
 /* Define the values that can be returned by terminals and non-terminals */
 %union {
     int token;           /* For operators and keywords */
-    char* string_val;    /* For identifiers */
+    InternId id;         /* For identifiers (interned by the lexer) */
     bool bool_val;       /* For TRUE/FALSE literals */
     struct ASTNode* node; /* For AST nodes */
-    char** string_list;  /* For argument lists */
-    struct {
-        char** list;
-        int size;
-    } domain_info;       /* For domain lists with size */
+    IdList id_list;      /* For domain lists */
+    IdList args;         /* For argument lists, built in the AST arena */
+    Domain* domain;      /* For a quantifier's interned domain */
+}
+
+%code provides {
+/* Create a context that parses input, or a copy of text or of length bytes of it */
+ParseContext* create_parse_context(FILE* input);
+ParseContext* create_string_parse_context(const char* text);
+ParseContext* create_buffer_parse_context(const char* text, size_t length);
+
+/*
+ * Create a context that parses a file, read through a stream, or mapped and
+ * scanned in place without being copied into the scanner's buffer (files
+ * that cannot be mapped, such as pipes, are read as a stream). Both return
+ * NULL if the file cannot be opened.
+ */
+ParseContext* create_file_parse_context(const char* filename);
+ParseContext* create_mapped_parse_context(const char* filename);
+
+/*
+ * Scan the input with the hand-written scanner in fast_lexer.c instead of
+ * Flex. Only input held in memory (a string or a mapped file) can be scanned
+ * this way; returns false, leaving Flex in use, for a stream.
+ */
+bool use_fast_lexer(ParseContext* ctx);
+
+/* Scan the next token with whichever scanner is in use; returns 0 at the end */
+int next_token(ParseContext* ctx, YYSTYPE* value, SourceSpan* span);
+
+/* Scan the whole input without parsing it; returns the number of tokens */
+long scan_tokens(ParseContext* ctx);
+
+/* Parse the whole input; returns 0 on success, like yyparse() */
+int parse_input(ParseContext* ctx);
+
+/* Release the scanner, the formula list, the AST and any input it opened */
+void free_parse_context(ParseContext* ctx);
+}
+
+%code {
+#include "fast_lexer.h"
+#include "stats.h"
+
+/* Reentrant scanner interface (see lexer.l); Flex's scanner is named flex_token */
+int flex_token(YYSTYPE* yylval_param, yyscan_t yyscanner);
+int yylex(YYSTYPE* yylval_param, SourceSpan* yylloc_param, yyscan_t yyscanner);
+int yylex_init_extra(ParseContext* extra, yyscan_t* scanner);
+ParseContext* yyget_extra(yyscan_t scanner);
+int yylex_destroy(yyscan_t scanner);
+void yyset_in(FILE* input, yyscan_t scanner);
+char* yyget_text(yyscan_t scanner);
+int yyget_leng(yyscan_t scanner);
+struct yy_buffer_state* yy_scan_buffer(char* base, size_t size, yyscan_t scanner);
+
+void yyerror(SourceSpan* location, yyscan_t scanner, ParseContext* ctx, const char* msg);
+
+static ASTNode* take_formula(ParseContext* ctx, ASTNode* formula, SourceSpan* span);
+static void release_scanned_input(ParseContext* ctx);
+static const char* input_text(ParseContext* ctx, size_t* length);
+
+/* Helper functions for AST construction; nodes are allocated in ctx->arena */
+ASTNode* create_binary_op_node(ParseContext* ctx, int operator, ASTNode* left, ASTNode* right);
+ASTNode* create_unary_op_node(ParseContext* ctx, int operator, ASTNode* operand);
+ASTNode* create_quantifier_node(ParseContext* ctx, int quantifier, InternId variable, Domain* domain, ASTNode* expr);
+ASTNode* create_literal_node(ParseContext* ctx, bool value);
+ASTNode* create_variable_node(ParseContext* ctx, InternId name);
+ASTNode* create_predicate_node(ParseContext* ctx, InternId name, InternId* args, int arg_count);
+IdList create_id_list(InternId value);
+IdList append_to_id_list(IdList list, InternId value);
+IdList create_arg_list(ParseContext* ctx, InternId value);
+IdList append_to_arg_list(ParseContext* ctx, IdList list, InternId value);
 }
 
+/* A pure parser: all state is on its stack or in the ParseContext */
+%define api.pure full
+%define api.location.type {SourceSpan}
+%locations
+%param {yyscan_t scanner}
+%parse-param {ParseContext* ctx}
+
 /* Define tokens from the lexer */
 %token <token> AND OR NOT IMPLIES IFF XOR
 %token <token> FORALL EXISTS
 %token <bool_val> TRUE_VAL FALSE_VAL
 %token <token> LPAREN RPAREN LBRACKET RBRACKET
-%token <string_val> VARIABLE PREDICATE
+%token <id> VARIABLE PREDICATE
 
 /* Define the types for non-terminals */
 %type <node> program expr_list expr binary_expr unary_expr atom_expr quant_expr
 %type <node> literal variable predicate
-%type <domain_info> domain domain_list
-%type <string_list> arg_list
+%type <id_list> domain domain_list
+%type <args> arg_list
 %type <token> binary_op quantifier
 
+/* Domain lists discarded during error recovery are still owned by the parser */
+%destructor { free($$.list); } <id_list>
+
 /* Define operator precedence (highest to lowest) and associativity */
 %right NOT
 %left AND
@@ -76,7 +243,7 @@ program
     : expr_list
         {
             /* In case of multiple expressions, use the first one as the root */
-            ast_root = $1;
+            ctx->root = $1;
             $$ = $1;
         }
     ;
@@ -84,12 +251,13 @@ program
 expr_list
     : expr
         {
-            $$ = $1;
+            $$ = take_formula(ctx, $1, &@1);
         }
     | expr_list expr
         {
+            ASTNode* formula = take_formula(ctx, $2, &@2);
             /* Create a binary op node to combine expressions with implicit AND */
-            $$ = create_binary_op_node(AND, $1, $2);
+            $$ = formula != NULL ? create_binary_op_node(ctx, AND, $1, formula) : NULL;
         }
     ;
 
@@ -115,7 +283,7 @@ expr
 binary_expr
     : expr binary_op expr
         {
-            $$ = create_binary_op_node($2, $1, $3);
+            $$ = create_binary_op_node(ctx, $2, $1, $3);
         }
     ;
 
@@ -130,14 +298,27 @@ binary_op
 unary_expr
     : NOT expr
         {
-            $$ = create_unary_op_node(NOT, $2);
+            $$ = create_unary_op_node(ctx, NOT, $2);
         }
     ;
 
 quant_expr
-    : quantifier VARIABLE domain expr
+    : quantifier VARIABLE domain
+        {
+            /* The interner takes over the domain list before the body is
+               parsed, so fused analysis can bind the variable to it */
+            $<domain>$ = intern_domain_owned($3.list, $3.size);
+            $3.list = NULL;
+            if (ctx->actions != NULL) {
+                ctx->actions->enter_quantifier($2, $<domain>$->elements, $<domain>$->size, ctx->action_data);
+            }
+        }
+      expr
         {
-            $$ = create_quantifier_node($1, $2, $3.list, $3.size, $4);
+            $$ = create_quantifier_node(ctx, $1, $2, $<domain>4, $5);
+            if (ctx->actions != NULL) {
+                ctx->actions->leave_quantifier($$, ctx->action_data);
+            }
         }
     ;
 
@@ -156,23 +337,19 @@ domain
 domain_list
     : VARIABLE
         {
-            $$.list = create_domain_list($1);
-            $$.size = 1;
+            $$ = create_id_list($1);
         }
     | PREDICATE
         {
-            $$.list = create_domain_list($1);
-            $$.size = 1;
+            $$ = create_id_list($1);
         }
     | VARIABLE ',' domain_list
         {
-            $$.list = append_to_domain_list($3.list, $3.size, $1);
-            $$.size = $3.size + 1;
+            $$ = append_to_id_list($3, $1);
         }
     | PREDICATE ',' domain_list
         {
-            $$.list = append_to_domain_list($3.list, $3.size, $1);
-            $$.size = $3.size + 1;
+            $$ = append_to_id_list($3, $1);
         }
     ;
 
@@ -198,62 +375,60 @@ atom_expr
 predicate
     : PREDICATE LPAREN arg_list RPAREN
         {
-            /* Count the number of arguments */
-            int count = 0;
-            char** args_ptr = $3;
-            while (args_ptr && *args_ptr) {
-                count++;
-                args_ptr++;
+            $$ = create_predicate_node(ctx, $1, $3.list, $3.size);
+            if (ctx->actions != NULL) {
+                ctx->actions->atom($$, ctx->action_data);
             }
-            $$ = create_predicate_node($1, $3, count);
         }
     ;
 
 arg_list
     : VARIABLE
         {
-            $$ = create_arg_list($1);
+            $$ = create_arg_list(ctx, $1);
         }
     | VARIABLE ',' arg_list
         {
-            /* Count the number of existing arguments */
-            int count = 0;
-            char** args_ptr = $3;
-            while (args_ptr && *args_ptr) {
-                count++;
-                args_ptr++;
-            }
-            $$ = append_to_arg_list($3, count, $1);
+            $$ = append_to_arg_list(ctx, $3, $1);
         }
     ;
 
 variable
     : VARIABLE
         {
-            $$ = create_variable_node($1);
+            $$ = create_variable_node(ctx, $1);
+            if (ctx->actions != NULL) {
+                ctx->actions->atom($$, ctx->action_data);
+            }
         }
     ;
 
 literal
     : TRUE_VAL
         {
-            $$ = create_literal_node(true);
+            $$ = create_literal_node(ctx, true);
         }
     | FALSE_VAL
         {
-            $$ = create_literal_node(false);
+            $$ = create_literal_node(ctx, false);
         }
     ;
 
 %%
 
 /* Error handler for Bison */
-void yyerror(const char* msg) {
-    syntax_errors++;
-    fprintf(stderr, "Error at line %d, column %d: %s\n", line_num, col_num, msg);
+void yyerror(SourceSpan* location, yyscan_t scanner, ParseContext* ctx, const char* msg) {
+    ctx->syntax_errors++;
+    fprintf(stderr, "Error at line %d, column %d: %s\n", ctx->line_num, ctx->col_num, msg);
     
     /* Add more context to the error message */
-    fprintf(stderr, "Near token: '%s'\n", yytext);
+    const char* text = input_text(ctx, NULL);
+    if (text != NULL) {
+        /* The token may have been scanned by the hand-written scanner */
+        fprintf(stderr, "Near token: '%.*s'\n", (int)(location->end - location->start), text + location->start);
+    } else {
+        fprintf(stderr, "Near token: '%s'\n", yyget_text(scanner));
+    }
 }
 
 /* Main function if we're testing the parser directly */
@@ -270,169 +445,395 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
-    yyin = input_file;
+    ParseContext* ctx = create_parse_context(input_file);
     
     /* Parse the input */
-    int parse_result = yyparse();
+    int parse_result = parse_input(ctx);
     
     /* Report results */
-    if (parse_result == 0 && syntax_errors == 0) {
+    if (parse_result == 0 && ctx->syntax_errors == 0) {
         printf("Parsing completed successfully.\n");
         
         /* Print the AST if parsing was successful */
         printf("Abstract Syntax Tree:\n");
-        print_ast(ast_root, 0);
-        
-        /* Free the AST */
-        free_ast(ast_root);
+        print_ast(ctx->root, 0);
     } else {
-        printf("Parsing failed with %d errors.\n", syntax_errors);
+        printf("Parsing failed with %d errors.\n", ctx->syntax_errors);
     }
     
+    /* Free the AST */
+    free_parse_context(ctx);
+    free_interned();
     fclose(input_file);
     return parse_result;
 }
 #endif
 
+/* Create a context with a scanner and an empty AST arena */
+static ParseContext* new_parse_context() {
+    ParseContext* ctx = (ParseContext*)calloc(1, sizeof(ParseContext));
+    ctx->arena = create_ast_arena();
+    ctx->line_num = 1;
+    ctx->col_num = 1;
+    yylex_init_extra(ctx, &ctx->scanner);
+    return ctx;
+}
+
+/* Create a context that parses a file */
+ParseContext* create_parse_context(FILE* input) {
+    ParseContext* ctx = new_parse_context();
+    yyset_in(input, ctx->scanner);
+    return ctx;
+}
+
+/* Create a context that parses a copy of a string */
+ParseContext* create_string_parse_context(const char* text) {
+    return create_buffer_parse_context(text, strlen(text));
+}
+
+/*
+ * Create a context that parses a copy of length bytes of text. The copy ends
+ * in the two NUL bytes yy_scan_buffer needs and is kept with the context, so
+ * the fast scanner can read it too.
+ */
+ParseContext* create_buffer_parse_context(const char* text, size_t length) {
+    ParseContext* ctx = new_parse_context();
+    ctx->copied = (char*)malloc(length + 2);
+    memcpy(ctx->copied, text, length);
+    ctx->copied[length] = ctx->copied[length + 1] = '\0';
+    ctx->copied_length = length + 2;
+    yy_scan_buffer(ctx->copied, ctx->copied_length, ctx->scanner);
+    return ctx;
+}
+
+/*
+ * Map a file for yy_scan_buffer, which scans a buffer in place if it ends in
+ * two NUL bytes. The file is mapped privately over a zeroed anonymous region
+ * two bytes longer, so those bytes exist even when the file fills its last
+ * page; the scanner's temporary writes stay in copy-on-write pages.
+ */
+static char* map_input(int fd, size_t size, size_t* length) {
+    *length = size + 2;
+    char* base = (char*)mmap(NULL, *length, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+    if (size > 0 &&
+        mmap(base, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, *length);
+        return NULL;
+    }
+    return base;
+}
+
+/* Create a context that reads a file through a stream it owns */
+ParseContext* create_file_parse_context(const char* filename) {
+    FILE* input = fopen(filename, "r");
+    if (input == NULL) {
+        return NULL;
+    }
+    ParseContext* ctx = create_parse_context(input);
+    ctx->opened = input;
+    return ctx;
+}
+
+/* Create a context that scans a file in place if it can be mapped */
+ParseContext* create_mapped_parse_context(const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat info;
+    char* mapped = NULL;
+    size_t length = 0;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+        mapped = map_input(fd, (size_t)info.st_size, &length);
+    }
+
+    if (mapped == NULL) {
+        /* Pipes and other special files are read through a stream */
+        FILE* input = fdopen(fd, "r");
+        if (input == NULL) {
+            close(fd);
+            return NULL;
+        }
+        ParseContext* ctx = create_parse_context(input);
+        ctx->opened = input;
+        return ctx;
+    }
+    close(fd);
+
+    ParseContext* ctx = new_parse_context();
+    ctx->mapped = mapped;
+    ctx->mapped_length = length;
+    yy_scan_buffer(mapped, length, ctx->scanner);
+    return ctx;
+}
+
+/* Input held in memory and its length, or NULL for a stream */
+static const char* input_text(ParseContext* ctx, size_t* length) {
+    char* text = ctx->mapped != NULL ? ctx->mapped : ctx->copied;
+    if (length != NULL && text != NULL) {
+        /* Both buffers end in two NUL bytes that are not part of the input */
+        *length = (ctx->mapped != NULL ? ctx->mapped_length : ctx->copied_length) - 2;
+    }
+    return text;
+}
+
+/* Switch the context to the hand-written scanner if its input is in memory */
+bool use_fast_lexer(ParseContext* ctx) {
+    size_t length;
+    const char* text = input_text(ctx, &length);
+    if (text == NULL) {
+        return false;
+    }
+    if (ctx->fast_lexer == NULL) {
+        ctx->fast_lexer = (FastLexer*)malloc(sizeof(FastLexer));
+    }
+    fast_lexer_init(ctx->fast_lexer, text, length);
+    return true;
+}
+
+/*
+ * The parser's scanner: the hand-written one if the context uses it, else
+ * Flex. Tokens never span lines, so the span follows from the position the
+ * scanner leaves behind and the token's length.
+ */
+int yylex(YYSTYPE* yylval_param, SourceSpan* yylloc_param, yyscan_t yyscanner) {
+    ParseContext* ctx = yyget_extra(yyscanner);
+    const char* token_text;
+    int token;
+    int length;
+    double scan_start = ctx->stats != NULL ? monotonic_seconds() : 0;
+    if (ctx->fast_lexer != NULL) {
+        token = fast_lexer_next(ctx->fast_lexer, yylval_param, ctx);
+        token_text = ctx->fast_lexer->token;
+        length = (int)(ctx->fast_lexer->cursor - token_text);
+    } else {
+        token = flex_token(yylval_param, yyscanner);
+        token_text = yyget_text(yyscanner);
+        length = yyget_leng(yyscanner);
+    }
+    if (ctx->stats != NULL && token != 0) {
+        record_token(ctx->stats, monotonic_seconds() - scan_start);
+    }
+
+    size_t input_length = 0;
+    const char* text = input_text(ctx, &input_length);
+    if (token == 0) {
+        /* The end of input is an empty token after everything else */
+        length = 0;
+        token_text = text != NULL ? text + input_length : NULL;
+    }
+    yylloc_param->first_line = yylloc_param->last_line = ctx->line_num;
+    yylloc_param->first_column = ctx->col_num - length;
+    yylloc_param->last_column = ctx->col_num;
+    if (text != NULL && token_text >= text && token_text <= text + input_length) {
+        yylloc_param->start = (size_t)(token_text - text);
+        yylloc_param->end = yylloc_param->start + length;
+    } else {
+        yylloc_param->start = yylloc_param->end = 0;
+    }
+    return token;
+}
+
+int next_token(ParseContext* ctx, YYSTYPE* value, SourceSpan* span) {
+    return yylex(value, span, ctx->scanner);
+}
+
+/* Scan the context's input to the end, e.g. to measure the scanner alone */
+long scan_tokens(ParseContext* ctx) {
+    YYSTYPE value;
+    SourceSpan span;
+    long tokens = 0;
+    while (next_token(ctx, &value, &span) != 0) {
+        tokens++;
+        release_scanned_input(ctx);
+    }
+    return tokens;
+}
+
+/* Parse the context's input; the AST is left in ctx->root and ctx->formulas */
+int parse_input(ParseContext* ctx) {
+    return yyparse(ctx->scanner, ctx);
+}
+
+/* Release the scanner's buffers, the input, the formula list and the whole AST */
+void free_parse_context(ParseContext* ctx) {
+    if (ctx == NULL) {
+        return;
+    }
+    yylex_destroy(ctx->scanner);
+    if (ctx->mapped != NULL) {
+        munmap(ctx->mapped, ctx->mapped_length);
+    }
+    if (ctx->opened != NULL) {
+        fclose(ctx->opened);
+    }
+    free(ctx->copied);
+    free(ctx->fast_lexer);
+    free(ctx->formulas);
+    arena_destroy(ctx->arena);
+    free(ctx);
+}
+
+/* Record a top-level formula */
+static void add_formula(ParseContext* ctx, ASTNode* formula) {
+    if (ctx->formula_count == ctx->formula_capacity) {
+        ctx->formula_capacity = ctx->formula_capacity == 0 ? 8 : ctx->formula_capacity * 2;
+        ctx->formulas = (ASTNode**)realloc(ctx->formulas, sizeof(ASTNode*) * ctx->formula_capacity);
+    }
+    ctx->formulas[ctx->formula_count++] = formula;
+}
+
+/*
+ * Flex ends every token with a NUL while it is being matched, so each page of
+ * a mapped input the scanner passes becomes a private copy (the hand-written
+ * scanner only reads it, but the pages still count as resident). The AST keeps no
+ * pointers into the input, so pages wholly before the current token are
+ * dropped once a chunk of them has built up; a mapped file then does not stay
+ * resident as it is read.
+ */
+static void release_scanned_input(ParseContext* ctx) {
+    if (ctx->mapped == NULL) {
+        return;
+    }
+    const char* position = ctx->fast_lexer != NULL ? ctx->fast_lexer->cursor
+                                                   : yyget_text(ctx->scanner);
+    /* After an unterminated comment Flex has moved on to a buffer of its own */
+    if (position < ctx->mapped || position > ctx->mapped + ctx->mapped_length) {
+        return;
+    }
+    size_t scanned = (size_t)(position - ctx->mapped);
+    if (scanned - ctx->mapped_released >= RELEASE_CHUNK) {
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        scanned = scanned / page * page;
+        madvise(ctx->mapped + ctx->mapped_released, scanned - ctx->mapped_released, MADV_DONTNEED);
+        ctx->mapped_released = scanned;
+    }
+}
+
+/*
+ * Keep a top-level formula, or in streaming mode hand it to the handler and
+ * free its nodes. Only this formula is on the parser stack when it is reduced
+ * into the list, so the arena can be emptied; NULL means it was streamed.
+ */
+static ASTNode* take_formula(ParseContext* ctx, ASTNode* formula, SourceSpan* span) {
+    release_scanned_input(ctx);
+    ctx->formula_span = *span;
+    if (ctx->on_formula == NULL) {
+        add_formula(ctx, formula);
+        return formula;
+    }
+    ctx->formula_count++;
+    ctx->on_formula(formula, ctx->formula_count, ctx->handler_data);
+    arena_rewind(ctx->arena);
+    return NULL;
+}
+
 /* Helper functions for AST construction */
 
-ASTNode* create_binary_op_node(int operator, ASTNode* left, ASTNode* right) {
-    ASTNode* node = (ASTNode*)malloc(sizeof(ASTNode));
-    node->type = NODE_BINARY_OP;
+/* Allocate a node at the scanner's position and count it for --stats */
+static ASTNode* new_node(ParseContext* ctx, NodeType type) {
+    ASTNode* node = (ASTNode*)arena_alloc(ctx->arena, sizeof(ASTNode));
+    node->type = type;
+    node->line = ctx->line_num;
+    node->column = ctx->col_num;
+    if (ctx->stats != NULL) {
+        ctx->stats->nodes[type]++;
+    }
+    return node;
+}
+
+ASTNode* create_binary_op_node(ParseContext* ctx, int operator, ASTNode* left, ASTNode* right) {
+    ASTNode* node = new_node(ctx, NODE_BINARY_OP);
     node->data.binary.operator = token_to_binary_op(operator);
     node->data.binary.left = left;
     node->data.binary.right = right;
-    node->line = line_num;
-    node->column = col_num;
     return node;
 }
 
-ASTNode* create_unary_op_node(int operator, ASTNode* operand) {
-    ASTNode* node = (ASTNode*)malloc(sizeof(ASTNode));
-    node->type = NODE_UNARY_OP;
+ASTNode* create_unary_op_node(ParseContext* ctx, int operator, ASTNode* operand) {
+    ASTNode* node = new_node(ctx, NODE_UNARY_OP);
     node->data.unary.operator = token_to_unary_op(operator);
     node->data.unary.operand = operand;
-    node->line = line_num;
-    node->column = col_num;
     return node;
 }
 
-ASTNode* create_quantifier_node(int quantifier, char* variable, char** domain, int domain_size, ASTNode* expr) {
-    ASTNode* node = (ASTNode*)malloc(sizeof(ASTNode));
-    node->type = NODE_QUANTIFIER;
+ASTNode* create_quantifier_node(ParseContext* ctx, int quantifier, InternId variable, Domain* domain, ASTNode* expr) {
+    ASTNode* node = new_node(ctx, NODE_QUANTIFIER);
     node->data.quantifier.quantifier = token_to_quantifier(quantifier);
-    node->data.quantifier.variable = strdup(variable);
-    node->data.quantifier.domain = (char**)malloc(sizeof(char*) * (domain_size + 1)); // +1 for NULL terminator
-    
-    /* Copy domain values */
-    for (int i = 0; i < domain_size; i++) {
-        node->data.quantifier.domain[i] = strdup(domain[i]);
-    }
-    node->data.quantifier.domain[domain_size] = NULL; // NULL-terminate the list
-    
-    node->data.quantifier.domain_size = domain_size;
+    node->data.quantifier.variable = variable;
+    node->data.quantifier.domain = domain->elements;
+    node->data.quantifier.domain_size = domain->size;
     node->data.quantifier.expr = expr;
-    node->line = line_num;
-    node->column = col_num;
-    
-    /* Free the original domain list since we've duplicated it */
-    for (int i = 0; i < domain_size; i++) {
-        free(domain[i]);
-    }
-    free(domain);
-    
     return node;
 }
 
-ASTNode* create_literal_node(bool value) {
-    ASTNode* node = (ASTNode*)malloc(sizeof(ASTNode));
-    node->type = NODE_LITERAL;
+ASTNode* create_literal_node(ParseContext* ctx, bool value) {
+    ASTNode* node = new_node(ctx, NODE_LITERAL);
     node->data.literal.value = value;
-    node->line = line_num;
-    node->column = col_num;
     return node;
 }
 
-ASTNode* create_variable_node(char* name) {
-    ASTNode* node = (ASTNode*)malloc(sizeof(ASTNode));
-    node->type = NODE_VARIABLE;
-    node->data.variable.name = strdup(name);
-    node->line = line_num;
-    node->column = col_num;
+ASTNode* create_variable_node(ParseContext* ctx, InternId name) {
+    ASTNode* node = new_node(ctx, NODE_VARIABLE);
+    node->data.variable.name = name;
+    node->data.variable.slot = UNBOUND_SLOT;
     return node;
 }
 
-ASTNode* create_predicate_node(char* name, char** args, int arg_count) {
-    ASTNode* node = (ASTNode*)malloc(sizeof(ASTNode));
-    node->type = NODE_PREDICATE;
-    node->data.predicate.name = strdup(name);
-    node->data.predicate.args = (char**)malloc(sizeof(char*) * (arg_count + 1)); // +1 for NULL terminator
-    
-    /* Copy argument names */
+ASTNode* create_predicate_node(ParseContext* ctx, InternId name, InternId* args, int arg_count) {
+    ASTNode* node = new_node(ctx, NODE_PREDICATE);
+    node->data.predicate.name = name;
+    node->data.predicate.args = args; /* Already in the AST arena */
+    node->data.predicate.slots = (int*)arena_alloc(ctx->arena, sizeof(int) * arg_count);
     for (int i = 0; i < arg_count; i++) {
-        node->data.predicate.args[i] = strdup(args[i]);
+        node->data.predicate.slots[i] = UNBOUND_SLOT;
     }
-    node->data.predicate.args[arg_count] = NULL; // NULL-terminate the list
-    
     node->data.predicate.arg_count = arg_count;
-    node->line = line_num;
-    node->column = col_num;
-    
-    /* Free the original arg list since we've duplicated it */
-    for (int i = 0; i < arg_count; i++) {
-        free(args[i]);
-    }
-    free(args);
-    
     return node;
 }
 
-char** create_arg_list(char* arg) {
-    char** list = (char**)malloc(sizeof(char*) * 2); // Space for the arg and NULL terminator
-    list[0] = strdup(arg);
-    list[1] = NULL;
+/* Start a list with one name */
+IdList create_id_list(InternId value) {
+    IdList list;
+    list.capacity = 4;
+    list.list = (InternId*)malloc(sizeof(InternId) * list.capacity);
+    list.list[0] = value;
+    list.size = 1;
     return list;
 }
 
-char** append_to_arg_list(char** arg_list, int curr_size, char* arg) {
-    char** new_list = (char**)malloc(sizeof(char*) * (curr_size + 2)); // +1 for new arg, +1 for NULL
-    
-    /* Copy existing arguments */
-    for (int i = 0; i < curr_size; i++) {
-        new_list[i] = arg_list[i];
+/* Takes ownership of list and returns it with value appended in amortized O(1) */
+IdList append_to_id_list(IdList list, InternId value) {
+    if (list.size == list.capacity) {
+        list.capacity *= 2;
+        list.list = (InternId*)realloc(list.list, sizeof(InternId) * list.capacity);
     }
-    
-    /* Add the new argument */
-    new_list[curr_size] = strdup(arg);
-    new_list[curr_size + 1] = NULL;
-    
-    /* Free the old list but not its contents */
-    free(arg_list);
-    
-    return new_list;
+    list.list[list.size++] = value;
+    return list;
 }
 
-char** create_domain_list(char* value) {
-    char** list = (char**)malloc(sizeof(char*) * 2); // Space for the value and NULL terminator
-    list[0] = strdup(value);
-    list[1] = NULL;
+/* Start an argument list in the AST arena, where the predicate node keeps it */
+IdList create_arg_list(ParseContext* ctx, InternId value) {
+    IdList list;
+    list.capacity = 4;
+    list.list = (InternId*)arena_alloc(ctx->arena, sizeof(InternId) * list.capacity);
+    list.list[0] = value;
+    list.size = 1;
     return list;
 }
 
-char** append_to_domain_list(char** domain_list, int curr_size, char* value) {
-    char** new_list = (char**)malloc(sizeof(char*) * (curr_size + 2)); // +1 for new value, +1 for NULL
-    
-    /* Copy existing values */
-    for (int i = 0; i < curr_size; i++) {
-        new_list[i] = domain_list[i];
+/* Append to an argument list; nothing else is allocated while it is built, so it grows in place */
+IdList append_to_arg_list(ParseContext* ctx, IdList list, InternId value) {
+    if (list.size == list.capacity) {
+        list.list = (InternId*)arena_grow(ctx->arena, list.list, sizeof(InternId) * list.capacity,
+                                          sizeof(InternId) * list.capacity * 2);
+        list.capacity *= 2;
     }
-    
-    /* Add the new value */
-    new_list[curr_size] = strdup(value);
-    new_list[curr_size + 1] = NULL;
-    
-    /* Free the old list but not its contents */
-    free(domain_list);
-    
-    return new_list;
-}
\ No newline at end of file
+    list.list[list.size++] = value;
+    return list;
+}
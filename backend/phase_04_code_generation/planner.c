@@ -0,0 +1,566 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "planner.h"
+
+/* Partial join result: rows over a set of plan variables */
+typedef struct {
+    int* columns;                /* Plan variable held by each column */
+    int width;
+    InternId* data;              /* count * width values */
+    int count;
+    int capacity;
+} Rows;
+
+static void rows_init(Rows* rows, int* columns, int width) {
+    rows->columns = (int*)malloc(sizeof(int) * (width > 0 ? width : 1));
+    memcpy(rows->columns, columns, sizeof(int) * width);
+    rows->width = width;
+    rows->data = NULL;
+    rows->count = 0;
+    rows->capacity = 0;
+}
+
+static void rows_append(Rows* rows, InternId* row) {
+    if (rows->count == rows->capacity) {
+        rows->capacity = rows->capacity == 0 ? 16 : rows->capacity * 2;
+        rows->data = (InternId*)realloc(rows->data,
+                                        sizeof(InternId) * rows->capacity * (rows->width > 0 ? rows->width : 1));
+    }
+    memcpy(rows->data + (size_t)rows->count * rows->width, row, sizeof(InternId) * rows->width);
+    rows->count++;
+}
+
+static void rows_free(Rows* rows) {
+    free(rows->columns);
+    free(rows->data);
+}
+
+static int column_of(Rows* rows, int variable) {
+    for (int i = 0; i < rows->width; i++) {
+        if (rows->columns[i] == variable) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static InternId* row_at(Rows* rows, int i) {
+    return rows->data + (size_t)i * rows->width;
+}
+
+/* Hash the values of some columns of a row */
+static unsigned int hash_key(InternId* row, int* key_columns, int key_count) {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < key_count; i++) {
+        hash = (hash ^ row[key_columns[i]]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool keys_equal(InternId* a, int* a_columns, InternId* b, int* b_columns, int key_count) {
+    for (int i = 0; i < key_count; i++) {
+        if (a[a_columns[i]] != b[b_columns[i]]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Hash index over rows keyed on some of their columns (chained through next) */
+typedef struct {
+    int* heads;                  /* First row of each bucket, -1 if empty */
+    int* next;                   /* Next row in the same bucket */
+    unsigned int mask;
+} RowIndex;
+
+static void build_index(RowIndex* index, Rows* rows, int* key_columns, int key_count) {
+    unsigned int size = 16;
+    while (size < (unsigned int)rows->count * 2) {
+        size *= 2;
+    }
+
+    index->heads = (int*)malloc(sizeof(int) * size);
+    index->next = (int*)malloc(sizeof(int) * (rows->count > 0 ? rows->count : 1));
+    index->mask = size - 1;
+    memset(index->heads, -1, sizeof(int) * size);
+
+    for (int i = 0; i < rows->count; i++) {
+        unsigned int bucket = hash_key(row_at(rows, i), key_columns, key_count) & index->mask;
+        index->next[i] = index->heads[bucket];
+        index->heads[bucket] = i;
+    }
+}
+
+static void free_index(RowIndex* index) {
+    free(index->heads);
+    free(index->next);
+}
+
+/* Keep only the given variables, dropping duplicate rows */
+static Rows project(Rows* in, int* keep, int keep_count) {
+    Rows out;
+    int positions[keep_count > 0 ? keep_count : 1];
+    int out_positions[keep_count > 0 ? keep_count : 1];
+    InternId row[keep_count > 0 ? keep_count : 1];
+
+    for (int i = 0; i < keep_count; i++) {
+        positions[i] = column_of(in, keep[i]);
+        out_positions[i] = i;
+    }
+    rows_init(&out, keep, keep_count);
+
+    /* Open-addressing set of output rows (row index + 1, 0 = empty) */
+    unsigned int size = 16;
+    while (size < (unsigned int)in->count * 2) {
+        size *= 2;
+    }
+    int* slots = (int*)calloc(size, sizeof(int));
+
+    for (int i = 0; i < in->count; i++) {
+        InternId* source = row_at(in, i);
+        for (int j = 0; j < keep_count; j++) {
+            row[j] = source[positions[j]];
+        }
+
+        unsigned int slot = hash_key(row, out_positions, keep_count) & (size - 1);
+        bool duplicate = false;
+        while (slots[slot] != 0) {
+            if (keys_equal(row_at(&out, slots[slot] - 1), out_positions, row, out_positions, keep_count)) {
+                duplicate = true;
+                break;
+            }
+            slot = (slot + 1) & (size - 1);
+        }
+
+        if (!duplicate) {
+            rows_append(&out, row);
+            slots[slot] = out.count;
+        }
+    }
+
+    free(slots);
+    return out;
+}
+
+/* Hash join: build on the right rows, probe with the left rows */
+static Rows hash_join(Rows* left, Rows* right) {
+    int shared_left[right->width > 0 ? right->width : 1];
+    int shared_right[right->width > 0 ? right->width : 1];
+    int extra[right->width > 0 ? right->width : 1];
+    int shared_count = 0;
+    int extra_count = 0;
+
+    for (int i = 0; i < right->width; i++) {
+        int position = column_of(left, right->columns[i]);
+        if (position >= 0) {
+            shared_left[shared_count] = position;
+            shared_right[shared_count] = i;
+            shared_count++;
+        } else {
+            extra[extra_count++] = i;
+        }
+    }
+
+    /* Output columns: left columns followed by the right-only columns */
+    int width = left->width + extra_count;
+    int columns[width > 0 ? width : 1];
+    InternId row[width > 0 ? width : 1];
+    memcpy(columns, left->columns, sizeof(int) * left->width);
+    for (int i = 0; i < extra_count; i++) {
+        columns[left->width + i] = right->columns[extra[i]];
+    }
+
+    Rows out;
+    rows_init(&out, columns, width);
+
+    RowIndex index;
+    build_index(&index, right, shared_right, shared_count);
+
+    for (int i = 0; i < left->count; i++) {
+        InternId* probe = row_at(left, i);
+        unsigned int bucket = hash_key(probe, shared_left, shared_count) & index.mask;
+
+        for (int j = index.heads[bucket]; j >= 0; j = index.next[j]) {
+            InternId* match = row_at(right, j);
+            if (!keys_equal(probe, shared_left, match, shared_right, shared_count)) {
+                continue;
+            }
+            memcpy(row, probe, sizeof(InternId) * left->width);
+            for (int k = 0; k < extra_count; k++) {
+                row[left->width + k] = match[extra[k]];
+            }
+            rows_append(&out, row);
+        }
+    }
+
+    free_index(&index);
+    return out;
+}
+
+static int compare_ids(const void* a, const void* b) {
+    InternId x = *(const InternId*)a;
+    InternId y = *(const InternId*)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static bool in_domain(PlanVariable* variable, InternId value) {
+    return bsearch(&value, variable->domain, variable->domain_size,
+                   sizeof(InternId), compare_ids) != NULL;
+}
+
+/* Scan the relation of an atom, keeping tuples consistent with the bindings */
+static Rows scan_atom(JoinPlan* plan, PlanAtom* atom, FactTable* facts, InternId* external_values) {
+    int columns[atom->arity > 0 ? atom->arity : 1];
+    int positions[atom->arity > 0 ? atom->arity : 1]; /* Column of each variable argument */
+    int width = 0;
+
+    for (int i = 0; i < atom->arity; i++) {
+        positions[i] = -1;
+        if (atom->args[i].kind != ARG_VARIABLE) {
+            continue;
+        }
+        for (int j = 0; j < width; j++) {
+            if (columns[j] == atom->args[i].index) {
+                positions[i] = j;
+            }
+        }
+        if (positions[i] < 0) {
+            positions[i] = width;
+            columns[width++] = atom->args[i].index;
+        }
+    }
+
+    Rows rows;
+    rows_init(&rows, columns, width);
+
+    Relation* relation = find_relation(facts, atom->predicate, atom->arity);
+    if (relation == NULL) {
+        return rows;
+    }
+
+    InternId row[width > 0 ? width : 1];
+    bool seen[width > 0 ? width : 1];
+
+    for (int t = 0; t < relation->count; t++) {
+        InternId* tuple = relation->tuples + (size_t)t * atom->arity;
+        bool match = true;
+        memset(seen, 0, sizeof(bool) * width);
+
+        for (int i = 0; i < atom->arity && match; i++) {
+            PlanArg* arg = &atom->args[i];
+            if (arg->kind == ARG_EXTERNAL) {
+                match = tuple[i] == external_values[arg->index];
+            } else if (seen[positions[i]]) {
+                match = row[positions[i]] == tuple[i];
+            } else {
+                seen[positions[i]] = true;
+                row[positions[i]] = tuple[i];
+                match = in_domain(&plan->variables[arg->index], tuple[i]);
+            }
+        }
+
+        if (match) {
+            rows_append(&rows, row);
+        }
+    }
+
+    return rows;
+}
+
+static bool atom_uses(PlanAtom* atom, int variable) {
+    for (int i = 0; i < atom->arity; i++) {
+        if (atom->args[i].kind == ARG_VARIABLE && atom->args[i].index == variable) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void print_atom(PlanAtom* atom) {
+    printf("%s(", interned_string(atom->predicate));
+    for (int i = 0; i < atom->arity; i++) {
+        printf("%s%s", i > 0 ? ", " : "", interned_string(atom->node->data.predicate.args[i]));
+    }
+    printf(")");
+}
+
+static void print_plan_header(JoinPlan* plan) {
+    printf("Join plan for quantifier chain at line %d:\n", plan->root->line);
+    printf("  Quantifiers:");
+    for (int i = 0; i < plan->variable_count; i++) {
+        bool first_of_kind = i == 0 || plan->variables[i - 1].universal != plan->variables[i].universal;
+        printf("%s%s", first_of_kind ? (plan->variables[i].universal ? " FORALL " : " EXISTS ") : ", ",
+               interned_string(plan->variables[i].name));
+    }
+    printf("\n");
+}
+
+/* Run a plan; external_values holds the current value of each external name */
+bool execute_join_plan(JoinPlan* plan, FactTable* facts, InternId* external_values, bool explain) {
+    explain = explain && !plan->explained;
+    plan->explained = plan->explained || explain;
+    if (explain) {
+        print_plan_header(plan);
+    }
+
+    /* A universal over an empty domain holds vacuously */
+    bool used[plan->variable_count > 0 ? plan->variable_count : 1];
+    memset(used, 0, sizeof(bool) * plan->variable_count);
+    for (int a = 0; a < plan->atom_count; a++) {
+        for (int i = 0; i < plan->atoms[a].arity; i++) {
+            if (plan->atoms[a].args[i].kind == ARG_VARIABLE) {
+                used[plan->atoms[a].args[i].index] = true;
+            }
+        }
+    }
+    for (int v = 0; v < plan->variable_count; v++) {
+        if (plan->variables[v].universal && plan->variables[v].domain_size == 0) {
+            if (explain) printf("  Result: universal over empty domain: TRUE\n");
+            return true;
+        }
+    }
+    for (int v = 0; v < plan->variable_count; v++) {
+        if (!plan->variables[v].universal && !used[v] && plan->variables[v].domain_size == 0) {
+            if (explain) printf("  Result: existential over empty domain: FALSE\n");
+            return false;
+        }
+    }
+
+    /* Scan every atom; its row count is its cardinality estimate */
+    Rows scans[plan->atom_count];
+    bool joined[plan->atom_count];
+    for (int a = 0; a < plan->atom_count; a++) {
+        scans[a] = scan_atom(plan, &plan->atoms[a], facts, external_values);
+        joined[a] = false;
+    }
+
+    Rows result;
+    int no_columns[1];
+    InternId empty_row[1];
+    rows_init(&result, no_columns, 0);
+    rows_append(&result, empty_row); /* The empty binding */
+
+    for (int step = 0; step < plan->atom_count; step++) {
+        /* Smallest atom sharing a variable with the result, else the smallest */
+        int best = -1;
+        bool best_connected = false;
+        for (int a = 0; a < plan->atom_count; a++) {
+            if (joined[a]) {
+                continue;
+            }
+            bool connected = false;
+            for (int c = 0; c < scans[a].width && !connected; c++) {
+                connected = column_of(&result, scans[a].columns[c]) >= 0;
+            }
+            if (best < 0 || (connected && !best_connected) ||
+                (connected == best_connected && scans[a].count < scans[best].count)) {
+                best = a;
+                best_connected = connected;
+            }
+        }
+        joined[best] = true;
+
+        Rows next = hash_join(&result, &scans[best]);
+        if (explain) {
+            printf("  %d. %s ", step + 1, step == 0 ? "Scan" : (best_connected ? "Hash join" : "Cross product"));
+            print_atom(&plan->atoms[best]);
+            printf(" [%d rows]: %d rows\n", scans[best].count, next.count);
+        }
+        rows_free(&result);
+        result = next;
+
+        /* Semi-join: drop existential variables no remaining atom needs */
+        int keep[result.width > 0 ? result.width : 1];
+        int keep_count = 0;
+        for (int c = 0; c < result.width; c++) {
+            int variable = result.columns[c];
+            bool needed = plan->variables[variable].universal;
+            for (int a = 0; a < plan->atom_count && !needed; a++) {
+                needed = !joined[a] && atom_uses(&plan->atoms[a], variable);
+            }
+            if (needed) {
+                keep[keep_count++] = variable;
+            }
+        }
+        if (keep_count < result.width) {
+            Rows projected = project(&result, keep, keep_count);
+            if (explain) {
+                printf("     Semi-join: project out");
+                for (int c = 0; c < result.width; c++) {
+                    if (column_of(&projected, result.columns[c]) < 0) {
+                        printf(" %s", interned_string(plan->variables[result.columns[c]].name));
+                    }
+                }
+                printf(": %d rows\n", projected.count);
+            }
+            rows_free(&result);
+            result = projected;
+        }
+
+        if (result.count == 0) {
+            break;
+        }
+    }
+
+    /* Every binding of the universal variables used by atoms must survive */
+    long long needed = 1;
+    for (int c = 0; c < result.width; c++) {
+        needed *= plan->variables[result.columns[c]].domain_size;
+    }
+    for (int v = 0; v < plan->variable_count; v++) {
+        if (plan->variables[v].universal && used[v] && column_of(&result, v) < 0) {
+            needed = -1; /* Stopped early with no rows left */
+        }
+    }
+    bool value = needed >= 0 && result.count == needed;
+
+    if (explain) {
+        printf("  Result: %d of %lld universal bindings satisfied: %s\n",
+               result.count, needed >= 0 ? needed : 0, value ? "TRUE" : "FALSE");
+    }
+
+    rows_free(&result);
+    for (int a = 0; a < plan->atom_count; a++) {
+        rows_free(&scans[a]);
+    }
+    return value;
+}
+
+/* Add a predicate of the conjunction to the plan */
+static void add_atom(ASTNode* node, JoinPlan* plan, int* capacity) {
+    if (plan->atom_count == *capacity) {
+        *capacity = *capacity == 0 ? 4 : *capacity * 2;
+        plan->atoms = (PlanAtom*)realloc(plan->atoms, sizeof(PlanAtom) * *capacity);
+    }
+    PlanAtom* atom = &plan->atoms[plan->atom_count++];
+    atom->node = node;
+    atom->predicate = node->data.predicate.name;
+    atom->arity = node->data.predicate.arg_count;
+    atom->args = (PlanArg*)malloc(sizeof(PlanArg) * (atom->arity > 0 ? atom->arity : 1));
+
+    for (int i = 0; i < atom->arity; i++) {
+        InternId name = node->data.predicate.args[i];
+        int index = -1;
+
+        for (int v = 0; v < plan->variable_count && index < 0; v++) {
+            if (plan->variables[v].name == name) {
+                index = v;
+            }
+        }
+        if (index >= 0) {
+            atom->args[i].kind = ARG_VARIABLE;
+            atom->args[i].index = index;
+            continue;
+        }
+
+        for (int e = 0; e < plan->external_count && index < 0; e++) {
+            if (plan->externals[e] == name) {
+                index = e;
+            }
+        }
+        if (index < 0) {
+            plan->externals = (InternId*)realloc(plan->externals, sizeof(InternId) * (plan->external_count + 1));
+            plan->externals[plan->external_count] = name;
+            index = plan->external_count++;
+        }
+        atom->args[i].kind = ARG_EXTERNAL;
+        atom->args[i].index = index;
+    }
+}
+
+/* State of collect_atoms */
+typedef struct {
+    JoinPlan* plan;
+    int capacity;
+    bool ok;
+} AtomCollection;
+
+static bool collect_atom_visit(ASTNode* node, VisitStage stage, int depth, void* data) {
+    AtomCollection* collection = (AtomCollection*)data;
+
+    if (stage != VISIT_ENTER || !collection->ok) {
+        return false;
+    }
+    if (node->type == NODE_BINARY_OP && node->data.binary.operator == OP_AND) {
+        return true;
+    }
+    if (node->type == NODE_PREDICATE) {
+        add_atom(node, collection->plan, &collection->capacity);
+    } else {
+        collection->ok = false;
+    }
+    return false;
+}
+
+/* Collect the atoms of a conjunction; fails on any other node */
+static bool collect_atoms(ASTNode* node, JoinPlan* plan) {
+    AtomCollection collection = { plan, 0, true };
+    walk_ast(node, collect_atom_visit, &collection);
+    return collection.ok;
+}
+
+/* Build a plan for a quantifier chain; returns NULL if the shape does not match */
+JoinPlan* plan_quantified_conjunction(ASTNode* node) {
+    JoinPlan* plan = (JoinPlan*)calloc(1, sizeof(JoinPlan));
+    plan->root = node;
+
+    /* FORALL* EXISTS* prefix with distinct variable names */
+    int count = 0;
+    for (ASTNode* q = node; q->type == NODE_QUANTIFIER; q = q->data.quantifier.expr) {
+        count++;
+    }
+    plan->variables = (PlanVariable*)calloc(count, sizeof(PlanVariable));
+
+    ASTNode* body = node;
+    bool seen_exists = false;
+    bool matches = true;
+    while (body->type == NODE_QUANTIFIER && matches) {
+        bool universal = body->data.quantifier.quantifier == QUANT_FORALL;
+        PlanVariable* variable = &plan->variables[plan->variable_count];
+
+        matches = !(universal && seen_exists);
+        for (int v = 0; v < plan->variable_count && matches; v++) {
+            matches = plan->variables[v].name != body->data.quantifier.variable;
+        }
+        seen_exists = seen_exists || !universal;
+
+        variable->name = body->data.quantifier.variable;
+        variable->universal = universal;
+        variable->domain = (InternId*)malloc(sizeof(InternId) * (body->data.quantifier.domain_size + 1));
+        memcpy(variable->domain, body->data.quantifier.domain,
+               sizeof(InternId) * body->data.quantifier.domain_size);
+        qsort(variable->domain, body->data.quantifier.domain_size, sizeof(InternId), compare_ids);
+        variable->domain_size = 0;
+        for (int i = 0; i < body->data.quantifier.domain_size; i++) {
+            if (i == 0 || variable->domain[i] != variable->domain[i - 1]) {
+                variable->domain[variable->domain_size++] = variable->domain[i];
+            }
+        }
+        plan->variable_count++;
+
+        body = body->data.quantifier.expr;
+    }
+
+    if (!matches || !collect_atoms(body, plan)) {
+        free_join_plan(plan);
+        return NULL;
+    }
+    return plan;
+}
+
+void free_join_plan(JoinPlan* plan) {
+    if (plan == NULL) {
+        return;
+    }
+    for (int v = 0; v < plan->variable_count; v++) {
+        free(plan->variables[v].domain);
+    }
+    for (int a = 0; a < plan->atom_count; a++) {
+        free(plan->atoms[a].args);
+    }
+    free(plan->variables);
+    free(plan->atoms);
+    free(plan->externals);
+    free(plan);
+}
@@ -0,0 +1,68 @@
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include <stdbool.h>
+#include "ast.h"
+#include "intern.h"
+#include "eval.h"
+
+/*
+ * Join planning for quantified conjunctions.
+ *
+ * A chain of quantifiers FORALL u1..uk EXISTS e1..em whose body is a
+ * conjunction of predicate atoms is a conjunctive query: it holds iff every
+ * binding of the universal variables extends to an existential binding that
+ * satisfies all atoms. Instead of nested loops with point lookups, the plan
+ * scans each atom's relation once, hash-joins the atoms in order of
+ * increasing cardinality, projects out existential variables as soon as no
+ * remaining atom needs them (semi-joins), and counts the universal bindings
+ * that survive.
+ */
+
+/* Kind of a predicate argument in a plan */
+typedef enum {
+    ARG_VARIABLE,                /* Variable bound by the quantifier chain */
+    ARG_EXTERNAL                 /* Any other name: resolved by the caller */
+} PlanArgKind;
+
+typedef struct {
+    PlanArgKind kind;
+    int index;                   /* Variable index or external index */
+} PlanArg;
+
+/* One predicate atom of the conjunction */
+typedef struct {
+    ASTNode* node;
+    InternId predicate;
+    int arity;
+    PlanArg* args;
+} PlanAtom;
+
+/* One variable of the quantifier chain */
+typedef struct {
+    InternId name;
+    bool universal;
+    InternId* domain;            /* Sorted, duplicate-free domain */
+    int domain_size;
+} PlanVariable;
+
+typedef struct JoinPlan {
+    ASTNode* root;
+    PlanVariable* variables;
+    int variable_count;
+    PlanAtom* atoms;
+    int atom_count;
+    InternId* externals;         /* Names resolved by the caller at run time */
+    int external_count;
+    bool explained;
+} JoinPlan;
+
+/* Build a plan for a quantifier chain; returns NULL if the shape does not match */
+JoinPlan* plan_quantified_conjunction(ASTNode* node);
+
+/* Run a plan; external_values holds the current value of each external name */
+bool execute_join_plan(JoinPlan* plan, FactTable* facts, InternId* external_values, bool explain);
+
+void free_join_plan(JoinPlan* plan);
+
+#endif /* PLANNER_H */
@@ -0,0 +1,67 @@
+#ifndef PREDICATES_H
+#define PREDICATES_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "intern.h"
+
+/*
+ * Global predicate registry. Predicates are not scoped: every use of a name
+ * anywhere in the program refers to the same predicate, so they are kept
+ * apart from the symbol table, keyed by interned name. Each one records its
+ * arity and position at first use, how often it is used, and the domain its
+ * arguments range over at every use. A predicate's handle is its index in
+ * order of first use.
+ */
+
+/* Domain size of an argument position that is not one domain at every use */
+#define ARGUMENT_CONSTANT (-1)   /* A constant, or a name no quantifier binds */
+#define ARGUMENT_MIXED (-2)      /* Uses disagree */
+
+typedef struct {
+    InternId* domain;            /* Interned domain of the variables passed, or NULL */
+    int domain_size;             /* Its size, or ARGUMENT_CONSTANT or ARGUMENT_MIXED */
+} ArgumentSignature;
+
+typedef struct {
+    InternId name;
+    int arity;                   /* Number of arguments at first use */
+    int handle;
+    long uses;
+    int line;                    /* Position of the first use */
+    int column;
+    ArgumentSignature* arguments;  /* One per argument, once a valid use is recorded */
+    bool has_signature;
+} PredicateInfo;
+
+typedef struct {
+    PredicateInfo* predicates;   /* By handle */
+    int count;
+    int capacity;
+    int* handles;                /* Handle + 1 of each name by InternId, 0 if unused */
+    int handles_size;
+} PredicateRegistry;
+
+PredicateRegistry* create_predicate_registry();
+void free_predicate_registry(PredicateRegistry* registry);
+
+/*
+ * Count a use of a predicate, registering it with this arity and position
+ * if it is new. The caller checks the arity against the one returned. The
+ * pointer is valid until the next predicate is registered.
+ */
+PredicateInfo* use_predicate(PredicateRegistry* registry, InternId name, int arity, int line, int column);
+
+/* The predicate with this name, or NULL if it has not been used */
+PredicateInfo* find_predicate(PredicateRegistry* registry, InternId name);
+
+/*
+ * Merge the domains of the arguments of one use with the predicate's arity
+ * into its signature; domains[i] is NULL for an argument no quantifier binds
+ */
+void record_signature(PredicateInfo* predicate, InternId** domains, const int* domain_sizes);
+
+/* Print every predicate with its arity, uses and argument domains */
+void print_predicate_registry(PredicateRegistry* registry, FILE* out);
+
+#endif /* PREDICATES_H */
@@ -0,0 +1,77 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+#include "ast.h"
+
+/*
+ * Per-phase timing and counters for --stats. Each phase's monotonic wall
+ * time and process CPU time are measured with a stopwatch; a phase that runs
+ * inside another (code generation of streamed formulas during parsing, say)
+ * is taken out of the outer one, so the phases add up to the total.
+ *
+ * Lexing runs a token at a time inside parsing. Its wall time is measured
+ * around every call to the scanner, and the CPU time of parsing is split
+ * between the two in the same proportion, since reading the CPU clock per
+ * token would cost more than scanning the token.
+ */
+
+typedef enum {
+    PHASE_LEX,
+    PHASE_PARSE,
+    PHASE_SEMANTIC,
+    PHASE_CODEGEN,
+    PHASE_COUNT
+} CompilePhase;
+
+#define NODE_TYPE_COUNT (NODE_NARY_OP + 1)
+
+typedef struct CompileStats {
+    double wall[PHASE_COUNT];    /* Seconds spent in each phase */
+    double cpu[PHASE_COUNT];
+    bool ran[PHASE_COUNT];
+    double timed_wall;           /* Sum of the above, to take nested phases out */
+    double timed_cpu;
+    long tokens;
+    long nodes[NODE_TYPE_COUNT]; /* AST nodes created, by NodeType */
+    long lookups;                /* Symbol table lookups */
+    long instructions;           /* Generated instructions */
+    long labels;                 /* Labels defined in the generated code */
+    long bytes;                  /* Bytes of assembly written */
+} CompileStats;
+
+/* Clock readings at the start of a phase */
+typedef struct {
+    double wall;
+    double cpu;
+    double timed_wall;
+    double timed_cpu;
+    double lex_wall;
+} Stopwatch;
+
+void init_compile_stats(CompileStats* stats);
+
+/* Monotonic time in seconds, cheap enough to read around every token */
+static inline double monotonic_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+Stopwatch start_phase(const CompileStats* stats);
+void stop_phase(CompileStats* stats, CompilePhase phase, Stopwatch watch);
+
+/* Count one token that took the given wall time to scan (called by the parser) */
+static inline void record_token(CompileStats* stats, double seconds) {
+    stats->tokens++;
+    stats->wall[PHASE_LEX] += seconds;
+    stats->timed_wall += seconds;
+}
+
+/* Print the report as a table or as a JSON object */
+void print_compile_stats(const CompileStats* stats, FILE* out);
+void write_compile_stats_json(const CompileStats* stats, FILE* out);
+
+#endif /* STATS_H */
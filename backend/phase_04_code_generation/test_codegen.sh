@@ -145,5 +145,426 @@ run_test "03_and.logic" "-s"
 run_test "04_or.logic" "-s"
 run_test "08_complex.logic" "-s"
 
+# Test memoization of loop-invariant quantifiers
+echo "===== Testing Loop-Invariant Memoization ====="
+run_test "16_memo_invariant.logic" "-m"
+run_test "12_nested_quantifiers.logic" "-m"
+
+# The flat AST layout must round-trip every test to the same output
+echo "===== Testing Flat AST Round Trip ====="
+for test_file in "$TEST_PATH"/*.logic; do
+    name=$(basename "$test_file" .logic)
+    ./code_generator "$test_file" "${RESULTS_DIR}/${name}_tree.s" -m > "${RESULTS_DIR}/${name}_tree.txt" 2>&1
+    ./code_generator "$test_file" "${RESULTS_DIR}/${name}_flat.s" -m --flat-ast > "${RESULTS_DIR}/${name}_flat.txt" 2>&1
+    sed -i 's/_flat\.s/_tree.s/' "${RESULTS_DIR}/${name}_flat.txt"
+    if cmp -s "${RESULTS_DIR}/${name}_tree.s" "${RESULTS_DIR}/${name}_flat.s" &&
+       cmp -s "${RESULTS_DIR}/${name}_tree.txt" "${RESULTS_DIR}/${name}_flat.txt"; then
+        echo "Flat AST round trip: $name PASSED"
+    else
+        echo "Flat AST round trip: $name FAILED"
+    fi
+done
+echo
+
+# Code generated from a saved AST cache must match code generated from source
+echo "===== Testing AST Cache Round Trip ====="
+for test_file in "$TEST_PATH"/*.logic; do
+    name=$(basename "$test_file" .logic)
+    ./code_generator "$test_file" "${RESULTS_DIR}/${name}_tree.s" -m --save-ast "${RESULTS_DIR}/${name}.astc" > "${RESULTS_DIR}/${name}_tree.txt" 2>&1
+    ./code_generator "${RESULTS_DIR}/${name}.astc" "${RESULTS_DIR}/${name}_cache.s" -m --load-ast > "${RESULTS_DIR}/${name}_cache.txt" 2>&1
+    sed -i 's/_cache\.s/_tree.s/' "${RESULTS_DIR}/${name}_cache.txt"
+    if cmp -s "${RESULTS_DIR}/${name}_tree.s" "${RESULTS_DIR}/${name}_cache.s" &&
+       cmp -s <(tail -n +2 "${RESULTS_DIR}/${name}_tree.txt") <(tail -n +2 "${RESULTS_DIR}/${name}_cache.txt"); then
+        echo "AST cache round trip: $name PASSED"
+    else
+        echo "AST cache round trip: $name FAILED"
+    fi
+done
+# A truncated cache must be rejected
+head -c 100 "${RESULTS_DIR}/08_complex.astc" > "${RESULTS_DIR}/truncated.astc"
+if ./code_generator "${RESULTS_DIR}/truncated.astc" /dev/null --load-ast 2>&1 | grep -q "Loading failed"; then
+    echo "AST cache truncated file: PASSED"
+else
+    echo "AST cache truncated file: FAILED"
+fi
+rm -f "${RESULTS_DIR}"/*.astc
+echo
+
+# The allocation-counting build must free every allocation it makes
+echo "===== Testing Allocation Counts ====="
+if [ ! -f "code_generator_counted" ]; then
+    make code_generator_counted > /dev/null
+fi
+for test_file in "$TEST_PATH"/*.logic; do
+    name=$(basename "$test_file" .logic)
+    if ./code_generator_counted "$test_file" /dev/null -m -q > "${RESULTS_DIR}/${name}_allocs.txt" 2>&1 &&
+       grep -q "^Total: .* 0 live$" "${RESULTS_DIR}/${name}_allocs.txt"; then
+        echo "Allocation count: $name PASSED ($(grep "^Parse: .* per input byte" "${RESULTS_DIR}/${name}_allocs.txt" | cut -d' ' -f2) parse allocations per input byte)"
+    else
+        echo "Allocation count: $name FAILED"
+    fi
+done
+# A cache that cannot be written fails the run, which must still free everything
+first_test=$(ls "$TEST_PATH"/*.logic | head -n 1)
+if ! ./code_generator_counted "$first_test" /dev/null -q --save-ast "${RESULTS_DIR}/missing/cache.astc" > "${RESULTS_DIR}/cache_failure_allocs.txt" 2>&1 &&
+   grep -q "^Total: .* 0 live$" "${RESULTS_DIR}/cache_failure_allocs.txt"; then
+    echo "Allocation count: failed cache write PASSED"
+else
+    echo "Allocation count: failed cache write FAILED"
+fi
+echo
+
+# With --mmap files are mapped and scanned in place; the result must match
+# reading the same text through a pipe, which cannot be mapped, including
+# when the file ends exactly on a page boundary
+echo "===== Mapped Input Test ====="
+cp "${TEST_PATH}/12_nested_quantifiers.logic" "${RESULTS_DIR}/mapped_small.logic"
+for size in 4096 16384; do
+    # Whole lines of atoms, padded with blanks to exactly $size bytes
+    file="${RESULTS_DIR}/mapped_${size}.logic"
+    { cat "${TEST_PATH}/12_nested_quantifiers.logic"; yes "P(a)" | head -n $((size / 5 - 20)); } > "$file"
+    printf "%*s" $((size - $(wc -c < "$file"))) "" >> "$file"
+done
+for name in mapped_small mapped_4096 mapped_16384; do
+    ./code_generator "${RESULTS_DIR}/${name}.logic" "${RESULTS_DIR}/${name}_file.s" -m --mmap > "${RESULTS_DIR}/${name}_file.txt" 2>&1
+    ./code_generator <(cat "${RESULTS_DIR}/${name}.logic") "${RESULTS_DIR}/${name}_pipe.s" -m --mmap > "${RESULTS_DIR}/${name}_pipe.txt" 2>&1
+    if grep -q "Assembly code generated successfully" "${RESULTS_DIR}/${name}_file.txt" &&
+       cmp -s "${RESULTS_DIR}/${name}_file.s" "${RESULTS_DIR}/${name}_pipe.s" &&
+       cmp -s <(tail -n +2 "${RESULTS_DIR}/${name}_file.txt" | sed 's/_file\.s$//') \
+              <(tail -n +2 "${RESULTS_DIR}/${name}_pipe.txt" | sed 's/_pipe\.s$//'); then
+        echo "Mapped input: $name ($(wc -c < "${RESULTS_DIR}/${name}.logic") bytes) PASSED"
+    else
+        echo "Mapped input: $name FAILED"
+    fi
+done
+: > "${RESULTS_DIR}/mapped_empty.logic"
+if ./code_generator "${RESULTS_DIR}/mapped_empty.logic" /dev/null --mmap 2>&1 | grep -q "Parsing failed"; then
+    echo "Mapped input: empty file PASSED"
+else
+    echo "Mapped input: empty file FAILED"
+fi
+rm -f "${RESULTS_DIR}"/mapped_*
+echo
+
+# The hand-written scanner must see the same tokens, positions and errors as
+# Flex on random inputs, with and without its SIMD blocks, and compile every
+# test to the same code
+echo "===== Fast Lexer Test ====="
+fuzzers="lexer_fuzz lexer_fuzz_scalar"
+if grep -q avx2 /proc/cpuinfo 2>/dev/null; then
+    fuzzers="$fuzzers lexer_fuzz_avx2"
+fi
+for fuzzer in $fuzzers; do
+    if [ ! -f "$fuzzer" ]; then
+        make $fuzzer > /dev/null
+    fi
+    if ./$fuzzer 20000 > "${RESULTS_DIR}/${fuzzer}.txt" 2>&1; then
+        echo "Scanner fuzzing: $(tail -n 1 "${RESULTS_DIR}/${fuzzer}.txt") PASSED"
+    else
+        echo "Scanner fuzzing: $fuzzer FAILED"
+        head -n 40 "${RESULTS_DIR}/${fuzzer}.txt"
+    fi
+    rm -f "${RESULTS_DIR}/${fuzzer}.txt"
+done
+for test_file in "$TEST_PATH"/*.logic; do
+    name=$(basename "$test_file" .logic)
+    ./code_generator "$test_file" "${RESULTS_DIR}/${name}_flex.s" -m > "${RESULTS_DIR}/${name}_flex.txt" 2>&1
+    ./code_generator "$test_file" "${RESULTS_DIR}/${name}_fast.s" -m --fast-lexer > "${RESULTS_DIR}/${name}_fast.txt" 2>&1
+    if cmp -s "${RESULTS_DIR}/${name}_flex.s" "${RESULTS_DIR}/${name}_fast.s" &&
+       cmp -s <(sed 's/_flex\.s$//' "${RESULTS_DIR}/${name}_flex.txt") \
+              <(sed 's/_fast\.s$//' "${RESULTS_DIR}/${name}_fast.txt"); then
+        echo "Fast lexer: $name PASSED"
+    else
+        echo "Fast lexer: $name FAILED"
+    fi
+    rm -f "${RESULTS_DIR}/${name}"_flex.* "${RESULTS_DIR}/${name}"_fast.*
+done
+echo
+
+# Separate parse contexts can parse on many threads at once
+echo "===== Concurrent Parsing Test ====="
+if [ ! -f "parse_threads" ]; then
+    make parse_threads > /dev/null
+fi
+if ./parse_threads 16 4096 > "${RESULTS_DIR}/parse_threads.txt" 2>&1; then
+    echo "Concurrent parsing: $(cat "${RESULTS_DIR}/parse_threads.txt") PASSED"
+else
+    echo "Concurrent parsing: 4096 inputs on 16 threads FAILED"
+fi
+echo
+
+# Streaming compiles every formula into its own function, and the memory used
+# must not grow with the number of formulas
+echo "===== Streaming Test ====="
+for test_file in "$TEST_PATH"/*.logic; do
+    name=$(basename "$test_file" .logic)
+    ./code_generator "$test_file" "${RESULTS_DIR}/${name}_stream.s" -m -q --stream > "${RESULTS_DIR}/${name}_stream.txt" 2>&1
+    count=$(grep "^Formulas compiled: " "${RESULTS_DIR}/${name}_stream.txt" | cut -d' ' -f3)
+    if [ -n "$count" ] && [ "$(grep -c "^    call formula_" "${RESULTS_DIR}/${name}_stream.s")" = "$count" ] &&
+       [ "$(grep -c "^formula_[0-9]*:$" "${RESULTS_DIR}/${name}_stream.s")" = "$count" ]; then
+        echo "Streaming: $name PASSED ($count formulas)"
+    else
+        echo "Streaming: $name FAILED"
+    fi
+done
+for formulas in 1000 100000; do
+    yes "forall x [a, b] (P(x, c) -> exists y [c] R(x, y)) \\/ ~S(d)" | head -n $formulas > "${RESULTS_DIR}/stream_${formulas}.logic"
+    ./code_generator "${RESULTS_DIR}/stream_${formulas}.logic" /dev/null -m -q --stream --mem-stats > "${RESULTS_DIR}/stream_${formulas}.txt" 2>&1
+done
+# A mapped input drops the pages it has scanned, so it must not grow either
+./code_generator "${RESULTS_DIR}/stream_100000.logic" /dev/null -m -q --stream --mem-stats --mmap > "${RESULTS_DIR}/stream_mapped.txt" 2>&1
+mapped_rss=$(grep "^Peak resident set: " "${RESULTS_DIR}/stream_mapped.txt" | cut -d' ' -f4)
+small_rss=$(grep "^Peak resident set: " "${RESULTS_DIR}/stream_1000.txt" | cut -d' ' -f4)
+large_rss=$(grep "^Peak resident set: " "${RESULTS_DIR}/stream_100000.txt" | cut -d' ' -f4)
+if grep -q "^Formulas compiled: 100000$" "${RESULTS_DIR}/stream_100000.txt" &&
+   grep -q "peak 65536 bytes reserved$" "${RESULTS_DIR}/stream_100000.txt" &&
+   [ -n "$small_rss" ] && [ -n "$large_rss" ] && [ "$large_rss" -lt $((small_rss + 1024)) ] &&
+   [ -n "$mapped_rss" ] && [ "$mapped_rss" -lt $((small_rss + 1024)) ]; then
+    echo "Streaming memory: 100000 formulas in one arena block, ${large_rss} KB peak, ${mapped_rss} KB mapped (1000 formulas: ${small_rss} KB) PASSED"
+else
+    echo "Streaming memory: 100000 formulas FAILED"
+fi
+rm -f "${RESULTS_DIR}"/stream_*.logic "${RESULTS_DIR}"/stream_*.txt
+echo
+
+# An incremental build reparses and recompiles only the formulas around an
+# edit, and must produce exactly what a build without a cache produces
+echo "===== Incremental Build Test ====="
+for test_file in "$TEST_PATH"/*.logic; do
+    name=$(basename "$test_file" .logic)
+    rm -f "${RESULTS_DIR}/${name}.bld"
+    ./code_generator "$test_file" "${RESULTS_DIR}/${name}_build.s" -m --incremental "${RESULTS_DIR}/${name}.bld" > /dev/null 2>&1
+    ./code_generator "$test_file" "${RESULTS_DIR}/${name}_rebuild.s" -m --incremental "${RESULTS_DIR}/${name}.bld" > "${RESULTS_DIR}/${name}_rebuild.txt" 2>&1
+    if cmp -s "${RESULTS_DIR}/${name}_build.s" "${RESULTS_DIR}/${name}_rebuild.s" &&
+       grep -q "^Incremental build: 0 reparsed .* 0 compiled" "${RESULTS_DIR}/${name}_rebuild.txt"; then
+        echo "Incremental build: $name PASSED"
+    else
+        echo "Incremental build: $name FAILED"
+    fi
+    rm -f "${RESULTS_DIR}/${name}.bld" "${RESULTS_DIR}/${name}"_build.s "${RESULTS_DIR}/${name}"_rebuild.*
+done
+awk 'BEGIN { for (i = 0; i < 5000; i++) {
+                 if (i % 10 == 0) print "/* group " i / 10 " */"
+                 print "forall x [a, b] (P(x, c" i ") -> exists y [c] R(x, y)) \\/ ~S(d" i ")" } }' > "${RESULTS_DIR}/build_base.logic"
+rm -f "${RESULTS_DIR}/build_base.bld"
+./code_generator "${RESULTS_DIR}/build_base.logic" /dev/null -m --incremental "${RESULTS_DIR}/build_base.bld" > /dev/null 2>&1
+# Each edit is checked against a build of the edited file without a cache
+check_edit() {
+    local edit=$1 reparsed=$2
+    cp "${RESULTS_DIR}/build_base.bld" "${RESULTS_DIR}/build_edit.bld"
+    ./code_generator "${RESULTS_DIR}/build_edit.logic" "${RESULTS_DIR}/build_edit.s" -m \
+        --incremental "${RESULTS_DIR}/build_edit.bld" > "${RESULTS_DIR}/build_edit.txt" 2>&1
+    rm -f "${RESULTS_DIR}/build_full.bld"
+    ./code_generator "${RESULTS_DIR}/build_edit.logic" "${RESULTS_DIR}/build_full.s" -m \
+        --incremental "${RESULTS_DIR}/build_full.bld" > /dev/null 2>&1
+    local stats=$(grep "^Incremental build: " "${RESULTS_DIR}/build_edit.txt")
+    local count=$(echo "$stats" | cut -d' ' -f3)
+    if cmp -s "${RESULTS_DIR}/build_edit.s" "${RESULTS_DIR}/build_full.s" &&
+       cmp -s "${RESULTS_DIR}/build_edit.bld" "${RESULTS_DIR}/build_full.bld" &&
+       [ -n "$count" ] && [ "$count" -le "$reparsed" ]; then
+        echo "Incremental edit: $edit (${stats#Incremental build: }) PASSED"
+    else
+        echo "Incremental edit: $edit FAILED"
+    fi
+}
+sed 's/P(x, c2500)/P(x, c2500, e)/' "${RESULTS_DIR}/build_base.logic" > "${RESULTS_DIR}/build_edit.logic"
+check_edit "change a formula" 3
+awk '{ print } /c2500\)/ { print "Q(e) /\\ ~Q(f)" }' "${RESULTS_DIR}/build_base.logic" > "${RESULTS_DIR}/build_edit.logic"
+check_edit "insert a formula" 3
+sed '/c2500)/d' "${RESULTS_DIR}/build_base.logic" > "${RESULTS_DIR}/build_edit.logic"
+check_edit "delete a formula" 3
+sed 's|~S(d2500)$|~S(d2500) /\\|' "${RESULTS_DIR}/build_base.logic" > "${RESULTS_DIR}/build_edit.logic"
+check_edit "join two formulas" 4
+sed 's|~S(d2503)$|~S(d2503) /*|' "${RESULTS_DIR}/build_base.logic" > "${RESULTS_DIR}/build_edit.logic"
+check_edit "comment out formulas" 12
+{ cat "${RESULTS_DIR}/build_base.logic"; echo "Q(e)"; } > "${RESULTS_DIR}/build_edit.logic"
+check_edit "append a formula" 2
+# A syntax error fails the build and leaves the cache as it was
+sed 's/P(x, c2500)/P(x, c2500/' "${RESULTS_DIR}/build_base.logic" > "${RESULTS_DIR}/build_edit.logic"
+cp "${RESULTS_DIR}/build_base.bld" "${RESULTS_DIR}/build_edit.bld"
+if ! ./code_generator "${RESULTS_DIR}/build_edit.logic" /dev/null -m --incremental "${RESULTS_DIR}/build_edit.bld" > /dev/null 2>&1 &&
+   cmp -s "${RESULTS_DIR}/build_base.bld" "${RESULTS_DIR}/build_edit.bld"; then
+    echo "Incremental edit: syntax error keeps the cache PASSED"
+else
+    echo "Incremental edit: syntax error keeps the cache FAILED"
+fi
+rm -f "${RESULTS_DIR}"/build_*
+echo
+
+# Long lists are built in linear time and keep their order
+echo "===== Long List Test ====="
+awk 'BEGIN { printf "forall x ["; for (i = 0; i < 100000; i++) printf "%sd%d", (i ? ", " : ""), i;
+             printf "] P("; for (i = 0; i < 100000; i++) printf "%sa%d", (i ? ", " : ""), i; print ")" }' > "${RESULTS_DIR}/long_lists.logic"
+./code_generator "${RESULTS_DIR}/long_lists.logic" /dev/null > "${RESULTS_DIR}/long_lists.txt" 2>&1
+if grep -q "^Domain: \[d99999, d99998, .*, d0\]$" "${RESULTS_DIR}/long_lists.txt" &&
+   grep -q "^  Arguments: \[a99999, a99998, .*, a0\]$" "${RESULTS_DIR}/long_lists.txt"; then
+    echo "Long lists: 100000-element domain and argument list PASSED"
+else
+    echo "Long lists: 100000-element domain and argument list FAILED"
+fi
+rm -f "${RESULTS_DIR}/long_lists.logic" "${RESULTS_DIR}/long_lists.txt"
+echo
+
+# A million top-level formulas form a million-deep implicit AND spine, and a
+# million negations nest as deeply; no pass may run out of stack on either
+echo "===== Deep Formula Stress Test ====="
+yes "P(a)" | head -n 1000000 > "${RESULTS_DIR}/deep_spine.logic"
+{ yes "~" | head -n 1000000 | tr '\n' ' '; echo "P(a)"; } > "${RESULTS_DIR}/deep_not.logic"
+for name in deep_spine deep_not; do
+    for options in "-s -m" "-m --flat-ast" "-b"; do
+        if ./code_generator "${RESULTS_DIR}/${name}.logic" /dev/null -q $options 2>&1 | grep -q "Assembly code generated successfully"; then
+            echo "Deep formula: $name ($options) PASSED"
+        else
+            echo "Deep formula: $name ($options) FAILED"
+        fi
+    done
+done
+rm -f "${RESULTS_DIR}/deep_spine.logic" "${RESULTS_DIR}/deep_not.logic"
+echo
+
+# A chain of one associative operator is generated as a flat sequence: one
+# exit label for a short-circuit AND, one stack slot for an XOR, and -b keeps
+# it shallow; every form must give the code the same predicates in order
+echo "===== Associative Chain Test ====="
+awk 'BEGIN { for (i = 0; i < 10000; i++) printf "%sP(a%d)", (i ? " /\\ " : ""), i; print "" }' > "${RESULTS_DIR}/chain_and.logic"
+awk 'BEGIN { for (i = 0; i < 10000; i++) printf "%s(Q(b%d)", (i ? " ^ " : ""), i; for (i = 0; i < 10000; i++) printf ")"; print "" }' > "${RESULTS_DIR}/chain_xor.logic"
+./code_generator "${RESULTS_DIR}/chain_and.logic" "${RESULTS_DIR}/chain_and.s" -q -s > /dev/null 2>&1
+if [ "$(grep -c "je .end_" "${RESULTS_DIR}/chain_and.s")" = 9999 ] &&
+   [ "$(grep -c "^\.end_" "${RESULTS_DIR}/chain_and.s")" = 1 ] &&
+   ! grep -q "pushl %eax" "${RESULTS_DIR}/chain_and.s"; then
+    echo "Associative chain: short-circuit AND shares one exit label PASSED"
+else
+    echo "Associative chain: short-circuit AND shares one exit label FAILED"
+fi
+./code_generator "${RESULTS_DIR}/chain_xor.logic" "${RESULTS_DIR}/chain_xor.s" -q > /dev/null 2>&1
+if [ "$(grep -c "pushl %eax" "${RESULTS_DIR}/chain_xor.s")" = 1 ] &&
+   [ "$(grep -c "xorl %eax, (%esp)" "${RESULTS_DIR}/chain_xor.s")" = 9998 ]; then
+    echo "Associative chain: right-nested XOR uses one stack slot PASSED"
+else
+    echo "Associative chain: right-nested XOR uses one stack slot FAILED"
+fi
+for name in chain_and chain_xor; do
+    ./code_generator "${RESULTS_DIR}/${name}.logic" "${RESULTS_DIR}/${name}_flat.s" -q > /dev/null 2>&1
+    ./code_generator "${RESULTS_DIR}/${name}.logic" "${RESULTS_DIR}/${name}_balanced.s" -q -b > /dev/null 2>&1
+    if grep "Predicate call" "${RESULTS_DIR}/${name}_flat.s" > "${RESULTS_DIR}/${name}_flat.txt" &&
+       grep "Predicate call" "${RESULTS_DIR}/${name}_balanced.s" | cmp -s - "${RESULTS_DIR}/${name}_flat.txt" &&
+       [ "$(grep -c "pushl %eax" "${RESULTS_DIR}/${name}_balanced.s")" = 9999 ]; then
+        echo "Associative chain: $name balanced with -b PASSED"
+    else
+        echo "Associative chain: $name balanced with -b FAILED"
+    fi
+done
+rm -f "${RESULTS_DIR}"/chain_*
+echo
+
+# Bound variables read the slot of their own quantifier's loop, including a
+# variable that shadows another; names no quantifier binds stay constants
+echo "===== Variable Slot Test ====="
+echo "forall x [a, b] (exists y [a, b] ((x <-> y) /\\ (forall x [c] (x \\/ z))))" > "${RESULTS_DIR}/slots.logic"
+for options in "-s" "-m" "--stream"; do
+    ./code_generator "${RESULTS_DIR}/slots.logic" "${RESULTS_DIR}/slots.s" -q $options > /dev/null 2>&1
+    if grep -A1 "Variable reference: x (slot 0)" "${RESULTS_DIR}/slots.s" | grep -q "movl quant_slots+0, %eax" &&
+       grep -A1 "Variable reference: y (slot 1)" "${RESULTS_DIR}/slots.s" | grep -q "movl quant_slots+4, %eax" &&
+       grep -A1 "Variable reference: x (slot 2)" "${RESULTS_DIR}/slots.s" | grep -q "movl quant_slots+8, %eax" &&
+       grep -q "Variable reference: z (assumed TRUE)" "${RESULTS_DIR}/slots.s" &&
+       [ "$(grep -c "movl %edx, quant_slots+" "${RESULTS_DIR}/slots.s")" = 3 ] &&
+       grep -q "lcomm quant_slots, 12" "${RESULTS_DIR}/slots.s"; then
+        echo "Variable slots ($options) PASSED"
+    else
+        echo "Variable slots ($options) FAILED"
+    fi
+done
+rm -f "${RESULTS_DIR}"/slots.*
+echo
+
+# Each predicate reads its own fact table, indexed by the slots of its
+# arguments with constants folded into the offset; the tables are declared
+# once per function, and a call with another arity is assumed TRUE
+echo "===== Fact Table Test ====="
+echo "forall x [a, b] exists y [a, b] (Q(x, y) /\\ R(y, k, x) /\\ Q(y, x))" > "${RESULTS_DIR}/facts.logic"
+echo "exists z [a] (Q(z, k) \\/ Q(z))" >> "${RESULTS_DIR}/facts.logic"
+for options in "-s" "-m" "--stream"; do
+    ./code_generator "${RESULTS_DIR}/facts.logic" "${RESULTS_DIR}/facts.s" -q $options > /dev/null 2>&1
+    if grep -A4 "Predicate call: Q/2" "${RESULTS_DIR}/facts.s" | grep -q "movzbl facts_Q_2(%ecx), %eax" &&
+       grep -A5 "Predicate call: R/3" "${RESULTS_DIR}/facts.s" | grep -q "movzbl facts_R_3+2(%ecx), %eax" &&
+       grep -A2 "Predicate call: Q/2" "${RESULTS_DIR}/facts.s" | grep -q "movzbl facts_Q_2+2(%ecx), %eax" &&
+       grep -q "Predicate call: Q (assumed TRUE)" "${RESULTS_DIR}/facts.s" &&
+       [ "$(grep -c "comm facts_Q_2, 4, 1" "${RESULTS_DIR}/facts.s")" = "$([ "$options" = "--stream" ] && echo 2 || echo 1)" ] &&
+       [ "$(grep -c "comm facts_R_3, 8, 1" "${RESULTS_DIR}/facts.s")" = 1 ]; then
+        echo "Fact tables ($options) PASSED"
+    else
+        echo "Fact tables ($options) FAILED"
+    fi
+done
+rm -f "${RESULTS_DIR}"/facts.*
+echo
+
+# Generated workloads are reproducible from their seed and valid input for
+# every mode of the code generator and for the evaluator
+echo "===== Workload Generator Test ====="
+for program in gen_workload evaluator; do
+    if [ ! -f "$program" ]; then
+        make $program > /dev/null
+    fi
+done
+./gen_workload -n 500 -d 5 -q 3 --seed 42 -o "${RESULTS_DIR}/workload.logic" --facts "${RESULTS_DIR}/workload_facts.logic" 2> /dev/null
+if ./gen_workload -n 500 -d 5 -q 3 --seed 42 2> /dev/null | cmp -s - "${RESULTS_DIR}/workload.logic" &&
+   ! ./gen_workload -n 500 -d 5 -q 3 --seed 43 2> /dev/null | cmp -s - "${RESULTS_DIR}/workload.logic"; then
+    echo "Workload generator: same seed, same workload PASSED"
+else
+    echo "Workload generator: same seed, same workload FAILED"
+fi
+for options in "-s -m" "-o" "-b" "--stream" "--fast-lexer"; do
+    if ./code_generator "${RESULTS_DIR}/workload.logic" /dev/null -q $options 2>&1 | grep -q "^Assembly code generated successfully"; then
+        echo "Workload generator: compiles ($options) PASSED"
+    else
+        echo "Workload generator: compiles ($options) FAILED"
+    fi
+done
+plain=$(./evaluator "${RESULTS_DIR}/workload.logic" "${RESULTS_DIR}/workload_facts.logic" | grep "^Result:")
+join=$(./evaluator "${RESULTS_DIR}/workload.logic" "${RESULTS_DIR}/workload_facts.logic" -m -j | grep "^Result:")
+if [ -n "$plain" ] && [ "$plain" == "$join" ]; then
+    echo "Workload generator: evaluates against generated facts PASSED"
+else
+    echo "Workload generator: evaluates against generated facts FAILED"
+fi
+./gen_workload --size 1M -o "${RESULTS_DIR}/workload.logic" 2> /dev/null
+if [ "$(stat -c %s "${RESULTS_DIR}/workload.logic")" -ge 1048576 ]; then
+    echo "Workload generator: --size 1M PASSED"
+else
+    echo "Workload generator: --size 1M FAILED"
+fi
+rm -f "${RESULTS_DIR}"/workload*
+echo
+
+# --stats reports each phase and counts exactly what was written
+echo "===== Stats Test ====="
+./gen_workload -n 300 -d 4 -q 2 --seed 9 -o "${RESULTS_DIR}/stats.logic" 2> /dev/null
+for options in "-s -m" "--stream"; do
+    ./code_generator "${RESULTS_DIR}/stats.logic" "${RESULTS_DIR}/stats.s" -q $options --stats \
+        --stats-json "${RESULTS_DIR}/stats.json" > "${RESULTS_DIR}/stats.txt" 2>&1
+    instructions=$(grep -c "^    [a-z]" "${RESULTS_DIR}/stats.s")
+    labels=$(grep -c "^\.[A-Za-z0-9_]*:$" "${RESULTS_DIR}/stats.s")
+    bytes=$(stat -c %s "${RESULTS_DIR}/stats.s")
+    if grep -q "^Lexing  *[0-9.]* *[0-9.]*$" "${RESULTS_DIR}/stats.txt" &&
+       grep -q "^Parsing " "${RESULTS_DIR}/stats.txt" && grep -q "^Total " "${RESULTS_DIR}/stats.txt" &&
+       grep -q "^Generated code: $instructions instructions, $labels labels, $bytes bytes$" "${RESULTS_DIR}/stats.txt" &&
+       grep -q "\"code\": { \"instructions\": $instructions, \"labels\": $labels, \"bytes\": $bytes }" "${RESULTS_DIR}/stats.json" &&
+       grep -q "\"codegen\": { \"wall_ms\": [0-9.]*, \"cpu_ms\": [0-9.]* }" "${RESULTS_DIR}/stats.json"; then
+        echo "Stats: phase times and code counts ($options) PASSED"
+    else
+        echo "Stats: phase times and code counts ($options) FAILED"
+    fi
+done
+tokens=$(grep "^Tokens: " "${RESULTS_DIR}/stats.txt")
+./code_generator "${RESULTS_DIR}/stats.logic" /dev/null -q --fast-lexer --stats > "${RESULTS_DIR}/stats.txt" 2>&1
+if [ -n "$tokens" ] && grep -q "^$tokens$" "${RESULTS_DIR}/stats.txt"; then
+    echo "Stats: both scanners count the same tokens PASSED"
+else
+    echo "Stats: both scanners count the same tokens FAILED"
+fi
+rm -f "${RESULTS_DIR}"/stats.*
+echo
+
 echo "All code generation tests completed."
 echo "Assembly output files are in the $RESULTS_DIR directory."
\ No newline at end of file
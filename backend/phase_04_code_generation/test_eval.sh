@@ -0,0 +1,116 @@
+#!/bin/bash
+# Make this script executable
+chmod +x "$0"
+
+# Define paths and directories
+TEST_PATH="eval_tests"
+FACTS="${TEST_PATH}/facts.logic"
+
+# Ensure the evaluator is built
+if [ ! -f "evaluator" ]; then
+    echo "Evaluator not found. Building..."
+    make evaluator
+fi
+
+failures=0
+
+# Function to run a test plain, memoized and with join evaluation
+run_test() {
+    local test_file="${TEST_PATH}/$1"
+    local expected="$2"
+    
+    echo -n "Running test: $1... "
+    
+    local plain=$(./evaluator "$test_file" "$FACTS" | grep "^Result:")
+    local memo=$(./evaluator "$test_file" "$FACTS" -m | grep "^Result:")
+    local join=$(./evaluator "$test_file" "$FACTS" -j | grep "^Result:")
+    
+    if [ "$plain" == "Result: $expected" ] && [ "$memo" == "Result: $expected" ] && [ "$join" == "Result: $expected" ]; then
+        echo "PASSED"
+    else
+        echo "FAILED (expected $expected, got '$plain' / memoized '$memo' / join '$join')"
+        failures=$((failures + 1))
+    fi
+}
+
+echo "===== Evaluator Tests ====="
+run_test "01_forall_true.logic" "TRUE"
+run_test "02_forall_false.logic" "FALSE"
+run_test "03_exists.logic" "TRUE"
+run_test "04_constants.logic" "TRUE"
+run_test "05_invariant_inner.logic" "FALSE"
+run_test "06_invariant_true.logic" "TRUE"
+run_test "07_join_true.logic" "TRUE"
+run_test "08_join_false.logic" "FALSE"
+run_test "09_join_external.logic" "TRUE"
+
+# The inner quantifier must be answered from the memo table
+echo -n "Running test: memo hits on 06_invariant_true.logic... "
+if ./evaluator "${TEST_PATH}/06_invariant_true.logic" "$FACTS" -m -v | grep -q "Memo hits: [1-9]"; then
+    echo "PASSED"
+else
+    echo "FAILED"
+    failures=$((failures + 1))
+fi
+
+# A memo table with far more keys than its initial 64 buckets must grow
+echo -n "Running test: memo table with 160000 keys... "
+MEMO_DIR=$(mktemp -d)
+DOMAIN=$(seq 0 399 | sed 's/^/c/' | paste -sd, | sed 's/,/, /g')
+echo "forall w [a, b, c, d] forall x [$DOMAIN] forall y [$DOMAIN] (P(w) -> ~exists z [a, b] Q(x, y, z))" > "$MEMO_DIR/formula.logic"
+echo "P(a) P(b) P(c) P(d)" > "$MEMO_DIR/facts.logic"
+memo_large=$(timeout 20 ./evaluator "$MEMO_DIR/formula.logic" "$MEMO_DIR/facts.logic" -m -v | grep -E "^(Result|Memo hits)")
+rm -rf "$MEMO_DIR"
+if [ "$memo_large" == "$(printf "Result: TRUE\nMemo hits: 480000, misses: 160000")" ]; then
+    echo "PASSED"
+else
+    echo "FAILED (got '$memo_large')"
+    failures=$((failures + 1))
+fi
+
+# The conjunction must be evaluated by a join plan with a semi-join
+echo -n "Running test: join plan on 07_join_true.logic... "
+if ./evaluator "${TEST_PATH}/07_join_true.logic" "$FACTS" --explain | grep -q "Semi-join: project out y"; then
+    echo "PASSED"
+else
+    echo "FAILED"
+    failures=$((failures + 1))
+fi
+
+# Formulas must follow batches of fact insertions and deletions
+echo -n "Running test: incremental updates on 10_incremental.logic... "
+incremental=$(./evaluator "${TEST_PATH}/10_incremental.logic" "$FACTS" \
+    -u "${TEST_PATH}/updates_1.logic" -u "${TEST_PATH}/updates_2.logic" -u "${TEST_PATH}/updates_3.logic")
+expected_batches="Batch 1: 2 update(s), formula 1 changed to FALSE
+Batch 2: 2 update(s), formula 1 changed to TRUE, formula 3 changed to FALSE
+Batch 3: 2 update(s), no formulas changed
+Result: FALSE"
+if [ "$(echo "$incremental" | grep -E "^(Batch|Result)")" == "$expected_batches" ]; then
+    echo "PASSED"
+else
+    echo "FAILED"
+    echo "$incremental"
+    failures=$((failures + 1))
+fi
+
+# A million formulas, facts and negations must not run out of stack
+echo -n "Running test: million-deep formula and facts spines... "
+DEEP_DIR=$(mktemp -d)
+yes "forall x [a, b] (P(x) -> P(x))" | head -n 1000000 > "$DEEP_DIR/formulas.logic"
+seq 1000000 | sed 's/.*/P(c&)/' > "$DEEP_DIR/facts.logic"
+{ yes "~" | head -n 1000000 | tr '\n' ' '; echo "P(c1)"; } > "$DEEP_DIR/not.logic"
+echo "~P(c1)" > "$DEEP_DIR/updates.logic"
+deep_join=$(./evaluator "$DEEP_DIR/formulas.logic" "$DEEP_DIR/facts.logic" -m -j | grep "^Result:")
+deep_incremental=$(./evaluator "$DEEP_DIR/not.logic" "$DEEP_DIR/facts.logic" -u "$DEEP_DIR/updates.logic" | grep -E "^(Batch|Result)")
+rm -rf "$DEEP_DIR"
+if [ "$deep_join" == "Result: TRUE" ] &&
+   [ "$deep_incremental" == "$(printf "Batch 1: 1 update(s), formula 1 changed to FALSE\nResult: FALSE")" ]; then
+    echo "PASSED"
+else
+    echo "FAILED (got '$deep_join' / '$deep_incremental')"
+    failures=$((failures + 1))
+fi
+
+echo
+echo "Evaluator tests completed with $failures failure(s)."
+exit $failures
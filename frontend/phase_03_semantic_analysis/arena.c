@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+/* Every allocation is aligned for any scalar or pointer type */
+#define ARENA_ALIGNMENT 16
+
+static size_t align_up(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+/* Create an arena whose blocks hold block_size bytes */
+Arena* arena_create(size_t block_size) {
+    Arena* arena = (Arena*)calloc(1, sizeof(Arena));
+    arena->block_size = block_size;
+    return arena;
+}
+
+static ArenaBlock* new_block(Arena* arena, size_t size) {
+    ArenaBlock* block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + size);
+    if (block == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    block->size = size;
+    block->used = 0;
+
+    arena->stats.blocks++;
+    arena->stats.bytes_reserved += size;
+    if (arena->stats.bytes_reserved > arena->stats.peak_bytes) {
+        arena->stats.peak_bytes = arena->stats.bytes_reserved;
+    }
+    return block;
+}
+
+/* Allocate size bytes that live until the arena is reset or destroyed */
+void* arena_alloc(Arena* arena, size_t size) {
+    arena->stats.allocations++;
+    arena->stats.bytes_requested += size;
+    size = align_up(size > 0 ? size : 1);
+
+    ArenaBlock* head = arena->head;
+    if (head == NULL || head->size - head->used < size) {
+        if (size > arena->block_size / 4) {
+            /* Large requests get a block of their own behind the current one */
+            ArenaBlock* block = new_block(arena, size);
+            block->used = size;
+            if (head != NULL) {
+                block->next = head->next;
+                head->next = block;
+            } else {
+                block->next = NULL;
+                arena->head = block;
+            }
+            return block->data;
+        }
+
+        head = new_block(arena, arena->block_size);
+        head->next = arena->head;
+        arena->head = head;
+    }
+
+    void* result = head->data + head->used;
+    head->used += size;
+    return result;
+}
+
+/*
+ * Grow the latest allocation from old_size to new_size bytes. It is extended
+ * in place while the current block has room, and a large allocation's own
+ * block is reallocated; anything else is copied to a new allocation.
+ */
+void* arena_grow(Arena* arena, void* ptr, size_t old_size, size_t new_size) {
+    size_t old_aligned = align_up(old_size > 0 ? old_size : 1);
+    size_t new_aligned = align_up(new_size > 0 ? new_size : 1);
+
+    ArenaBlock* head = arena->head;
+    if (head != NULL && (char*)ptr + old_aligned == head->data + head->used &&
+        head->size - head->used >= new_aligned - old_aligned) {
+        arena->stats.bytes_requested += new_size - old_size;
+        head->used += new_aligned - old_aligned;
+        return ptr;
+    }
+
+    /* A large allocation is alone in the current block or the one behind it */
+    ArenaBlock** link = &arena->head;
+    if (head != NULL && head->next != NULL && head->next->data == (char*)ptr) {
+        link = &head->next;
+    }
+    ArenaBlock* block = *link;
+    if (block != NULL && block->data == (char*)ptr && block->used == old_aligned) {
+        block = (ArenaBlock*)realloc(block, sizeof(ArenaBlock) + new_aligned);
+        if (block == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(1);
+        }
+        *link = block;
+
+        arena->stats.bytes_requested += new_size - old_size;
+        arena->stats.bytes_reserved += new_aligned - block->size;
+        if (arena->stats.bytes_reserved > arena->stats.peak_bytes) {
+            arena->stats.peak_bytes = arena->stats.bytes_reserved;
+        }
+        block->size = new_aligned;
+        block->used = new_aligned;
+        return block->data;
+    }
+
+    void* moved = arena_alloc(arena, new_size);
+    memcpy(moved, ptr, old_size);
+    return moved;
+}
+
+char* arena_strdup(Arena* arena, const char* str) {
+    size_t length = strlen(str) + 1;
+    char* copy = (char*)arena_alloc(arena, length);
+    memcpy(copy, str, length);
+    return copy;
+}
+
+/* Release all blocks but keep the arena (and its peak) for reuse */
+void arena_reset(Arena* arena) {
+    ArenaBlock* block = arena->head;
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+    arena->stats.bytes_reserved = 0;
+}
+
+/* Release every block but the current one and hand that one out again */
+void arena_rewind(Arena* arena) {
+    ArenaBlock* keep = arena->head;
+    if (keep != NULL && keep->size != arena->block_size) {
+        /* The current block holds one large allocation; keep none */
+        keep = NULL;
+    }
+
+    ArenaBlock* block = arena->head;
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+        if (block != keep) {
+            free(block);
+        }
+        block = next;
+    }
+
+    arena->head = keep;
+    arena->stats.bytes_reserved = 0;
+    if (keep != NULL) {
+        keep->next = NULL;
+        keep->used = 0;
+        arena->stats.bytes_reserved = keep->size;
+    }
+}
+
+void arena_destroy(Arena* arena) {
+    if (arena == NULL) {
+        return;
+    }
+    arena_reset(arena);
+    free(arena);
+}
+
+void print_arena_stats(const char* label, Arena* arena) {
+    printf("%s: %ld allocations in %ld blocks, %zu bytes requested, peak %zu bytes reserved\n",
+           label, arena->stats.allocations, arena->stats.blocks,
+           arena->stats.bytes_requested, arena->stats.peak_bytes);
+}
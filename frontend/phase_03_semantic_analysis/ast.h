@@ -2,6 +2,8 @@
 #define AST_H
 
 #include <stdbool.h>
+#include "intern.h"
+#include "arena.h"
 
 /* Forward declaration */
 struct ASTNode;
@@ -14,7 +16,8 @@ typedef enum {
     NODE_QUANTIFIER,
     NODE_LITERAL,
     NODE_VARIABLE,
-    NODE_PREDICATE
+    NODE_PREDICATE,
+    NODE_NARY_OP        /* AND, OR or XOR of any number of operands (see flatten_associative) */
 } NodeType;
 
 /* Binary operator types */
@@ -46,14 +49,19 @@ struct ASTNode {
             ASTNode* left;
             ASTNode* right;
         } binary;
+        struct {
+            BinaryOpType operator;  /* OP_AND, OP_OR or OP_XOR */
+            ASTNode** operands;     /* At least two, in source order */
+            int operand_count;
+        } nary;
         struct {
             UnaryOpType operator;   /* For unary operators */
             ASTNode* operand;
         } unary;
         struct {
             QuantifierType quantifier; /* FORALL or EXISTS */
-            char* variable;
-            char** domain;          /* Array of domain values */
+            InternId variable;      /* Interned variable name */
+            InternId* domain;       /* Interned domain elements (shared, see intern.h) */
             int domain_size;
             ASTNode* expr;
         } quantifier;
@@ -61,11 +69,13 @@ struct ASTNode {
             bool value;             /* For TRUE/FALSE literals */
         } literal;
         struct {
-            char* name;             /* For variables */
+            InternId name;          /* Interned variable name */
+            int slot;               /* Binding quantifier's slot (see resolve_bindings) */
         } variable;
         struct {
-            char* name;             /* For predicates */
-            char** args;            /* Arguments */
+            InternId name;          /* Interned predicate name */
+            InternId* args;         /* Interned argument names */
+            int* slots;             /* Slot of each argument, as for variables */
             int arg_count;
         } predicate;
     } data;
@@ -78,8 +88,71 @@ BinaryOpType token_to_binary_op(int token);
 UnaryOpType token_to_unary_op(int token);
 QuantifierType token_to_quantifier(int token);
 
+/* Set of interned variable names */
+typedef struct {
+    InternId* names;
+    int count;
+    int capacity;
+} VariableSet;
+
+/*
+ * AST memory. Nodes and argument arrays of one tree all live in one arena
+ * (the parse context's, for trees built by the parser) and are released
+ * together by destroying it, without walking the tree.
+ */
+Arena* create_ast_arena();
+
+/* Stages at which walk_ast calls its visitor */
+typedef enum {
+    VISIT_ENTER,    /* Before the children; returning false skips them and VISIT_LEAVE */
+    VISIT_BETWEEN,  /* After the left operand of a binary operator, or each but the last of an n-ary one */
+    VISIT_LEAVE     /* After the children */
+} VisitStage;
+
+typedef bool (*ASTVisitor)(ASTNode* node, VisitStage stage, int depth, void* data);
+
+/*
+ * Depth-first walk over a subtree. The pending nodes are kept on an explicit
+ * stack, so arbitrarily deep trees (such as the implicit AND spine of a file
+ * with many formulas) do not exhaust the C stack. depth is 0 at the root.
+ */
+void walk_ast(ASTNode* root, ASTVisitor visit, void* data);
+
+/*
+ * Associative chains. The parser builds a /\ b /\ c, and the implicit AND
+ * that joins the top-level formulas of a file, as left-deep binary trees with
+ * one level per operand. flatten_associative turns every maximal chain of
+ * one of AND, OR and XOR into a single NODE_NARY_OP over the chain's
+ * operands, in place. balance_associative rebuilds each chain instead as a
+ * binary tree of depth log2 of its length, for evaluators that only take
+ * binary operators. Operand arrays and new nodes are allocated in arena,
+ * which should be the tree's own.
+ */
+void flatten_associative(ASTNode* root, Arena* arena);
+void balance_associative(ASTNode* root, Arena* arena);
+
+/*
+ * Bound variables. The slot of a variable or predicate argument is the
+ * nesting depth of the quantifier that binds it: 0 for the outermost
+ * quantifier of a formula, 1 for one inside it and so on, which is also the
+ * index of that quantifier's loop in a stack of the enclosing loops. Names
+ * that no quantifier binds are constants and keep UNBOUND_SLOT. The parser
+ * leaves every slot unbound; semantic analysis fills them in as it looks the
+ * names up, and resolve_bindings does the same for trees that are compiled or
+ * evaluated without it.
+ */
+#define UNBOUND_SLOT (-1)
+
+void resolve_bindings(ASTNode* root);
+
 /* Functions for AST operations */
-void free_ast(ASTNode* node);
 void print_ast(ASTNode* node, int indent);
+const char* get_op_name(int op_type);
+const char* get_quantifier_name(int quant_type);
+
+/* Free variable analysis */
+void collect_free_variables(ASTNode* node, VariableSet* set);
+bool variable_set_contains(VariableSet* set, InternId name);
+void free_variable_set(VariableSet* set);
 
 #endif /* AST_H */
\ No newline at end of file
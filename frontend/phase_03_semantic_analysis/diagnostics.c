@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "diagnostics.h"
+
+DiagnosticOptions default_diagnostic_options() {
+    DiagnosticOptions options = { -1, false, false };
+    return options;
+}
+
+void init_diagnostics(Diagnostics* diagnostics, DiagnosticOptions options) {
+    memset(diagnostics, 0, sizeof(Diagnostics));
+    diagnostics->options = options;
+}
+
+void free_diagnostics(Diagnostics* diagnostics) {
+    free(diagnostics->errors.items);
+    free(diagnostics->warnings.items);
+    free(diagnostics->seen);
+}
+
+bool is_error(DiagnosticCode code) {
+    return code != DIAG_SHADOWED_VARIABLE;
+}
+
+static unsigned int hash_key(int code, InternId symbol, InternId predicate) {
+    unsigned int hash = (unsigned int)code * 2654435761u;
+    hash = (hash ^ symbol) * 2654435761u;
+    hash = (hash ^ predicate) * 2654435761u;
+    return hash ^ (hash >> 15);
+}
+
+/* Note the code and names of a diagnostic; false if they were seen before */
+static bool first_seen(Diagnostics* diagnostics, const Diagnostic* diagnostic) {
+    /* Keep the table at most half full */
+    if (2 * (diagnostics->seen_count + 1) > diagnostics->seen_capacity) {
+        int capacity = diagnostics->seen_capacity > 0 ? diagnostics->seen_capacity * 2 : 64;
+        DiagnosticKey* seen = (DiagnosticKey*)calloc(capacity, sizeof(DiagnosticKey));
+        for (int i = 0; i < diagnostics->seen_capacity; i++) {
+            DiagnosticKey* key = &diagnostics->seen[i];
+            if (key->code != 0) {
+                unsigned int slot = hash_key(key->code, key->symbol, key->predicate) & (capacity - 1);
+                while (seen[slot].code != 0) {
+                    slot = (slot + 1) & (capacity - 1);
+                }
+                seen[slot] = *key;
+            }
+        }
+        free(diagnostics->seen);
+        diagnostics->seen = seen;
+        diagnostics->seen_capacity = capacity;
+    }
+
+    int code = diagnostic->code + 1;
+    unsigned int mask = diagnostics->seen_capacity - 1;
+    unsigned int slot = hash_key(code, diagnostic->symbol, diagnostic->predicate) & mask;
+    for (DiagnosticKey* key = &diagnostics->seen[slot]; key->code != 0; key = &diagnostics->seen[slot]) {
+        if (key->code == code && key->symbol == diagnostic->symbol && key->predicate == diagnostic->predicate) {
+            return false;
+        }
+        slot = (slot + 1) & mask;
+    }
+    diagnostics->seen[slot].code = code;
+    diagnostics->seen[slot].symbol = diagnostic->symbol;
+    diagnostics->seen[slot].predicate = diagnostic->predicate;
+    diagnostics->seen_count++;
+    return true;
+}
+
+static void print_line(const Diagnostic* diagnostic, FILE* out) {
+    fprintf(out, "  %s: ", is_error(diagnostic->code) ? "Error" : "Warning");
+    print_diagnostic(diagnostic, out);
+    fprintf(out, "\n");
+}
+
+int add_diagnostic(Diagnostics* diagnostics, const Diagnostic* diagnostic, bool complete) {
+    DiagnosticList* list = is_error(diagnostic->code) ? &diagnostics->errors : &diagnostics->warnings;
+    list->found++;
+
+    if ((diagnostics->options.limit >= 0 && list->kept >= diagnostics->options.limit) ||
+        (diagnostics->options.deduplicate && !first_seen(diagnostics, diagnostic))) {
+        list->dropped++;
+        return -1;
+    }
+    list->kept++;
+
+    if (diagnostics->options.stream && complete) {
+        print_line(diagnostic, stdout);
+        return -1;
+    }
+
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity > 0 ? list->capacity * 2 : 16;
+        list->items = (Diagnostic*)realloc(list->items, list->capacity * sizeof(Diagnostic));
+    }
+    list->items[list->count] = *diagnostic;
+    return list->count++;
+}
+
+void complete_diagnostic(Diagnostics* diagnostics, int index) {
+    if (diagnostics->options.stream) {
+        print_line(&diagnostics->warnings.items[index], stdout);
+    }
+}
+
+void print_diagnostic(const Diagnostic* d, FILE* out) {
+    /* Only the fields a code's message cites are set */
+    switch (d->code) {
+        case DIAG_UNKNOWN_NODE:
+            fprintf(out, "Unknown node type in AST");
+            break;
+        case DIAG_MISSING_BINARY_OPERAND:
+            fprintf(out, "Missing operand in binary operation at line %d, column %d", d->line, d->column);
+            break;
+        case DIAG_MISSING_UNARY_OPERAND:
+            fprintf(out, "Missing operand in unary operation at line %d, column %d", d->line, d->column);
+            break;
+        case DIAG_DUPLICATE_VARIABLE:
+            fprintf(out, "Variable '%s' at line %d, column %d is already defined in this scope",
+                    interned_string(d->symbol), d->line, d->column);
+            break;
+        case DIAG_NOT_A_PREDICATE:
+            fprintf(out, "Symbol '%s' at line %d, column %d is not a predicate", interned_string(d->symbol), d->line, d->column);
+            break;
+        case DIAG_ARITY_MISMATCH:
+            fprintf(out, "Predicate '%s' at line %d, column %d is called with %d arguments, but it was defined with %d arguments at line %d, column %d",
+                    interned_string(d->symbol), d->line, d->column, d->values[0], d->values[1], d->values[2], d->values[3]);
+            break;
+        case DIAG_ARGUMENT_NOT_VARIABLE:
+            fprintf(out, "Symbol '%s' used as argument %d in predicate '%s' at line %d, column %d is not a variable",
+                    interned_string(d->symbol), d->values[0], interned_string(d->predicate), d->line, d->column);
+            break;
+        case DIAG_UNBOUND_ARGUMENT:
+            fprintf(out, "Unbound variable '%s' used as argument %d in predicate '%s' at line %d, column %d",
+                    interned_string(d->symbol), d->values[0], interned_string(d->predicate), d->line, d->column);
+            break;
+        case DIAG_NOT_A_VARIABLE:
+            fprintf(out, "Symbol '%s' at line %d, column %d is not a variable", interned_string(d->symbol), d->line, d->column);
+            break;
+        case DIAG_UNBOUND_VARIABLE:
+            fprintf(out, "Unbound variable '%s' at line %d, column %d", interned_string(d->symbol), d->line, d->column);
+            break;
+        case DIAG_SHADOWED_VARIABLE:
+            fprintf(out, "Variable '%s' at line %d, column %d shadows another variable defined at line %d, column %d",
+                    interned_string(d->symbol), d->line, d->column, d->values[0], d->values[1]);
+            break;
+    }
+}
+
+void print_diagnostic_list(Diagnostics* diagnostics, DiagnosticList* list, FILE* out) {
+    if (list->found == 0) {
+        return;
+    }
+
+    const char* kind = list == &diagnostics->errors ? "Errors" : "Warnings";
+    if (diagnostics->options.stream) {
+        fprintf(out, "\nSemantic %s (%ld), printed as they were found\n", kind, list->found);
+    } else {
+        fprintf(out, "\nSemantic %s (%ld):\n", kind, list->found);
+        for (int i = 0; i < list->count; i++) {
+            print_line(&list->items[i], out);
+        }
+    }
+    if (list->dropped > 0) {
+        fprintf(out, "  (%ld more not shown)\n", list->dropped);
+    }
+}
+
+void clear_diagnostics(Diagnostics* diagnostics) {
+    diagnostics->errors.count = 0;
+    diagnostics->errors.found = 0;
+    diagnostics->errors.dropped = 0;
+    diagnostics->warnings.count = 0;
+    diagnostics->warnings.found = 0;
+    diagnostics->warnings.dropped = 0;
+}
@@ -0,0 +1,100 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "intern.h"
+
+/*
+ * Semantic diagnostics. Each one is recorded as its code with the position
+ * of the node and the names and numbers its message cites, and is only
+ * formatted when it is printed, so analysis costs the same whether the
+ * messages are shown or not. Names are interned, so the records stay valid
+ * until free_interned.
+ */
+
+typedef enum {
+    /* Errors */
+    DIAG_UNKNOWN_NODE,
+    DIAG_MISSING_BINARY_OPERAND,
+    DIAG_MISSING_UNARY_OPERAND,
+    DIAG_DUPLICATE_VARIABLE,      /* symbol */
+    DIAG_NOT_A_PREDICATE,         /* symbol */
+    DIAG_ARITY_MISMATCH,          /* symbol; values: arguments, arity, line and column of the first use */
+    DIAG_ARGUMENT_NOT_VARIABLE,   /* symbol, predicate; values: argument number */
+    DIAG_UNBOUND_ARGUMENT,        /* symbol, predicate; values: argument number */
+    DIAG_NOT_A_VARIABLE,          /* symbol */
+    DIAG_UNBOUND_VARIABLE,        /* symbol */
+    /* Warnings */
+    DIAG_SHADOWED_VARIABLE        /* symbol; values: line and column of the hidden binding */
+} DiagnosticCode;
+
+typedef struct {
+    DiagnosticCode code;
+    int line;                /* Position of the node */
+    int column;
+    InternId symbol;         /* Name the diagnostic is about */
+    InternId predicate;      /* Predicate it is an argument of */
+    int values[4];           /* Numbers and positions the message cites */
+} Diagnostic;
+
+typedef struct {
+    Diagnostic* items;       /* Kept since the last report */
+    int count;
+    int capacity;
+    long found;              /* Found since the last report */
+    long dropped;            /* Of those, dropped by the limit or as repeats */
+    long kept;               /* Kept or printed over the whole run, for the limit */
+} DiagnosticList;
+
+typedef struct {
+    long limit;              /* Most errors, and most warnings, kept over the run; -1 for all */
+    bool deduplicate;        /* Keep one diagnostic per code and names */
+    bool stream;             /* Print each diagnostic as soon as it is complete */
+} DiagnosticOptions;
+
+/* Codes and names of the diagnostics seen, for deduplication */
+typedef struct {
+    int code;                /* Code + 1, or 0 for an empty slot */
+    InternId symbol;
+    InternId predicate;
+} DiagnosticKey;
+
+typedef struct {
+    DiagnosticOptions options;
+    DiagnosticList errors;
+    DiagnosticList warnings;
+    DiagnosticKey* seen;     /* Open addressing, by code and names */
+    int seen_count;
+    int seen_capacity;
+} Diagnostics;
+
+void init_diagnostics(Diagnostics* diagnostics, DiagnosticOptions options);
+void free_diagnostics(Diagnostics* diagnostics);
+
+/* Options of a plain run: keep every diagnostic and print them at the end */
+DiagnosticOptions default_diagnostic_options();
+
+bool is_error(DiagnosticCode code);
+
+/*
+ * Record a diagnostic. Returns its index in its list, or -1 when it was
+ * dropped by the limit or as a repeat, or printed at once when streaming.
+ * An incomplete diagnostic is always kept, even when streaming; whoever
+ * fills in the rest calls complete_diagnostic.
+ */
+int add_diagnostic(Diagnostics* diagnostics, const Diagnostic* diagnostic, bool complete);
+
+/* Print a diagnostic that was kept incomplete, if it is due now */
+void complete_diagnostic(Diagnostics* diagnostics, int index);
+
+/* Format one diagnostic's message, without a newline */
+void print_diagnostic(const Diagnostic* diagnostic, FILE* out);
+
+/* Print the diagnostics of a list found since the last report */
+void print_diagnostic_list(Diagnostics* diagnostics, DiagnosticList* list, FILE* out);
+
+/* Forget the diagnostics reported, keeping the limit and repeat state of the run */
+void clear_diagnostics(Diagnostics* diagnostics);
+
+#endif /* DIAGNOSTICS_H */
@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "fast_lexer.h"
+
+/*
+ * Blocks are compared a whole register at a time and reduced to a bit mask
+ * with one bit per byte, lowest bit first. FAST_LEXER_SCALAR turns the block
+ * loops off so the byte-at-a-time paths can be tested on their own.
+ */
+#if defined(__AVX2__) && !defined(FAST_LEXER_SCALAR)
+#include <immintrin.h>
+#define SIMD_BLOCK 32
+typedef __m256i Block;
+
+static inline Block load_block(const char* p) {
+    return _mm256_loadu_si256((const __m256i*)p);
+}
+
+static inline uint64_t match_byte(Block block, char c) {
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(c)));
+}
+#elif defined(__SSE2__) && !defined(FAST_LEXER_SCALAR)
+#include <emmintrin.h>
+#define SIMD_BLOCK 16
+typedef __m128i Block;
+
+static inline Block load_block(const char* p) {
+    return _mm_loadu_si128((const __m128i*)p);
+}
+
+static inline uint64_t match_byte(Block block, char c) {
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(c)));
+}
+#endif
+
+/* Identifiers longer than this are reported, as lexer.l does */
+#define MAX_IDENTIFIER_LENGTH 64
+
+void fast_lexer_init(FastLexer* lexer, const char* text, size_t length) {
+    lexer->cursor = text;
+    lexer->token = text;
+    lexer->end = text + length;
+}
+
+int fast_lexer_block_size() {
+#ifdef SIMD_BLOCK
+    return SIMD_BLOCK;
+#else
+    return 1;
+#endif
+}
+
+/* Bits of a mask for the first n bytes of a block */
+static inline uint64_t first_bytes(int n) {
+    return (1ull << n) - 1;
+}
+
+/* Move the position over n bytes; newlines has a bit for each '\n' among them */
+static inline void advance(ParseContext* ctx, int n, uint64_t newlines) {
+    if (newlines == 0) {
+        ctx->col_num += n;
+        return;
+    }
+    ctx->line_num += __builtin_popcountll(newlines);
+    ctx->col_num = n - (63 - __builtin_clzll(newlines));
+}
+
+/* Skip blanks and newlines ("\n", "\r\n" or "\r"); returns the first other byte */
+static const char* skip_space(const char* p, const char* end, ParseContext* ctx) {
+    for (;;) {
+#ifdef SIMD_BLOCK
+        while (end - p >= SIMD_BLOCK) {
+            Block block = load_block(p);
+            uint64_t newlines = match_byte(block, '\n');
+            uint64_t space = match_byte(block, ' ') | match_byte(block, '\t') | newlines;
+            int n = __builtin_ctzll(~space);
+            advance(ctx, n, newlines & first_bytes(n));
+            p += n;
+            if (n < SIMD_BLOCK) {
+                break;
+            }
+        }
+#endif
+        /* The tail of the input, and carriage returns, which end a block */
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n')) {
+            if (*p == '\n') {
+                ctx->line_num++;
+                ctx->col_num = 1;
+            } else {
+                ctx->col_num++;
+            }
+            p++;
+        }
+        if (p == end || *p != '\r') {
+            return p;
+        }
+        p += p + 1 < end && p[1] == '\n' ? 2 : 1;
+        ctx->line_num++;
+        ctx->col_num = 1;
+    }
+}
+
+/*
+ * Skip the body of a block comment; returns the byte after its closing '/'.
+ * Like the Flex rule, the comment ends at a '/' that follows a '*' inside it
+ * (so a '/' right after the opening does not end it), the closing '/' does
+ * not move the column, and a NUL byte or the end of input ends it with an
+ * error.
+ */
+static const char* skip_block_comment(const char* p, const char* end, ParseContext* ctx,
+                                      int start_line, int start_col) {
+    const char* body = p;
+    for (;;) {
+#ifdef SIMD_BLOCK
+        /* Past the first byte, the byte before each one is also in the comment */
+        while (p > body && end - p >= SIMD_BLOCK) {
+            Block block = load_block(p);
+            uint64_t newlines = match_byte(block, '\n');
+            uint64_t stop = (match_byte(block, '/') & match_byte(load_block(p - 1), '*')) |
+                            match_byte(block, '\0');
+            if (stop == 0) {
+                advance(ctx, SIMD_BLOCK, newlines);
+                p += SIMD_BLOCK;
+                continue;
+            }
+            int n = __builtin_ctzll(stop);
+            advance(ctx, n, newlines & first_bytes(n));
+            p += n;
+            break;
+        }
+#endif
+        if (p == end || *p == '\0') {
+            fprintf(stderr, "Error: Unterminated comment starting at line %d, column %d\n",
+                    start_line, start_col);
+            return p == end ? p : p + 1;
+        }
+        char c = *p++;
+        if (c == '/' && p - 1 > body && p[-2] == '*') {
+            return p;
+        }
+        if (c == '\n') {
+            ctx->line_num++;
+            ctx->col_num = 1;
+        } else {
+            ctx->col_num++;
+        }
+    }
+}
+
+static inline bool is_letter(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static inline bool is_identifier_char(char c) {
+    return is_letter(c) || (c >= '0' && c <= '9') || c == '_';
+}
+
+/* Whether an identifier is a keyword, ignoring case (keyword is lower case) */
+static bool is_keyword(const char* text, int length, const char* keyword, int keyword_length) {
+    if (length != keyword_length) {
+        return false;
+    }
+    for (int i = 0; i < length; i++) {
+        /* Identifier bytes are letters, digits or '_', so this only folds case */
+        if ((text[i] | 0x20) != keyword[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Keyword, variable or predicate spanning length bytes */
+static int identifier_token(const char* text, int length, YYSTYPE* value, ParseContext* ctx) {
+    if (is_keyword(text, length, "forall", 6)) {
+        return FORALL;
+    }
+    if (is_keyword(text, length, "exists", 6)) {
+        return EXISTS;
+    }
+    if (is_keyword(text, length, "true", 4)) {
+        value->bool_val = true;
+        return TRUE_VAL;
+    }
+    if (is_keyword(text, length, "false", 5)) {
+        value->bool_val = false;
+        return FALSE_VAL;
+    }
+
+    if (length > MAX_IDENTIFIER_LENGTH) {
+        fprintf(stderr, "Error at line %d, column %d: Identifier '%.*s' exceeds maximum length of 64 characters\n",
+                ctx->line_num, ctx->col_num, length, text);
+    }
+    value->id = intern_slice(text, length);
+    return text[0] >= 'a' ? VARIABLE : PREDICATE;
+}
+
+int fast_lexer_next(FastLexer* lexer, YYSTYPE* value, ParseContext* ctx) {
+    const char* p = lexer->cursor;
+    const char* end = lexer->end;
+
+    for (;;) {
+        p = skip_space(p, end, ctx);
+        if (p == end) {
+            lexer->cursor = lexer->token = p;
+            return 0;
+        }
+
+        char next = p + 1 < end ? p[1] : '\0';
+        int token = 0;
+        int length = 1;
+        switch (*p) {
+            case '/':
+                if (next == '\\') {
+                    token = AND;
+                    length = 2;
+                } else if (next == '/') {
+                    /* Single line comment: the newline is scanned as usual */
+                    const char* newline = (const char*)memchr(p, '\n', end - p);
+                    p = newline != NULL ? newline : end;
+                    continue;
+                } else if (next == '*') {
+                    int start_line = ctx->line_num;
+                    int start_col = ctx->col_num;
+                    ctx->col_num += 2;
+                    p = skip_block_comment(p + 2, end, ctx, start_line, start_col);
+                    continue;
+                }
+                break;
+            case '\\':
+                if (next == '/') {
+                    token = OR;
+                    length = 2;
+                }
+                break;
+            case '-':
+                if (next == '>') {
+                    token = IMPLIES;
+                    length = 2;
+                }
+                break;
+            case '<':
+                if (next == '-' && p + 2 < end && p[2] == '>') {
+                    token = IFF;
+                    length = 3;
+                }
+                break;
+            case '~': token = NOT; break;
+            case '^': token = XOR; break;
+            case '(': token = LPAREN; break;
+            case ')': token = RPAREN; break;
+            case '[': token = LBRACKET; break;
+            case ']': token = RBRACKET; break;
+            case ',': token = ','; break;
+            default:
+                if (is_letter(*p)) {
+                    const char* q = p + 1;
+                    while (q < end && is_identifier_char(*q)) {
+                        q++;
+                    }
+                    length = (int)(q - p);
+                    token = identifier_token(p, length, value, ctx);
+                }
+                break;
+        }
+
+        if (token == 0) {
+            fprintf(stderr, "Error at line %d, column %d: Unrecognized character '%c'\n",
+                    ctx->line_num, ctx->col_num, *p);
+            ctx->col_num++;
+            p++;
+            continue;
+        }
+        ctx->col_num += length;
+        lexer->token = p;
+        lexer->cursor = p + length;
+        return token;
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef FAST_LEXER_H
+#define FAST_LEXER_H
+
+#include <stddef.h>
+#include "parser.h"
+
+/*
+ * Hand-written scanner for input held in memory. It returns the same tokens,
+ * values, positions and diagnostics as the Flex scanner in lexer.l, but skips
+ * blanks, newlines and comment bodies a block of 16 bytes (SSE2) or 32 bytes
+ * (AVX2, when compiled with -mavx2) at a time. The input is only read, so a
+ * mapped file is never copied page by page.
+ */
+typedef struct FastLexer {
+    const char* cursor;          /* Next byte to scan */
+    const char* token;           /* Start of the token last returned */
+    const char* end;             /* One past the last byte of input */
+} FastLexer;
+
+/* Start scanning length bytes of text */
+void fast_lexer_init(FastLexer* lexer, const char* text, size_t length);
+
+/* Scan the next token; returns its code from parser.h, or 0 at the end */
+int fast_lexer_next(FastLexer* lexer, YYSTYPE* value, ParseContext* ctx);
+
+/* Width of the blocks the scanner skips at a time, 1 without SIMD */
+int fast_lexer_block_size();
+
+#endif /* FAST_LEXER_H */
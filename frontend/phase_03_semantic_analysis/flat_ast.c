@@ -0,0 +1,392 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flat_ast.h"
+
+static FlatAST* create_flat_ast(int capacity) {
+    FlatAST* flat = (FlatAST*)calloc(1, sizeof(FlatAST));
+    flat->capacity = capacity > 0 ? capacity : 16;
+    flat->tags = (uint8_t*)malloc(flat->capacity);
+    flat->ops = (uint8_t*)malloc(flat->capacity);
+    flat->names = (InternId*)malloc(sizeof(InternId) * flat->capacity);
+    flat->lhs = (FlatIndex*)malloc(sizeof(FlatIndex) * flat->capacity);
+    flat->rhs = (FlatIndex*)malloc(sizeof(FlatIndex) * flat->capacity);
+    flat->lines = (int32_t*)malloc(sizeof(int32_t) * flat->capacity);
+    flat->columns = (int32_t*)malloc(sizeof(int32_t) * flat->capacity);
+    flat->root = FLAT_NONE;
+    return flat;
+}
+
+static void grow_nodes(FlatAST* flat) {
+    flat->capacity *= 2;
+    flat->tags = (uint8_t*)realloc(flat->tags, flat->capacity);
+    flat->ops = (uint8_t*)realloc(flat->ops, flat->capacity);
+    flat->names = (InternId*)realloc(flat->names, sizeof(InternId) * flat->capacity);
+    flat->lhs = (FlatIndex*)realloc(flat->lhs, sizeof(FlatIndex) * flat->capacity);
+    flat->rhs = (FlatIndex*)realloc(flat->rhs, sizeof(FlatIndex) * flat->capacity);
+    flat->lines = (int32_t*)realloc(flat->lines, sizeof(int32_t) * flat->capacity);
+    flat->columns = (int32_t*)realloc(flat->columns, sizeof(int32_t) * flat->capacity);
+}
+
+/* Append a node; its children must already be in the arrays */
+static FlatIndex add_node(FlatAST* flat, ASTNode* node, uint8_t op, InternId name, FlatIndex lhs, FlatIndex rhs) {
+    if (flat->count == flat->capacity) {
+        grow_nodes(flat);
+    }
+    FlatIndex index = flat->count++;
+    flat->tags[index] = (uint8_t)node->type;
+    flat->ops[index] = op;
+    flat->names[index] = name;
+    flat->lhs[index] = lhs;
+    flat->rhs[index] = rhs;
+    flat->lines[index] = node->line;
+    flat->columns[index] = node->column;
+    return index;
+}
+
+/* Reserve a list of the given length in the pool; returns its offset */
+static FlatIndex add_list(FlatAST* flat, int size) {
+    if (flat->list_count + size + 1 > flat->list_capacity) {
+        while (flat->list_count + size + 1 > flat->list_capacity) {
+            flat->list_capacity = flat->list_capacity == 0 ? 64 : flat->list_capacity * 2;
+        }
+        flat->lists = (uint32_t*)realloc(flat->lists, sizeof(uint32_t) * flat->list_capacity);
+    }
+    FlatIndex offset = flat->list_count;
+    flat->lists[offset] = size;
+    flat->list_count += size + 1;
+    return offset;
+}
+
+static bool count_visit(ASTNode* node, VisitStage stage, int depth, void* data) {
+    if (stage == VISIT_ENTER) {
+        (*(int*)data)++;
+    }
+    return true;
+}
+
+/* State of flatten_ast: indices of the flattened subtrees awaiting their parent */
+typedef struct {
+    FlatAST* flat;
+    FlatIndex* pending;
+    int count;
+    int capacity;
+} FlattenWalk;
+
+static FlatIndex pop_pending(FlattenWalk* walk) {
+    return walk->pending[--walk->count];
+}
+
+/* Append a node once its children have been appended (post-order) */
+static bool flatten_visit(ASTNode* node, VisitStage stage, int depth, void* data) {
+    FlattenWalk* walk = (FlattenWalk*)data;
+    FlatAST* flat = walk->flat;
+    FlatIndex index = FLAT_NONE;
+
+    if (stage != VISIT_LEAVE) {
+        return true;
+    }
+
+    switch (node->type) {
+        case NODE_BINARY_OP: {
+            FlatIndex right = pop_pending(walk);
+            FlatIndex left = pop_pending(walk);
+            index = add_node(flat, node, node->data.binary.operator, 0, left, right);
+            break;
+        }
+
+        case NODE_UNARY_OP: {
+            FlatIndex operand = pop_pending(walk);
+            index = add_node(flat, node, node->data.unary.operator, 0, operand, FLAT_NONE);
+            break;
+        }
+
+        case NODE_QUANTIFIER: {
+            FlatIndex body = pop_pending(walk);
+            FlatIndex domain = add_list(flat, node->data.quantifier.domain_size);
+            memcpy(&flat->lists[domain + 1], node->data.quantifier.domain,
+                   sizeof(InternId) * node->data.quantifier.domain_size);
+            index = add_node(flat, node, node->data.quantifier.quantifier,
+                             node->data.quantifier.variable, body, domain);
+            break;
+        }
+
+        case NODE_LITERAL:
+            index = add_node(flat, node, node->data.literal.value, 0, FLAT_NONE, FLAT_NONE);
+            break;
+
+        case NODE_VARIABLE:
+            index = add_node(flat, node, 0, node->data.variable.name, FLAT_NONE, FLAT_NONE);
+            break;
+
+        case NODE_PREDICATE: {
+            FlatIndex args = add_list(flat, node->data.predicate.arg_count);
+            memcpy(&flat->lists[args + 1], node->data.predicate.args,
+                   sizeof(InternId) * node->data.predicate.arg_count);
+            index = add_node(flat, node, 0, node->data.predicate.name, FLAT_NONE, args);
+            break;
+        }
+
+        default:
+            fprintf(stderr, "Error: Unknown node type in flatten_ast: %d\n", node->type);
+            exit(1);
+    }
+
+    if (walk->count == walk->capacity) {
+        walk->capacity = walk->capacity == 0 ? 64 : walk->capacity * 2;
+        walk->pending = (FlatIndex*)realloc(walk->pending, sizeof(FlatIndex) * walk->capacity);
+    }
+    walk->pending[walk->count++] = index;
+    return true;
+}
+
+/* Convert a pointer tree to the flat layout */
+FlatAST* flatten_ast(ASTNode* root) {
+    if (root == NULL) {
+        return create_flat_ast(0);
+    }
+    int count = 0;
+    walk_ast(root, count_visit, &count);
+
+    FlattenWalk walk = { create_flat_ast(count), NULL, 0, 0 };
+    walk_ast(root, flatten_visit, &walk);
+    walk.flat->root = walk.pending[0];
+    free(walk.pending);
+    return walk.flat;
+}
+
+uint32_t flat_list_size(FlatAST* flat, FlatIndex index) {
+    return flat->lists[flat->rhs[index]];
+}
+
+uint32_t* flat_list(FlatAST* flat, FlatIndex index) {
+    return &flat->lists[flat->rhs[index] + 1];
+}
+
+/*
+ * Convert a flat subtree back to a pointer tree in the given arena. Nodes are
+ * stored post-order, so the subtree occupies the indices from its leftmost
+ * leaf up to its root, and every child is converted before its parent.
+ */
+ASTNode* unflatten_ast(FlatAST* flat, FlatIndex index, Arena* arena) {
+    if (index == FLAT_NONE) {
+        return NULL;
+    }
+
+    FlatIndex first = index;
+    while (flat->lhs[first] != FLAT_NONE) {
+        first = flat->lhs[first];
+    }
+
+    ASTNode** nodes = (ASTNode**)malloc(sizeof(ASTNode*) * (index - first + 1));
+    for (FlatIndex i = first; i <= index; i++) {
+        ASTNode* node = (ASTNode*)arena_alloc(arena, sizeof(ASTNode));
+        node->type = (NodeType)flat->tags[i];
+        node->line = flat->lines[i];
+        node->column = flat->columns[i];
+        nodes[i - first] = node;
+
+        switch (node->type) {
+            case NODE_BINARY_OP:
+                node->data.binary.operator = (BinaryOpType)flat->ops[i];
+                node->data.binary.left = nodes[flat->lhs[i] - first];
+                node->data.binary.right = nodes[flat->rhs[i] - first];
+                break;
+
+            case NODE_UNARY_OP:
+                node->data.unary.operator = (UnaryOpType)flat->ops[i];
+                node->data.unary.operand = nodes[flat->lhs[i] - first];
+                break;
+
+            case NODE_QUANTIFIER: {
+                Domain* domain = intern_domain(flat_list(flat, i), flat_list_size(flat, i));
+                node->data.quantifier.quantifier = (QuantifierType)flat->ops[i];
+                node->data.quantifier.variable = flat->names[i];
+                node->data.quantifier.domain = domain->elements;
+                node->data.quantifier.domain_size = domain->size;
+                node->data.quantifier.expr = nodes[flat->lhs[i] - first];
+                break;
+            }
+
+            case NODE_LITERAL:
+                node->data.literal.value = flat->ops[i];
+                break;
+
+            case NODE_VARIABLE:
+                node->data.variable.name = flat->names[i];
+                node->data.variable.slot = UNBOUND_SLOT;
+                break;
+
+            case NODE_PREDICATE: {
+                int arg_count = flat_list_size(flat, i);
+                node->data.predicate.name = flat->names[i];
+                node->data.predicate.args = (InternId*)arena_alloc(arena, sizeof(InternId) * (arg_count > 0 ? arg_count : 1));
+                memcpy(node->data.predicate.args, flat_list(flat, i), sizeof(InternId) * arg_count);
+                node->data.predicate.slots = (int*)arena_alloc(arena, sizeof(int) * (arg_count > 0 ? arg_count : 1));
+                for (int j = 0; j < arg_count; j++) {
+                    node->data.predicate.slots[j] = UNBOUND_SLOT;
+                }
+                node->data.predicate.arg_count = arg_count;
+                break;
+            }
+
+            case NODE_NARY_OP:
+                /* Never stored; check_nodes in ast_cache.c rejects the tag */
+                break;
+        }
+    }
+
+    ASTNode* root = nodes[index - first];
+    free(nodes);
+    return root;
+}
+
+static void print_indent(int indent) {
+    for (int i = 0; i < indent; i++) {
+        printf("  ");
+    }
+}
+
+static void print_id_list(uint32_t* ids, uint32_t size) {
+    printf("[");
+    for (uint32_t i = 0; i < size; i++) {
+        printf("%s%s", interned_string(ids[i]), i < size - 1 ? ", " : "");
+    }
+    printf("]\n");
+}
+
+/* Pending node of print_flat_ast and the number of its children already printed */
+typedef struct {
+    FlatIndex index;
+    int child;
+    int indent;
+} FlatPrintFrame;
+
+/* Print the header of a node and its first child label */
+static void print_flat_node(FlatAST* flat, FlatIndex index, int indent) {
+    print_indent(indent);
+
+    switch ((NodeType)flat->tags[index]) {
+        case NODE_BINARY_OP:
+            printf("BinaryOp: %s\n", get_op_name(flat->ops[index]));
+            print_indent(indent);
+            printf("Left:\n");
+            break;
+
+        case NODE_UNARY_OP:
+            printf("UnaryOp: %s\n", get_op_name(flat->ops[index]));
+            print_indent(indent);
+            printf("Operand:\n");
+            break;
+
+        case NODE_QUANTIFIER:
+            printf("Quantifier: %s\n", get_quantifier_name(flat->ops[index]));
+            print_indent(indent);
+            printf("Variable: %s\n", interned_string(flat->names[index]));
+            print_indent(indent);
+            printf("Domain: ");
+            print_id_list(flat_list(flat, index), flat_list_size(flat, index));
+            print_indent(indent);
+            printf("Expression:\n");
+            break;
+
+        case NODE_LITERAL:
+            printf("Literal: %s\n", flat->ops[index] ? "TRUE" : "FALSE");
+            break;
+
+        case NODE_VARIABLE:
+            printf("Variable: %s\n", interned_string(flat->names[index]));
+            break;
+
+        case NODE_PREDICATE:
+            printf("Predicate: %s\n", interned_string(flat->names[index]));
+            print_indent(indent);
+            printf("Arguments: ");
+            print_id_list(flat_list(flat, index), flat_list_size(flat, index));
+            break;
+
+        case NODE_NARY_OP:
+            break;
+    }
+}
+
+/* Print a flat subtree in the format of print_ast, with an explicit stack */
+void print_flat_ast(FlatAST* flat, FlatIndex index, int indent) {
+    if (index == FLAT_NONE) {
+        print_indent(indent);
+        printf("NULL\n");
+        return;
+    }
+
+    FlatPrintFrame* stack = NULL;
+    int count = 0;
+    int capacity = 0;
+    FlatIndex next = index;
+    int next_indent = indent;
+
+    for (;;) {
+        if (next != FLAT_NONE) {
+            print_flat_node(flat, next, next_indent);
+            if (count == capacity) {
+                capacity = capacity == 0 ? 64 : capacity * 2;
+                stack = (FlatPrintFrame*)realloc(stack, sizeof(FlatPrintFrame) * capacity);
+            }
+            stack[count].index = next;
+            stack[count].child = 0;
+            stack[count].indent = next_indent;
+            count++;
+            next = FLAT_NONE;
+        }
+
+        if (count == 0) {
+            break;
+        }
+
+        FlatPrintFrame* frame = &stack[count - 1];
+        int child = frame->child++;
+        next_indent = frame->indent + 1;
+
+        switch ((NodeType)flat->tags[frame->index]) {
+            case NODE_BINARY_OP:
+                if (child == 0) {
+                    next = flat->lhs[frame->index];
+                } else if (child == 1) {
+                    print_indent(frame->indent);
+                    printf("Right:\n");
+                    next = flat->rhs[frame->index];
+                }
+                break;
+
+            case NODE_UNARY_OP:
+            case NODE_QUANTIFIER:
+                if (child == 0) {
+                    next = flat->lhs[frame->index];
+                }
+                break;
+
+            default:
+                break;
+        }
+
+        if (next == FLAT_NONE) {
+            count--;
+        }
+    }
+
+    free(stack);
+}
+
+void free_flat_ast(FlatAST* flat) {
+    if (flat == NULL) {
+        return;
+    }
+    free(flat->tags);
+    free(flat->ops);
+    free(flat->names);
+    free(flat->lhs);
+    free(flat->rhs);
+    free(flat->lines);
+    free(flat->columns);
+    free(flat->lists);
+    free(flat);
+}
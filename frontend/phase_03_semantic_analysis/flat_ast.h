@@ -0,0 +1,56 @@
+#ifndef FLAT_AST_H
+#define FLAT_AST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ast.h"
+#include "intern.h"
+
+/*
+ * Flat, index-based AST layout.
+ *
+ * Nodes live in parallel arrays (struct of arrays) and refer to each other
+ * by 32-bit index. Children always precede their parent (post-order), so a
+ * bottom-up pass is a single forward sweep over the arrays. Names are
+ * interned IDs. Predicate arguments and quantifier domains are stored in a
+ * shared list pool as a length followed by the element IDs. Variable slots
+ * are not stored: they follow from the tree, and unflattened nodes are left
+ * unbound for resolve_bindings.
+ */
+
+typedef uint32_t FlatIndex;
+
+#define FLAT_NONE UINT32_MAX
+
+typedef struct {
+    int count;                   /* Number of nodes */
+    int capacity;
+    uint8_t* tags;               /* NodeType */
+    uint8_t* ops;                /* Operator, quantifier type or literal value */
+    InternId* names;             /* Variable, predicate or quantified variable name */
+    FlatIndex* lhs;              /* Left operand, unary operand or quantifier body */
+    FlatIndex* rhs;              /* Right operand, or list offset for predicates and quantifiers */
+    int32_t* lines;
+    int32_t* columns;
+
+    uint32_t* lists;             /* List pool: length, then elements */
+    int list_count;
+    int list_capacity;
+
+    FlatIndex root;
+} FlatAST;
+
+/* Convert between the pointer tree and the flat layout (which has no n-ary nodes) */
+FlatAST* flatten_ast(ASTNode* root);
+ASTNode* unflatten_ast(FlatAST* flat, FlatIndex index, Arena* arena);
+
+/* Argument list of a predicate or domain of a quantifier */
+uint32_t flat_list_size(FlatAST* flat, FlatIndex index);
+uint32_t* flat_list(FlatAST* flat, FlatIndex index);
+
+/* Same output as print_ast, read from the flat arrays */
+void print_flat_ast(FlatAST* flat, FlatIndex index, int indent);
+
+void free_flat_ast(FlatAST* flat);
+
+#endif /* FLAT_AST_H */
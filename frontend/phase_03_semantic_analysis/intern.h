@@ -0,0 +1,32 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Dense integer ID of an interned string */
+typedef uint32_t InternId;
+
+/* A quantifier domain: a sequence of interned elements, stored once */
+typedef struct Domain {
+    InternId* elements;          /* Element IDs in declaration order */
+    int size;                    /* Number of elements */
+    unsigned int hash;           /* Hash of the elements, compared before them */
+} Domain;
+
+/* String interning; every function here may be called from several threads at once */
+InternId intern_string(const char* str);
+InternId intern_slice(const char* text, size_t length);
+const char* interned_string(InternId id);
+int interned_count();
+
+/* Domain interning: identical element sequences share one Domain */
+Domain* intern_domain(InternId* elements, int size);
+
+/* Same for a malloc'd array whose ownership passes to the interner */
+Domain* intern_domain_owned(InternId* elements, int size);
+
+/* Release all interned strings and domains */
+void free_interned();
+
+#endif /* INTERN_H */
@@ -44,6 +44,97 @@
 #if YYDEBUG
 extern int yydebug;
 #endif
+/* "%code requires" blocks.  */
+#line 36 "parser.y"
+
+#include <stdio.h>
+#include "intern.h"
+#include "arena.h"
+
+/* Handle of a reentrant Flex scanner (lexer.c defines it the same way) */
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void* yyscan_t;
+#endif
+
+struct ASTNode;
+struct CompileStats;
+
+/*
+ * Location of a token or rule: line and column of its first character and
+ * just past its last, and the same as byte offsets into the input. Offsets
+ * are only known for input held in memory (strings and mapped files); they
+ * are 0 for a stream.
+ */
+typedef struct SourceSpan {
+    int first_line;
+    int first_column;
+    int last_line;
+    int last_column;
+    size_t start;
+    size_t end;
+} SourceSpan;
+
+/* Receives each top-level formula in streaming mode; number counts from 1 */
+typedef void (*FormulaHandler)(struct ASTNode* formula, int number, void* data);
+
+/*
+ * Analysis fused with the parse, called from the grammar actions in source
+ * order: enter_quantifier once a quantifier's variable and domain have been
+ * read and before its body is parsed, leave_quantifier once its node has
+ * been built, and atom as each predicate and variable node is built
+ */
+typedef struct ParseActions {
+    void (*enter_quantifier)(InternId variable, InternId* domain, int domain_size, void* data);
+    void (*leave_quantifier)(struct ASTNode* quantifier, void* data);
+    void (*atom)(struct ASTNode* atom, void* data);
+} ParseActions;
+
+/*
+ * State of one parse. The parser and scanner keep everything here rather
+ * than in globals, so separate contexts can parse on different threads at
+ * the same time; only the interner is shared, and it is locked.
+ */
+typedef struct ParseContext {
+    yyscan_t scanner;             /* Scanner reading this context's input */
+    Arena* arena;                 /* Owns every node of the AST */
+    struct ASTNode* root;         /* Root of the AST; NULL until parsed */
+    struct ASTNode** formulas;    /* Top-level formulas in source order (root joins them with AND) */
+    int formula_count;
+    int formula_capacity;
+    int line_num;                 /* Current scanner position */
+    int col_num;
+    int syntax_errors;
+    /*
+     * Streaming mode: when on_formula is set, each top-level formula is passed
+     * to it as soon as it has been parsed and its nodes are freed afterwards,
+     * so memory does not grow with the input; root and formulas stay empty
+     * and formula_count only counts
+     */
+    FormulaHandler on_formula;
+    void* handler_data;
+    SourceSpan formula_span;      /* Source of the formula last taken, e.g. for on_formula */
+    const ParseActions* actions;  /* Analysis fused with the parse, or NULL */
+    void* action_data;
+    /* Input owned by the context, released with it */
+    char* mapped;                 /* Mapping scanned in place, or NULL */
+    size_t mapped_length;
+    size_t mapped_released;       /* Leading bytes of the mapping already dropped */
+    char* copied;                 /* Copy of a string being parsed, or NULL */
+    size_t copied_length;
+    FILE* opened;                 /* Stream opened for the file, or NULL */
+    struct FastLexer* fast_lexer; /* Hand-written scanner in use, or NULL for Flex */
+    struct CompileStats* stats;   /* Counts tokens and nodes and times the scanner for --stats, or NULL */
+} ParseContext;
+
+/* Growable list of argument or domain names; capacity doubles as it fills */
+typedef struct {
+    InternId* list;
+    int size;
+    int capacity;
+} IdList;
+
+#line 138 "parser.h"
 
 /* Token kinds.  */
 #ifndef YYTOKENTYPE
@@ -78,19 +169,17 @@ extern int yydebug;
 #if ! defined YYSTYPE && ! defined YYSTYPE_IS_DECLARED
 union YYSTYPE
 {
-#line 36 "parser.y"
+#line 126 "parser.y"
 
     int token;           /* For operators and keywords */
-    char* string_val;    /* For identifiers */
+    InternId id;         /* For identifiers (interned by the lexer) */
     bool bool_val;       /* For TRUE/FALSE literals */
     struct ASTNode* node; /* For AST nodes */
-    char** string_list;  /* For argument lists */
-    struct {
-        char** list;
-        int size;
-    } domain_info;       /* For domain lists with size */
+    IdList id_list;      /* For domain lists */
+    IdList args;         /* For argument lists, built in the AST arena */
+    Domain* domain;      /* For a quantifier's interned domain */
 
-#line 94 "parser.h"
+#line 183 "parser.h"
 
 };
 typedef union YYSTYPE YYSTYPE;
@@ -98,11 +187,50 @@ typedef union YYSTYPE YYSTYPE;
 # define YYSTYPE_IS_DECLARED 1
 #endif
 
+/* Location type.  */
+typedef SourceSpan YYLTYPE;
+
+
+
+
+int yyparse (yyscan_t scanner, ParseContext* ctx);
+
+/* "%code provides" blocks.  */
+#line 136 "parser.y"
+
+/* Create a context that parses input, or a copy of text or of length bytes of it */
+ParseContext* create_parse_context(FILE* input);
+ParseContext* create_string_parse_context(const char* text);
+ParseContext* create_buffer_parse_context(const char* text, size_t length);
+
+/*
+ * Create a context that parses a file, read through a stream, or mapped and
+ * scanned in place without being copied into the scanner's buffer (files
+ * that cannot be mapped, such as pipes, are read as a stream). Both return
+ * NULL if the file cannot be opened.
+ */
+ParseContext* create_file_parse_context(const char* filename);
+ParseContext* create_mapped_parse_context(const char* filename);
+
+/*
+ * Scan the input with the hand-written scanner in fast_lexer.c instead of
+ * Flex. Only input held in memory (a string or a mapped file) can be scanned
+ * this way; returns false, leaving Flex in use, for a stream.
+ */
+bool use_fast_lexer(ParseContext* ctx);
+
+/* Scan the next token with whichever scanner is in use; returns 0 at the end */
+int next_token(ParseContext* ctx, YYSTYPE* value, SourceSpan* span);
 
-extern YYSTYPE yylval;
+/* Scan the whole input without parsing it; returns the number of tokens */
+long scan_tokens(ParseContext* ctx);
 
+/* Parse the whole input; returns 0 on success, like yyparse() */
+int parse_input(ParseContext* ctx);
 
-int yyparse (void);
+/* Release the scanner, the formula list, the AST and any input it opened */
+void free_parse_context(ParseContext* ctx);
 
+#line 235 "parser.h"
 
 #endif /* !YY_YY_PARSER_H_INCLUDED  */
@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "predicates.h"
+
+PredicateRegistry* create_predicate_registry() {
+    return (PredicateRegistry*)calloc(1, sizeof(PredicateRegistry));
+}
+
+void free_predicate_registry(PredicateRegistry* registry) {
+    if (registry == NULL) {
+        return;
+    }
+
+    /* Names and domains are owned by the interner */
+    for (int i = 0; i < registry->count; i++) {
+        free(registry->predicates[i].arguments);
+    }
+    free(registry->predicates);
+    free(registry->handles);
+    free(registry);
+}
+
+PredicateInfo* find_predicate(PredicateRegistry* registry, InternId name) {
+    if ((int)name >= registry->handles_size || registry->handles[name] == 0) {
+        return NULL;
+    }
+    return &registry->predicates[registry->handles[name] - 1];
+}
+
+PredicateInfo* use_predicate(PredicateRegistry* registry, InternId name, int arity, int line, int column) {
+    PredicateInfo* predicate = find_predicate(registry, name);
+    if (predicate != NULL) {
+        predicate->uses++;
+        return predicate;
+    }
+
+    if ((int)name >= registry->handles_size) {
+        int size = registry->handles_size > 0 ? registry->handles_size : 64;
+        while (size <= (int)name) {
+            size *= 2;
+        }
+        registry->handles = (int*)realloc(registry->handles, size * sizeof(int));
+        memset(registry->handles + registry->handles_size, 0, (size - registry->handles_size) * sizeof(int));
+        registry->handles_size = size;
+    }
+    if (registry->count == registry->capacity) {
+        registry->capacity = registry->capacity > 0 ? registry->capacity * 2 : 16;
+        registry->predicates = (PredicateInfo*)realloc(registry->predicates, registry->capacity * sizeof(PredicateInfo));
+    }
+
+    predicate = &registry->predicates[registry->count];
+    predicate->name = name;
+    predicate->arity = arity;
+    predicate->handle = registry->count;
+    predicate->uses = 1;
+    predicate->line = line;
+    predicate->column = column;
+    predicate->arguments = (ArgumentSignature*)calloc(arity > 0 ? arity : 1, sizeof(ArgumentSignature));
+    predicate->has_signature = false;
+    registry->handles[name] = ++registry->count;
+    return predicate;
+}
+
+void record_signature(PredicateInfo* predicate, InternId** domains, const int* domain_sizes) {
+    for (int i = 0; i < predicate->arity; i++) {
+        ArgumentSignature* argument = &predicate->arguments[i];
+        int domain_size = domains[i] != NULL ? domain_sizes[i] : ARGUMENT_CONSTANT;
+
+        /* Interned domains are equal exactly when they are the same array */
+        if (!predicate->has_signature) {
+            argument->domain = domains[i];
+            argument->domain_size = domain_size;
+        } else if (argument->domain != domains[i] || argument->domain_size != domain_size) {
+            argument->domain = NULL;
+            argument->domain_size = ARGUMENT_MIXED;
+        }
+    }
+    predicate->has_signature = true;
+}
+
+void print_predicate_registry(PredicateRegistry* registry, FILE* out) {
+    fprintf(out, "Predicates (%d):\n", registry->count);
+    for (int i = 0; i < registry->count; i++) {
+        PredicateInfo* predicate = &registry->predicates[i];
+        fprintf(out, "  %s/%d: %ld use%s, first at line %d, column %d",
+                interned_string(predicate->name), predicate->arity, predicate->uses,
+                predicate->uses == 1 ? "" : "s", predicate->line, predicate->column);
+
+        for (int j = 0; j < predicate->arity && predicate->has_signature; j++) {
+            ArgumentSignature* argument = &predicate->arguments[j];
+            fprintf(out, "%s", j == 0 ? "; arguments " : " x ");
+            if (argument->domain_size == ARGUMENT_CONSTANT) {
+                fprintf(out, "constant");
+            } else if (argument->domain_size == ARGUMENT_MIXED) {
+                fprintf(out, "mixed");
+            } else {
+                fprintf(out, "[");
+                for (int k = 0; k < argument->domain_size; k++) {
+                    fprintf(out, "%s%s", k > 0 ? ", " : "", interned_string(argument->domain[k]));
+                }
+                fprintf(out, "]");
+            }
+        }
+        fprintf(out, "\n");
+    }
+}
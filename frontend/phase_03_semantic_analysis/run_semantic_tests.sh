@@ -76,6 +76,7 @@ echo -e "\n===== GROUP 3: Predicate Arity Errors (should all fail) ====="
 run_test "09_arity_simple.logic" "FAIL"
 run_test "10_arity_mixed.logic" "FAIL"
 run_test "11_arity_complex.logic" "FAIL"
+run_test "23_arity_scopes.logic" "FAIL"
 
 echo -e "\n===== GROUP 4: Variable Shadowing (should have warnings but pass) ====="
 run_test "12_shadow_simple.logic" "PASS_WITH_WARNING"
@@ -94,5 +95,145 @@ run_test "21_operators_precedence.logic" "PASS"
 echo -e "\n===== GROUP 6: Mixed Errors (should fail) ====="
 run_test "22_mixed_errors.logic" "FAIL"
 
+echo -e "\n===== GROUP 7: Deep Formulas (should pass without exhausting the stack) ====="
+echo -n "Running test: deep_spine... "
+DEEP_FILE=$(mktemp)
+yes "forall x [a, b] ~ ~ P(x)" | head -n 1000000 > "$DEEP_FILE"
+if ./semantic_analyzer "$DEEP_FILE" -q | grep -q "Semantic analysis completed successfully"; then
+    echo "PASSED"
+else
+    echo "UNEXPECTED FAILURE (expected pass)"
+fi
+echo -n "Running test: deep_nesting... "
+{ yes "~ (" | head -n 1000000 | tr '\n' ' '; echo -n "forall x [a] P(x)"; yes ")" | head -n 1000000 | tr -d '\n'; echo; } > "$DEEP_FILE"
+if ./semantic_analyzer "$DEEP_FILE" -q | grep -q "Semantic analysis completed successfully"; then
+    echo "PASSED"
+else
+    echo "UNEXPECTED FAILURE (expected pass)"
+fi
+rm -f "$DEEP_FILE"
+
+echo -e "\n===== GROUP 8: AST Cache (written only after successful analysis) ====="
+CACHE_FILE=$(mktemp)
+rm -f "$CACHE_FILE"
+echo -n "Running test: cache_valid... "
+./semantic_analyzer "$TEST_PATH/02_valid_complex.logic" -q -c "$CACHE_FILE" > /dev/null
+if [ "$(head -c 8 "$CACHE_FILE" 2>/dev/null)" = "LOGICAST" ]; then
+    echo "PASSED"
+else
+    echo "UNEXPECTED FAILURE (expected a cache file)"
+fi
+rm -f "$CACHE_FILE"
+echo -n "Running test: cache_invalid... "
+./semantic_analyzer "$TEST_PATH/06_unbound_simple.logic" -q -c "$CACHE_FILE" > /dev/null
+if [ ! -e "$CACHE_FILE" ]; then
+    echo "PASSED"
+else
+    echo "UNEXPECTED PASS (expected no cache file)"
+fi
+rm -f "$CACHE_FILE"
+
+echo -e "\n===== GROUP 9: Streaming (each formula analyzed as soon as it is parsed) ====="
+for test_file in "$TEST_PATH"/*.logic; do
+    test_name=$(basename "$test_file" .logic)
+    echo -n "Running test: stream_${test_name}... "
+    whole=$(./semantic_analyzer "$test_file" -q | grep -E "^Semantic analysis (completed|failed)")
+    streamed=$(./semantic_analyzer "$test_file" -q --stream | grep -E "^Semantic analysis (completed|failed)")
+    if [ -n "$whole" ] && [ "$whole" = "$streamed" ]; then
+        echo "PASSED"
+    else
+        echo "UNEXPECTED RESULT (streamed: '$streamed', whole file: '$whole')"
+    fi
+done
+echo -n "Running test: stream_deep_spine... "
+DEEP_FILE=$(mktemp)
+yes "forall x [a, b] ~ ~ P(x)" | head -n 1000000 > "$DEEP_FILE"
+if ./semantic_analyzer "$DEEP_FILE" -q --stream | grep -q "^Formulas analyzed: 1000000$"; then
+    echo "PASSED"
+else
+    echo "UNEXPECTED FAILURE (expected pass)"
+fi
+rm -f "$DEEP_FILE"
+
+echo -e "\n===== GROUP 10: Predicate Registry (one entry per predicate, whatever its scopes) ====="
+echo -n "Running test: predicates... "
+PREDICATES_FILE=$(mktemp)
+echo "forall x [a, b] (P(x) /\\ exists y [c] Q(y, x)) /\\ forall z [a, b] P(z)" > "$PREDICATES_FILE"
+listed=$(./semantic_analyzer "$PREDICATES_FILE" -q --predicates | sed -n '/^Predicates/,$p')
+if [ "$listed" = "$(printf 'Predicates (2):\n  P/1: 2 uses, first at line 1, column 22; arguments [b, a]\n  Q/2: 1 use, first at line 1, column 46; arguments [b, a] x [c]')" ]; then
+    echo "PASSED"
+else
+    echo "UNEXPECTED RESULT ($listed)"
+fi
+rm -f "$PREDICATES_FILE"
+
+echo -e "\n===== GROUP 11: Fused Analysis (same output when run from the parser's actions) ====="
+for test_file in "$TEST_PATH"/*.logic; do
+    test_name=$(basename "$test_file" .logic)
+    echo -n "Running test: fused_${test_name}... "
+    if [ "$(./semantic_analyzer "$test_file")" = "$(./semantic_analyzer "$test_file" --fused)" ] &&
+       [ "$(./semantic_analyzer "$test_file" -q --stream)" = "$(./semantic_analyzer "$test_file" -q --stream --fused)" ]; then
+        echo "PASSED"
+    else
+        echo "UNEXPECTED RESULT (output differs with --fused)"
+    fi
+done
+echo -n "Running test: fused_shadowing... "
+SHADOW_FILE=$(mktemp)
+echo "forall x [a] (exists x [b] (forall y [c] exists x [d] P(x, y)) /\\ forall y [e] Q(x, y, z))" > "$SHADOW_FILE"
+if [ "$(./semantic_analyzer "$SHADOW_FILE" -q)" = "$(./semantic_analyzer "$SHADOW_FILE" -q --fused)" ] &&
+   [ "$(./semantic_analyzer "$SHADOW_FILE" -q --fused | grep -c "shadows")" = 2 ]; then
+    echo "PASSED"
+else
+    echo "UNEXPECTED RESULT (output differs with --fused)"
+fi
+rm -f "$SHADOW_FILE"
+echo -n "Running test: fused_deep_shadowing... "
+SHADOW_FILE=$(mktemp)
+{ yes "forall x [a]" | head -n 40000 | tr '\n' ' '; echo "P(x)"; } > "$SHADOW_FILE"
+if [ "$(./semantic_analyzer "$SHADOW_FILE" -q)" = "$(timeout 10 ./semantic_analyzer "$SHADOW_FILE" -q --fused)" ]; then
+    echo "PASSED"
+else
+    echo "UNEXPECTED RESULT (output differs with --fused)"
+fi
+rm -f "$SHADOW_FILE"
+
+echo -e "\n===== GROUP 12: Diagnostics (kept, limited, deduplicated and streamed) ====="
+DIAG_FILE=$(mktemp)
+yes "forall x [a] P(x, y)" | head -n 300 > "$DIAG_FILE"
+echo -n "Running test: diagnostics_all... "
+if [ "$(./semantic_analyzer "$DIAG_FILE" -q | grep -c "^  Error: Unbound variable 'y'")" = 300 ]; then
+    echo "PASSED"
+else
+    echo "UNEXPECTED RESULT (expected all 300 errors)"
+fi
+echo -n "Running test: diagnostics_limit... "
+limited=$(./semantic_analyzer "$DIAG_FILE" -q --max-diagnostics 2 | grep -E "^(Semantic Errors|  )")
+if [ "$limited" = "$(printf "Semantic Errors (300):\n  Error: Unbound variable 'y' used as argument 1 in predicate 'P' at line 1, column 21\n  Error: Unbound variable 'y' used as argument 1 in predicate 'P' at line 2, column 21\n  (298 more not shown)")" ]; then
+    echo "PASSED"
+else
+    echo "UNEXPECTED RESULT ($limited)"
+fi
+echo -n "Running test: diagnostics_dedup... "
+echo "forall y [a] Q(z, y) /\\ R(z)" >> "$DIAG_FILE"
+if [ "$(./semantic_analyzer "$DIAG_FILE" -q --dedup-diagnostics | grep -c "^  Error")" = 3 ] &&
+   ./semantic_analyzer "$DIAG_FILE" -q --dedup-diagnostics | grep -q "^  (299 more not shown)$"; then
+    echo "PASSED"
+else
+    echo "UNEXPECTED RESULT (expected one error per code and names)"
+fi
+rm -f "$DIAG_FILE"
+for test_file in "$TEST_PATH"/*.logic; do
+    test_name=$(basename "$test_file" .logic)
+    echo -n "Running test: diagnostics_stream_${test_name}... "
+    collected=$(./semantic_analyzer "$test_file" -q | grep -E "^  (Error|Warning):" | sort)
+    if [ "$collected" = "$(./semantic_analyzer "$test_file" -q --stream-diagnostics | grep -E "^  (Error|Warning):" | sort)" ] &&
+       [ "$collected" = "$(./semantic_analyzer "$test_file" -q --stream-diagnostics --fused | grep -E "^  (Error|Warning):" | sort)" ]; then
+        echo "PASSED"
+    else
+        echo "UNEXPECTED RESULT (streamed messages differ)"
+    fi
+done
+
 echo -e "\nAll tests completed. Detailed results are in the $RESULTS_DIR directory."
 echo "To view a specific test result: cat $RESULTS_DIR/[test_name]_result.txt"
\ No newline at end of file
@@ -1,15 +1,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <stdarg.h>
 #include "semantic.h"
 
 /* Create a new semantic context */
 SemanticContext* create_semantic_context() {
     SemanticContext* context = (SemanticContext*)malloc(sizeof(SemanticContext));
-    context->symbols = create_symbol_table(101); /* Prime number size for better hash distribution */
-    context->errors.count = 0;
-    context->warnings.count = 0;
+    context->symbols = create_symbol_table();
+    context->predicates = create_predicate_registry();
+    init_diagnostics(&context->diagnostics, default_diagnostic_options());
+    context->pending = NULL;
+    context->pending_count = 0;
+    context->pending_capacity = 0;
     return context;
 }
 
@@ -19,230 +21,255 @@ void free_semantic_context(SemanticContext* context) {
         return;
     }
     
-    /* Free error messages */
-    for (int i = 0; i < context->errors.count; i++) {
-        free(context->errors.messages[i]);
-    }
-    
-    /* Free warning messages */
-    for (int i = 0; i < context->warnings.count; i++) {
-        free(context->warnings.messages[i]);
-    }
-    
-    /* Free symbol table */
+    /* Free the diagnostics and symbol table */
+    free_diagnostics(&context->diagnostics);
     free_symbol_table(context->symbols);
+    free_predicate_registry(context->predicates);
+    free(context->pending);
     
     free(context);
 }
 
-/* Add an error message to the context */
-void add_error(SemanticContext* context, const char* format, ...) {
-    if (context->errors.count >= 256) {
-        return; /* Too many errors */
-    }
-    
-    /* Format the error message */
-    char buffer[1024];
-    va_list args;
-    va_start(args, format);
-    vsnprintf(buffer, sizeof(buffer), format, args);
-    va_end(args);
-    
-    /* Add to error list */
-    context->errors.messages[context->errors.count] = strdup(buffer);
-    context->errors.count++;
-}
-
-/* Add a warning message to the context */
-void add_warning(SemanticContext* context, const char* format, ...) {
-    if (context->warnings.count >= 256) {
-        return; /* Too many warnings */
-    }
-    
-    /* Format the warning message */
-    char buffer[1024];
-    va_list args;
-    va_start(args, format);
-    vsnprintf(buffer, sizeof(buffer), format, args);
-    va_end(args);
-    
-    /* Add to warning list */
-    context->warnings.messages[context->warnings.count] = strdup(buffer);
-    context->warnings.count++;
-}
-
 /* Print all error messages */
 void print_errors(SemanticContext* context) {
-    if (context == NULL || context->errors.count == 0) {
-        return;
-    }
-    
-    printf("\nSemantic Errors (%d):\n", context->errors.count);
-    for (int i = 0; i < context->errors.count; i++) {
-        printf("  Error: %s\n", context->errors.messages[i]);
+    if (context != NULL) {
+        print_diagnostic_list(&context->diagnostics, &context->diagnostics.errors, stdout);
     }
 }
 
 /* Print all warning messages */
 void print_warnings(SemanticContext* context) {
-    if (context == NULL || context->warnings.count == 0) {
-        return;
-    }
-    
-    printf("\nSemantic Warnings (%d):\n", context->warnings.count);
-    for (int i = 0; i < context->warnings.count; i++) {
-        printf("  Warning: %s\n", context->warnings.messages[i]);
+    if (context != NULL) {
+        print_diagnostic_list(&context->diagnostics, &context->diagnostics.warnings, stdout);
     }
 }
 
-/* Main entry point for semantic analysis */
-bool analyze_semantics(ASTNode* root) {
-    if (root == NULL) {
-        return false;
-    }
+/* State of the walk in analyze_semantics */
+typedef struct {
+    SemanticContext* context;
+    bool result;             /* Every node analyzed so far is valid */
+} SemanticWalk;
+
+/* Analyze one node on the way into and out of its subtree */
+static bool analyze_visit(ASTNode* node, VisitStage stage, int depth, void* data) {
+    SemanticWalk* walk = (SemanticWalk*)data;
+    SemanticContext* context = walk->context;
     
-    /* Create semantic context */
-    SemanticContext* context = create_semantic_context();
+    if (stage == VISIT_LEAVE && node->type == NODE_QUANTIFIER) {
+        exit_quantifier(node, context);
+    }
+    if (stage != VISIT_ENTER) {
+        return true;
+    }
     
-    /* Analyze the AST recursively */
-    bool result = false;
+    bool ok = false;
     
-    switch (root->type) {
+    switch (node->type) {
         case NODE_BINARY_OP:
-            result = analyze_binary_op(root, context);
+            ok = analyze_binary_op(node, context);
             break;
         case NODE_UNARY_OP:
-            result = analyze_unary_op(root, context);
+            ok = analyze_unary_op(node, context);
             break;
         case NODE_QUANTIFIER:
-            result = analyze_quantifier(root, context);
+            ok = analyze_quantifier(node, context);
+            if (!ok) {
+                /* The scope was not entered: skip the body */
+                walk->result = false;
+                return false;
+            }
             break;
         case NODE_PREDICATE:
-            result = analyze_predicate(root, context);
+            ok = analyze_predicate(node, context);
             break;
         case NODE_VARIABLE:
-            result = analyze_variable(root, context);
+            ok = analyze_variable(node, context);
             break;
         case NODE_LITERAL:
-            result = analyze_literal(root, context);
+            ok = analyze_literal(node, context);
             break;
         default:
-            add_error(context, "Unknown node type in AST");
-            result = false;
+            add_diagnostic(&context->diagnostics, &(Diagnostic){ DIAG_UNKNOWN_NODE, node->line, node->column }, true);
+            ok = false;
     }
     
+    walk->result = walk->result && ok;
+    return true;
+}
+
+/* Analyze a tree in the context and print its warnings and errors */
+static bool analyze_and_report(SemanticContext* context, ASTNode* root) {
+    /* Analyze the AST with an explicit stack, so deep trees cannot overflow */
+    SemanticWalk walk = { context, true };
+    walk_ast(root, analyze_visit, &walk);
+    
     /* Print any errors or warnings */
     print_warnings(context);
     print_errors(context);
     
+    return context->diagnostics.errors.found == 0 && walk.result;
+}
+
+/* Main entry point for semantic analysis */
+bool analyze_semantics(ASTNode* root) {
+    if (root == NULL) {
+        return false;
+    }
+    
+    /* Create semantic context */
+    SemanticContext* context = create_semantic_context();
+    
     /* Cleanup and return result */
-    bool success = (context->errors.count == 0);
+    bool success = analyze_and_report(context, root);
     free_semantic_context(context);
     
-    return success && result;
+    return success;
 }
 
-/* Analyze binary operation nodes */
-bool analyze_binary_op(ASTNode* node, SemanticContext* context) {
-    if (node == NULL || node->type != NODE_BINARY_OP) {
+/*
+ * Analyze one top-level formula in a context shared by all formulas of the
+ * input, so predicate arities are checked against earlier formulas. The
+ * messages are printed and released, leaving only the predicate registry in
+ * the context, and the formula's AST can be freed as soon as this returns.
+ */
+bool analyze_formula(SemanticContext* context, ASTNode* formula) {
+    if (formula == NULL) {
         return false;
     }
     
-    /* Analyze left and right operands */
-    bool left_ok = false;
-    bool right_ok = false;
+    bool success = analyze_and_report(context, formula);
+    clear_diagnostics(&context->diagnostics);
+    return success;
+}
+
+/*
+ * Fused analysis. The parser reduces predicates and variables in source
+ * order and enters each quantifier's scope before parsing its body, which
+ * is the order of the separate pass. Only a quantifier's position comes
+ * later, from its node, so a shadowing warning keeps its place in the list
+ * and its positions are filled in once both quantifiers have been built.
+ */
+static void fused_enter_quantifier(InternId variable, InternId* domain, int domain_size, void* data) {
+    SemanticContext* context = (SemanticContext*)data;
+    SymbolEntry* existing = lookup_symbol(context->symbols, variable);
+    
+    /* A new scope is empty, so the variable is always bound; its position is set when its node is built */
+    enter_scope(context->symbols);
+    SymbolEntry* entry = insert_variable(context->symbols, variable, domain, domain_size, 0, 0);
+    
+    if (existing == NULL) {
+        return;
+    }
     
-    switch (node->data.binary.left->type) {
-        case NODE_BINARY_OP:
-            left_ok = analyze_binary_op(node->data.binary.left, context);
-            break;
-        case NODE_UNARY_OP:
-            left_ok = analyze_unary_op(node->data.binary.left, context);
-            break;
-        case NODE_QUANTIFIER:
-            left_ok = analyze_quantifier(node->data.binary.left, context);
-            break;
-        case NODE_PREDICATE:
-            left_ok = analyze_predicate(node->data.binary.left, context);
-            break;
-        case NODE_VARIABLE:
-            left_ok = analyze_variable(node->data.binary.left, context);
-            break;
-        case NODE_LITERAL:
-            left_ok = analyze_literal(node->data.binary.left, context);
-            break;
-        default:
-            add_error(context, "Invalid left operand type in binary operation at line %d, column %d",
-                      node->line, node->column);
-            left_ok = false;
+    /* Record the warning now, to keep its place; fused_leave_quantifier fills in the positions */
+    int index = add_diagnostic(&context->diagnostics, &(Diagnostic){ DIAG_SHADOWED_VARIABLE, 0, 0, variable }, false);
+    if (index >= 0) {
+        if (context->pending_count == context->pending_capacity) {
+            context->pending_capacity = context->pending_capacity > 0 ? context->pending_capacity * 2 : 16;
+            context->pending = (PendingShadow*)realloc(context->pending, context->pending_capacity * sizeof(PendingShadow));
+        }
+        PendingShadow* shadow = &context->pending[context->pending_count];
+        shadow->index = index;
+        shadow->shadowing = entry;
+        shadow->next = existing->pending;
+        existing->pending = context->pending_count++;
+    }
+}
+
+static void fused_leave_quantifier(ASTNode* node, void* data) {
+    SemanticContext* context = (SemanticContext*)data;
+    /* The quantifier's own binding is the innermost one of its variable */
+    SymbolEntry* entry = context->symbols->visible[node->data.quantifier.variable];
+    entry->line = node->line;
+    entry->column = node->column;
+    
+    /*
+     * A warning this binding raised is the last one chained from the binding
+     * it hides, since quantifiers entered later are nested in this one and
+     * hide it instead. Earlier siblings' warnings were marked built when they
+     * were left, as their entries may have been reused for this one.
+     */
+    if (entry->shadowed != NULL && entry->shadowed->pending >= 0) {
+        PendingShadow* shadow = &context->pending[entry->shadowed->pending];
+        if (shadow->shadowing == entry) {
+            Diagnostic* warning = &context->diagnostics.warnings.items[shadow->index];
+            warning->line = node->line;
+            warning->column = node->column;
+            shadow->shadowing = NULL;
+        }
     }
     
-    switch (node->data.binary.right->type) {
-        case NODE_BINARY_OP:
-            right_ok = analyze_binary_op(node->data.binary.right, context);
-            break;
-        case NODE_UNARY_OP:
-            right_ok = analyze_unary_op(node->data.binary.right, context);
-            break;
-        case NODE_QUANTIFIER:
-            right_ok = analyze_quantifier(node->data.binary.right, context);
-            break;
-        case NODE_PREDICATE:
-            right_ok = analyze_predicate(node->data.binary.right, context);
-            break;
-        case NODE_VARIABLE:
-            right_ok = analyze_variable(node->data.binary.right, context);
-            break;
-        case NODE_LITERAL:
-            right_ok = analyze_literal(node->data.binary.right, context);
-            break;
-        default:
-            add_error(context, "Invalid right operand type in binary operation at line %d, column %d",
-                      node->line, node->column);
-            right_ok = false;
+    /* The warnings citing this binding are complete, as their quantifiers are nested in it */
+    for (int i = entry->pending; i >= 0; i = context->pending[i].next) {
+        Diagnostic* warning = &context->diagnostics.warnings.items[context->pending[i].index];
+        warning->values[0] = entry->line;
+        warning->values[1] = entry->column;
+        complete_diagnostic(&context->diagnostics, context->pending[i].index);
+    }
+    
+    exit_scope(context->symbols);
+}
+
+static void fused_atom(ASTNode* node, void* data) {
+    if (node->type == NODE_PREDICATE) {
+        analyze_predicate(node, (SemanticContext*)data);
+    } else {
+        analyze_variable(node, (SemanticContext*)data);
+    }
+}
+
+static const ParseActions semantic_actions = { fused_enter_quantifier, fused_leave_quantifier, fused_atom };
+
+/* Analyze the input as the parser builds it */
+void attach_semantic_actions(ParseContext* ctx, SemanticContext* context) {
+    ctx->actions = &semantic_actions;
+    ctx->action_data = context;
+}
+
+/* Print and release the messages of a formula analyzed while it was parsed */
+bool report_formula(SemanticContext* context) {
+    print_warnings(context);
+    print_errors(context);
+    
+    bool success = context->diagnostics.errors.found == 0;
+    clear_diagnostics(&context->diagnostics);
+    context->pending_count = 0;
+    return success;
+}
+
+/* Analyze binary operation nodes (the operands are visited by the walk) */
+bool analyze_binary_op(ASTNode* node, SemanticContext* context) {
+    if (node == NULL || node->type != NODE_BINARY_OP) {
+        return false;
     }
     
-    return left_ok && right_ok;
+    if (node->data.binary.left == NULL || node->data.binary.right == NULL) {
+        add_diagnostic(&context->diagnostics, &(Diagnostic){ DIAG_MISSING_BINARY_OPERAND, node->line, node->column }, true);
+        return false;
+    }
+    
+    return true;
 }
 
-/* Analyze unary operation nodes */
+/* Analyze unary operation nodes (the operand is visited by the walk) */
 bool analyze_unary_op(ASTNode* node, SemanticContext* context) {
     if (node == NULL || node->type != NODE_UNARY_OP) {
         return false;
     }
     
-    /* Analyze operand */
-    bool operand_ok = false;
-    
-    switch (node->data.unary.operand->type) {
-        case NODE_BINARY_OP:
-            operand_ok = analyze_binary_op(node->data.unary.operand, context);
-            break;
-        case NODE_UNARY_OP:
-            operand_ok = analyze_unary_op(node->data.unary.operand, context);
-            break;
-        case NODE_QUANTIFIER:
-            operand_ok = analyze_quantifier(node->data.unary.operand, context);
-            break;
-        case NODE_PREDICATE:
-            operand_ok = analyze_predicate(node->data.unary.operand, context);
-            break;
-        case NODE_VARIABLE:
-            operand_ok = analyze_variable(node->data.unary.operand, context);
-            break;
-        case NODE_LITERAL:
-            operand_ok = analyze_literal(node->data.unary.operand, context);
-            break;
-        default:
-            add_error(context, "Invalid operand type in unary operation at line %d, column %d",
-                      node->line, node->column);
-            operand_ok = false;
+    if (node->data.unary.operand == NULL) {
+        add_diagnostic(&context->diagnostics, &(Diagnostic){ DIAG_MISSING_UNARY_OPERAND, node->line, node->column }, true);
+        return false;
     }
     
-    return operand_ok;
+    return true;
 }
 
-/* Analyze quantifier nodes */
+/*
+ * Analyze quantifier nodes and enter the scope of the quantified variable.
+ * The body is visited by the walk, which calls exit_quantifier afterwards;
+ * on failure no scope is entered.
+ */
 bool analyze_quantifier(ASTNode* node, SemanticContext* context) {
     if (node == NULL || node->type != NODE_QUANTIFIER) {
         return false;
@@ -250,13 +277,14 @@ bool analyze_quantifier(ASTNode* node, SemanticContext* context) {
     
     /* Check if variable shadows another variable */
     SymbolEntry* existing = lookup_symbol(context->symbols, node->data.quantifier.variable);
-    if (existing != NULL && existing->type == SYM_VARIABLE) {
-        add_warning(context, "Variable '%s' at line %d, column %d shadows another variable defined at line %d, column %d",
-                    node->data.quantifier.variable, node->line, node->column, existing->line, existing->column);
+    if (existing != NULL) {
+        add_diagnostic(&context->diagnostics,
+                       &(Diagnostic){ DIAG_SHADOWED_VARIABLE, node->line, node->column, node->data.quantifier.variable,
+                                      0, { existing->line, existing->column } }, true);
     }
     
     /* Enter a new scope for the quantifier */
-    context->symbols = enter_scope(context->symbols);
+    enter_scope(context->symbols);
     
     /* Add the quantified variable to the symbol table */
     SymbolEntry* entry = insert_variable(context->symbols, 
@@ -267,98 +295,77 @@ bool analyze_quantifier(ASTNode* node, SemanticContext* context) {
                                         node->column);
     
     if (entry == NULL) {
-        add_error(context, "Variable '%s' at line %d, column %d is already defined in this scope",
-                 node->data.quantifier.variable, node->line, node->column);
-        context->symbols = exit_scope(context->symbols);
+        add_diagnostic(&context->diagnostics,
+                       &(Diagnostic){ DIAG_DUPLICATE_VARIABLE, node->line, node->column, node->data.quantifier.variable }, true);
+        exit_scope(context->symbols);
         return false;
     }
     
-    /* Analyze the quantifier's expression */
-    bool expr_ok = false;
-    
-    switch (node->data.quantifier.expr->type) {
-        case NODE_BINARY_OP:
-            expr_ok = analyze_binary_op(node->data.quantifier.expr, context);
-            break;
-        case NODE_UNARY_OP:
-            expr_ok = analyze_unary_op(node->data.quantifier.expr, context);
-            break;
-        case NODE_QUANTIFIER:
-            expr_ok = analyze_quantifier(node->data.quantifier.expr, context);
-            break;
-        case NODE_PREDICATE:
-            expr_ok = analyze_predicate(node->data.quantifier.expr, context);
-            break;
-        case NODE_VARIABLE:
-            expr_ok = analyze_variable(node->data.quantifier.expr, context);
-            break;
-        case NODE_LITERAL:
-            expr_ok = analyze_literal(node->data.quantifier.expr, context);
-            break;
-        default:
-            add_error(context, "Invalid expression type in quantifier at line %d, column %d",
-                      node->line, node->column);
-            expr_ok = false;
-    }
-    
-    /* Exit the quantifier's scope */
-    context->symbols = exit_scope(context->symbols);
-    
-    return expr_ok;
+    return true;
+}
+
+/* Exit the quantifier's scope once its body has been analyzed */
+void exit_quantifier(ASTNode* node, SemanticContext* context) {
+    exit_scope(context->symbols);
 }
 
-/* Analyze predicate nodes */
+/*
+ * Analyze predicate nodes. Predicates are global, so the arity is checked
+ * against the first use anywhere in the program, whatever scope it was in.
+ */
 bool analyze_predicate(ASTNode* node, SemanticContext* context) {
     if (node == NULL || node->type != NODE_PREDICATE) {
         return false;
     }
     
-    /* Check if the predicate is defined */
-    SymbolEntry* entry = lookup_symbol(context->symbols, node->data.predicate.name);
-    
-    if (entry == NULL) {
-        /* First use of this predicate, register it */
-        entry = insert_predicate(context->symbols, 
-                                node->data.predicate.name,
-                                node->data.predicate.arg_count,
-                                node->line, 
-                                node->column);
-                                
-        if (entry == NULL) {
-            add_error(context, "Failed to register predicate '%s' at line %d, column %d",
-                     node->data.predicate.name, node->line, node->column);
-            return false;
-        }
-    } else if (entry->type != SYM_PREDICATE) {
-        add_error(context, "Symbol '%s' at line %d, column %d is not a predicate",
-                 node->data.predicate.name, node->line, node->column);
+    /* A quantified variable hides a predicate of the same name */
+    if (lookup_symbol(context->symbols, node->data.predicate.name) != NULL) {
+        add_diagnostic(&context->diagnostics,
+                       &(Diagnostic){ DIAG_NOT_A_PREDICATE, node->line, node->column, node->data.predicate.name }, true);
         return false;
-    } else if (entry->data.predicate.arity != node->data.predicate.arg_count) {
-        add_error(context, "Predicate '%s' at line %d, column %d is called with %d arguments, but it was defined with %d arguments at line %d, column %d",
-                 node->data.predicate.name, node->line, node->column,
-                 node->data.predicate.arg_count, entry->data.predicate.arity,
-                 entry->line, entry->column);
+    }
+    
+    /* Register the predicate on first use, or check the arity it was registered with */
+    int arg_count = node->data.predicate.arg_count;
+    PredicateInfo* predicate = use_predicate(context->predicates, node->data.predicate.name,
+                                             arg_count, node->line, node->column);
+    if (predicate->arity != arg_count) {
+        add_diagnostic(&context->diagnostics,
+                       &(Diagnostic){ DIAG_ARITY_MISMATCH, node->line, node->column, node->data.predicate.name, 0,
+                                      { arg_count, predicate->arity, predicate->line, predicate->column } }, true);
         return false;
     }
     
     /* Check that all arguments are valid variables */
-    for (int i = 0; i < node->data.predicate.arg_count; i++) {
+    InternId** domains = (InternId**)malloc((arg_count > 0 ? arg_count : 1) * sizeof(InternId*));
+    int* domain_sizes = (int*)malloc((arg_count > 0 ? arg_count : 1) * sizeof(int));
+    bool valid = true;
+    for (int i = 0; i < arg_count; i++) {
         SymbolEntry* arg_entry = lookup_symbol(context->symbols, node->data.predicate.args[i]);
         
         if (arg_entry == NULL) {
-            add_error(context, "Unbound variable '%s' used as argument %d in predicate '%s' at line %d, column %d",
-                     node->data.predicate.args[i], i + 1, node->data.predicate.name, 
-                     node->line, node->column);
-            return false;
-        } else if (arg_entry->type != SYM_VARIABLE) {
-            add_error(context, "Symbol '%s' used as argument %d in predicate '%s' at line %d, column %d is not a variable",
-                     node->data.predicate.args[i], i + 1, node->data.predicate.name,
-                     node->line, node->column);
-            return false;
+            DiagnosticCode code = find_predicate(context->predicates, node->data.predicate.args[i]) != NULL
+                                  ? DIAG_ARGUMENT_NOT_VARIABLE : DIAG_UNBOUND_ARGUMENT;
+            add_diagnostic(&context->diagnostics,
+                           &(Diagnostic){ code, node->line, node->column, node->data.predicate.args[i],
+                                          node->data.predicate.name, { i + 1 } }, true);
+            valid = false;
+            break;
         }
+        
+        /* Record the binding for code generation (see resolve_bindings) */
+        node->data.predicate.slots[i] = arg_entry->scope_level - 1;
+        domains[i] = arg_entry->domain;
+        domain_sizes[i] = arg_entry->domain_size;
     }
     
-    return true;
+    /* Only uses that passed analysis shape the predicate's signature */
+    if (valid) {
+        record_signature(predicate, domains, domain_sizes);
+    }
+    free(domains);
+    free(domain_sizes);
+    return valid;
 }
 
 /* Analyze variable nodes */
@@ -371,15 +378,14 @@ bool analyze_variable(ASTNode* node, SemanticContext* context) {
     SymbolEntry* entry = lookup_symbol(context->symbols, node->data.variable.name);
     
     if (entry == NULL) {
-        add_error(context, "Unbound variable '%s' at line %d, column %d",
-                 node->data.variable.name, node->line, node->column);
-        return false;
-    } else if (entry->type != SYM_VARIABLE) {
-        add_error(context, "Symbol '%s' at line %d, column %d is not a variable",
-                 node->data.variable.name, node->line, node->column);
+        DiagnosticCode code = find_predicate(context->predicates, node->data.variable.name) != NULL
+                              ? DIAG_NOT_A_VARIABLE : DIAG_UNBOUND_VARIABLE;
+        add_diagnostic(&context->diagnostics,
+                       &(Diagnostic){ code, node->line, node->column, node->data.variable.name }, true);
         return false;
     }
     
+    node->data.variable.slot = entry->scope_level - 1;
     return true;
 }
 
@@ -4,41 +4,57 @@
 #include <stdbool.h>
 #include "ast.h"
 #include "symbol_table.h"
-
-/* Error reporting structure */
-typedef struct {
-    char* messages[256];     /* Array of error messages */
-    int count;               /* Number of errors */
-} ErrorList;
-
-/* Warning reporting structure */
+#include "predicates.h"
+#include "parser.h"
+#include "diagnostics.h"
+
+/*
+ * A shadowing warning of fused analysis, waiting for the positions of its
+ * quantifiers, which are only known once their nodes have been built. The
+ * warnings that cite a binding are chained from its SymbolEntry.
+ */
 typedef struct {
-    char* messages[256];     /* Array of warning messages */
-    int count;               /* Number of warnings */
-} WarningList;
+    int index;               /* Its place in the warning list */
+    SymbolEntry* shadowing;  /* Binding of the shadowing quantifier until it is built */
+    int next;                /* Next warning citing the same hidden binding, or -1 */
+} PendingShadow;
 
 /* Semantic analysis context */
 typedef struct {
-    SymbolTable* symbols;    /* Current symbol table */
-    ErrorList errors;        /* List of semantic errors */
-    WarningList warnings;    /* List of semantic warnings */
+    SymbolTable* symbols;    /* Scoped symbol table of the quantified variables */
+    PredicateRegistry* predicates;  /* Every predicate used so far, by name */
+    Diagnostics diagnostics; /* Errors and warnings, formatted when printed */
+    PendingShadow* pending;  /* Fused analysis: shadowing warnings of the formula */
+    int pending_count;
+    int pending_capacity;
 } SemanticContext;
 
 /* Function to perform semantic analysis on the AST */
 bool analyze_semantics(ASTNode* root);
 
+/* Analyze one top-level formula of a streamed input against a shared context */
+bool analyze_formula(SemanticContext* context, ASTNode* formula);
+
+/*
+ * Fused analysis: the parser calls the analysis from its grammar actions,
+ * so no separate pass over the tree is needed. Once a formula (or the whole
+ * input) has been parsed, report_formula prints and releases its messages
+ * like analyze_formula does, with the same messages in the same order.
+ */
+void attach_semantic_actions(ParseContext* ctx, SemanticContext* context);
+bool report_formula(SemanticContext* context);
+
 /* Utility functions */
 SemanticContext* create_semantic_context();
 void free_semantic_context(SemanticContext* context);
-void add_error(SemanticContext* context, const char* format, ...);
-void add_warning(SemanticContext* context, const char* format, ...);
 void print_errors(SemanticContext* context);
 void print_warnings(SemanticContext* context);
 
-/* Analyze specific node types */
+/* Analyze specific node types (one node each, children are visited by analyze_semantics) */
 bool analyze_binary_op(ASTNode* node, SemanticContext* context);
 bool analyze_unary_op(ASTNode* node, SemanticContext* context);
 bool analyze_quantifier(ASTNode* node, SemanticContext* context);
+void exit_quantifier(ASTNode* node, SemanticContext* context);
 bool analyze_predicate(ASTNode* node, SemanticContext* context);
 bool analyze_variable(ASTNode* node, SemanticContext* context);
 bool analyze_literal(ASTNode* node, SemanticContext* context);
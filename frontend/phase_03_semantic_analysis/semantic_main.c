@@ -1,55 +1,219 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "ast.h"
 #include "semantic.h"
+#include "flat_ast.h"
+#include "ast_cache.h"
+#include "parser.h"
+#include "stats.h"
 
-/* External declarations */
-extern ASTNode* ast_root;
-extern int yyparse();
-extern FILE* yyin;
+/* Options and outcome of a streamed analysis */
+typedef struct {
+    SemanticContext* context;  /* Shared by all formulas; keeps the predicates */
+    bool print_tree;
+    bool fused;                /* Formulas were analyzed while they were parsed */
+    bool result;               /* Every formula so far passed analysis */
+    CompileStats* stats;       /* Analysis is timed apart from parsing, or NULL */
+} StreamState;
+
+/* Print the --stats table and write the --stats-json report, as asked */
+static bool report_stats(CompileStats* stats, bool table, const char* json_filename) {
+    if (table) {
+        printf("\n");
+        print_compile_stats(stats, stdout);
+    }
+    if (json_filename == NULL) {
+        return true;
+    }
+    FILE* json = strcmp(json_filename, "-") == 0 ? stdout : fopen(json_filename, "w");
+    if (json == NULL) {
+        fprintf(stderr, "Error: Could not open stats file '%s'\n", json_filename);
+        return false;
+    }
+    write_compile_stats_json(stats, json);
+    if (json != stdout) {
+        fclose(json);
+    }
+    return true;
+}
+
+/* Print and analyze one top-level formula as soon as it has been parsed */
+static void stream_formula(ASTNode* formula, int number, void* data) {
+    StreamState* state = (StreamState*)data;
+    if (state->print_tree) {
+        printf("Formula %d:\n", number);
+        print_ast(formula, 0);
+        printf("\n");
+    }
+    Stopwatch watch = state->stats != NULL ? start_phase(state->stats) : (Stopwatch){ 0 };
+    if (!(state->fused ? report_formula(state->context) : analyze_formula(state->context, formula))) {
+        state->result = false;
+    }
+    if (state->stats != NULL) {
+        stop_phase(state->stats, PHASE_SEMANTIC, watch);
+    }
+}
 
 /* Main function to test semantic analysis */
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <input_file>\n", argv[0]);
+    bool print_tree = true;
+    char* cache_filename = NULL;
+    bool stream = false;
+    bool stats_table = false;
+    char* stats_filename = NULL;
+    bool print_predicates = false;
+    bool fused = false;
+    DiagnosticOptions diagnostic_options = default_diagnostic_options();
+    bool usage_error = argc < 2;
+    
+    for (int i = 2; i < argc && !usage_error; i++) {
+        if (strcmp(argv[i], "-q") == 0) {
+            print_tree = false; /* Do not print the AST */
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            cache_filename = argv[++i]; /* Write the analyzed AST to a cache file */
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            stream = true; /* Analyze and free each formula as it is parsed */
+        } else if (strcmp(argv[i], "--fused") == 0) {
+            fused = true; /* Analyze in the parser's actions instead of a separate pass */
+        } else if (strcmp(argv[i], "--max-diagnostics") == 0 && i + 1 < argc) {
+            char* end;
+            diagnostic_options.limit = strtol(argv[++i], &end, 10); /* Keep the first n errors and the first n warnings */
+            usage_error = *end != '\0' || end == argv[i] || diagnostic_options.limit < 0;
+        } else if (strcmp(argv[i], "--dedup-diagnostics") == 0) {
+            diagnostic_options.deduplicate = true; /* Report each kind of problem with a name once */
+        } else if (strcmp(argv[i], "--stream-diagnostics") == 0) {
+            diagnostic_options.stream = true; /* Print diagnostics as they are found, without keeping them */
+        } else if (strcmp(argv[i], "--predicates") == 0) {
+            print_predicates = true; /* List every predicate once analysis is done */
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats_table = true; /* Print the time and work of each phase */
+        } else if (strcmp(argv[i], "--stats-json") == 0 && i + 1 < argc) {
+            stats_filename = argv[++i]; /* Write the same report as JSON */
+        } else {
+            usage_error = true;
+        }
+    }
+    if (usage_error || (stream && cache_filename != NULL)) {
+        fprintf(stderr, "Usage: %s <input_file> [-q] [-c <cache_file> | --stream] [--fused] [--max-diagnostics <n>] [--dedup-diagnostics] [--stream-diagnostics] [--predicates] [--stats] [--stats-json <stats_file>]\n", argv[0]);
         return 1;
     }
     
-    FILE* input_file = fopen(argv[1], "r");
-    if (!input_file) {
+    /* Phase times and counters are only gathered when they will be reported */
+    CompileStats stats_storage;
+    CompileStats* stats = NULL;
+    if (stats_table || stats_filename != NULL) {
+        init_compile_stats(&stats_storage);
+        stats = &stats_storage;
+    }
+    
+    /* The context owns the input file and closes it when freed */
+    ParseContext* ctx = create_file_parse_context(argv[1]);
+    if (ctx == NULL) {
         fprintf(stderr, "Error: Cannot open file '%s'\n", argv[1]);
         return 1;
     }
     
-    yyin = input_file;
+    /*
+     * In streaming mode each formula is analyzed by stream_formula while
+     * parsing, and with --fused by the parser's own actions; either way one
+     * context collects the predicates of the input
+     */
+    SemanticContext* context = create_semantic_context();
+    context->diagnostics.options = diagnostic_options;
+    context->symbols->stats = stats;
+    StreamState state = { context, print_tree, fused, true, stats };
+    if (fused) {
+        attach_semantic_actions(ctx, context);
+    }
+    if (stream) {
+        ctx->on_formula = stream_formula;
+        ctx->handler_data = &state;
+        printf("Performing semantic analysis...\n");
+    }
     
     /* Parse the input file */
-    int parse_result = yyparse();
+    ctx->stats = stats;
+    Stopwatch watch = stats != NULL ? start_phase(stats) : (Stopwatch){ 0 };
+    int parse_result = parse_input(ctx);
+    if (stats != NULL) {
+        stop_phase(stats, PHASE_PARSE, watch);
+    }
     
-    if (parse_result != 0 || ast_root == NULL) {
+    if (stream) {
+        bool stream_result = parse_result == 0 && ctx->formula_count > 0 && state.result;
+        if (parse_result != 0 || ctx->formula_count == 0) {
+            fprintf(stderr, "Parsing failed. Cannot perform semantic analysis.\n");
+        } else if (stream_result) {
+            printf("\nFormulas analyzed: %d\n", ctx->formula_count);
+            printf("Semantic analysis completed successfully!\n");
+        } else {
+            printf("\nSemantic analysis failed. See errors above.\n");
+        }
+        if (stream_result && print_predicates) {
+            printf("\n");
+            print_predicate_registry(context->predicates, stdout);
+        }
+        if (stream_result && stats != NULL) {
+            stream_result = report_stats(stats, stats_table, stats_filename);
+        }
+        free_semantic_context(context);
+        free_parse_context(ctx);
+        free_interned();
+        return stream_result ? 0 : 1;
+    }
+    
+    if (parse_result != 0 || ctx->root == NULL) {
         fprintf(stderr, "Parsing failed. Cannot perform semantic analysis.\n");
-        fclose(input_file);
+        free_semantic_context(context);
+        free_parse_context(ctx);
         return 1;
     }
+    ASTNode* ast_root = ctx->root;
     
     /* Print the AST */
-    printf("Abstract Syntax Tree:\n");
-    print_ast(ast_root, 0);
-    printf("\n");
+    if (print_tree) {
+        printf("Abstract Syntax Tree:\n");
+        print_ast(ast_root, 0);
+        printf("\n");
+    }
     
     /* Perform semantic analysis */
     printf("Performing semantic analysis...\n");
-    bool semantic_result = analyze_semantics(ast_root);
+    watch = stats != NULL ? start_phase(stats) : (Stopwatch){ 0 };
+    bool semantic_result = fused ? report_formula(context) : analyze_formula(context, ast_root);
+    if (stats != NULL) {
+        stop_phase(stats, PHASE_SEMANTIC, watch);
+    }
     
     if (semantic_result) {
         printf("\nSemantic analysis completed successfully!\n");
+        if (print_predicates) {
+            printf("\n");
+            print_predicate_registry(context->predicates, stdout);
+        }
+        
+        /* Only an AST that passed analysis is cached for the code generator */
+        if (cache_filename != NULL) {
+            FlatAST* flat = flatten_ast(ast_root);
+            if (write_ast_cache(cache_filename, flat, AST_CACHE_ANALYZED)) {
+                printf("AST cache written to %s\n", cache_filename);
+            } else {
+                semantic_result = false;
+            }
+            free_flat_ast(flat);
+        }
     } else {
         printf("\nSemantic analysis failed. See errors above.\n");
     }
+    if (semantic_result && stats != NULL) {
+        semantic_result = report_stats(stats, stats_table, stats_filename);
+    }
     
     /* Clean up */
-    free_ast(ast_root);
-    fclose(input_file);
+    free_semantic_context(context);
+    free_parse_context(ctx);
+    free_interned();
     
     return semantic_result ? 0 : 1;
 }
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <string.h>
+#include "stats.h"
+
+static const char* phase_names[PHASE_COUNT] = {
+    "Lexing", "Parsing", "Semantic analysis", "Code generation"
+};
+static const char* phase_keys[PHASE_COUNT] = { "lex", "parse", "semantic", "codegen" };
+
+static const char* node_keys[NODE_TYPE_COUNT] = {
+    "binary", "unary", "quantifier", "literal", "variable", "predicate", "nary"
+};
+
+void init_compile_stats(CompileStats* stats) {
+    memset(stats, 0, sizeof(CompileStats));
+}
+
+static double cpu_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+Stopwatch start_phase(const CompileStats* stats) {
+    Stopwatch watch;
+    watch.timed_wall = stats->timed_wall;
+    watch.timed_cpu = stats->timed_cpu;
+    watch.lex_wall = stats->wall[PHASE_LEX];
+    watch.cpu = cpu_seconds();
+    watch.wall = monotonic_seconds();
+    return watch;
+}
+
+void stop_phase(CompileStats* stats, CompilePhase phase, Stopwatch watch) {
+    double wall = monotonic_seconds() - watch.wall;
+    double cpu = cpu_seconds() - watch.cpu;
+
+    /* Phases that ran inside this one have already been recorded */
+    wall -= stats->timed_wall - watch.timed_wall;
+    cpu -= stats->timed_cpu - watch.timed_cpu;
+    stats->timed_wall += wall;
+    stats->timed_cpu += cpu;
+
+    /* Tokens scanned meanwhile recorded their wall time but not their CPU time */
+    double lexing = stats->wall[PHASE_LEX] - watch.lex_wall;
+    if (lexing > 0 && wall + lexing > 0) {
+        double lex_cpu = cpu * lexing / (wall + lexing);
+        stats->cpu[PHASE_LEX] += lex_cpu;
+        stats->ran[PHASE_LEX] = true;
+        cpu -= lex_cpu;
+    }
+
+    stats->wall[phase] += wall;
+    stats->cpu[phase] += cpu;
+    stats->ran[phase] = true;
+}
+
+static long node_total(const CompileStats* stats) {
+    long total = 0;
+    for (int i = 0; i < NODE_TYPE_COUNT; i++) {
+        total += stats->nodes[i];
+    }
+    return total;
+}
+
+void print_compile_stats(const CompileStats* stats, FILE* out) {
+    fprintf(out, "%-20s %12s %12s\n", "Phase", "Wall (ms)", "CPU (ms)");
+    double wall = 0;
+    double cpu = 0;
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        if (stats->ran[phase]) {
+            fprintf(out, "%-20s %12.3f %12.3f\n", phase_names[phase],
+                    stats->wall[phase] * 1000, stats->cpu[phase] * 1000);
+            wall += stats->wall[phase];
+            cpu += stats->cpu[phase];
+        }
+    }
+    fprintf(out, "%-20s %12.3f %12.3f\n", "Total", wall * 1000, cpu * 1000);
+
+    fprintf(out, "Tokens: %ld\n", stats->tokens);
+    fprintf(out, "AST nodes: %ld", node_total(stats));
+    const char* separator = " (";
+    for (int i = 0; i < NODE_TYPE_COUNT; i++) {
+        if (stats->nodes[i] > 0) {
+            fprintf(out, "%s%s %ld", separator, node_keys[i], stats->nodes[i]);
+            separator = ", ";
+        }
+    }
+    fprintf(out, "%s\n", node_total(stats) > 0 ? ")" : "");
+    if (stats->ran[PHASE_SEMANTIC]) {
+        fprintf(out, "Symbol table lookups: %ld\n", stats->lookups);
+    }
+    if (stats->ran[PHASE_CODEGEN]) {
+        fprintf(out, "Generated code: %ld instructions, %ld labels, %ld bytes\n",
+                stats->instructions, stats->labels, stats->bytes);
+    }
+}
+
+void write_compile_stats_json(const CompileStats* stats, FILE* out) {
+    fprintf(out, "{\n  \"phases\": {");
+    double wall = 0;
+    double cpu = 0;
+    const char* separator = "\n";
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        if (stats->ran[phase]) {
+            fprintf(out, "%s    \"%s\": { \"wall_ms\": %.3f, \"cpu_ms\": %.3f }", separator,
+                    phase_keys[phase], stats->wall[phase] * 1000, stats->cpu[phase] * 1000);
+            wall += stats->wall[phase];
+            cpu += stats->cpu[phase];
+            separator = ",\n";
+        }
+    }
+    fprintf(out, "\n  },\n");
+    fprintf(out, "  \"total\": { \"wall_ms\": %.3f, \"cpu_ms\": %.3f },\n", wall * 1000, cpu * 1000);
+    fprintf(out, "  \"tokens\": %ld,\n", stats->tokens);
+    fprintf(out, "  \"nodes\": { \"total\": %ld", node_total(stats));
+    for (int i = 0; i < NODE_TYPE_COUNT; i++) {
+        fprintf(out, ", \"%s\": %ld", node_keys[i], stats->nodes[i]);
+    }
+    fprintf(out, " }");
+    if (stats->ran[PHASE_SEMANTIC]) {
+        fprintf(out, ",\n  \"symbol_table\": { \"lookups\": %ld }", stats->lookups);
+    }
+    if (stats->ran[PHASE_CODEGEN]) {
+        fprintf(out, ",\n  \"code\": { \"instructions\": %ld, \"labels\": %ld, \"bytes\": %ld }",
+                stats->instructions, stats->labels, stats->bytes);
+    }
+    fprintf(out, "\n}\n");
+}
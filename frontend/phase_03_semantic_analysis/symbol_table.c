@@ -2,235 +2,183 @@
 #include <stdlib.h>
 #include <string.h>
 #include "symbol_table.h"
+#include "stats.h"
 
-/* Hash function for symbol table */
-unsigned int hash_string(char* str, int table_size) {
-    unsigned int hash = 0;
-    for (int i = 0; str[i] != '\0'; i++) {
-        hash = hash * 31 + str[i];
-    }
-    return hash % table_size;
-}
-
-/* Create a new symbol table */
-SymbolTable* create_symbol_table(int size) {
-    SymbolTable* table = (SymbolTable*)malloc(sizeof(SymbolTable));
-    table->buckets = (SymbolEntry**)calloc(size, sizeof(SymbolEntry*));
-    table->size = size;
-    table->scope_level = 0;
-    table->parent = NULL;
+/* Create an empty symbol table at scope level 0 */
+SymbolTable* create_symbol_table() {
+    SymbolTable* table = (SymbolTable*)calloc(1, sizeof(SymbolTable));
+    table->scope_capacity = 16;
+    table->scope_starts = (int*)malloc(table->scope_capacity * sizeof(int));
+    table->scope_starts[0] = 0;
     return table;
 }
 
-/* Free memory used by symbol table */
+/* Free memory used by the symbol table and every binding in it */
 void free_symbol_table(SymbolTable* table) {
     if (table == NULL) {
         return;
     }
     
-    /* Free all symbol entries */
-    for (int i = 0; i < table->size; i++) {
-        SymbolEntry* entry = table->buckets[i];
-        while (entry != NULL) {
-            SymbolEntry* next = entry->next;
-            
-            /* Free domain values for variables */
-            if (entry->type == SYM_VARIABLE && entry->data.variable.domain != NULL) {
-                for (int j = 0; j < entry->data.variable.domain_size; j++) {
-                    free(entry->data.variable.domain[j]);
-                }
-                free(entry->data.variable.domain);
-            }
-            
-            free(entry->name);
-            free(entry);
-            entry = next;
-        }
+    /* Names and variable domains are owned by the interner */
+    for (int i = 0; i < table->binding_count; i++) {
+        free(table->bindings[i]);
     }
-    
-    free(table->buckets);
-    
-    /* Free parent tables recursively */
-    if (table->parent != NULL) {
-        free_symbol_table(table->parent);
+    while (table->free_entries != NULL) {
+        SymbolEntry* next = table->free_entries->shadowed;
+        free(table->free_entries);
+        table->free_entries = next;
     }
     
+    free(table->visible);
+    free(table->bindings);
+    free(table->scope_starts);
     free(table);
 }
 
 /* Enter a new scope level */
-SymbolTable* enter_scope(SymbolTable* current) {
-    SymbolTable* new_scope = create_symbol_table(current->size);
-    new_scope->scope_level = current->scope_level + 1;
-    new_scope->parent = current;
-    return new_scope;
+void enter_scope(SymbolTable* table) {
+    if (table->scope_level + 1 >= table->scope_capacity) {
+        table->scope_capacity *= 2;
+        table->scope_starts = (int*)realloc(table->scope_starts, table->scope_capacity * sizeof(int));
+    }
+    table->scope_level++;
+    table->scope_starts[table->scope_level] = table->binding_count;
 }
 
-/* Exit current scope and return to parent scope */
-SymbolTable* exit_scope(SymbolTable* current) {
-    if (current == NULL || current->parent == NULL) {
-        return current; /* No parent scope */
+/* Exit the current scope, uncovering the bindings its own ones shadowed */
+void exit_scope(SymbolTable* table) {
+    if (table == NULL || table->scope_level == 0) {
+        return; /* No enclosing scope */
     }
     
-    SymbolTable* parent = current->parent;
-    
-    /* Detach parent before freeing to avoid recursive free */
-    current->parent = NULL;
-    free_symbol_table(current);
-    
-    return parent;
+    int start = table->scope_starts[table->scope_level];
+    while (table->binding_count > start) {
+        SymbolEntry* entry = table->bindings[--table->binding_count];
+        table->visible[entry->name] = entry->shadowed;
+        entry->shadowed = table->free_entries;
+        table->free_entries = entry;
+    }
+    table->scope_level--;
 }
 
-/* Insert a variable into the symbol table */
-SymbolEntry* insert_variable(SymbolTable* table, char* name, char** domain, int domain_size, int line, int column) {
-    unsigned int hash = hash_string(name, table->size);
-    
-    /* Check if variable already exists in current scope */
-    SymbolEntry* existing = lookup_symbol_current_scope(table, name);
-    if (existing != NULL) {
-        return NULL; /* Variable already defined in this scope */
+/* Bind name in the current scope, hiding any outer binding of it */
+static SymbolEntry* push_binding(SymbolTable* table, InternId name, int line, int column) {
+    if ((int)name >= table->visible_size) {
+        int size = table->visible_size > 0 ? table->visible_size : 64;
+        while (size <= (int)name) {
+            size *= 2;
+        }
+        table->visible = (SymbolEntry**)realloc(table->visible, size * sizeof(SymbolEntry*));
+        memset(table->visible + table->visible_size, 0, (size - table->visible_size) * sizeof(SymbolEntry*));
+        table->visible_size = size;
+    }
+    if (table->binding_count == table->binding_capacity) {
+        table->binding_capacity = table->binding_capacity > 0 ? table->binding_capacity * 2 : 64;
+        table->bindings = (SymbolEntry**)realloc(table->bindings, table->binding_capacity * sizeof(SymbolEntry*));
     }
     
-    /* Create new symbol entry */
-    SymbolEntry* entry = (SymbolEntry*)malloc(sizeof(SymbolEntry));
-    entry->name = strdup(name);
-    entry->type = SYM_VARIABLE;
+    /* Reuse an entry popped by an earlier scope when there is one */
+    SymbolEntry* entry = table->free_entries;
+    if (entry != NULL) {
+        table->free_entries = entry->shadowed;
+    } else {
+        entry = (SymbolEntry*)malloc(sizeof(SymbolEntry));
+    }
+    entry->name = name;
     entry->scope_level = table->scope_level;
     entry->line = line;
     entry->column = column;
+    entry->pending = -1;
     
-    /* Copy domain values */
-    if (domain != NULL && domain_size > 0) {
-        entry->data.variable.domain = (char**)malloc(sizeof(char*) * domain_size);
-        entry->data.variable.domain_size = domain_size;
-        
-        for (int i = 0; i < domain_size; i++) {
-            entry->data.variable.domain[i] = strdup(domain[i]);
-        }
-    } else {
-        entry->data.variable.domain = NULL;
-        entry->data.variable.domain_size = 0;
-    }
-    
-    /* Insert at head of bucket chain */
-    entry->next = table->buckets[hash];
-    table->buckets[hash] = entry;
-    
+    entry->shadowed = table->visible[name];
+    table->visible[name] = entry;
+    table->bindings[table->binding_count++] = entry;
     return entry;
 }
 
-/* Insert a predicate into the symbol table */
-SymbolEntry* insert_predicate(SymbolTable* table, char* name, int arity, int line, int column) {
-    unsigned int hash = hash_string(name, table->size);
-    
-    /* Check if predicate already exists */
-    SymbolEntry* existing = lookup_symbol(table, name);
+/* Insert a variable into the symbol table */
+SymbolEntry* insert_variable(SymbolTable* table, InternId name, InternId* domain, int domain_size, int line, int column) {
+    /* Check if variable already exists in current scope */
+    SymbolEntry* existing = lookup_symbol_current_scope(table, name);
     if (existing != NULL) {
-        /* Only report error if arity doesn't match */
-        if (existing->type == SYM_PREDICATE && existing->data.predicate.arity != arity) {
-            return NULL; /* Predicate already defined with different arity */
-        }
-        return existing; /* Return existing entry with matching arity */
+        return NULL; /* Variable already defined in this scope */
     }
     
-    /* Create new symbol entry */
-    SymbolEntry* entry = (SymbolEntry*)malloc(sizeof(SymbolEntry));
-    entry->name = strdup(name);
-    entry->type = SYM_PREDICATE;
-    entry->scope_level = 0; /* Predicates are global */
-    entry->line = line;
-    entry->column = column;
-    entry->data.predicate.arity = arity;
+    SymbolEntry* entry = push_binding(table, name, line, column);
     
-    /* Insert at head of bucket chain */
-    entry->next = table->buckets[hash];
-    table->buckets[hash] = entry;
+    /* Share the interned domain */
+    if (domain != NULL && domain_size > 0) {
+        entry->domain = domain;
+        entry->domain_size = domain_size;
+    } else {
+        entry->domain = NULL;
+        entry->domain_size = 0;
+    }
     
     return entry;
 }
 
-/* Look up a symbol in the current scope and parent scopes */
-SymbolEntry* lookup_symbol(SymbolTable* table, char* name) {
+/* Look up the innermost binding of a symbol */
+SymbolEntry* lookup_symbol(SymbolTable* table, InternId name) {
     if (table == NULL) {
         return NULL;
     }
-    
-    unsigned int hash = hash_string(name, table->size);
-    
-    /* Search in current scope */
-    SymbolEntry* entry = table->buckets[hash];
-    while (entry != NULL) {
-        if (strcmp(entry->name, name) == 0) {
-            return entry;
-        }
-        entry = entry->next;
+    if (table->stats != NULL) {
+        table->stats->lookups++;
     }
-    
-    /* If not found, search in parent scope */
-    return lookup_symbol(table->parent, name);
+    if ((int)name >= table->visible_size) {
+        return NULL;
+    }
+    return table->visible[name];
 }
 
 /* Look up a symbol in the current scope only */
-SymbolEntry* lookup_symbol_current_scope(SymbolTable* table, char* name) {
-    if (table == NULL) {
+SymbolEntry* lookup_symbol_current_scope(SymbolTable* table, InternId name) {
+    if (table == NULL || (int)name >= table->visible_size) {
         return NULL;
     }
     
-    unsigned int hash = hash_string(name, table->size);
-    
-    /* Search in current scope only */
-    SymbolEntry* entry = table->buckets[hash];
-    while (entry != NULL) {
-        if (strcmp(entry->name, name) == 0) {
-            return entry;
-        }
-        entry = entry->next;
+    /* The innermost binding, if it is in this scope */
+    SymbolEntry* entry = table->visible[name];
+    if (entry != NULL && entry->scope_level == table->scope_level) {
+        return entry;
     }
     
     return NULL;
 }
 
-/* Print the contents of the symbol table */
+/* Print the contents of the symbol table, innermost scope first */
 void print_symbol_table(SymbolTable* table) {
     if (table == NULL) {
         return;
     }
     
-    printf("Symbol Table (Scope Level %d):\n", table->scope_level);
-    
-    for (int i = 0; i < table->size; i++) {
-        SymbolEntry* entry = table->buckets[i];
+    int end = table->binding_count;
+    for (int level = table->scope_level; level >= 0; level--) {
+        if (level < table->scope_level) {
+            printf("\n");
+        }
+        printf("Symbol Table (Scope Level %d):\n", level);
         
-        while (entry != NULL) {
-            printf("  %s: ", entry->name);
+        int start = table->scope_starts[level];
+        for (int i = end - 1; i >= start; i--) {
+            SymbolEntry* entry = table->bindings[i];
+            printf("  %s: Variable (Scope %d, Line %d, Col %d)", interned_string(entry->name),
+                   entry->scope_level, entry->line, entry->column);
             
-            if (entry->type == SYM_VARIABLE) {
-                printf("Variable (Scope %d, Line %d, Col %d)", 
-                        entry->scope_level, entry->line, entry->column);
-                
-                if (entry->data.variable.domain != NULL) {
-                    printf(", Domain: [");
-                    for (int j = 0; j < entry->data.variable.domain_size; j++) {
-                        printf("%s", entry->data.variable.domain[j]);
-                        if (j < entry->data.variable.domain_size - 1) {
-                            printf(", ");
-                        }
+            if (entry->domain != NULL) {
+                printf(", Domain: [");
+                for (int j = 0; j < entry->domain_size; j++) {
+                    printf("%s", interned_string(entry->domain[j]));
+                    if (j < entry->domain_size - 1) {
+                        printf(", ");
                     }
-                    printf("]");
                 }
-            } else if (entry->type == SYM_PREDICATE) {
-                printf("Predicate (Arity %d, Line %d, Col %d)", 
-                        entry->data.predicate.arity, entry->line, entry->column);
+                printf("]");
             }
             
             printf("\n");
-            entry = entry->next;
         }
+        end = start;
     }
-    
-    /* Recursively print parent scopes */
-    if (table->parent != NULL) {
-        printf("\n");
-        print_symbol_table(table->parent);
-    }
-}
\ No newline at end of file
+}
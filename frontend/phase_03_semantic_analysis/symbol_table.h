@@ -2,54 +2,53 @@
 #define SYMBOL_TABLE_H
 
 #include <stdbool.h>
+#include "intern.h"
 
-/* Symbol types */
-typedef enum {
-    SYM_VARIABLE,
-    SYM_PREDICATE
-} SymbolType;
-
-/* Symbol table entry */
+/* A quantified variable bound in a scope (predicates are in predicates.h) */
 typedef struct SymbolEntry {
-    char* name;                  /* Name of the symbol */
-    SymbolType type;             /* Type of symbol */
-    int scope_level;             /* Scope level (for variables) */
-    int line;                    /* Line where symbol was defined */
-    int column;                  /* Column where symbol was defined */
-    union {
-        struct {
-            char** domain;       /* Domain values for quantified variables */
-            int domain_size;     /* Size of the domain */
-        } variable;
-        struct {
-            int arity;           /* Number of arguments for predicates */
-        } predicate;
-    } data;
-    struct SymbolEntry* next;    /* For hash table chaining */
+    InternId name;               /* Interned name of the variable */
+    int scope_level;             /* Scope level it is bound in */
+    int line;                    /* Line where it was bound */
+    int column;                  /* Column where it was bound */
+    InternId* domain;            /* Interned domain of the quantifier (shared) */
+    int domain_size;             /* Size of the domain */
+    struct SymbolEntry* shadowed; /* Binding of the same name this one hides */
+    int pending;                 /* Fused analysis: first shadowing warning waiting for it, or -1 */
 } SymbolEntry;
 
-/* Symbol table structure */
+/*
+ * Scoped symbol table in the style of LeBlanc and Cook. Every binding is
+ * pushed on one stack, and each name's innermost binding is kept in an array
+ * indexed by its InternId, linked to the bindings it shadows. A lookup reads
+ * one slot; leaving a scope pops its bindings off the stack and puts back
+ * the ones they shadowed. Entering, leaving and looking up take constant
+ * time however deep the scopes nest, and popped entries are kept for reuse.
+ */
 typedef struct SymbolTable {
-    SymbolEntry** buckets;       /* Hash table buckets */
-    int size;                    /* Number of buckets */
+    SymbolEntry** visible;       /* Innermost binding of each name, by InternId */
+    int visible_size;
+    SymbolEntry** bindings;      /* Stack of bindings in the order they were made */
+    int binding_count;
+    int binding_capacity;
+    int* scope_starts;           /* Stack height when each scope was entered */
+    int scope_capacity;
     int scope_level;             /* Current scope level */
-    struct SymbolTable* parent;  /* Parent symbol table (for nested scopes) */
+    SymbolEntry* free_entries;   /* Popped entries, chained through shadowed */
+    struct CompileStats* stats;  /* Counts lookups for --stats, or NULL */
 } SymbolTable;
 
 /* Symbol table operations */
-SymbolTable* create_symbol_table(int size);
+SymbolTable* create_symbol_table();
 void free_symbol_table(SymbolTable* table);
-SymbolTable* enter_scope(SymbolTable* current);
-SymbolTable* exit_scope(SymbolTable* current);
+void enter_scope(SymbolTable* table);
+void exit_scope(SymbolTable* table);
 
 /* Symbol operations */
-SymbolEntry* insert_variable(SymbolTable* table, char* name, char** domain, int domain_size, int line, int column);
-SymbolEntry* insert_predicate(SymbolTable* table, char* name, int arity, int line, int column);
-SymbolEntry* lookup_symbol(SymbolTable* table, char* name);
-SymbolEntry* lookup_symbol_current_scope(SymbolTable* table, char* name);
+SymbolEntry* insert_variable(SymbolTable* table, InternId name, InternId* domain, int domain_size, int line, int column);
+SymbolEntry* lookup_symbol(SymbolTable* table, InternId name);
+SymbolEntry* lookup_symbol_current_scope(SymbolTable* table, InternId name);
 
 /* Utility functions */
-unsigned int hash_string(char* str, int table_size);
 void print_symbol_table(SymbolTable* table);
 
 #endif /* SYMBOL_TABLE_H */
\ No newline at end of file